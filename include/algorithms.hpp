@@ -33,6 +33,7 @@ See the GNU Lesser General Public License
 #include "algorithms/edge_enhancement.hpp"
 #include "algorithms/flash_photography.hpp"
 #include "algorithms/iterative_poisson_solver.hpp"
+#include "algorithms/multigrid_poisson_solver.hpp"
 #include "algorithms/poisson_filling.hpp"
 #include "algorithms/poisson_solver.hpp"
 #include "algorithms/pushpull.hpp"
@@ -41,6 +42,7 @@ See the GNU Lesser General Public License
 #include "algorithms/region_border.hpp"
 #include "algorithms/superpixels_oracle.hpp"
 #include "algorithms/superpixels_slic.hpp"
+#include "algorithms/weighted_laplacian_solver.hpp"
 #include "algorithms/color_to_gray.hpp"
 
 #endif /* PIC_ALGORITHMS_HPP */
@@ -225,11 +225,18 @@ protected:
         printf("Computing histograms...");
         #endif
         
-        for(int j = 0; j < channels; j++) {
-            for(unsigned int i = 0; i < exposures; i++) {
-                h[c].Calculate(stack[i], VS_LDR, 256, j);
+        //all channels of an exposure are binned in a single pass
+        ImageHistogram hist;
+
+        for(unsigned int i = 0; i < exposures; i++) {
+            ImageRAW *img = stack[i];
+            hist.Calculate(img->data, img->width * img->height * img->frames,
+                           channels, VS_LDR, 256);
+
+            for(int j = 0; j < channels; j++) {
+                c = j * exposures + i;
+                h[c].Calculate(hist, j);
                 h[c].cumulativef(true);
-                c++;
             }
         }
         #ifdef PIC_DEBUG
@@ -479,9 +486,9 @@ public:
             //Wrapping into an ImageRAW for normalization
             ImageRAW img(1, 256, 1, 1, icrf_channel);
 
-            float *max_val = img.getMaxVal(NULL, NULL);
-            if(max_val[0] > 0.0f) {
-                img.Div(max_val[0]);
+            float max_val = img.getStatistics(IS_MAX).maxVal[0];
+            if(max_val > 0.0f) {
+                img.Div(max_val);
             }
 
             icrf.push_back(icrf_channel);
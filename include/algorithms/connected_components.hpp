@@ -26,27 +26,15 @@ See the GNU Lesser General Public License
 #define PIC_ALGORITHMS_CONNECTED_COMPONENTS_HPP
 
 #include <vector>
-#include <set>
-#include <map>
 
 #include "image_raw.hpp"
-#include "filtering/filter_luminance.hpp"
+#include "util/array.hpp"
+#include "util/bbox.hpp"
+#include "util/thread_pool.hpp"
+#include "util/union_find.hpp"
 
 namespace pic {
 
-//Connected components on a single channel image
-typedef std::vector<int> ConnectComp;
-
-struct LabelInfo {
-    float id;
-    float minLabel;
-
-    friend bool operator<(LabelInfo const &a, LabelInfo const &b)
-    {
-        return a.id < b.id;
-    }
-};
-
 class LabelOutput
 {
 public:
@@ -74,224 +62,300 @@ public:
     }
 };
 
+/**
+ * @brief The ComponentStats struct stores the statistics of a connected
+ * component.
+ */
+struct ComponentStats
+{
+    int                 area;
+    BBox                box;    //x1 and y1 are exclusive
+    std::vector<float>  mean;   //mean color
+};
 
 /**
- * @brief ConnectedComponents computes connected components in an image
- * @param img
- * @param ret
- * @param comp
- * @param channel
- * @return
+ * @brief The ComponentLabeler class labels 4-connected components of an
+ * image. Two neighbors are connected when the distance of their colors
+ * is at most thr times the largest of their norms. Strips of rows are
+ * labeled in parallel with a union-find forest over pixel indices; strips
+ * are then merged across their seams. Labels are in [1, nComponents] in
+ * the raster order of the first pixel of each component.
  */
-ImageRAW *ConnectedComponents(ImageRAW *img, std::vector<LabelOutput> &ret,
-                              ImageRAW *comp = NULL, float thr = 0.05f)
+class ComponentLabeler
 {
-    //Check input paramters
-    if(img == NULL) {
-        return NULL;
+protected:
+    float               thr;
+    int                 maxThreads;
+    int                 nComponents;
+    int                 width, height;
+    UnionFind           uf;
+    std::vector<float>  norms;
+
+    /**
+     * @brief Connected
+     * @param img
+     * @param i
+     * @param j
+     * @return It returns true if pixels i and j are connected.
+     */
+    bool Connected(ImageRAW *img, int i, int j)
+    {
+        int channels = img->channels;
+        float dist = sqrtf(Array<float>::distanceSq(&img->data[i * channels],
+                                                    &img->data[j * channels],
+                                                    channels));
+        float n = MAX(norms[i], norms[j]);
+
+        return dist <= (thr * n);
     }
 
-    float *data  = img->data;
-    int width    = img->width;
-    int height   = img->height;
-    int channels = img->channels;
-    int n = height * width;
+    /**
+     * @brief LabelStrip labels the rows in [y0, y1).
+     * @param img
+     * @param y0
+     * @param y1
+     */
+    void LabelStrip(ImageRAW *img, int y0, int y1);
 
-    if(comp == NULL) {
-        comp = new ImageRAW(1, width, height, 1);
+public:
+    std::vector<int>            labels;
+    std::vector<ComponentStats> stats;
+
+    /**
+     * @brief ComponentLabeler
+     * @param thr is the relative color threshold for connectivity.
+     * @param maxThreads caps the number of workers; a value <= 0 means
+     * all workers of the pool.
+     */
+    ComponentLabeler(float thr = 0.05f, int maxThreads = -1)
+    {
+        this->thr = thr;
+        this->maxThreads = maxThreads;
+        nComponents = 0;
+        width = 0;
+        height = 0;
     }
 
-    comp->SetZero();
-
-    //First pass: assigning basics labels
-    // and generating the list of neighbors
-    int label = 1;
+    /**
+     * @brief getNumberOfComponents
+     * @return
+     */
+    int getNumberOfComponents()
+    {
+        return nComponents;
+    }
 
-    std::set<LabelInfo> labelEq;
-    std::set<LabelInfo>::iterator it;
+    /**
+     * @brief Process labels img; stats[k - 1] holds the statistics of
+     * the component with label k.
+     * @param img
+     * @param bStats enables the computation of stats.
+     * @return It returns the number of components.
+     */
+    int Process(ImageRAW *img, bool bStats = true);
+
+    /**
+     * @brief getLabelImage
+     * @param comp is a single channel image; it is allocated if it is NULL.
+     * @return It returns the labels as a single channel image.
+     */
+    ImageRAW *getLabelImage(ImageRAW *comp = NULL);
+
+    /**
+     * @brief getCoordinates appends, for each component, its label and the
+     * indices of its pixels to ret.
+     * @param ret
+     */
+    void getCoordinates(std::vector<LabelOutput> &ret);
+};
 
-    for(int j = 0; j < height; j++) {
-        int indY = j * width;
+PIC_INLINE void ComponentLabeler::LabelStrip(ImageRAW *img, int y0, int y1)
+{
+    int channels = img->channels;
 
+    for(int j = y0; j < y1; j++) {
         for(int i = 0; i < width; i++) {
-            int ind = (indY + i);
-
-            int ind_img = ind * channels;
-
-            //neighbors
-            int neighbors[2];
-            int nNeighbors = 0;
+            int ind = j * width + i;
+            norms[ind] = Array<float>::norm(&img->data[ind * channels], channels);
+        }
+    }
 
-            if((i - 1) > -1) {
-                int ind_img_prev = ind_img - channels;
+    for(int j = y0; j < y1; j++) {
+        for(int i = 0; i < width; i++) {
+            int ind = j * width + i;
 
-                float n1 = Array<float>::norm(&data[ind_img], channels);
-                float n2 = Array<float>::norm(&data[ind_img_prev], channels);
-                float dist = sqrtf(Array<float>::distanceSq(&data[ind_img], &data[ind_img_prev], channels));
+            if(i > 0) {
+                if(Connected(img, ind, ind - 1)) {
+                    uf.Union(ind, ind - 1);
+                }
+            }
 
-                if(dist <= (thr * MAX(n1, n2))) {
-                    neighbors[0] = ind - 1;
-                    nNeighbors++;
+            if(j > y0) {
+                if(Connected(img, ind, ind - width)) {
+                    uf.Union(ind, ind - width);
                 }
             }
+        }
+    }
+}
 
-            if((j - 1) > -1) {
-                int ind_img_prev = ind_img - (width * channels);
+PIC_INLINE int ComponentLabeler::Process(ImageRAW *img, bool bStats)
+{
+    nComponents = 0;
+    labels.clear();
+    stats.clear();
 
-                float n1 = Array<float>::norm(&data[ind_img], channels);
-                float n2 = Array<float>::norm(&data[ind_img_prev], channels);
-                float dist = sqrtf(Array<float>::distanceSq(&data[ind_img], &data[ind_img_prev], channels));
+    if(img == NULL) {
+        return 0;
+    }
 
-                if(dist <= (thr * MAX(n1, n2))) {
-                    neighbors[nNeighbors] = ind - width;
-                    nNeighbors++;
-                }
-            }
+    if(!img->isValid()) {
+        return 0;
+    }
 
-            //No neighbors?
-            if(nNeighbors == 0) {
-                comp->data[ind] = float(label);
-                label++;
-            }
+    width = img->width;
+    height = img->height;
+    int channels = img->channels;
+    int n = width * height;
 
-            if(nNeighbors == 1) {
-                comp->data[ind] = comp->data[neighbors[0]];
-            }
+    uf.Init(n);
+    norms.resize(n);
+    labels.resize(n);
 
-            if(nNeighbors == 2) {
-                //Assigning the label of neighbors
-                float minVal, t1, t2;
-                t1 = comp->data[neighbors[0]];
-                t2 = comp->data[neighbors[1]];
-                minVal = MIN(t1, t2);
-
-                //Tracking neighbors
-                LabelInfo tmpLI;
-                bool test = true;
-
-                while(test) {
-                    test = false;
-                    tmpLI.id = minVal;
-                    it = labelEq.find(tmpLI);
-
-                    if(it != labelEq.end()) {
-                        float tmpMinLabel = it->minLabel;
-
-                        if(minVal > tmpMinLabel) {
-                            minVal = tmpMinLabel;
-                            test = true;
-                        }
-                    }
-                }
+    //labeling strips of rows in parallel; each strip links only its pixels
+    int stripSize = 64;
+    int nStrips = (height + stripSize - 1) / stripSize;
 
-                comp->data[ind] = minVal;
-
-                //Tracking T1
-                test = true;
-                tmpLI.id = t1;
-                it = labelEq.find(tmpLI);
-
-                if(it != labelEq.end()) {
-                    LabelInfo tmp_it;
-                    tmp_it.id = it->id;
-                    tmp_it.minLabel = minVal;
-
-                    labelEq.erase(it);
-                    labelEq.insert(tmp_it);
-                } else {
-                    LabelInfo tmpLabelInfo;
-                    tmpLabelInfo.id = t1;
-                    tmpLabelInfo.minLabel = minVal;
-                    labelEq.insert(tmpLabelInfo);
-                }
+    ThreadPool::Execute(nStrips, [&](unsigned int s) {
+        int y0 = s * stripSize;
+        int y1 = MIN(y0 + stripSize, height);
+        LabelStrip(img, y0, y1);
+    }, maxThreads);
 
-                //T2
-                tmpLI.id = t2;
-                it = labelEq.find(tmpLI);
-
-                if(it != labelEq.end()) {
-                    LabelInfo tmp_it;
-                    tmp_it.id = it->id;
-                    tmp_it.minLabel = minVal;
-
-                    labelEq.erase(it);
-                    labelEq.insert(tmp_it);
-                } else {
-                    LabelInfo tmpLabelInfo;
-                    tmpLabelInfo.id = t2;
-                    tmpLabelInfo.minLabel = minVal;
-                    labelEq.insert(tmpLabelInfo);
-                }
+    //merging across seams
+    for(int s = 1; s < nStrips; s++) {
+        int ind = s * stripSize * width;
+
+        for(int i = 0; i < width; i++) {
+            if(Connected(img, ind + i, ind + i - width)) {
+                uf.Union(ind + i, ind + i - width);
             }
         }
     }
 
-    //Label Search
-    LabelInfo tmpLI;
-    std::set<LabelInfo>::iterator it2;
+    //resolving labels; roots are the first pixel of their component, so
+    //parent[i] <= i and the parent of each visited pixel is already a root
+    std::vector<double> sum;
+    int *parent = &uf.parent[0];
 
-    std::set<LabelInfo> labelEq_new;
+    for(int ind = 0; ind < n; ind++) {
+        int root = parent[parent[ind]];
+        parent[ind] = root;
 
-    for(it2 = labelEq.begin() ; it2 != labelEq.end(); it2++) {
-        float minVal = it2->minLabel;
-        bool test = true;
+        int x = ind % width;
+        int y = ind / width;
 
-        while(test) {
-            test = false;
-            tmpLI.id = minVal;
-            it = labelEq.find(tmpLI);
+        if(root == ind) {
+            nComponents++;
+            labels[ind] = nComponents;
 
-            if(it != labelEq.end()) {
-                float tmpMinLabel = (*it).minLabel;
-
-                if(minVal > tmpMinLabel) {
-                    minVal = tmpMinLabel;
-                    test = true;
-                }
+            if(bStats) {
+                ComponentStats cs;
+                cs.area = 0;
+                cs.box = BBox(x, x + 1, y, y + 1, width, height);
+                stats.push_back(cs);
+                sum.resize(sum.size() + channels, 0.0);
             }
+        } else {
+            labels[ind] = labels[root];
         }
 
-        LabelInfo tmp_it;
-        tmp_it.id = it2->id;
-        tmp_it.minLabel = minVal;
-        labelEq_new.insert(tmp_it);
+        if(bStats) {
+            int k = labels[ind] - 1;
+            ComponentStats &cs = stats[k];
+            cs.area++;
+            cs.box.x0 = MIN(cs.box.x0, x);
+            cs.box.x1 = MAX(cs.box.x1, x + 1);
+            cs.box.y1 = y + 1;
+
+            double *tmp_sum = &sum[k * channels];
+            float *data = &img->data[ind * channels];
+
+            for(int c = 0; c < channels; c++) {
+                tmp_sum[c] += data[c];
+            }
+        }
     }
 
-    //Second pass: using tracked neighbors
-    //for assigning the correct labels
-    //TO DO: optimizing outside this loop
-    std::set<float> unique;
-    std::set<float>::iterator uniqueIt;
-    std::map<float, int> mapping;
+    for(int k = 0; k < int(stats.size()); k++) {
+        ComponentStats &cs = stats[k];
+        cs.mean.resize(channels);
 
-    int counter = 0;
+        for(int c = 0; c < channels; c++) {
+            cs.mean[c] = float(sum[k * channels + c] / double(cs.area));
+        }
+    }
 
-    for(int i=0; i < n; i++) {
-        tmpLI.id = comp->data[i];
-        it = labelEq_new.find(tmpLI);
+    return nComponents;
+}
 
-        if(it != labelEq_new.end()) {
-            comp->data[i] = it->minLabel;
+PIC_INLINE ImageRAW *ComponentLabeler::getLabelImage(ImageRAW *comp)
+{
+    if(comp == NULL) {
+        comp = new ImageRAW(1, width, height, 1);
+    } else {
+        if((comp->width != width) || (comp->height != height) ||
+           (comp->channels != 1)) {
+            comp = new ImageRAW(1, width, height, 1);
         }
+    }
+
+    for(int i = 0; i < int(labels.size()); i++) {
+        comp->data[i] = float(labels[i]);
+    }
 
-        //Storing coordiantes of the connected components
-        float id = comp->data[i];
-        uniqueIt = unique.find(id);
+    return comp;
+}
 
-        if(uniqueIt != unique.end()) {
-            ret[mapping[id]].Add(i);
-        } else {
-            std::pair<float, int> tmp = std::make_pair(id, counter);
-            mapping.insert(tmp);
+PIC_INLINE void ComponentLabeler::getCoordinates(std::vector<LabelOutput> &ret)
+{
+    int offset = int(ret.size());
+    ret.resize(offset + nComponents);
 
-            LabelOutput tmpRet(id, i);
-            ret.push_back(tmpRet);
+    for(int k = 0; k < nComponents; k++) {
+        ret[offset + k].id = float(k + 1);
 
-            unique.insert(id);
-            counter++;
+        if(k < int(stats.size())) {
+            ret[offset + k].coords.reserve(stats[k].area);
         }
     }
-    return comp;
+
+    for(int i = 0; i < int(labels.size()); i++) {
+        ret[offset + labels[i] - 1].Add(i);
+    }
+}
+
+/**
+ * @brief ConnectedComponents computes connected components in an image
+ * @param img
+ * @param ret
+ * @param comp
+ * @param thr
+ * @return
+ */
+PIC_INLINE ImageRAW *ConnectedComponents(ImageRAW *img,
+        std::vector<LabelOutput> &ret, ImageRAW *comp = NULL, float thr = 0.05f)
+{
+    //Check input paramters
+    if(img == NULL) {
+        return NULL;
+    }
+
+    ComponentLabeler labeler(thr);
+    labeler.Process(img, true);
+    labeler.getCoordinates(ret);
+
+    return labeler.getLabelImage(comp);
 }
 
 } // end namespace pic
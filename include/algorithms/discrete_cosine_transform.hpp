@@ -25,26 +25,102 @@ See the GNU Lesser General Public License
 #ifndef PIC_ALGORITHMS_DISCRETE_COSINE_TRANSFORM_HPP
 #define PIC_ALGORITHMS_DISCRETE_COSINE_TRANSFORM_HPP
 
+#include <vector>
+
 #include "image_raw.hpp"
-#include "util/tile_list.hpp"
+#include "util/simd.hpp"
+#include "util/thread_pool.hpp"
 
 namespace pic {
 
 /**
- * @brief The DCT class provides a reference
- * implementation for Discret Cosine Transform.
+ * @brief The DCT class computes the orthonormal block DCT-II (and its
+ * inverse, the DCT-III) of an image. Blocks are size x size and aligned
+ * to multiples of size; blocks crossing the border are padded by clamping
+ * coordinates. The transform is separable: 1D transforms are applied to a
+ * band of size rows at once, so the same operation is executed over all
+ * blocks, pixels, and channels of the band (SIMD friendly), and bands are
+ * processed in parallel. For size == 8 the 1D transform is the AAN
+ * factorization; other sizes use a precomputed basis table.
  */
 class DCT
 {
+protected:
+    int size;
+    std::vector<float> basis;   //basis[u * size + x]
+    std::vector<float> basisT;  //basisT[x * size + u]
+    float aanForward[8], aanInverse[8];
+
+    /**
+     * @brief AAN8 computes the 8-point AAN forward DCT of the rows in[k]
+     * element-wise; outputs are scaled by the AAN factors.
+     * @param in
+     * @param out
+     * @param count
+     */
+    static void AAN8(float **in, float **out, int count);
+
+    /**
+     * @brief IAAN8 computes the 8-point AAN inverse DCT of the rows in[k]
+     * element-wise; inputs have to be scaled by the AAN factors.
+     * @param in
+     * @param out
+     * @param count
+     */
+    static void IAAN8(float **in, float **out, int count);
+
+    /**
+     * @brief Transform1D applies the 1D transform across size rows of
+     * count elements; row k of src starts at src + k * count.
+     * @param src
+     * @param dst
+     * @param count
+     * @param bForward
+     */
+    void Transform1D(float *src, float *dst, int count, bool bForward);
+
+    /**
+     * @brief TransformBand applies the 2D transform to the blocks of the
+     * band starting at row y0 of the frame f.
+     * @param imgIn
+     * @param imgOut
+     * @param y0
+     * @param f
+     * @param bForward
+     * @param A is scratch memory of 2 * size * size * bx * channels floats.
+     */
+    void TransformBand(ImageRAW *imgIn, ImageRAW *imgOut, int y0, int f,
+                       bool bForward, float *A);
+
 public:
 
     /**
      * @brief DCT
+     * @param size is the size of blocks.
      */
-    DCT()
+    DCT(int size = 8);
+
+    /**
+     * @brief getSize
+     * @return
+     */
+    int getSize()
     {
+        return size;
     }
 
+    /**
+     * @brief Process
+     * @param imgIn
+     * @param imgOut
+     * @param bForward
+     * @param maxThreads caps the number of workers; a value <= 0 means all
+     * workers of the pool.
+     * @return
+     */
+    ImageRAW *Process(ImageRAW *imgIn, ImageRAW *imgOut, bool bForward,
+                      int maxThreads = -1);
+
     /**
      * @brief Transform
      * @param imgIn
@@ -54,165 +130,334 @@ public:
      */
     static ImageRAW *Transform(ImageRAW *imgIn, ImageRAW *imgOut, int size = 8)
     {
-        if(imgIn == NULL) {
-            return imgOut;
-        }
+        DCT dct(size);
+        return dct.Process(imgIn, imgOut, true);
+    }
 
-        if(imgOut == NULL) {
-            imgOut = imgIn->AllocateSimilarOne();
-        }
+    /**
+     * @brief Inverse
+     * @param imgIn
+     * @param imgOut
+     * @param size
+     * @return
+     */
+    static ImageRAW *Inverse(ImageRAW *imgIn, ImageRAW *imgOut, int size = 8)
+    {
+        DCT dct(size);
+        return dct.Process(imgIn, imgOut, false);
+    }
+};
 
-        if(size < 1) {
-            size = 8;
-        }
+PIC_INLINE DCT::DCT(int size)
+{
+    if(size < 1) {
+        size = 8;
+    }
 
-        float size2 = float(size * 2);
-        float squareRoot2 = sqrtf(2.0f);
-        float squareRoot = sqrtf(2.0f / float(size));
-        float squareRootPow2 = squareRoot * squareRoot;
+    this->size = size;
 
-        int channels = imgIn->channels;
+    basis.resize(size * size);
+    basisT.resize(size * size);
 
-        TileList tiles(size, imgOut->width, imgOut->height);
+    std::vector<double> C(size * size);
 
-        for(unsigned int t = 0; t < tiles.tiles.size(); t++) {
-            BBox box;
-            tiles.genBBox(t, &box);
+    for(int u = 0; u < size; u++) {
+        double s = sqrt((u == 0 ? 1.0 : 2.0) / double(size));
 
-            for(int v = box.y0; v < box.y1; v++) {
-                int vr = v % size;
+        for(int x = 0; x < size; x++) {
+            C[u * size + x] = s * cos(C_PI * double(u * (2 * x + 1)) / double(2 * size));
+            basis[u * size + x] = float(C[u * size + x]);
+            basisT[x * size + u] = basis[u * size + x];
+        }
+    }
 
-                for(int u = box.x0; u < box.x1; u++) {
-                    int ur = u % size;
+    if(size != 8) {
+        return;
+    }
 
-                    float *dataOut = (*imgOut)(u, v);
+    //AAN scale factors: AAN8 maps the basis vector u to
+    //aanForward[u] times the impulse at u, and IAAN8 maps the impulse at u
+    //to aanInverse[u] times the basis vector u
+    float in[64], out[64];
+    float *pIn[8], *pOut[8];
 
-                    for(int p = 0; p < channels; p++) {
-                        dataOut[p] = 0.0f;
-                    }
+    for(int k = 0; k < 8; k++) {
+        pIn[k] = &in[k * 8];
+        pOut[k] = &out[k * 8];
+    }
 
-                    for(int y = 0; y < size; y++) {
-                        int yi		=  y + box.y0;
-                        int	val		= vr * (2 * y + 1);
-                        float cosU	= cosf(C_PI * float(val) / size2);
+    for(int u = 0; u < 8; u++) {
+        for(int k = 0; k < 8; k++) {
+            in[k * 8 + u] = float(C[u * 8 + k]);
+        }
+    }
 
-                        for(int x = 0; x < size; x++) {
-                            int xi		=  x + box.x0;
-                            val			= ur * (2 * x + 1);
-                            float tot	= cosU * cosf(C_PI * float(val) / size2);
+    AAN8(pIn, pOut, 8);
 
-                            float *dataIn = (*imgIn)(xi, yi);
+    for(int u = 0; u < 8; u++) {
+        aanForward[u] = 1.0f / out[u * 8 + u];
+    }
 
-                            for(int p = 0; p < channels; p++) {
-                                dataOut[p] += tot * dataIn[p];
-                            }
-                        }
-                    }
+    for(int u = 0; u < 8; u++) {
+        for(int k = 0; k < 8; k++) {
+            in[k * 8 + u] = (k == u) ? 1.0f : 0.0f;
+        }
+    }
 
-                    if(ur == 0) {
-                        for(int p = 0; p < channels; p++) {
-                            dataOut[p] /= squareRoot2;
-                        }
-                    }
+    IAAN8(pIn, pOut, 8);
 
-                    if(vr == 0) {
-                        for(int p = 0; p < channels; p++) {
-                            dataOut[p] /= squareRoot2;
-                        }
-                    }
+    for(int u = 0; u < 8; u++) {
+        aanInverse[u] = out[u] / float(C[u * 8]);
+    }
+}
 
-                    for(int p = 0; p < channels; p++) {
-                        dataOut[p] *= squareRootPow2;
-                    }
-                }
-            }
-        }
+PIC_INLINE void DCT::AAN8(float **in, float **out, int count)
+{
+    float *d0 = in[0], *d1 = in[1], *d2 = in[2], *d3 = in[3];
+    float *d4 = in[4], *d5 = in[5], *d6 = in[6], *d7 = in[7];
+
+    float *o0 = out[0], *o1 = out[1], *o2 = out[2], *o3 = out[3];
+    float *o4 = out[4], *o5 = out[5], *o6 = out[6], *o7 = out[7];
+
+    for(int i = 0; i < count; i++) {
+        float tmp0 = d0[i] + d7[i];
+        float tmp7 = d0[i] - d7[i];
+        float tmp1 = d1[i] + d6[i];
+        float tmp6 = d1[i] - d6[i];
+        float tmp2 = d2[i] + d5[i];
+        float tmp5 = d2[i] - d5[i];
+        float tmp3 = d3[i] + d4[i];
+        float tmp4 = d3[i] - d4[i];
+
+        //even part
+        float tmp10 = tmp0 + tmp3;
+        float tmp13 = tmp0 - tmp3;
+        float tmp11 = tmp1 + tmp2;
+        float tmp12 = tmp1 - tmp2;
+
+        o0[i] = tmp10 + tmp11;
+        o4[i] = tmp10 - tmp11;
+
+        float z1 = (tmp12 + tmp13) * 0.707106781f;
+        o2[i] = tmp13 + z1;
+        o6[i] = tmp13 - z1;
+
+        //odd part
+        tmp10 = tmp4 + tmp5;
+        tmp11 = tmp5 + tmp6;
+        tmp12 = tmp6 + tmp7;
+
+        float z5 = (tmp10 - tmp12) * 0.382683433f;
+        float z2 = 0.541196100f * tmp10 + z5;
+        float z4 = 1.306562965f * tmp12 + z5;
+        float z3 = tmp11 * 0.707106781f;
+
+        float z11 = tmp7 + z3;
+        float z13 = tmp7 - z3;
+
+        o5[i] = z13 + z2;
+        o3[i] = z13 - z2;
+        o1[i] = z11 + z4;
+        o7[i] = z11 - z4;
+    }
+}
 
-        return imgOut;
+PIC_INLINE void DCT::IAAN8(float **in, float **out, int count)
+{
+    float *d0 = in[0], *d1 = in[1], *d2 = in[2], *d3 = in[3];
+    float *d4 = in[4], *d5 = in[5], *d6 = in[6], *d7 = in[7];
+
+    float *o0 = out[0], *o1 = out[1], *o2 = out[2], *o3 = out[3];
+    float *o4 = out[4], *o5 = out[5], *o6 = out[6], *o7 = out[7];
+
+    for(int i = 0; i < count; i++) {
+        //even part
+        float tmp10 = d0[i] + d4[i];
+        float tmp11 = d0[i] - d4[i];
+        float tmp13 = d2[i] + d6[i];
+        float tmp12 = (d2[i] - d6[i]) * 1.414213562f - tmp13;
+
+        float tmp0 = tmp10 + tmp13;
+        float tmp3 = tmp10 - tmp13;
+        float tmp1 = tmp11 + tmp12;
+        float tmp2 = tmp11 - tmp12;
+
+        //odd part
+        float z13 = d5[i] + d3[i];
+        float z10 = d5[i] - d3[i];
+        float z11 = d1[i] + d7[i];
+        float z12 = d1[i] - d7[i];
+
+        float tmp7 = z11 + z13;
+        tmp11 = (z11 - z13) * 1.414213562f;
+
+        float z5 = (z10 + z12) * 1.847759065f;
+        tmp10 = 1.082392200f * z12 - z5;
+        tmp12 = -2.613125930f * z10 + z5;
+
+        float tmp6 = tmp12 - tmp7;
+        float tmp5 = tmp11 - tmp6;
+        float tmp4 = tmp10 + tmp5;
+
+        o0[i] = tmp0 + tmp7;
+        o7[i] = tmp0 - tmp7;
+        o1[i] = tmp1 + tmp6;
+        o6[i] = tmp1 - tmp6;
+        o2[i] = tmp2 + tmp5;
+        o5[i] = tmp2 - tmp5;
+        o4[i] = tmp3 + tmp4;
+        o3[i] = tmp3 - tmp4;
     }
+}
 
-    /**
-     * @brief Inverse
-     * @param imgIn
-     * @param imgOut
-     * @param size
-     * @return
-     */
-    static ImageRAW *Inverse(ImageRAW *imgIn, ImageRAW *imgOut, int size = 8)
-    {
-        if(imgIn == NULL) {
-            return imgOut;
-        }
+PIC_INLINE void DCT::Transform1D(float *src, float *dst, int count,
+                                 bool bForward)
+{
+    if(size == 8) {
+        float *in[8], *out[8];
 
-        if(imgOut == NULL) {
-            imgOut = imgIn->AllocateSimilarOne();
+        for(int k = 0; k < 8; k++) {
+            in[k] = src + k * count;
+            out[k] = dst + k * count;
         }
 
-        if(size < 1) {
-            size = 8;
+        if(bForward) {
+            AAN8(in, out, count);
+
+            for(int k = 0; k < 8; k++) {
+                float s = aanForward[k];
+
+                for(int i = 0; i < count; i++) {
+                    out[k][i] *= s;
+                }
+            }
+        } else {
+            for(int k = 0; k < 8; k++) {
+                float s = 1.0f / aanInverse[k];
+
+                for(int i = 0; i < count; i++) {
+                    in[k][i] *= s;
+                }
+            }
+
+            IAAN8(in, out, count);
         }
 
-        float size2 = float(size * 2);
-        float squareRoot2 = sqrtf(2.0f);
-        float squareRoot = sqrtf(2.0f / float(size));
-        float squareRootPow2 = squareRoot * squareRoot;
+        return;
+    }
 
-        int channels = imgIn->channels;
+    std::vector<const float *> rows(size);
 
-        TileList tiles(size, imgOut->width, imgOut->height);
+    for(int k = 0; k < size; k++) {
+        rows[k] = src + k * count;
+    }
 
-        for(unsigned int t = 0; t < tiles.tiles.size(); t++) {
-            BBox box;
-            tiles.genBBox(t, &box);
+    const float *table = bForward ? &basis[0] : &basisT[0];
 
-            for(int y = box.y0; y < box.y1; y++) {
-                int yr = y % size;
+    for(int k = 0; k < size; k++) {
+        WeightedSum(&rows[0], table + k * size, size, dst + k * count, count);
+    }
+}
 
-                for(int x = box.x0; x < box.x1; x++) {
-                    int xr = x % size;
+PIC_INLINE void DCT::TransformBand(ImageRAW *imgIn, ImageRAW *imgOut, int y0,
+                                   int f, bool bForward, float *A)
+{
+    int width = imgOut->width;
+    int height = imgOut->height;
+    int channels = imgOut->channels;
+
+    int bx = (width + size - 1) / size;
+    int stride = bx * size * channels;
+    int blockStride = size * channels;
+    float *B = A + size * stride;
+
+    //gathering the band; blocks crossing the border are padded by clamping
+    for(int y = 0; y < size; y++) {
+        int yi = MIN(y0 + y, imgIn->height - 1);
+        float *row = &A[y * stride];
+
+        for(int x = 0; x < (bx * size); x++) {
+            int xi = MIN(x, imgIn->width - 1);
+            float *data = (*imgIn)(xi, yi, f);
+
+            for(int p = 0; p < channels; p++) {
+                row[x * channels + p] = data[p];
+            }
+        }
+    }
+
+    //vertical pass
+    Transform1D(A, B, stride, bForward);
 
-                    float *dataOut = (*imgOut)(x, y);
+    //transposing each block, so the horizontal pass is a vertical one
+    for(int b = 0; b < bx; b++) {
+        int off = b * blockStride;
 
-                    for(int p = 0; p < channels; p++) {
-                        dataOut[p] = 0.0f;
-                    }
+        for(int y = 0; y < size; y++) {
+            for(int x = 0; x < size; x++) {
+                float *src = &B[y * stride + off + x * channels];
+                float *dst = &A[x * stride + off + y * channels];
 
-                    for(int v = 0; v < size; v++) {
-                        int vi		= box.y0 + v;
-                        int	val		= v * (2 * yr + 1);
-                        float cosU	= cosf(C_PI * float(val) / size2);
+                for(int p = 0; p < channels; p++) {
+                    dst[p] = src[p];
+                }
+            }
+        }
+    }
 
-                        if(v == 0) {
-                            cosU /= squareRoot2;
-                        }
+    //horizontal pass
+    Transform1D(A, B, stride, bForward);
 
-                        for(int u = 0; u < size; u++) {
-                            int ui		= box.x0 + u;
-                            val			= u * (2 * xr + 1);
-                            float tot	= cosU * cosf(C_PI * float(val) / size2);
+    //scattering the band transposing back each block
+    int y1 = MIN(y0 + size, height);
 
-                            if(u == 0) {
-                                tot /= squareRoot2;
-                            }
+    for(int y = y0; y < y1; y++) {
+        int v = y - y0;
 
-                            float *dataIn = (*imgIn)(ui, vi);
+        for(int x = 0; x < width; x++) {
+            int b = x / size;
+            int u = x - b * size;
 
-                            for(int p = 0; p < channels; p++) {
-                                dataOut[p] += tot * dataIn[p];
-                            }
-                        }
-                    }
+            float *src = &B[u * stride + b * blockStride + v * channels];
+            float *data = (*imgOut)(x, y, f);
 
-                    for(int p = 0; p < channels; p++) {
-                        dataOut[p] *= squareRootPow2;
-                    }
-                }
+            for(int p = 0; p < channels; p++) {
+                data[p] = src[p];
             }
         }
+    }
+}
 
+PIC_INLINE ImageRAW *DCT::Process(ImageRAW *imgIn, ImageRAW *imgOut,
+                                  bool bForward, int maxThreads)
+{
+    if(imgIn == NULL) {
         return imgOut;
     }
-};
+
+    if(imgOut == NULL) {
+        imgOut = imgIn->AllocateSimilarOne();
+    } else {
+        if(!imgIn->SimilarType(imgOut)) {
+            imgOut = imgIn->AllocateSimilarOne();
+        }
+    }
+
+    int bx = (imgOut->width + size - 1) / size;
+    int by = (imgOut->height + size - 1) / size;
+    int frames = imgOut->frames;
+
+    int scratchStride = 2 * size * size * bx * imgOut->channels;
+    std::vector<float> scratch(size_t(scratchStride) *
+                               ThreadPool::getInstance()->getMaxThreads());
+
+    ThreadPool::Execute(by * frames, [&](unsigned int i) {
+        float *A = &scratch[size_t(ThreadPool::getWorkerIndex()) * scratchStride];
+        TransformBand(imgIn, imgOut, (i % by) * size, i / by, bForward, A);
+    }, maxThreads);
+
+    return imgOut;
+}
 
 } // end namespace pic
 
@@ -0,0 +1,1084 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+PICCANTE is free software; you can redistribute it and/or modify
+under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation; either version 3.0 of
+the License, or (at your option) any later version.
+
+PICCANTE is distributed in the hope that it will be useful, but
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU Lesser General Public License
+( http://www.gnu.org/licenses/lgpl-3.0.html ) for more details.
+
+*/
+
+#ifndef PIC_ALGORITHMS_MULTIGRID_POISSON_SOLVER_HPP
+#define PIC_ALGORITHMS_MULTIGRID_POISSON_SOLVER_HPP
+
+#include <vector>
+#include <chrono>
+#include <float.h>
+
+#include "image_raw.hpp"
+#include "util/thread_pool.hpp"
+
+namespace pic {
+
+/**
+ * @brief The PoissonBoundary enum: PB_DIRICHLET sets values outside
+ * the image to zero (as in PoissonSolver), PB_NEUMANN sets a zero derivative
+ * at the image border.
+ */
+enum PoissonBoundary {PB_DIRICHLET, PB_NEUMANN};
+
+/**
+ * @brief The MultigridPoissonSolver class solves lap(x) = f, where lap is
+ * the 5-point Laplacian, with a matrix-free geometric multigrid (V-cycles
+ * with red-black Gauss-Seidel smoothing, full weighting restriction and
+ * bilinear prolongation) or with conjugate gradients preconditioned by
+ * a V-cycle. The coarsest level is solved with conjugate gradients. Each
+ * channel is solved independently.
+ * A mask can restrict the domain: pixels outside the mask are kept to the
+ * values of the initial guess and they act as Dirichlet boundary conditions.
+ */
+class MultigridPoissonSolver
+{
+protected:
+    /**
+     * @brief The Level struct is a level of the multigrid hierarchy.
+     */
+    struct Level
+    {
+        int width, height;
+        float h2;
+        //coupling with the zero values outside: left, right, top, bottom
+        float border[4];
+        std::vector<float> u, f, r;
+        std::vector<unsigned char> unknown;
+    };
+
+    std::vector<Level> levels;
+
+    PoissonBoundary bc;
+    bool  bPCG, bSingular;
+    int   maxIter, preSteps, postSteps, maxThreads;
+    float tolerance;
+
+    //PCG vectors
+    std::vector<float> x, res, p, q;
+
+    //CG vectors of the coarsest level
+    std::vector<float> cr, cp, cq;
+
+    /**
+     * @brief Stencil computes the sum of the neighbors of (i, j) and
+     * the diagonal of the 5-point stencil at a level.
+     * @param lev
+     * @param u
+     * @param i
+     * @param j
+     * @param sum
+     * @param d
+     */
+    static inline void Stencil(Level &lev, float *u, int i, int j, float &sum, float &d)
+    {
+        int ind = j * lev.width + i;
+
+        sum = 0.0f;
+        d = 0.0f;
+
+        if(i > 0) {
+            sum += u[ind - 1];
+            d += 1.0f;
+        } else {
+            d += lev.border[0];
+        }
+
+        if(i < (lev.width - 1)) {
+            sum += u[ind + 1];
+            d += 1.0f;
+        } else {
+            d += lev.border[1];
+        }
+
+        if(j > 0) {
+            sum += u[ind - lev.width];
+            d += 1.0f;
+        } else {
+            d += lev.border[2];
+        }
+
+        if(j < (lev.height - 1)) {
+            sum += u[ind + lev.width];
+            d += 1.0f;
+        } else {
+            d += lev.border[3];
+        }
+    }
+
+    /**
+     * @brief Allocate builds the hierarchy.
+     * @param width
+     * @param height
+     * @param mask
+     */
+    void Allocate(int width, int height, bool *mask);
+
+    /**
+     * @brief Apply computes out = lap(u) at level l.
+     * @param l
+     * @param u
+     * @param out
+     */
+    void Apply(int l, float *u, float *out);
+
+    /**
+     * @brief Smooth runs red-black Gauss-Seidel sweeps at level l.
+     * @param l
+     * @param steps
+     * @param bRedFirst
+     */
+    void Smooth(int l, int steps, bool bRedFirst);
+
+    /**
+     * @brief Residual computes r = f - lap(u) at level l.
+     * @param l
+     */
+    void Residual(int l);
+
+    /**
+     * @brief Restrict restricts the residual of level l into f of level l + 1.
+     * @param l
+     */
+    void Restrict(int l);
+
+    /**
+     * @brief Prolongate adds the interpolated solution of level l + 1 to
+     * u of level l.
+     * @param l
+     */
+    void Prolongate(int l);
+
+    /**
+     * @brief Mean computes the mean of a vector at level l.
+     * @param l
+     * @param v
+     * @return
+     */
+    double Mean(int l, float *v);
+
+    /**
+     * @brief RemoveMean shifts a vector at level l to have a given mean; this
+     * projects out the constant null space of the pure Neumann problem.
+     * @param l
+     * @param v
+     * @param mean is the target mean.
+     */
+    void RemoveMean(int l, float *v, double mean = 0.0);
+
+    /**
+     * @brief SolveCoarsest solves the coarsest level with conjugate gradients
+     * down to a tight tolerance.
+     */
+    void SolveCoarsest();
+
+    /**
+     * @brief VCycle
+     * @param l
+     */
+    void VCycle(int l);
+
+    /**
+     * @brief Norm computes the L2 norm of a vector on unknowns at level 0.
+     * @param v
+     * @return
+     */
+    double Norm(float *v);
+
+    /**
+     * @brief getTolerance returns the relative residual at which the current
+     * channel stops: tolerance, or the residual that the float solution can
+     * attain, if larger. Rounding u to float perturbs lap(u) by up to
+     * 4 * FLT_EPSILON * |u| per pixel, which is taken as attainable.
+     * @param u is the current solution.
+     * @param norm0 is the norm of the initial residual.
+     * @return
+     */
+    float getTolerance(float *u, double norm0);
+
+    /**
+     * @brief SolveMG solves the current channel with V-cycles.
+     * @param rel receives the final relative residual.
+     * @return It returns true if the tolerance was reached.
+     */
+    bool SolveMG(float &rel);
+
+    /**
+     * @brief SolvePCG solves the current channel with V-cycle preconditioned CG.
+     * @param rel receives the final relative residual, computed from the
+     * solution and not from the CG recurrence.
+     * @return It returns true if the tolerance was reached.
+     */
+    bool SolvePCG(float &rel);
+
+    /**
+     * @brief Init sets default values.
+     * @param bc
+     * @param bPCG
+     */
+    void Init(PoissonBoundary bc, bool bPCG)
+    {
+        this->bc = bc;
+        this->bPCG = bPCG;
+
+        bSingular = false;
+        maxIter = 100;
+        preSteps = 2;
+        postSteps = 2;
+        maxThreads = -1;
+        tolerance = 1e-5f;
+
+        iterations = 0;
+        time = 0.0;
+        bConverged = false;
+        residual = 0.0f;
+    }
+
+public:
+    //statistics of the last Process call
+    std::vector<float> residuals;
+    int    iterations;
+    double time;
+
+    //true if all channels reached the tolerance (see getTolerance)
+    bool   bConverged;
+
+    //the largest final relative residual of the channels
+    float  residual;
+
+    /**
+     * @brief MultigridPoissonSolver; Neumann problems use PCG, which is
+     * more robust on elongated or irregular domains, and Dirichlet
+     * problems use V-cycles.
+     * @param bc is the boundary condition at the image border.
+     */
+    MultigridPoissonSolver(PoissonBoundary bc = PB_DIRICHLET)
+    {
+        Init(bc, bc == PB_NEUMANN);
+    }
+
+    /**
+     * @brief MultigridPoissonSolver
+     * @param bc is the boundary condition at the image border.
+     * @param bPCG if true, CG preconditioned by a V-cycle is used;
+     * this is more robust for irregular masked domains.
+     */
+    MultigridPoissonSolver(PoissonBoundary bc, bool bPCG)
+    {
+        Init(bc, bPCG);
+    }
+
+    /**
+     * @brief SetTolerance sets the relative residual at which iterations stop.
+     * @param tolerance
+     */
+    void SetTolerance(float tolerance)
+    {
+        this->tolerance = tolerance;
+    }
+
+    /**
+     * @brief SetMaxIterations sets the maximum number of V-cycles
+     * (or CG iterations).
+     * @param maxIter
+     */
+    void SetMaxIterations(int maxIter)
+    {
+        this->maxIter = MAX(maxIter, 1);
+    }
+
+    /**
+     * @brief SetSmoothingSteps sets the number of pre and post
+     * smoothing sweeps.
+     * @param preSteps
+     * @param postSteps
+     */
+    void SetSmoothingSteps(int preSteps, int postSteps)
+    {
+        this->preSteps = MAX(preSteps, 1);
+        this->postSteps = MAX(postSteps, 1);
+    }
+
+    /**
+     * @brief SetMaxThreads caps the number of workers.
+     * @param maxThreads
+     */
+    void SetMaxThreads(int maxThreads)
+    {
+        this->maxThreads = maxThreads;
+    }
+
+    /**
+     * @brief Process solves lap(imgOut) = f.
+     * @param f is the right-hand side; e.g. the divergence of a gradient field.
+     * @param imgOut is the output; if it is NULL, it is allocated.
+     * @param guess is an initial guess; it may be NULL. Pixels outside
+     * mask are set to its values.
+     * @param mask is a width * height array; true marks unknowns. If it is
+     * NULL, all pixels are unknowns.
+     * @return It returns imgOut; bConverged and residual tell whether the
+     * solve reached the tolerance.
+     */
+    ImageRAW *Process(ImageRAW *f, ImageRAW *imgOut, ImageRAW *guess = NULL,
+                      bool *mask = NULL);
+
+    /**
+     * @brief PrintStats prints convergence and time of the last call.
+     */
+    void PrintStats()
+    {
+        printf("MultigridPoissonSolver (%s, %s): %d iterations, %f seconds\n",
+               bPCG ? "PCG" : "V-cycles", bc == PB_DIRICHLET ? "Dirichlet" : "Neumann",
+               iterations, time);
+        printf("Residual: %e (%s)\n", residual, bConverged ? "converged" : "not converged");
+
+        for(unsigned int i = 0; i < residuals.size(); i++) {
+            printf("%d: %e\n", i, residuals[i]);
+        }
+    }
+
+    /**
+     * @brief Execute
+     * @param f
+     * @param imgOut
+     * @param bc
+     * @return
+     */
+    static ImageRAW *Execute(ImageRAW *f, ImageRAW *imgOut,
+                             PoissonBoundary bc = PB_DIRICHLET)
+    {
+        MultigridPoissonSolver solver(bc);
+        return solver.Process(f, imgOut);
+    }
+
+    /**
+     * @brief Execute
+     * @param f
+     * @param imgOut
+     * @param bc
+     * @param bPCG
+     * @return
+     */
+    static ImageRAW *Execute(ImageRAW *f, ImageRAW *imgOut,
+                             PoissonBoundary bc, bool bPCG)
+    {
+        MultigridPoissonSolver solver(bc, bPCG);
+        return solver.Process(f, imgOut);
+    }
+};
+
+PIC_INLINE void MultigridPoissonSolver::Allocate(int width, int height, bool *mask)
+{
+    levels.clear();
+
+    int fineWidth = width;
+    int fineHeight = height;
+    float h2 = 1.0f;
+    float scale = 1.0f;
+
+    while(true) {
+        Level lev;
+        lev.width = width;
+        lev.height = height;
+        lev.h2 = h2;
+
+        if(bc == PB_DIRICHLET) {
+            //the zero values are at fine pixels -1 and width (or height);
+            //coarse cells are cell-centered so the coupling is the inverse
+            //of the distance, in coarse cells, from the border cell center
+            float c0 = (scale - 1.0f) * 0.5f;
+            float dLeft = (c0 + 1.0f) / scale;
+            float dRight = (float(fineWidth) - (float(width - 1) * scale + c0)) / scale;
+            float dBottom = (float(fineHeight) - (float(height - 1) * scale + c0)) / scale;
+
+            lev.border[0] = 1.0f / dLeft;
+            lev.border[1] = 1.0f / MAX(dRight, 0.25f);
+            lev.border[2] = 1.0f / dLeft;
+            lev.border[3] = 1.0f / MAX(dBottom, 0.25f);
+        } else {
+            for(int i = 0; i < 4; i++) {
+                lev.border[i] = 0.0f;
+            }
+        }
+
+        int n = width * height;
+        lev.u.assign(n, 0.0f);
+        lev.f.assign(n, 0.0f);
+        lev.r.assign(n, 0.0f);
+        lev.unknown.assign(n, 1);
+
+        if(levels.empty()) {
+            if(mask != NULL) {
+                for(int i = 0; i < n; i++) {
+                    lev.unknown[i] = mask[i] ? 1 : 0;
+                }
+            }
+        } else {
+            //a coarse cell is unknown if all its children are unknown;
+            //in this way, fixed pixels are kept at every level
+            Level &fine = levels.back();
+
+            for(int j = 0; j < height; j++) {
+                for(int i = 0; i < width; i++) {
+                    unsigned char val = 1;
+
+                    for(int k = 0; k < 2; k++) {
+                        int fj = MIN(j * 2 + k, fine.height - 1);
+
+                        for(int m = 0; m < 2; m++) {
+                            int fi = MIN(i * 2 + m, fine.width - 1);
+                            val &= fine.unknown[fj * fine.width + fi];
+                        }
+                    }
+
+                    lev.unknown[j * width + i] = val;
+                }
+            }
+        }
+
+        levels.push_back(lev);
+
+        if((width <= 4) || (height <= 4)) {
+            break;
+        }
+
+        width  = (width  + 1) / 2;
+        height = (height + 1) / 2;
+        h2 *= 4.0f;
+        scale *= 2.0f;
+    }
+}
+
+PIC_INLINE void MultigridPoissonSolver::Apply(int l, float *u, float *out)
+{
+    Level &lev = levels[l];
+    int width = lev.width;
+    int height = lev.height;
+    float invH2 = 1.0f / lev.h2;
+
+    ThreadPool::ExecuteRows(width, height, [&](int y0, int y1) {
+        for(int j = y0; j < y1; j++) {
+            for(int i = 0; i < width; i++) {
+                int ind = j * width + i;
+
+                float sum, d;
+                Stencil(lev, u, i, j, sum, d);
+                out[ind] = (sum - d * u[ind]) * invH2;
+            }
+        }
+    }, maxThreads);
+}
+
+PIC_INLINE void MultigridPoissonSolver::Smooth(int l, int steps, bool bRedFirst)
+{
+    Level &lev = levels[l];
+    int width = lev.width;
+    int height = lev.height;
+    float h2 = lev.h2;
+    float *u = &lev.u[0];
+    float *f = &lev.f[0];
+    unsigned char *unknown = &lev.unknown[0];
+
+    for(int s = 0; s < steps; s++) {
+        for(int c = 0; c < 2; c++) {
+            int color = bRedFirst ? c : (1 - c);
+
+            ThreadPool::ExecuteRows(width, height, [&](int y0, int y1) {
+                for(int j = y0; j < y1; j++) {
+                    for(int i = (j + color) % 2; i < width; i += 2) {
+                        int ind = j * width + i;
+
+                        if(!unknown[ind]) {
+                            continue;
+                        }
+
+                        float sum, d;
+                        Stencil(lev, u, i, j, sum, d);
+
+                        if(d > 0.0f) {
+                            u[ind] = (sum - h2 * f[ind]) / d;
+                        }
+                    }
+                }
+            }, maxThreads);
+        }
+    }
+}
+
+PIC_INLINE void MultigridPoissonSolver::Residual(int l)
+{
+    Level &lev = levels[l];
+    int n = lev.width * lev.height;
+
+    Apply(l, &lev.u[0], &lev.r[0]);
+
+    for(int i = 0; i < n; i++) {
+        lev.r[i] = lev.unknown[i] ? (lev.f[i] - lev.r[i]) : 0.0f;
+    }
+}
+
+PIC_INLINE void MultigridPoissonSolver::Restrict(int l)
+{
+    Level &fine = levels[l];
+    Level &coarse = levels[l + 1];
+
+    int fw = fine.width;
+    int fh = fine.height;
+    int cw = coarse.width;
+    int ch = coarse.height;
+
+    float *r = &fine.r[0];
+    float *f = &coarse.f[0];
+
+    //transpose of the bilinear prolongation (scaled by 1/4); a fine
+    //cell x gives 3/4 to x / 2 and 1/4 to its other neighbor
+    auto weight = [](int x, int c, int nc) {
+        int c0 = x >> 1;
+        int c1 = (x & 1) ? c0 + 1 : c0 - 1;
+        c1 = CLAMPi(c1, 0, nc - 1);
+
+        float w = 0.0f;
+        if(c0 == c) {
+            w += 0.75f;
+        }
+
+        if(c1 == c) {
+            w += 0.25f;
+        }
+
+        return w;
+    };
+
+    ThreadPool::ExecuteRows(cw, ch, [&](int y0, int y1) {
+        for(int j = y0; j < y1; j++) {
+            for(int i = 0; i < cw; i++) {
+                float sum = 0.0f;
+
+                for(int fj = MAX(j * 2 - 1, 0); fj <= MIN(j * 2 + 2, fh - 1); fj++) {
+                    float wj = weight(fj, j, ch);
+
+                    if(wj <= 0.0f) {
+                        continue;
+                    }
+
+                    for(int fi = MAX(i * 2 - 1, 0); fi <= MIN(i * 2 + 2, fw - 1); fi++) {
+                        float wi = weight(fi, i, cw);
+                        sum += wi * wj * r[fj * fw + fi];
+                    }
+                }
+
+                int ind = j * cw + i;
+                f[ind] = coarse.unknown[ind] ? (sum * 0.25f) : 0.0f;
+            }
+        }
+    }, maxThreads);
+}
+
+PIC_INLINE void MultigridPoissonSolver::Prolongate(int l)
+{
+    Level &fine = levels[l];
+    Level &coarse = levels[l + 1];
+
+    int fw = fine.width;
+    int cw = coarse.width;
+    int ch = coarse.height;
+
+    float *u = &fine.u[0];
+    float *e = &coarse.u[0];
+
+    ThreadPool::ExecuteRows(fine.width, fine.height, [&](int y0, int y1) {
+        for(int j = y0; j < y1; j++) {
+            int cj0 = j >> 1;
+            int cj1 = (j & 1) ? cj0 + 1 : cj0 - 1;
+            cj1 = CLAMPi(cj1, 0, ch - 1);
+
+            for(int i = 0; i < fw; i++) {
+                int ind = j * fw + i;
+
+                if(!fine.unknown[ind]) {
+                    continue;
+                }
+
+                int ci0 = i >> 1;
+                int ci1 = (i & 1) ? ci0 + 1 : ci0 - 1;
+                ci1 = CLAMPi(ci1, 0, cw - 1);
+
+                u[ind] += 0.5625f * e[cj0 * cw + ci0] +
+                          0.1875f * (e[cj0 * cw + ci1] + e[cj1 * cw + ci0]) +
+                          0.0625f * e[cj1 * cw + ci1];
+            }
+        }
+    }, maxThreads);
+}
+
+PIC_INLINE double MultigridPoissonSolver::Mean(int l, float *v)
+{
+    Level &lev = levels[l];
+    int n = lev.width * lev.height;
+
+    double sum = 0.0;
+    for(int i = 0; i < n; i++) {
+        sum += v[i];
+    }
+
+    return sum / double(n);
+}
+
+PIC_INLINE void MultigridPoissonSolver::RemoveMean(int l, float *v, double mean)
+{
+    Level &lev = levels[l];
+    int n = lev.width * lev.height;
+
+    float shift = float(Mean(l, v) - mean);
+
+    for(int i = 0; i < n; i++) {
+        v[i] -= shift;
+    }
+}
+
+PIC_INLINE void MultigridPoissonSolver::SolveCoarsest()
+{
+    int l = int(levels.size() - 1);
+    Level &lev = levels[l];
+    int width = lev.width;
+    int height = lev.height;
+    int n = width * height;
+    float invH2 = 1.0f / lev.h2;
+    float *u = &lev.u[0];
+
+    cr.assign(n, 0.0f);
+    cp.assign(n, 0.0f);
+    cq.assign(n, 0.0f);
+
+    //q = A v with A = -lap on the unknowns; the level is small, so it is
+    //processed serially
+    auto multiply = [&](float *v, float *out) {
+        for(int j = 0; j < height; j++) {
+            for(int i = 0; i < width; i++) {
+                int ind = j * width + i;
+
+                if(lev.unknown[ind]) {
+                    float sum, d;
+                    Stencil(lev, v, i, j, sum, d);
+                    out[ind] = (d * v[ind] - sum) * invH2;
+                } else {
+                    out[ind] = 0.0f;
+                }
+            }
+        }
+    };
+
+    auto dot = [&](float *a, float *b) {
+        double tmp = 0.0;
+
+        for(int i = 0; i < n; i++) {
+            tmp += double(a[i]) * double(b[i]);
+        }
+
+        return tmp;
+    };
+
+    //A u = -f, so r = -f - A u
+    multiply(u, &cq[0]);
+
+    for(int i = 0; i < n; i++) {
+        cr[i] = lev.unknown[i] ? (-lev.f[i] - cq[i]) : 0.0f;
+    }
+
+    if(bSingular) {
+        RemoveMean(l, &cr[0]);
+    }
+
+    double rr0 = dot(&cr[0], &cr[0]);
+
+    if(rr0 <= 0.0) {
+        return;
+    }
+
+    double rr = rr0;
+    double tol2 = 1e-12 * rr0;
+    cp = cr;
+
+    //CG converges in at most n steps in exact arithmetic
+    for(int k = 0; k < (n * 2); k++) {
+        multiply(&cp[0], &cq[0]);
+
+        double pq = dot(&cp[0], &cq[0]);
+
+        if(pq <= 0.0) {
+            break;
+        }
+
+        float alpha = float(rr / pq);
+
+        for(int i = 0; i < n; i++) {
+            u[i] += alpha * cp[i];
+            cr[i] -= alpha * cq[i];
+        }
+
+        if(bSingular) {
+            RemoveMean(l, &cr[0]);
+        }
+
+        double rrNew = dot(&cr[0], &cr[0]);
+
+        if(rrNew <= tol2) {
+            break;
+        }
+
+        float beta = float(rrNew / rr);
+        rr = rrNew;
+
+        for(int i = 0; i < n; i++) {
+            cp[i] = cr[i] + beta * cp[i];
+        }
+    }
+
+    //the constant component of the correction is arbitrary
+    if(bSingular) {
+        RemoveMean(l, u);
+    }
+}
+
+PIC_INLINE void MultigridPoissonSolver::VCycle(int l)
+{
+    Level &lev = levels[l];
+
+    if(bSingular) {
+        RemoveMean(l, &lev.f[0]);
+    }
+
+    if(l == int(levels.size() - 1)) {
+        SolveCoarsest();
+        return;
+    }
+
+    Smooth(l, preSteps, true);
+    Residual(l);
+    Restrict(l);
+
+    Level &coarse = levels[l + 1];
+    std::fill(coarse.u.begin(), coarse.u.end(), 0.0f);
+
+    VCycle(l + 1);
+
+    Prolongate(l);
+    Smooth(l, postSteps, false);
+}
+
+PIC_INLINE double MultigridPoissonSolver::Norm(float *v)
+{
+    Level &lev = levels[0];
+
+    double sum = ThreadPool::SumRows(lev.width, lev.height, [&](int y0, int y1) {
+        double tmp = 0.0;
+
+        for(int i = y0 * lev.width; i < y1 * lev.width; i++) {
+            if(lev.unknown[i]) {
+                tmp += double(v[i]) * double(v[i]);
+            }
+        }
+
+        return tmp;
+    }, maxThreads);
+
+    return sqrt(sum);
+}
+
+PIC_INLINE float MultigridPoissonSolver::getTolerance(float *u, double norm0)
+{
+    float attainable = float(4.0 * double(FLT_EPSILON) * Norm(u) / norm0);
+    return MAX(tolerance, attainable);
+}
+
+PIC_INLINE bool MultigridPoissonSolver::SolveMG(float &rel)
+{
+    Level &lev = levels[0];
+
+    //the mean of the initial guess is kept for the pure Neumann problem
+    double mean0 = bSingular ? Mean(0, &lev.u[0]) : 0.0;
+
+    Residual(0);
+    double norm0 = Norm(&lev.r[0]);
+
+    rel = 0.0f;
+
+    if(norm0 <= 0.0) {
+        return true;
+    }
+
+    for(int k = 0; k < maxIter; k++) {
+        VCycle(0);
+
+        if(bSingular) {
+            RemoveMean(0, &lev.u[0], mean0);
+        }
+
+        Residual(0);
+        rel = float(Norm(&lev.r[0]) / norm0);
+        residuals.push_back(rel);
+        iterations++;
+
+        if(rel < getTolerance(&lev.u[0], norm0)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+PIC_INLINE bool MultigridPoissonSolver::SolvePCG(float &rel)
+{
+    Level &lev = levels[0];
+    int n = lev.width * lev.height;
+
+    //x holds the solution; lev.u and lev.f are used by the preconditioner
+    x = lev.u;
+    std::vector<float> b = lev.f;
+    res.assign(n, 0.0f);
+    p.assign(n, 0.0f);
+    q.assign(n, 0.0f);
+
+    //A = -lap is SPD on the unknowns; A x = -f, so r = -f - A x = lap(x) - f
+    Residual(0);
+
+    for(int i = 0; i < n; i++) {
+        res[i] = -lev.r[i];
+    }
+
+    if(bSingular) {
+        RemoveMean(0, &res[0]);
+    }
+
+    double norm0 = Norm(&res[0]);
+
+    rel = 0.0f;
+
+    if(norm0 <= 0.0) {
+        return true;
+    }
+
+    double mean0 = bSingular ? Mean(0, &x[0]) : 0.0;
+
+    auto dot = [&](float *a, float *c) {
+        return ThreadPool::SumRows(lev.width, lev.height, [&](int y0, int y1) {
+            double tmp = 0.0;
+
+            for(int i = y0 * lev.width; i < y1 * lev.width; i++) {
+                if(lev.unknown[i]) {
+                    tmp += double(a[i]) * double(c[i]);
+                }
+            }
+
+            return tmp;
+        }, maxThreads);
+    };
+
+    //z = M^-1 r: a V-cycle on lap(z) = -r with zero Dirichlet values
+    auto precondition = [&]() {
+        for(int i = 0; i < n; i++) {
+            lev.f[i] = -res[i];
+            lev.u[i] = 0.0f;
+        }
+
+        VCycle(0);
+
+        for(int i = 0; i < n; i++) {
+            if(!lev.unknown[i]) {
+                lev.u[i] = 0.0f;
+            }
+        }
+
+        if(bSingular) {
+            RemoveMean(0, &lev.u[0]);
+        }
+    };
+
+    //the true residual of x; the CG recurrence drifts from it in float
+    auto trueResidual = [&]() {
+        lev.u = x;
+        lev.f = b;
+        Residual(0);
+        return float(Norm(&lev.r[0]) / norm0);
+    };
+
+    precondition();
+    p = lev.u;
+    double rz = dot(&res[0], &lev.u[0]);
+
+    float relTrue = 1.0f;
+    bool bDone = false;
+
+    for(int k = 0; (k < maxIter) && !bDone; k++) {
+        //q = A p
+        Apply(0, &p[0], &q[0]);
+
+        for(int i = 0; i < n; i++) {
+            q[i] = lev.unknown[i] ? -q[i] : 0.0f;
+        }
+
+        double pq = dot(&p[0], &q[0]);
+
+        if(pq <= 0.0) {
+            break;
+        }
+
+        float alpha = float(rz / pq);
+
+        for(int i = 0; i < n; i++) {
+            if(lev.unknown[i]) {
+                x[i] += alpha * p[i];
+                res[i] -= alpha * q[i];
+            }
+        }
+
+        if(bSingular) {
+            RemoveMean(0, &res[0]);
+        }
+
+        float relCG = float(Norm(&res[0]) / norm0);
+        residuals.push_back(relCG);
+        iterations++;
+
+        bool bRestart = false;
+
+        if(relCG < getTolerance(&x[0], norm0)) {
+            //residual replacement: CG restarts from the true residual until
+            //the tolerance is met or the true residual stops decreasing
+            float relNew = trueResidual();
+
+            if((relNew < getTolerance(&x[0], norm0)) || (relNew > (relTrue * 0.5f))) {
+                bDone = true;
+                continue;
+            }
+
+            relTrue = relNew;
+
+            for(int i = 0; i < n; i++) {
+                res[i] = -lev.r[i];
+            }
+
+            if(bSingular) {
+                RemoveMean(0, &res[0]);
+            }
+
+            bRestart = true;
+        }
+
+        precondition();
+        double rzNew = dot(&res[0], &lev.u[0]);
+        float beta = bRestart ? 0.0f : float(rzNew / rz);
+        rz = rzNew;
+
+        for(int i = 0; i < n; i++) {
+            p[i] = lev.u[i] + beta * p[i];
+        }
+    }
+
+    if(bSingular) {
+        RemoveMean(0, &x[0], mean0);
+    }
+
+    rel = trueResidual();
+
+    return rel < getTolerance(&lev.u[0], norm0);
+}
+
+PIC_INLINE ImageRAW *MultigridPoissonSolver::Process(ImageRAW *f, ImageRAW *imgOut,
+        ImageRAW *guess, bool *mask)
+{
+    if(f == NULL) {
+        return NULL;
+    }
+
+    if(!f->isValid()) {
+        return NULL;
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+
+    if(imgOut == NULL) {
+        imgOut = f->AllocateSimilarOne();
+    }
+
+    int width = f->width;
+    int height = f->height;
+    int channels = f->channels;
+    int n = width * height;
+
+    Allocate(width, height, mask);
+
+    //the pure Neumann problem is defined up to a constant
+    bSingular = false;
+    if(bc == PB_NEUMANN) {
+        bSingular = true;
+
+        for(int i = 0; i < n; i++) {
+            if(!levels[0].unknown[i]) {
+                bSingular = false;
+                break;
+            }
+        }
+    }
+
+    residuals.clear();
+    iterations = 0;
+    bConverged = true;
+    residual = 0.0f;
+
+    Level &lev = levels[0];
+
+    for(int ch = 0; ch < channels; ch++) {
+        for(int i = 0; i < n; i++) {
+            lev.f[i] = f->data[i * channels + ch];
+            lev.u[i] = (guess != NULL) ? guess->data[i * guess->channels + (ch % guess->channels)] : 0.0f;
+        }
+
+        if(bSingular) {
+            RemoveMean(0, &lev.f[0]);
+        }
+
+        float rel;
+        bool bChannel = bPCG ? SolvePCG(rel) : SolveMG(rel);
+
+        bConverged = bConverged && bChannel;
+        residual = MAX(residual, rel);
+
+        for(int i = 0; i < n; i++) {
+            imgOut->data[i * channels + ch] = lev.u[i];
+        }
+    }
+
+    time = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+#ifdef PIC_DEBUG
+    PrintStats();
+#endif
+
+    return imgOut;
+}
+
+} // end namespace pic
+
+#endif /* PIC_ALGORITHMS_MULTIGRID_POISSON_SOLVER_HPP */
+
@@ -25,27 +25,100 @@ See the GNU Lesser General Public License
 #ifndef PIC_ALGORITHMS_PYRAMID_HPP
 #define PIC_ALGORITHMS_PYRAMID_HPP
 
+#include <vector>
+
 #include "image_raw.hpp"
-#include "filtering/filter_gaussian_2d.hpp"
-#include "filtering/filter_sampler_2d.hpp"
-#include "filtering/filter_sampler_2dsub.hpp"
-#include "filtering/filter_sampler_2dadd.hpp"
+#include "util/image_sampler.hpp"
+#include "util/precomputed_gaussian.hpp"
+#include "util/thread_pool.hpp"
 
 namespace pic {
 
 /**
- * @brief The Pyramid class
+ * @brief The Pyramid class is a Gaussian/Laplacian pyramid. All levels,
+ * the temporaries of Update and Reconstruct, and the sampling tables are
+ * allocated once in a single arena, so Update and Reconstruct do not
+ * allocate memory. Blurring (sigma = 1) and nearest downsampling are fused
+ * and the blur is evaluated only at downsampled pixels; bilinear upsampling
+ * is fused with the subtraction (Update) and the addition (Reconstruct).
+ * Fine levels are split among the workers of the ThreadPool by rows, while
+ * coarse levels run on the calling thread.
  */
 class Pyramid
 {
 protected:
+    /**
+     * @brief The Sampling struct stores the coordinates between level i
+     * and the downsampled level i + 1.
+     */
+    struct Sampling
+    {
+        //nearest downsampling: coordinates at level i for each pixel at i + 1
+        std::vector<int>   sx, sy;
+        //bilinear upsampling: coordinates and weights at level i + 1 for
+        //each pixel at level i
+        std::vector<int>   ux0, ux1, uy0, uy1;
+        std::vector<float> udx, udy;
+    };
+
     bool    lapGauss;
     int     limitLevel;
+    int     maxThreads;
+
+    float   *arena;
+    int     scratchStride;
+
+    PrecomputedGaussian     pg;
+    std::vector<Sampling>   sampling;
+    std::vector<float>      scratch;
 
     std::vector<ImageRAW *> trackerRec, trackerUp;
 
+    /**
+     * @brief Allocate allocates the arena and the levels.
+     * @param width
+     * @param height
+     * @param channels
+     * @param lapGauss
+     * @param limitLevel
+     */
+    void Allocate(int width, int height, int channels, bool lapGauss,
+                  int limitLevel);
+
+    /**
+     * @brief Release frees the arena and the levels.
+     */
+    void Release();
+
+    /**
+     * @brief Create allocates and computes the pyramid of img.
+     * @param img
+     * @param lapGauss
+     * @param limitLevel
+     */
     void Create(ImageRAW *img, bool lapGauss, int limitLevel);
 
+    /**
+     * @brief Downsample blurs imgIn (level i) with a Gaussian filter and
+     * downsamples it into imgOut (level i + 1).
+     * @param imgIn
+     * @param imgOut
+     * @param i
+     */
+    void Downsample(ImageRAW *imgIn, ImageRAW *imgOut, int i);
+
+    /**
+     * @brief Upsample computes imgOut = imgIn +/- the bilinear upsampling
+     * of imgLow, where imgIn and imgOut are at level i.
+     * @param imgIn
+     * @param imgLow
+     * @param imgOut
+     * @param i
+     * @param bSub
+     */
+    void Upsample(ImageRAW *imgIn, ImageRAW *imgLow, ImageRAW *imgOut, int i,
+                  bool bSub);
+
 public:
     std::vector<ImageRAW *>  stack;
 
@@ -78,8 +151,19 @@ public:
         this->lapGauss = lapGauss;
     }
 
+    /**
+     * @brief SetMaxThreads caps the number of workers of the thread pool
+     * used for building and reconstructing the pyramid.
+     * @param maxThreads
+     */
+    void SetMaxThreads(int maxThreads)
+    {
+        this->maxThreads = maxThreads;
+    }
+
     /**
      * @brief Update recomputes the pyramid given a compatible image, img.
+     * No memory is allocated.
      * @param img
      */
     void Update(ImageRAW *img);
@@ -130,80 +214,283 @@ public:
     }
 };
 
-Pyramid::Pyramid(ImageRAW *img, bool lapGauss, int limitLevel = 0)
+PIC_INLINE Pyramid::Pyramid(ImageRAW *img, bool lapGauss, int limitLevel = 0) : pg(1.0f)
 {
+    maxThreads = -1;
+    arena = NULL;
     Create(img, lapGauss, limitLevel);
 }
 
-
-Pyramid::Pyramid(int width, int height, int channels, bool lapGauss, int limitLevel = 0)
+PIC_INLINE Pyramid::Pyramid(int width, int height, int channels, bool lapGauss,
+                            int limitLevel = 0) : pg(1.0f)
 {
-    ImageRAW *tmpImg = new ImageRAW(1, width, height, channels);
-    tmpImg->SetZero();
+    maxThreads = -1;
+    arena = NULL;
 
-    Create(tmpImg, lapGauss, limitLevel);
+    Allocate(width, height, channels, lapGauss, limitLevel);
 
-    delete tmpImg;
+    for(unsigned int i = 0; i < stack.size(); i++) {
+        stack[i]->SetZero();
+    }
 
 #ifdef PIC_DEBUG
     printf("Pyramid size: %lu\n", stack.size());
 #endif
 }
 
-Pyramid::~Pyramid()
+PIC_INLINE Pyramid::~Pyramid()
+{
+    Release();
+}
+
+PIC_INLINE void Pyramid::Release()
 {
     for(unsigned int i = 0; i < stack.size(); i++) {
         if(stack[i] != NULL) {
             delete stack[i];
         }
     }
+
+    for(unsigned int i = 0; i < trackerUp.size(); i++) {
+        delete trackerUp[i];
+    }
+
+    for(unsigned int i = 0; i < trackerRec.size(); i++) {
+        delete trackerRec[i];
+    }
+
+    stack.clear();
+    trackerUp.clear();
+    trackerRec.clear();
+    sampling.clear();
+
+    if(arena != NULL) {
+        delete[] arena;
+        arena = NULL;
+    }
 }
 
-void Pyramid::Create(ImageRAW *img, bool lapGauss, int limitLevel = 0)
+PIC_INLINE void Pyramid::Allocate(int width, int height, int channels,
+                                  bool lapGauss, int limitLevel = 0)
 {
+    Release();
+
     this->lapGauss  = lapGauss;
     this->limitLevel = limitLevel;
 
-    FilterGaussian2D	fltG(1.0f);
-    FilterSampler2D		fltS(0.5f);
-    FilterSampler2DSub	fSub;
+    int levels = MAX(log2(MIN(width, height)) - limitLevel, 1);
 
-    ImageRAW *tmpImg = img;
+    //level sizes: stack has levels + 1 images
+    std::vector<int> w, h;
+    w.push_back(width);
+    h.push_back(height);
 
-    int levels = MAX(log2(MIN(img->width, img->height)) - limitLevel, 1);
+    for(int i = 0; i < levels; i++) {
+        w.push_back(int(float(w[i]) * 0.5f));
+        h.push_back(int(float(h[i]) * 0.5f));
+    }
+
+    //arena layout: stack, downsampled levels (trackerUp), and
+    //reconstruction temporaries (trackerRec)
+    size_t tot = 0;
+
+    for(int i = 0; i <= levels; i++) {
+        tot += size_t(w[i]) * size_t(h[i]) * channels;
+    }
+
+    for(int i = 1; i < levels; i++) {
+        tot += size_t(w[i]) * size_t(h[i]) * channels * 2;
+    }
+
+    arena = new float[tot];
+    float *ptr = arena;
+
+    for(int i = 0; i <= levels; i++) {
+        stack.push_back(new ImageRAW(1, w[i], h[i], channels, ptr));
+        ptr += w[i] * h[i] * channels;
+    }
+
+    for(int i = 1; i < levels; i++) {
+        trackerUp.push_back(new ImageRAW(1, w[i], h[i], channels, ptr));
+        ptr += w[i] * h[i] * channels;
+    }
+
+    //trackerRec[c] is at level n - 1 - c, where n = levels
+    for(int i = levels - 1; i >= 1; i--) {
+        trackerRec.push_back(new ImageRAW(1, w[i], h[i], channels, ptr));
+        ptr += w[i] * h[i] * channels;
+    }
 
-    ImageRAW *tmpG = NULL;
-    ImageRAW *tmpD = NULL;
+    //sampling tables; the coordinates are computed as in
+    //FilterSampler2D (nearest) and ImageSamplerBilinear
+    sampling.resize(levels);
 
     for(int i = 0; i < levels; i++) {
-        tmpG = fltG.ProcessP(Single(tmpImg), NULL);
-        tmpD = fltS.ProcessP(Single(tmpG), NULL);
-
-        if(lapGauss) {	//Laplacian Pyramid
-            ImageRAW *tmpDiff = fSub.ProcessP(Double(tmpImg, tmpD), tmpG);
-            stack.push_back(tmpDiff);
-        } else {			//Gaussian Pyramid
-            tmpG->Assign(tmpImg);
-            stack.push_back(tmpG);
+        Sampling &s = sampling[i];
+        int wd = w[i + 1];
+        int hd = h[i + 1];
+
+        s.sx.resize(wd);
+        s.sy.resize(hd);
+
+        for(int k = 0; k < wd; k++) {
+            float x = (wd > 1) ? float(k) / float(wd - 1) : 0.0f;
+            x = CLAMPi(x, 0.0f, 1.0f);
+            s.sx[k] = int(lround(x * float(w[i] - 1)));
         }
 
-        if(i < (levels - 1)) {
-            trackerUp.push_back(tmpD);
+        for(int k = 0; k < hd; k++) {
+            float y = (hd > 1) ? float(k) / float(hd - 1) : 0.0f;
+            y = CLAMPi(y, 0.0f, 1.0f);
+            s.sy[k] = int(lround(y * float(h[i] - 1)));
         }
 
-        tmpImg = tmpD;
-    }
+        s.ux0.resize(w[i]);
+        s.ux1.resize(w[i]);
+        s.udx.resize(w[i]);
+
+        for(int k = 0; k < w[i]; k++) {
+            float x = (w[i] > 1) ? float(k) / float(w[i] - 1) : 0.0f;
+            x *= float(wd - 1);
+            float xx = floorf(x);
+            int ix = int(xx);
+            s.ux0[k] = ix;
+            s.ux1[k] = CLAMP(ix + 1, wd);
+            s.udx[k] = x - xx;
+        }
 
-    if(tmpD != NULL) {
-        stack.push_back(tmpD);
+        s.uy0.resize(h[i]);
+        s.uy1.resize(h[i]);
+        s.udy.resize(h[i]);
+
+        for(int k = 0; k < h[i]; k++) {
+            float y = (h[i] > 1) ? float(k) / float(h[i] - 1) : 0.0f;
+            y *= float(hd - 1);
+            float yy = floorf(y);
+            int iy = int(yy);
+            s.uy0[k] = iy;
+            s.uy1[k] = CLAMP(iy + 1, hd);
+            s.udy[k] = y - yy;
+        }
     }
 
+    //a row of the vertical pass for each worker
+    scratchStride = width * channels;
+    scratch.resize(size_t(scratchStride) * ThreadPool::getInstance()->getMaxThreads());
+}
+
+PIC_INLINE void Pyramid::Create(ImageRAW *img, bool lapGauss, int limitLevel = 0)
+{
+    Allocate(img->width, img->height, img->channels, lapGauss, limitLevel);
+    Update(img);
+
 #ifdef PIC_DEBUG
     printf("Pyramid size: %lu\n", stack.size());
 #endif
 }
 
-ImageRAW *Pyramid::Reconstruct(ImageRAW *imgOut)
+PIC_INLINE void Pyramid::Downsample(ImageRAW *imgIn, ImageRAW *imgOut, int i)
+{
+    Sampling &s = sampling[i];
+
+    int width = imgIn->width;
+    int height = imgIn->height;
+    int channels = imgIn->channels;
+    int wd = imgOut->width;
+
+    float *coeff = pg.coeff;
+    int n = pg.kernelSize;
+    int r = pg.halfKernelSize;
+
+    //the cost of an output row is proportional to the input width
+    ThreadPool::ExecuteRows(imgIn->width, imgOut->height, [&](int y0, int y1) {
+        float *V = &scratch[ThreadPool::getWorkerIndex() * scratchStride];
+        int rowSize = width * channels;
+
+        for(int j = y0; j < y1; j++) {
+            int y = s.sy[j];
+
+            //vertical pass at row y
+            for(int k = 0; k < rowSize; k++) {
+                V[k] = 0.0f;
+            }
+
+            for(int k = 0; k < n; k++) {
+                int cy = y + k - r;
+                cy = CLAMPi(cy, 0, height - 1);
+
+                float *row = &imgIn->data[cy * rowSize];
+                float c = coeff[k];
+
+                for(int m = 0; m < rowSize; m++) {
+                    V[m] += row[m] * c;
+                }
+            }
+
+            //horizontal pass at the sampled columns
+            float *out = &imgOut->data[j * wd * channels];
+
+            for(int i = 0; i < wd; i++) {
+                int x = s.sx[i];
+                float *tmpOut = &out[i * channels];
+
+                for(int l = 0; l < channels; l++) {
+                    tmpOut[l] = 0.0f;
+                }
+
+                for(int k = 0; k < n; k++) {
+                    int cx = x + k - r;
+                    cx = CLAMPi(cx, 0, width - 1);
+
+                    float *tmpV = &V[cx * channels];
+                    float c = coeff[k];
+
+                    for(int l = 0; l < channels; l++) {
+                        tmpOut[l] += tmpV[l] * c;
+                    }
+                }
+            }
+        }
+    }, maxThreads);
+}
+
+PIC_INLINE void Pyramid::Upsample(ImageRAW *imgIn, ImageRAW *imgLow,
+                                  ImageRAW *imgOut, int i, bool bSub)
+{
+    Sampling &s = sampling[i];
+
+    int width = imgOut->width;
+    int channels = imgOut->channels;
+    int wl = imgLow->width;
+    float sign = bSub ? -1.0f : 1.0f;
+
+    ThreadPool::ExecuteRows(imgOut->width, imgOut->height, [&](int y0, int y1) {
+        for(int j = y0; j < y1; j++) {
+            float *low0 = &imgLow->data[s.uy0[j] * wl * channels];
+            float *low1 = &imgLow->data[s.uy1[j] * wl * channels];
+            float dy = s.udy[j];
+
+            float *in  = &imgIn->data[j * width * channels];
+            float *out = &imgOut->data[j * width * channels];
+
+            for(int x = 0; x < width; x++) {
+                int ind0 = s.ux0[x] * channels;
+                int ind1 = s.ux1[x] * channels;
+                float dx = s.udx[x];
+
+                for(int l = 0; l < channels; l++) {
+                    float v = Bilinear<float>(low0[ind0 + l], low0[ind1 + l],
+                                              low1[ind0 + l], low1[ind1 + l],
+                                              dx, dy);
+
+                    out[x * channels + l] = in[x * channels + l] + sign * v;
+                }
+            }
+        }
+    }, maxThreads);
+}
+
+PIC_INLINE ImageRAW *Pyramid::Reconstruct(ImageRAW *imgOut)
 {
     if(stack.size() < 2) {
         return imgOut;
@@ -213,33 +500,24 @@ ImageRAW *Pyramid::Reconstruct(ImageRAW *imgOut)
         imgOut = stack[0]->AllocateSimilarOne();
     }
 
-    FilterSampler2DAdd fltAdd;
     int n = stack.size() - 1;
     ImageRAW *tmp = stack[n];
 
-    if(trackerRec.empty()) {
-        for(int i = n; i >= 2; i--) {
-            ImageRAW *tmp2 = fltAdd.ProcessP(Double(stack[i - 1], tmp), NULL);
-            trackerRec.push_back(tmp2);
-            tmp = tmp2;
-        }
-    } else {
-        int c = 0;
+    int c = 0;
 
-        for(int i = n; i >= 2; i--) {
-            tmp = fltAdd.ProcessP(Double(stack[i - 1], tmp), trackerRec[c]);
-            c++;
-        }
+    for(int i = n; i >= 2; i--) {
+        Upsample(stack[i - 1], tmp, trackerRec[c], i - 1, false);
+        tmp = trackerRec[c];
+        c++;
     }
 
-    fltAdd.ProcessP(Double(stack[0], tmp), imgOut);
+    Upsample(stack[0], tmp, imgOut, 0, false);
 
     return imgOut;
 }
 
-void Pyramid::Update(ImageRAW *img)
+PIC_INLINE void Pyramid::Update(ImageRAW *img)
 {
-    //TODO: check if the image and the pyramid are compatible
     if(img == NULL) {
         return;
     }
@@ -248,34 +526,29 @@ void Pyramid::Update(ImageRAW *img)
         return;
     }
 
-    FilterGaussian2D	fltG(1.0f);
-    FilterSampler2D		fltS(0.5f);
-    FilterSampler2DSub	fSub;
-
-    ImageRAW *tmpImg = img;
+    int levels = int(stack.size()) - 1;
 
-    unsigned int levels = MAX(log2(MIN(img->width, img->height)) - limitLevel, 1);
+    if(lapGauss) {  //Laplacian Pyramid
+        ImageRAW *tmpImg = img;
 
-    for(unsigned int i = 0; i < (levels - 1); i++) {
-        fltG.ProcessP(Single(tmpImg), stack[i]);
+        for(int i = 0; i < levels; i++) {
+            ImageRAW *tmpD = (i < (levels - 1)) ? trackerUp[i] : stack[levels];
 
-        fltS.ProcessP(Single(stack[i]), trackerUp[i]);
+            Downsample(tmpImg, tmpD, i);
+            Upsample(tmpImg, tmpD, stack[i], i, true);
 
-        if(lapGauss) {	//Laplacian Pyramid
-            stack[i] = fSub.ProcessP(Double(tmpImg, trackerUp[i]), stack[i]);
-        } else {		//Gaussian Pyramid
-            stack[i]->Assign(tmpImg);
+            tmpImg = tmpD;
         }
+    } else {        //Gaussian Pyramid
+        stack[0]->Assign(img);
 
-        tmpImg = trackerUp[i];
-    }
-
-    if(tmpImg != NULL) {
-        stack[levels - 1]->Assign(tmpImg);
+        for(int i = 0; i < levels; i++) {
+            Downsample(stack[i], stack[i + 1], i);
+        }
     }
 }
 
-void Pyramid::Mul(const Pyramid *pyr)
+PIC_INLINE void Pyramid::Mul(const Pyramid *pyr)
 {
     if(stack.size() != pyr->stack.size()) {
         return;
@@ -290,7 +563,7 @@ void Pyramid::Mul(const Pyramid *pyr)
     }
 }
 
-void Pyramid::Add(const Pyramid *pyr)
+PIC_INLINE void Pyramid::Add(const Pyramid *pyr)
 {
     if(stack.size() != pyr->stack.size()) {
         return;
@@ -301,7 +574,7 @@ void Pyramid::Add(const Pyramid *pyr)
     }
 }
 
-void Pyramid::Blend(Pyramid *pyr, Pyramid *weight)
+PIC_INLINE void Pyramid::Blend(Pyramid *pyr, Pyramid *weight)
 {
     if((stack.size() != pyr->stack.size()) && (pyr->stack.size() > 0)) {
         return;
@@ -0,0 +1,768 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+PICCANTE is free software; you can redistribute it and/or modify
+under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation; either version 3.0 of
+the License, or (at your option) any later version.
+
+PICCANTE is distributed in the hope that it will be useful, but
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU Lesser General Public License
+( http://www.gnu.org/licenses/lgpl-3.0.html ) for more details.
+
+*/
+
+#ifndef PIC_ALGORITHMS_WEIGHTED_LAPLACIAN_SOLVER_HPP
+#define PIC_ALGORITHMS_WEIGHTED_LAPLACIAN_SOLVER_HPP
+
+#include <vector>
+#include <chrono>
+#include <functional>
+
+#include "image_raw.hpp"
+#include "util/math.hpp"
+#include "util/thread_pool.hpp"
+
+namespace pic {
+
+/**
+ * @brief The WeightedLaplacianSolver class solves (D + L) x = b, where D is
+ * a non-negative diagonal and L is a 5-point weighted Laplacian; these are
+ * the systems of WLS smoothing and of Lischinski's minimization.
+ * The solver is matrix-free: it stores only D and the weights of the edges
+ * to the right and to the bottom of each pixel. It runs conjugate gradients
+ * preconditioned by a V-cycle of an aggregation multigrid; 2x2 cells are
+ * merged, and the Galerkin coarse operator is again a 5-point weighted
+ * Laplacian whose weights are the sums of the fine edges between two cells.
+ * Memory is linear in the number of pixels, the hierarchy can be reused for
+ * several right-hand sides, and x can be warm-started from a previous
+ * solution; e.g. the one of the previous frame of a video.
+ */
+class WeightedLaplacianSolver
+{
+protected:
+    /**
+     * @brief The Level struct is a level of the multigrid hierarchy.
+     */
+    struct Level
+    {
+        int width, height;
+        //data term, right and bottom weights, and the diagonal of D + L
+        std::vector<float> d, wx, wy, diag;
+        std::vector<float> u, f, r;
+    };
+
+    std::vector<Level> levels;
+
+    int   maxIter, preSteps, postSteps, maxThreads;
+    float tolerance;
+
+    //PCG vectors
+    std::vector<float> res, p, q, bc, xc;
+
+    /**
+     * @brief AllocateLevel allocates vectors of a level.
+     * @param lev
+     * @param width
+     * @param height
+     */
+    static void AllocateLevel(Level &lev, int width, int height)
+    {
+        int n = width * height;
+
+        lev.width = width;
+        lev.height = height;
+
+        lev.d.assign(n, 0.0f);
+        lev.wx.assign(n, 0.0f);
+        lev.wy.assign(n, 0.0f);
+        lev.diag.assign(n, 0.0f);
+        lev.u.assign(n, 0.0f);
+        lev.f.assign(n, 0.0f);
+        lev.r.assign(n, 0.0f);
+    }
+
+    /**
+     * @brief Neighbors computes the weighted sum of the neighbors of (i, j).
+     * @param lev
+     * @param u
+     * @param i
+     * @param j
+     * @return
+     */
+    static inline float Neighbors(Level &lev, float *u, int i, int j)
+    {
+        int width = lev.width;
+        int ind = j * width + i;
+        float sum = 0.0f;
+
+        if(i > 0) {
+            sum += lev.wx[ind - 1] * u[ind - 1];
+        }
+
+        if(i < (width - 1)) {
+            sum += lev.wx[ind] * u[ind + 1];
+        }
+
+        if(j > 0) {
+            sum += lev.wy[ind - width] * u[ind - width];
+        }
+
+        if(j < (lev.height - 1)) {
+            sum += lev.wy[ind] * u[ind + width];
+        }
+
+        return sum;
+    }
+
+    /**
+     * @brief ComputeDiagonal computes the diagonal of D + L at level l.
+     * @param l
+     */
+    void ComputeDiagonal(int l);
+
+    /**
+     * @brief Coarsen builds the hierarchy from level 0.
+     */
+    void Coarsen();
+
+    /**
+     * @brief Apply computes out = (D + L) u at level l.
+     * @param l
+     * @param u
+     * @param out
+     */
+    void Apply(int l, float *u, float *out);
+
+    /**
+     * @brief Smooth runs red-black Gauss-Seidel sweeps at level l.
+     * @param l
+     * @param steps
+     * @param bRedFirst
+     */
+    void Smooth(int l, int steps, bool bRedFirst);
+
+    /**
+     * @brief Restrict computes the residual of level l and sums it over
+     * 2x2 cells into f of level l + 1.
+     * @param l
+     */
+    void Restrict(int l);
+
+    /**
+     * @brief Prolongate adds the solution of level l + 1 to the children
+     * cells at level l.
+     * @param l
+     */
+    void Prolongate(int l);
+
+    /**
+     * @brief VCycle
+     * @param l
+     */
+    void VCycle(int l);
+
+    /**
+     * @brief Dot computes the dot product of two vectors at level 0.
+     * @param a
+     * @param b
+     * @return
+     */
+    double Dot(float *a, float *b);
+
+    /**
+     * @brief SolveAux solves a right-hand side with PCG.
+     * @param b
+     * @param x
+     * @param bWarmStart
+     * @return
+     */
+    bool SolveAux(float *b, float *x, bool bWarmStart);
+
+public:
+    //statistics of the last Solve or Process call
+    std::vector<float> residuals;
+    int    iterations;
+    double time;
+    bool   bConverged;
+
+    /**
+     * @brief WeightedLaplacianSolver
+     */
+    WeightedLaplacianSolver()
+    {
+        maxIter = 200;
+        preSteps = 2;
+        postSteps = 2;
+        maxThreads = -1;
+        tolerance = 1e-4f;
+
+        iterations = 0;
+        time = 0.0;
+        bConverged = false;
+    }
+
+    /**
+     * @brief SetTolerance sets the residual, relative to the norm of b,
+     * at which iterations stop.
+     * @param tolerance
+     */
+    void SetTolerance(float tolerance)
+    {
+        this->tolerance = tolerance;
+    }
+
+    /**
+     * @brief SetMaxIterations sets the maximum number of CG iterations.
+     * @param maxIter
+     */
+    void SetMaxIterations(int maxIter)
+    {
+        this->maxIter = MAX(maxIter, 1);
+    }
+
+    /**
+     * @brief SetMaxThreads caps the number of workers.
+     * @param maxThreads
+     */
+    void SetMaxThreads(int maxThreads)
+    {
+        this->maxThreads = maxThreads;
+    }
+
+    /**
+     * @brief Update sets the system.
+     * @param width
+     * @param height
+     * @param d is the data term; width * height values >= 0.
+     * @param wx are the weights between (i, j) and (i + 1, j); width * height
+     * values >= 0, the last column is ignored.
+     * @param wy are the weights between (i, j) and (i, j + 1); width * height
+     * values >= 0, the last row is ignored.
+     */
+    void Update(int width, int height, float *d, float *wx, float *wy);
+
+    /**
+     * @brief Update sets an edge-aware system; the weight between two
+     * neighbors p and q is lambda / (||guide(p) - guide(q)||^alpha + epsilon);
+     * i.e., the same system of FilterWLS for any number of channels.
+     * @param guide is the image driving the weights.
+     * @param d is the data term (first channel); if it is NULL, it is 1.
+     * @param alpha
+     * @param lambda
+     * @param epsilon
+     */
+    void Update(ImageRAW *guide, ImageRAW *d, float alpha, float lambda,
+                float epsilon = 0.0001f);
+
+    /**
+     * @brief Solve solves (D + L) x = b for the current system.
+     * @param b is the right-hand side; width * height values.
+     * @param x is the solution; width * height values.
+     * @param bWarmStart if true, the content of x is the initial guess.
+     * @return It returns true if the tolerance was reached.
+     */
+    bool Solve(float *b, float *x, bool bWarmStart = false);
+
+    /**
+     * @brief Process solves each channel of b for the current system.
+     * @param b
+     * @param imgOut is the output; if it is NULL, it is allocated.
+     * @param bWarmStart if true, the content of imgOut is the initial guess.
+     * @return It returns imgOut untouched if its size or its channels do not
+     * fit b. bConverged tells whether all channels reached the tolerance.
+     */
+    ImageRAW *Process(ImageRAW *b, ImageRAW *imgOut, bool bWarmStart = false);
+
+    /**
+     * @brief PrintStats prints convergence and time of the last call.
+     */
+    void PrintStats()
+    {
+        printf("WeightedLaplacianSolver: %d iterations, %f s, residual %e, %s\n",
+               iterations, time, residuals.empty() ? 0.0f : residuals.back(),
+               bConverged ? "converged" : "not converged");
+    }
+};
+
+PIC_INLINE void WeightedLaplacianSolver::Update(int width, int height, float *d,
+        float *wx, float *wy)
+{
+    levels.clear();
+    levels.push_back(Level());
+
+    Level &lev = levels[0];
+    AllocateLevel(lev, width, height);
+
+    int n = width * height;
+
+    for(int i = 0; i < n; i++) {
+        lev.d[i] = d[i];
+        lev.wx[i] = ((i % width) < (width - 1)) ? wx[i] : 0.0f;
+        lev.wy[i] = (i < (n - width)) ? wy[i] : 0.0f;
+    }
+
+    Coarsen();
+}
+
+PIC_INLINE void WeightedLaplacianSolver::Update(ImageRAW *guide, ImageRAW *d,
+        float alpha, float lambda, float epsilon)
+{
+    if(guide == NULL) {
+        return;
+    }
+
+    levels.clear();
+    levels.push_back(Level());
+
+    int width = guide->width;
+    int height = guide->height;
+    int channels = guide->channels;
+
+    Level &lev = levels[0];
+    AllocateLevel(lev, width, height);
+
+    //dist is squared; as in FilterWLS, the weight uses ||d||^alpha
+    float alphaDist = alpha * 0.5f;
+
+    ThreadPool::ExecuteRows(width, height, [&](int y0, int y1) {
+        for(int j = y0; j < y1; j++) {
+            for(int i = 0; i < width; i++) {
+                int ind = j * width + i;
+                float *g = &guide->data[ind * channels];
+
+                lev.d[ind] = (d != NULL) ? d->data[ind * d->channels] : 1.0f;
+
+                if(i < (width - 1)) {
+                    float dist = 0.0f;
+
+                    for(int k = 0; k < channels; k++) {
+                        float tmp = g[k + channels] - g[k];
+                        dist += tmp * tmp;
+                    }
+
+                    lev.wx[ind] = lambda / (powf(dist, alphaDist) + epsilon);
+                }
+
+                if(j < (height - 1)) {
+                    float dist = 0.0f;
+
+                    for(int k = 0; k < channels; k++) {
+                        float tmp = g[k + width * channels] - g[k];
+                        dist += tmp * tmp;
+                    }
+
+                    lev.wy[ind] = lambda / (powf(dist, alphaDist) + epsilon);
+                }
+            }
+        }
+    }, maxThreads);
+
+    Coarsen();
+}
+
+PIC_INLINE void WeightedLaplacianSolver::ComputeDiagonal(int l)
+{
+    Level &lev = levels[l];
+    int width = lev.width;
+
+    ThreadPool::ExecuteRows(lev.width, lev.height, [&](int y0, int y1) {
+        for(int j = y0; j < y1; j++) {
+            for(int i = 0; i < width; i++) {
+                int ind = j * width + i;
+                float sum = lev.d[ind] + lev.wx[ind] + lev.wy[ind];
+
+                if(i > 0) {
+                    sum += lev.wx[ind - 1];
+                }
+
+                if(j > 0) {
+                    sum += lev.wy[ind - width];
+                }
+
+                lev.diag[ind] = sum;
+            }
+        }
+    }, maxThreads);
+}
+
+PIC_INLINE void WeightedLaplacianSolver::Coarsen()
+{
+    ComputeDiagonal(0);
+
+    while(true) {
+        int l = int(levels.size()) - 1;
+
+        int fw = levels[l].width;
+        int fh = levels[l].height;
+
+        if((fw <= 4) || (fh <= 4)) {
+            break;
+        }
+
+        int cw = (fw + 1) / 2;
+        int ch = (fh + 1) / 2;
+
+        levels.push_back(Level());
+
+        Level &fine = levels[l];
+        Level &coarse = levels[l + 1];
+        AllocateLevel(coarse, cw, ch);
+
+        //Galerkin operator of piecewise constant prolongation: data terms
+        //are summed, edges inside a cell cancel out, and edges between
+        //two cells are summed
+        for(int j = 0; j < ch; j++) {
+            int fj0 = j * 2;
+            int fj1 = MIN(fj0 + 1, fh - 1);
+
+            for(int i = 0; i < cw; i++) {
+                int fi0 = i * 2;
+                int fi1 = MIN(fi0 + 1, fw - 1);
+                int ind = j * cw + i;
+
+                float d = 0.0f;
+
+                for(int fj = fj0; fj <= fj1; fj++) {
+                    for(int fi = fi0; fi <= fi1; fi++) {
+                        d += fine.d[fj * fw + fi];
+                    }
+                }
+
+                coarse.d[ind] = d;
+
+                if(i < (cw - 1)) {
+                    float w = 0.0f;
+
+                    for(int fj = fj0; fj <= fj1; fj++) {
+                        w += fine.wx[fj * fw + fi0 + 1];
+                    }
+
+                    coarse.wx[ind] = w;
+                }
+
+                if(j < (ch - 1)) {
+                    float w = 0.0f;
+
+                    for(int fi = fi0; fi <= fi1; fi++) {
+                        w += fine.wy[(fj0 + 1) * fw + fi];
+                    }
+
+                    coarse.wy[ind] = w;
+                }
+            }
+        }
+
+        ComputeDiagonal(l + 1);
+    }
+}
+
+PIC_INLINE void WeightedLaplacianSolver::Apply(int l, float *u, float *out)
+{
+    Level &lev = levels[l];
+    int width = lev.width;
+
+    ThreadPool::ExecuteRows(lev.width, lev.height, [&](int y0, int y1) {
+        for(int j = y0; j < y1; j++) {
+            for(int i = 0; i < width; i++) {
+                int ind = j * width + i;
+                out[ind] = lev.diag[ind] * u[ind] - Neighbors(lev, u, i, j);
+            }
+        }
+    }, maxThreads);
+}
+
+PIC_INLINE void WeightedLaplacianSolver::Smooth(int l, int steps, bool bRedFirst)
+{
+    Level &lev = levels[l];
+    int width = lev.width;
+    float *u = &lev.u[0];
+    float *f = &lev.f[0];
+
+    for(int s = 0; s < steps; s++) {
+        for(int c = 0; c < 2; c++) {
+            int color = bRedFirst ? c : (1 - c);
+
+            ThreadPool::ExecuteRows(lev.width, lev.height, [&](int y0, int y1) {
+                for(int j = y0; j < y1; j++) {
+                    for(int i = (j + color) % 2; i < width; i += 2) {
+                        int ind = j * width + i;
+
+                        if(lev.diag[ind] > 0.0f) {
+                            u[ind] = (f[ind] + Neighbors(lev, u, i, j)) / lev.diag[ind];
+                        }
+                    }
+                }
+            }, maxThreads);
+        }
+    }
+}
+
+PIC_INLINE void WeightedLaplacianSolver::Restrict(int l)
+{
+    Level &fine = levels[l];
+    Level &coarse = levels[l + 1];
+
+    int fw = fine.width;
+    int fh = fine.height;
+    int cw = coarse.width;
+
+    Apply(l, &fine.u[0], &fine.r[0]);
+
+    for(int i = 0; i < (fw * fh); i++) {
+        fine.r[i] = fine.f[i] - fine.r[i];
+    }
+
+    ThreadPool::ExecuteRows(coarse.width, coarse.height, [&](int y0, int y1) {
+        for(int j = y0; j < y1; j++) {
+            int fj1 = MIN(j * 2 + 1, fh - 1);
+
+            for(int i = 0; i < cw; i++) {
+                int fi1 = MIN(i * 2 + 1, fw - 1);
+                float sum = 0.0f;
+
+                for(int fj = j * 2; fj <= fj1; fj++) {
+                    for(int fi = i * 2; fi <= fi1; fi++) {
+                        sum += fine.r[fj * fw + fi];
+                    }
+                }
+
+                coarse.f[j * cw + i] = sum;
+            }
+        }
+    }, maxThreads);
+}
+
+PIC_INLINE void WeightedLaplacianSolver::Prolongate(int l)
+{
+    Level &fine = levels[l];
+    Level &coarse = levels[l + 1];
+
+    int fw = fine.width;
+    int cw = coarse.width;
+
+    ThreadPool::ExecuteRows(fine.width, fine.height, [&](int y0, int y1) {
+        for(int j = y0; j < y1; j++) {
+            float *e = &coarse.u[(j >> 1) * cw];
+            float *u = &fine.u[j * fw];
+
+            for(int i = 0; i < fw; i++) {
+                u[i] += e[i >> 1];
+            }
+        }
+    }, maxThreads);
+}
+
+PIC_INLINE void WeightedLaplacianSolver::VCycle(int l)
+{
+    if(l == int(levels.size() - 1)) {
+        Smooth(l, 32, true);
+        Smooth(l, 32, false);
+        return;
+    }
+
+    Smooth(l, preSteps, true);
+    Restrict(l);
+
+    Level &coarse = levels[l + 1];
+    std::fill(coarse.u.begin(), coarse.u.end(), 0.0f);
+
+    VCycle(l + 1);
+
+    Prolongate(l);
+    Smooth(l, postSteps, false);
+}
+
+PIC_INLINE double WeightedLaplacianSolver::Dot(float *a, float *b)
+{
+    Level &lev = levels[0];
+    int width = lev.width;
+
+    return ThreadPool::SumRows(lev.width, lev.height, [&](int y0, int y1) {
+        double tmp = 0.0;
+
+        for(int i = y0 * width; i < y1 * width; i++) {
+            tmp += double(a[i]) * double(b[i]);
+        }
+
+        return tmp;
+    }, maxThreads);
+}
+
+PIC_INLINE bool WeightedLaplacianSolver::SolveAux(float *b, float *x, bool bWarmStart)
+{
+    Level &lev = levels[0];
+    int n = lev.width * lev.height;
+
+    res.resize(n);
+    p.resize(n);
+    q.resize(n);
+
+    if(!bWarmStart) {
+        std::fill(x, x + n, 0.0f);
+    }
+
+    double normB = sqrt(Dot(b, b));
+
+    if(normB <= 0.0) {
+        std::fill(x, x + n, 0.0f);
+        return true;
+    }
+
+    Apply(0, x, &q[0]);
+
+    for(int i = 0; i < n; i++) {
+        res[i] = b[i] - q[i];
+    }
+
+    float rel = float(sqrt(Dot(&res[0], &res[0])) / normB);
+    residuals.push_back(rel);
+
+    if(rel < tolerance) {
+        return true;
+    }
+
+    //z = M^-1 r is stored in lev.u
+    auto precondition = [&]() {
+        std::copy(res.begin(), res.end(), lev.f.begin());
+        std::fill(lev.u.begin(), lev.u.end(), 0.0f);
+        VCycle(0);
+    };
+
+    precondition();
+    p = lev.u;
+    double rz = Dot(&res[0], &lev.u[0]);
+
+    for(int k = 0; k < maxIter; k++) {
+        Apply(0, &p[0], &q[0]);
+
+        double pq = Dot(&p[0], &q[0]);
+
+        if(pq <= 0.0) {
+            break;
+        }
+
+        float alpha = float(rz / pq);
+
+        for(int i = 0; i < n; i++) {
+            x[i] += alpha * p[i];
+            res[i] -= alpha * q[i];
+        }
+
+        rel = float(sqrt(Dot(&res[0], &res[0])) / normB);
+        residuals.push_back(rel);
+        iterations++;
+
+        if(rel < tolerance) {
+            return true;
+        }
+
+        precondition();
+        double rzNew = Dot(&res[0], &lev.u[0]);
+        float beta = float(rzNew / rz);
+        rz = rzNew;
+
+        for(int i = 0; i < n; i++) {
+            p[i] = lev.u[i] + beta * p[i];
+        }
+    }
+
+    return false;
+}
+
+PIC_INLINE bool WeightedLaplacianSolver::Solve(float *b, float *x, bool bWarmStart)
+{
+    if(levels.empty() || (b == NULL) || (x == NULL)) {
+        return false;
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+
+    residuals.clear();
+    iterations = 0;
+
+    bool bRet = SolveAux(b, x, bWarmStart);
+    bConverged = bRet;
+
+    time = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+#ifdef PIC_DEBUG
+    PrintStats();
+#endif
+
+    return bRet;
+}
+
+PIC_INLINE ImageRAW *WeightedLaplacianSolver::Process(ImageRAW *b, ImageRAW *imgOut,
+        bool bWarmStart)
+{
+    bConverged = false;
+
+    if(levels.empty() || (b == NULL)) {
+        return imgOut;
+    }
+
+    int n = levels[0].width * levels[0].height;
+
+    if((b->width * b->height) != n) {
+        return imgOut;
+    }
+
+    if((imgOut != NULL) && (((imgOut->width * imgOut->height) != n) ||
+                            (imgOut->channels < b->channels))) {
+        return imgOut;
+    }
+
+    if(imgOut == NULL) {
+        imgOut = b->AllocateSimilarOne();
+        bWarmStart = false;
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+
+    residuals.clear();
+    iterations = 0;
+    bConverged = true;
+
+    int channels = b->channels;
+    bc.resize(n);
+    xc.resize(n);
+
+    for(int ch = 0; ch < channels; ch++) {
+        for(int i = 0; i < n; i++) {
+            bc[i] = b->data[i * channels + ch];
+            xc[i] = bWarmStart ? imgOut->data[i * imgOut->channels + ch] : 0.0f;
+        }
+
+        if(!SolveAux(&bc[0], &xc[0], bWarmStart)) {
+            bConverged = false;
+        }
+
+        for(int i = 0; i < n; i++) {
+            imgOut->data[i * imgOut->channels + ch] = xc[i];
+        }
+    }
+
+    time = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+#ifdef PIC_DEBUG
+    PrintStats();
+#endif
+
+    return imgOut;
+}
+
+} // end namespace pic
+
+#endif /* PIC_ALGORITHMS_WEIGHTED_LAPLACIAN_SOLVER_HPP */
+
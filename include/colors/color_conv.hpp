@@ -25,6 +25,9 @@ See the GNU Lesser General Public License
 #ifndef PIC_COLORS_COLOR_CONV_HPP
 #define PIC_COLORS_COLOR_CONV_HPP
 
+#include "base.hpp"
+#include "util/simd.hpp"
+
 namespace pic {
 
 class ColorConv
@@ -47,6 +50,57 @@ public:
     */
     virtual void inverse(float *colIn, float *colOut) {}
 
+    /**
+     * @brief directRow converts a row of n pixels with three interleaved
+     * channels; colIn and colOut can be the same array.
+     * @param colIn
+     * @param colOut
+     * @param n
+     */
+    virtual void directRow(float *colIn, float *colOut, int n)
+    {
+        float tmp[3];
+
+        for(int i = 0; i < (n * 3); i += 3) {
+            tmp[0] = colIn[i    ];
+            tmp[1] = colIn[i + 1];
+            tmp[2] = colIn[i + 2];
+
+            direct(tmp, &colOut[i]);
+        }
+    }
+
+    /**
+     * @brief inverseRow is the inverse of directRow.
+     * @param colIn
+     * @param colOut
+     * @param n
+     */
+    virtual void inverseRow(float *colIn, float *colOut, int n)
+    {
+        float tmp[3];
+
+        for(int i = 0; i < (n * 3); i += 3) {
+            tmp[0] = colIn[i    ];
+            tmp[1] = colIn[i + 1];
+            tmp[2] = colIn[i + 2];
+
+            inverse(tmp, &colOut[i]);
+        }
+    }
+
+    /**
+     * @brief getLinear returns the matrix of a linear conversion, so
+     * consecutive linear conversions can be merged into one matrix.
+     * @param mtx is a 3x3 row-major matrix.
+     * @param bDirect
+     * @return It returns false if the conversion is not linear.
+     */
+    virtual bool getLinear(float *mtx, bool bDirect)
+    {
+        return false;
+    }
+
     static void apply(const float *mtx, float *colIn, float *colOut)
     {
         //Working copy
@@ -61,6 +115,79 @@ public:
         colOut[2] = tmp[0] * mtx[6] + tmp[1] * mtx[7] + tmp[2] * mtx[8];
     }
 
+    /**
+     * @brief applyRow applies mtx to a row of n pixels with three
+     * interleaved channels; colIn and colOut can be the same array.
+     * @param mtx
+     * @param colIn
+     * @param colOut
+     * @param n
+     */
+    static void applyRow(const float *mtx, float *colIn, float *colOut, int n)
+    {
+        int i = 0;
+
+#ifdef PIC_SIMD_X86
+        if(getSIMDLevel() != SIMD_NONE) {
+            i = applyRowSSE2(mtx, colIn, colOut, n);
+        }
+#endif
+
+        for(; i < n; i++) {
+            apply(mtx, &colIn[i * 3], &colOut[i * 3]);
+        }
+    }
+
+#ifdef PIC_SIMD_X86
+    PIC_TARGET_SSE2 static int applyRowSSE2(const float *mtx, float *colIn,
+                                            float *colOut, int n)
+    {
+        __m128 m[9];
+
+        for(int k = 0; k < 9; k++) {
+            m[k] = _mm_set1_ps(mtx[k]);
+        }
+
+        int i = 0;
+
+        for(; i <= (n - 4); i += 4) {
+            __m128 r, g, b;
+            LoadRGB4SSE2(&colIn[i * 3], r, g, b);
+
+            __m128 o0 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, m[0]), _mm_mul_ps(g, m[1])), _mm_mul_ps(b, m[2]));
+            __m128 o1 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, m[3]), _mm_mul_ps(g, m[4])), _mm_mul_ps(b, m[5]));
+            __m128 o2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, m[6]), _mm_mul_ps(g, m[7])), _mm_mul_ps(b, m[8]));
+
+            StoreRGB4SSE2(&colOut[i * 3], o0, o1, o2);
+        }
+
+        return i;
+    }
+#endif
+
+    /**
+     * @brief mul computes the matrix product C = A * B of 3x3 matrices.
+     * @param A
+     * @param B
+     * @param C can be A or B.
+     */
+    static void mul(const float *A, const float *B, float *C)
+    {
+        float tmp[9];
+
+        for(int i = 0; i < 3; i++) {
+            for(int j = 0; j < 3; j++) {
+                tmp[i * 3 + j] = A[i * 3    ] * B[j    ] +
+                                 A[i * 3 + 1] * B[j + 3] +
+                                 A[i * 3 + 2] * B[j + 6];
+            }
+        }
+
+        for(int i = 0; i < 9; i++) {
+            C[i] = tmp[i];
+        }
+    }
+
     //secure apply
     static void apply_s(const float *mtx, float *colIn, float *colOut)
     {
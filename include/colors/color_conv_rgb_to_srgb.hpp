@@ -82,6 +82,96 @@ public:
             }
         }
     }
+
+    /**
+     * @brief directRow uses an approximated pow with SSE2.
+     * @param colIn
+     * @param colOut
+     * @param n
+     */
+    void directRow(float *colIn, float *colOut, int n)
+    {
+        int i = 0;
+
+#ifdef PIC_SIMD_X86
+        if(getSIMDLevel() != SIMD_NONE) {
+            i = directRowSSE2(colIn, colOut, n);
+        }
+#endif
+
+        ColorConv::directRow(&colIn[i * 3], &colOut[i * 3], n - i);
+    }
+
+    /**
+     * @brief inverseRow uses an approximated pow with SSE2.
+     * @param colIn
+     * @param colOut
+     * @param n
+     */
+    void inverseRow(float *colIn, float *colOut, int n)
+    {
+        int i = 0;
+
+#ifdef PIC_SIMD_X86
+        if(getSIMDLevel() != SIMD_NONE) {
+            i = inverseRowSSE2(colIn, colOut, n);
+        }
+#endif
+
+        ColorConv::inverseRow(&colIn[i * 3], &colOut[i * 3], n - i);
+    }
+
+#ifdef PIC_SIMD_X86
+    PIC_TARGET_SSE2 int directRowSSE2(float *colIn, float *colOut, int n)
+    {
+        __m128 vThr = _mm_set1_ps(0.0031308f);
+        __m128 vGamma = _mm_set1_ps(gamma_inv);
+        __m128 vA = _mm_set1_ps(a);
+        __m128 vA1 = _mm_set1_ps(a_plus_1);
+        __m128 vLin = _mm_set1_ps(12.92f);
+
+        int i = 0;
+
+        for(; i <= (n - 4); i += 4) {
+            __m128 c[3];
+            LoadRGB4SSE2(&colIn[i * 3], c[0], c[1], c[2]);
+
+            for(int k = 0; k < 3; k++) {
+                __m128 hi = _mm_sub_ps(_mm_mul_ps(vA1, FastPowSSE2(c[k], vGamma)), vA);
+                c[k] = SelectSSE2(_mm_cmpgt_ps(c[k], vThr), hi, _mm_mul_ps(c[k], vLin));
+            }
+
+            StoreRGB4SSE2(&colOut[i * 3], c[0], c[1], c[2]);
+        }
+
+        return i;
+    }
+
+    PIC_TARGET_SSE2 int inverseRowSSE2(float *colIn, float *colOut, int n)
+    {
+        __m128 vThr = _mm_set1_ps(0.04045f);
+        __m128 vGamma = _mm_set1_ps(gamma);
+        __m128 vA = _mm_set1_ps(a);
+        __m128 vA1 = _mm_set1_ps(a_plus_1);
+        __m128 vLin = _mm_set1_ps(12.92f);
+
+        int i = 0;
+
+        for(; i <= (n - 4); i += 4) {
+            __m128 c[3];
+            LoadRGB4SSE2(&colIn[i * 3], c[0], c[1], c[2]);
+
+            for(int k = 0; k < 3; k++) {
+                __m128 hi = FastPowSSE2(_mm_div_ps(_mm_add_ps(c[k], vA), vA1), vGamma);
+                c[k] = SelectSSE2(_mm_cmpgt_ps(c[k], vThr), hi, _mm_div_ps(c[k], vLin));
+            }
+
+            StoreRGB4SSE2(&colOut[i * 3], c[0], c[1], c[2]);
+        }
+
+        return i;
+    }
+#endif
 };
 
 } // end namespace pic
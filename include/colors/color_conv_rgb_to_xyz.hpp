@@ -72,6 +72,45 @@ public:
     {
         apply(mtxXYZtoRGB, colIn, colOut);
     }
+
+    /**
+     * @brief directRow
+     * @param colIn
+     * @param colOut
+     * @param n
+     */
+    void directRow(float *colIn, float *colOut, int n)
+    {
+        applyRow(mtxRGBtoXYZ, colIn, colOut, n);
+    }
+
+    /**
+     * @brief inverseRow
+     * @param colIn
+     * @param colOut
+     * @param n
+     */
+    void inverseRow(float *colIn, float *colOut, int n)
+    {
+        applyRow(mtxXYZtoRGB, colIn, colOut, n);
+    }
+
+    /**
+     * @brief getLinear
+     * @param mtx
+     * @param bDirect
+     * @return
+     */
+    bool getLinear(float *mtx, bool bDirect)
+    {
+        const float *src = bDirect ? mtxRGBtoXYZ : mtxXYZtoRGB;
+
+        for(int i = 0; i < 9; i++) {
+            mtx[i] = src[i];
+        }
+
+        return true;
+    }
 };
 
 } // end namespace pic
@@ -72,6 +72,114 @@ public:
         colOut[2] = white_point[2] * f_inv(tmp - colIn[2] / 200.0f);
     }
 
+    /**
+     * @brief directRow uses an approximated cube root with SSE2.
+     * @param colIn
+     * @param colOut
+     * @param n
+     */
+    void directRow(float *colIn, float *colOut, int n)
+    {
+        int i = 0;
+
+#ifdef PIC_SIMD_X86
+        if(getSIMDLevel() != SIMD_NONE) {
+            i = directRowSSE2(colIn, colOut, n);
+        }
+#endif
+
+        ColorConv::directRow(&colIn[i * 3], &colOut[i * 3], n - i);
+    }
+
+    /**
+     * @brief inverseRow
+     * @param colIn
+     * @param colOut
+     * @param n
+     */
+    void inverseRow(float *colIn, float *colOut, int n)
+    {
+        int i = 0;
+
+#ifdef PIC_SIMD_X86
+        if(getSIMDLevel() != SIMD_NONE) {
+            i = inverseRowSSE2(colIn, colOut, n);
+        }
+#endif
+
+        ColorConv::inverseRow(&colIn[i * 3], &colOut[i * 3], n - i);
+    }
+
+#ifdef PIC_SIMD_X86
+    PIC_TARGET_SSE2 static __m128 fSSE2(__m128 t)
+    {
+        __m128 lin = _mm_add_ps(_mm_mul_ps(t, _mm_set1_ps(C_CIELAB_C1)),
+                                _mm_set1_ps(C_FOUR_OVER_TWENTY_NINE));
+
+        return SelectSSE2(_mm_cmpgt_ps(t, _mm_set1_ps(C_SIX_OVER_TWENTY_NINE_CUBIC)),
+                          FastCbrtSSE2(t), lin);
+    }
+
+    PIC_TARGET_SSE2 static __m128 f_invSSE2(__m128 t)
+    {
+        __m128 lin = _mm_mul_ps(_mm_sub_ps(t, _mm_set1_ps(C_FOUR_OVER_TWENTY_NINE)),
+                                _mm_set1_ps(C_CIELAB_C1_INV));
+
+        return SelectSSE2(_mm_cmpgt_ps(t, _mm_set1_ps(C_SIX_OVER_TWENTY_NINE)),
+                          _mm_mul_ps(_mm_mul_ps(t, t), t), lin);
+    }
+
+    PIC_TARGET_SSE2 int directRowSSE2(float *colIn, float *colOut, int n)
+    {
+        __m128 wX = _mm_set1_ps(white_point[0]);
+        __m128 wY = _mm_set1_ps(white_point[1]);
+        __m128 wZ = _mm_set1_ps(white_point[2]);
+
+        int i = 0;
+
+        for(; i <= (n - 4); i += 4) {
+            __m128 X, Y, Z;
+            LoadRGB4SSE2(&colIn[i * 3], X, Y, Z);
+
+            __m128 fX = fSSE2(_mm_div_ps(X, wX));
+            __m128 fY = fSSE2(_mm_div_ps(Y, wY));
+            __m128 fZ = fSSE2(_mm_div_ps(Z, wZ));
+
+            __m128 L = _mm_sub_ps(_mm_mul_ps(fY, _mm_set1_ps(116.0f)), _mm_set1_ps(16.0f));
+            __m128 A = _mm_mul_ps(_mm_sub_ps(fX, fY), _mm_set1_ps(500.0f));
+            __m128 B = _mm_mul_ps(_mm_sub_ps(fY, fZ), _mm_set1_ps(200.0f));
+
+            StoreRGB4SSE2(&colOut[i * 3], L, A, B);
+        }
+
+        return i;
+    }
+
+    PIC_TARGET_SSE2 int inverseRowSSE2(float *colIn, float *colOut, int n)
+    {
+        __m128 wX = _mm_set1_ps(white_point[0]);
+        __m128 wY = _mm_set1_ps(white_point[1]);
+        __m128 wZ = _mm_set1_ps(white_point[2]);
+
+        int i = 0;
+
+        for(; i <= (n - 4); i += 4) {
+            __m128 L, A, B;
+            LoadRGB4SSE2(&colIn[i * 3], L, A, B);
+
+            __m128 tmp = _mm_div_ps(_mm_add_ps(L, _mm_set1_ps(16.0f)), _mm_set1_ps(116.0f));
+
+            __m128 Y = _mm_mul_ps(wY, f_invSSE2(tmp));
+            __m128 X = _mm_mul_ps(wX, f_invSSE2(_mm_add_ps(tmp, _mm_div_ps(A, _mm_set1_ps(500.0f)))));
+            __m128 Z = _mm_mul_ps(wZ, f_invSSE2(_mm_sub_ps(tmp, _mm_div_ps(B, _mm_set1_ps(200.0f)))));
+
+            StoreRGB4SSE2(&colOut[i * 3], X, Y, Z);
+        }
+
+        return i;
+    }
+#endif
+
     static float f(float t)
     {
         if(t > C_SIX_OVER_TWENTY_NINE_CUBIC) {
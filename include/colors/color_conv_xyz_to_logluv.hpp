@@ -75,6 +75,103 @@ public:
         colOut[1] = Y;
         colOut[2] = z * norm;
     }
+
+    /**
+     * @brief directRow uses an approximated log with SSE2.
+     * @param colIn
+     * @param colOut
+     * @param n
+     */
+    void directRow(float *colIn, float *colOut, int n)
+    {
+        int i = 0;
+
+#ifdef PIC_SIMD_X86
+        if(getSIMDLevel() != SIMD_NONE) {
+            i = directRowSSE2(colIn, colOut, n);
+        }
+#endif
+
+        ColorConv::directRow(&colIn[i * 3], &colOut[i * 3], n - i);
+    }
+
+    /**
+     * @brief inverseRow uses an approximated exp with SSE2.
+     * @param colIn
+     * @param colOut
+     * @param n
+     */
+    void inverseRow(float *colIn, float *colOut, int n)
+    {
+        int i = 0;
+
+#ifdef PIC_SIMD_X86
+        if(getSIMDLevel() != SIMD_NONE) {
+            i = inverseRowSSE2(colIn, colOut, n);
+        }
+#endif
+
+        ColorConv::inverseRow(&colIn[i * 3], &colOut[i * 3], n - i);
+    }
+
+#ifdef PIC_SIMD_X86
+    PIC_TARGET_SSE2 int directRowSSE2(float *colIn, float *colOut, int n)
+    {
+        __m128 vEps = _mm_set1_ps(epsilon);
+
+        int i = 0;
+
+        for(; i <= (n - 4); i += 4) {
+            __m128 X, Y, Z;
+            LoadRGB4SSE2(&colIn[i * 3], X, Y, Z);
+
+            __m128 L = FastLogSSE2(_mm_add_ps(Y, vEps));
+
+            __m128 norm = _mm_add_ps(_mm_add_ps(X, Y), Z);
+            __m128 x = _mm_div_ps(X, norm);
+            __m128 y = _mm_div_ps(Y, norm);
+
+            __m128 norm_uv = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(y, _mm_set1_ps(12.0f)),
+                                                   _mm_mul_ps(x, _mm_set1_ps(2.0f))),
+                                        _mm_set1_ps(3.0f));
+
+            __m128 u_prime = _mm_div_ps(_mm_mul_ps(x, _mm_set1_ps(4.0f)), norm_uv);
+            __m128 v_prime = _mm_div_ps(_mm_mul_ps(y, _mm_set1_ps(9.0f)), norm_uv);
+
+            StoreRGB4SSE2(&colOut[i * 3], L, u_prime, v_prime);
+        }
+
+        return i;
+    }
+
+    PIC_TARGET_SSE2 int inverseRowSSE2(float *colIn, float *colOut, int n)
+    {
+        __m128 vEps = _mm_set1_ps(epsilon);
+        __m128 one = _mm_set1_ps(1.0f);
+
+        int i = 0;
+
+        for(; i <= (n - 4); i += 4) {
+            __m128 L, u, v;
+            LoadRGB4SSE2(&colIn[i * 3], L, u, v);
+
+            __m128 norm = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(u, _mm_set1_ps(6.0f)),
+                                                _mm_mul_ps(v, _mm_set1_ps(16.0f))),
+                                     _mm_set1_ps(12.0f));
+
+            __m128 x = _mm_div_ps(_mm_mul_ps(u, _mm_set1_ps(9.0f)), norm);
+            __m128 y = _mm_div_ps(_mm_mul_ps(v, _mm_set1_ps(4.0f)), norm);
+            __m128 z = _mm_sub_ps(_mm_sub_ps(one, x), y);
+
+            __m128 Y = _mm_max_ps(_mm_sub_ps(FastExpSSE2(L), vEps), _mm_setzero_ps());
+            __m128 normY = _mm_div_ps(Y, y);
+
+            StoreRGB4SSE2(&colOut[i * 3], _mm_mul_ps(x, normY), Y, _mm_mul_ps(z, normY));
+        }
+
+        return i;
+    }
+#endif
 };
 
 } // end namespace pic
@@ -37,7 +37,9 @@ See the GNU Lesser General Public License
 //Feature descriptors
 #include "features_matching/lucid_descriptor.hpp"
 #include "features_matching/brief_descriptor.hpp"
+#include "features_matching/poisson_descriptor.hpp"
 #include "features_matching/orb_descriptor.hpp"
+#include "features_matching/binary_feature_matcher.hpp"
 
 #include "features_matching/dense_sift.hpp"
 #include "features_matching/patch_comp.hpp"
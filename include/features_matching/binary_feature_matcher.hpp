@@ -0,0 +1,548 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+PICCANTE is free software; you can redistribute it and/or modify
+under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation; either version 3.0 of
+the License, or (at your option) any later version.
+
+PICCANTE is distributed in the hope that it will be useful, but
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU Lesser General Public License
+( http://www.gnu.org/licenses/lgpl-3.0.html ) for more details.
+
+*/
+
+#ifndef PIC_FEATURES_MATCHING_BINARY_FEATURE_MATCHER_HPP
+#define PIC_FEATURES_MATCHING_BINARY_FEATURE_MATCHER_HPP
+
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <limits.h>
+
+#include "base.hpp"
+#include "util/hamming_distance.hpp"
+#include "util/thread_pool.hpp"
+
+namespace pic {
+
+/**
+ * @brief The BINARY_DISTANCE enum: BD_BITS counts different bits (BRIEF,
+ * ORB, PoissonDescriptor), and BD_WORDS counts different words (LUCID).
+ */
+enum BINARY_DISTANCE {BD_BITS, BD_WORDS};
+
+/**
+ * @brief The FeatureMatch struct is a match between the i0-th query
+ * descriptor and the i1-th reference descriptor.
+ */
+struct FeatureMatch
+{
+    int             i0, i1;
+    unsigned int    distance;
+};
+
+/**
+ * @brief The BinaryFeatureMatcher class matches binary descriptors
+ * against a set of reference descriptors. Descriptors are packed in a
+ * contiguous array. Queries are matched by cache-blocked brute force or,
+ * after BuildIndex, by multi-index LSH. Each LSH table hashes a disjoint
+ * subset of bits (or words) of the descriptors; candidates are the
+ * descriptors sharing the bucket of the query in at least one table, and
+ * are ranked by the exact distance. Queries are processed in parallel.
+ */
+class BinaryFeatureMatcher
+{
+protected:
+    BINARY_DISTANCE             type;
+    int                         nfv, maxThreads;
+    std::vector<unsigned int>   refs;
+    std::vector<int>            ids;
+
+    //LSH
+    int                         nTables, keyLength;
+    bool                        bMultiProbe;
+    std::vector<int>            keyElements;
+    std::vector< std::vector< std::pair<unsigned int, int> > > tables;
+
+    /**
+     * @brief Distances
+     * @param q
+     * @param r
+     * @param nRefs
+     * @param out
+     */
+    void Distances(const unsigned int *q, const unsigned int *r, int nRefs,
+                   unsigned int *out)
+    {
+        if(type == BD_BITS) {
+            HammingDistances(q, r, nRefs, nfv, out);
+        } else {
+            WordDistances(q, r, nRefs, nfv, out);
+        }
+    }
+
+    /**
+     * @brief Insert inserts (j, d) in a sorted list of k neighbors; ties
+     * are broken by index.
+     * @param indices
+     * @param dists
+     * @param k
+     * @param j
+     * @param d
+     */
+    static void Insert(int *indices, unsigned int *dists, int k, int j,
+                       unsigned int d)
+    {
+        if((d > dists[k - 1]) || ((d == dists[k - 1]) && (j >= indices[k - 1]))) {
+            return;
+        }
+
+        int i = k - 1;
+
+        while((i > 0) && ((d < dists[i - 1]) ||
+                          ((d == dists[i - 1]) && (j < indices[i - 1])))) {
+            dists[i] = dists[i - 1];
+            indices[i] = indices[i - 1];
+            i--;
+        }
+
+        dists[i] = d;
+        indices[i] = j;
+    }
+
+    /**
+     * @brief getKey computes the key of desc in the table t.
+     * @param desc
+     * @param t
+     * @return
+     */
+    unsigned int getKey(const unsigned int *desc, int t)
+    {
+        const int *elements = &keyElements[t * keyLength];
+        unsigned int key = 0;
+
+        if(type == BD_BITS) {
+            for(int i = 0; i < keyLength; i++) {
+                int e = elements[i];
+                key = (key << 1) | ((desc[e >> 5] >> (e & 31)) & 1);
+            }
+        } else {
+            key = 2166136261u;
+
+            for(int i = 0; i < keyLength; i++) {
+                key = (key ^ desc[elements[i]]) * 16777619u;
+            }
+        }
+
+        return key;
+    }
+
+    /**
+     * @brief SearchBruteForce finds the k nearest neighbors of the queries
+     * in [q0, q1); references are visited in blocks which fit in cache.
+     * @param queries
+     * @param q0
+     * @param q1
+     * @param k
+     * @param indices
+     * @param dists
+     */
+    void SearchBruteForce(std::vector<unsigned int *> &queries, int q0, int q1,
+                          int k, int *indices, unsigned int *dists);
+
+    /**
+     * @brief SearchLSH finds the k nearest neighbors of a query among the
+     * candidates of the LSH tables.
+     * @param query
+     * @param k
+     * @param indices
+     * @param dists
+     * @param stamp marks visited candidates.
+     * @param stampValue
+     * @param tmp
+     * @return It returns the number of candidates.
+     */
+    int SearchLSH(unsigned int *query, int k, int *indices, unsigned int *dists,
+                  std::vector<int> &stamp, int stampValue,
+                  std::vector<int> &tmp);
+
+public:
+
+    /**
+     * @brief BinaryFeatureMatcher
+     * @param descs are the reference descriptors; NULL descriptors are
+     * skipped.
+     * @param nfv is the number of words of a descriptor; i.e.
+     * getDescriptorSize() for BRIEF and ORB, and nDesc for LUCID.
+     * @param type
+     * @param maxThreads caps the number of workers; a value <= 0 means all
+     * workers of the pool.
+     */
+    BinaryFeatureMatcher(std::vector<unsigned int *> &descs, int nfv,
+                         BINARY_DISTANCE type = BD_BITS, int maxThreads = -1);
+
+    /**
+     * @brief BuildIndex builds the multi-index LSH tables; until it is
+     * called searches are exhaustive.
+     * @param nTables is the number of tables.
+     * @param keyLength is the number of bits (or words) of a key; a value
+     * <= 0 selects it from the number of descriptors.
+     * @param bMultiProbe probes also keys at one bit from the key of the
+     * query (BD_BITS only).
+     * @param seed
+     */
+    void BuildIndex(int nTables = 6, int keyLength = -1, bool bMultiProbe = true,
+                    unsigned int seed = 1);
+
+    /**
+     * @brief ClearIndex removes the LSH tables.
+     */
+    void ClearIndex()
+    {
+        nTables = 0;
+        tables.clear();
+        keyElements.clear();
+    }
+
+    /**
+     * @brief size
+     * @return It returns the number of reference descriptors.
+     */
+    int size()
+    {
+        return int(ids.size());
+    }
+
+    /**
+     * @brief kNN finds the k nearest references of each query.
+     * @param queries
+     * @param k
+     * @param indices is filled with queries.size() * k indices of
+     * references (-1 where there is no neighbor).
+     * @param dists is filled with queries.size() * k distances.
+     */
+    void kNN(std::vector<unsigned int *> &queries, int k,
+             std::vector<int> &indices, std::vector<unsigned int> &dists);
+
+    /**
+     * @brief Match matches queries against the references.
+     * @param queries
+     * @param matches
+     * @param ratio is the threshold of the ratio test between the nearest
+     * and the second nearest distance; a value >= 1 disables it.
+     * @param bCrossCheck keeps only matches that are also nearest
+     * neighbors when references are matched against queries.
+     */
+    void Match(std::vector<unsigned int *> &queries,
+               std::vector<FeatureMatch> &matches,
+               float ratio = 0.8f, bool bCrossCheck = true);
+};
+
+PIC_INLINE BinaryFeatureMatcher::BinaryFeatureMatcher(
+        std::vector<unsigned int *> &descs, int nfv, BINARY_DISTANCE type,
+        int maxThreads)
+{
+    this->nfv = MAX(nfv, 1);
+    this->type = type;
+    this->maxThreads = maxThreads;
+
+    nTables = 0;
+    keyLength = 0;
+    bMultiProbe = false;
+
+    for(unsigned int i = 0; i < descs.size(); i++) {
+        if(descs[i] != NULL) {
+            ids.push_back(i);
+            refs.insert(refs.end(), descs[i], descs[i] + this->nfv);
+        }
+    }
+}
+
+PIC_INLINE void BinaryFeatureMatcher::BuildIndex(int nTables, int keyLength,
+        bool bMultiProbe, unsigned int seed)
+{
+    ClearIndex();
+
+    int n = size();
+
+    if((nTables < 1) || (n == 0)) {
+        return;
+    }
+
+    int nElements = (type == BD_BITS) ? (nfv * 32) : nfv;
+
+    if(keyLength <= 0) {
+        if(type == BD_BITS) {
+            //about one descriptor per bucket
+            keyLength = 1;
+
+            while((keyLength < 24) && ((1 << keyLength) < n)) {
+                keyLength++;
+            }
+
+            keyLength = MAX(keyLength, 8);
+        } else {
+            keyLength = 2;
+        }
+    }
+
+    keyLength = MIN(keyLength, nElements);
+    keyLength = (type == BD_BITS) ? MIN(keyLength, 32) : keyLength;
+
+    this->nTables = nTables;
+    this->keyLength = keyLength;
+    this->bMultiProbe = bMultiProbe && (type == BD_BITS);
+
+    //tables take disjoint elements of a random permutation, until they
+    //are exhausted
+    std::mt19937 m(seed);
+    std::vector<int> perm(nElements);
+
+    for(int i = 0; i < nElements; i++) {
+        perm[i] = i;
+    }
+
+    int used = nElements;
+    keyElements.resize(nTables * keyLength);
+
+    for(int t = 0; t < nTables; t++) {
+        if((used + keyLength) > nElements) {
+            std::shuffle(perm.begin(), perm.end(), m);
+            used = 0;
+        }
+
+        for(int i = 0; i < keyLength; i++) {
+            keyElements[t * keyLength + i] = perm[used + i];
+        }
+
+        used += keyLength;
+    }
+
+    tables.resize(nTables);
+
+    ThreadPool::Execute(nTables, [&](unsigned int t) {
+        std::vector< std::pair<unsigned int, int> > &table = tables[t];
+        table.resize(n);
+
+        for(int j = 0; j < n; j++) {
+            table[j] = std::make_pair(getKey(&refs[j * nfv], t), j);
+        }
+
+        std::sort(table.begin(), table.end());
+    }, maxThreads);
+}
+
+PIC_INLINE void BinaryFeatureMatcher::SearchBruteForce(
+        std::vector<unsigned int *> &queries, int q0, int q1, int k,
+        int *indices, unsigned int *dists)
+{
+    int n = size();
+
+    //about 16KB of references per block
+    int blockSize = MAX(16384 / (nfv * int(sizeof(unsigned int))), 16);
+    std::vector<unsigned int> tmp(blockSize);
+
+    for(int r0 = 0; r0 < n; r0 += blockSize) {
+        int nRefs = MIN(blockSize, n - r0);
+        const unsigned int *block = &refs[r0 * nfv];
+
+        for(int q = q0; q < q1; q++) {
+            if(queries[q] == NULL) {
+                continue;
+            }
+
+            Distances(queries[q], block, nRefs, &tmp[0]);
+
+            int *q_indices = &indices[q * k];
+            unsigned int *q_dists = &dists[q * k];
+
+            for(int j = 0; j < nRefs; j++) {
+                Insert(q_indices, q_dists, k, r0 + j, tmp[j]);
+            }
+        }
+    }
+}
+
+PIC_INLINE int BinaryFeatureMatcher::SearchLSH(unsigned int *query, int k,
+        int *indices, unsigned int *dists, std::vector<int> &stamp,
+        int stampValue, std::vector<int> &tmp)
+{
+    tmp.clear();
+
+    for(int t = 0; t < nTables; t++) {
+        std::vector< std::pair<unsigned int, int> > &table = tables[t];
+        unsigned int key = getKey(query, t);
+
+        int nProbes = bMultiProbe ? (keyLength + 1) : 1;
+
+        for(int p = 0; p < nProbes; p++) {
+            unsigned int probe = (p == 0) ? key : (key ^ (1u << (p - 1)));
+
+            std::vector< std::pair<unsigned int, int> >::iterator it =
+                std::lower_bound(table.begin(), table.end(),
+                                 std::make_pair(probe, INT_MIN));
+
+            for(; (it != table.end()) && (it->first == probe); it++) {
+                int j = it->second;
+
+                if(stamp[j] != stampValue) {
+                    stamp[j] = stampValue;
+                    tmp.push_back(j);
+                }
+            }
+        }
+    }
+
+    for(unsigned int i = 0; i < tmp.size(); i++) {
+        int j = tmp[i];
+        unsigned int d;
+        Distances(query, &refs[j * nfv], 1, &d);
+        Insert(indices, dists, k, j, d);
+    }
+
+    return int(tmp.size());
+}
+
+PIC_INLINE void BinaryFeatureMatcher::kNN(std::vector<unsigned int *> &queries,
+        int k, std::vector<int> &indices, std::vector<unsigned int> &dists)
+{
+    k = MAX(k, 1);
+
+    int nq = int(queries.size());
+    indices.assign(nq * k, -1);
+    dists.assign(nq * k, UINT_MAX);
+
+    if(size() == 0) {
+        return;
+    }
+
+    int blockSize = 64;
+    int nBlocks = (nq + blockSize - 1) / blockSize;
+
+    if(nTables == 0) {
+        ThreadPool::Execute(nBlocks, [&](unsigned int b) {
+            int q0 = b * blockSize;
+            int q1 = MIN(q0 + blockSize, nq);
+            SearchBruteForce(queries, q0, q1, k, &indices[0], &dists[0]);
+        }, maxThreads);
+    } else {
+        ThreadPool::Execute(nBlocks, [&](unsigned int b) {
+            int q0 = b * blockSize;
+            int q1 = MIN(q0 + blockSize, nq);
+
+            std::vector<int> stamp(size(), -1);
+            std::vector<int> tmp;
+
+            for(int q = q0; q < q1; q++) {
+                if(queries[q] == NULL) {
+                    continue;
+                }
+
+                int nc = SearchLSH(queries[q], k, &indices[q * k],
+                                   &dists[q * k], stamp, q, tmp);
+
+                //too few candidates: exhaustive search
+                if(nc < k) {
+                    for(int i = q * k; i < (q + 1) * k; i++) {
+                        indices[i] = -1;
+                        dists[i] = UINT_MAX;
+                    }
+
+                    SearchBruteForce(queries, q, q + 1, k, &indices[0],
+                                     &dists[0]);
+                }
+            }
+        }, maxThreads);
+    }
+
+    //from packed indices to indices of the input descriptors
+    for(unsigned int i = 0; i < indices.size(); i++) {
+        if(indices[i] >= 0) {
+            indices[i] = ids[indices[i]];
+        }
+    }
+}
+
+PIC_INLINE void BinaryFeatureMatcher::Match(std::vector<unsigned int *> &queries,
+        std::vector<FeatureMatch> &matches, float ratio, bool bCrossCheck)
+{
+    matches.clear();
+
+    std::vector<int> indices;
+    std::vector<unsigned int> dists;
+    kNN(queries, 2, indices, dists);
+
+    std::vector<FeatureMatch> tmp;
+
+    for(unsigned int i = 0; i < queries.size(); i++) {
+        int j = indices[i * 2];
+
+        if(j < 0) {
+            continue;
+        }
+
+        unsigned int d1 = dists[i * 2];
+        unsigned int d2 = dists[i * 2 + 1];
+
+        if((ratio < 1.0f) && (d2 != UINT_MAX)) {
+            if(float(d1) >= (ratio * float(d2))) {
+                continue;
+            }
+        }
+
+        FeatureMatch m;
+        m.i0 = i;
+        m.i1 = j;
+        m.distance = d1;
+        tmp.push_back(m);
+    }
+
+    if(!bCrossCheck || tmp.empty()) {
+        matches.swap(tmp);
+        return;
+    }
+
+    //matching back the matched references
+    std::vector<unsigned int *> back(tmp.size());
+    std::vector<int> refPos(ids.size() > 0 ? (ids.back() + 1) : 0, -1);
+
+    for(unsigned int i = 0; i < ids.size(); i++) {
+        refPos[ids[i]] = i;
+    }
+
+    for(unsigned int i = 0; i < tmp.size(); i++) {
+        back[i] = &refs[refPos[tmp[i].i1] * nfv];
+    }
+
+    BinaryFeatureMatcher reverse(queries, nfv, type, maxThreads);
+
+    if(nTables > 0) {
+        reverse.BuildIndex(nTables, keyLength, bMultiProbe);
+    }
+
+    std::vector<int> indicesBack;
+    std::vector<unsigned int> distsBack;
+    reverse.kNN(back, 1, indicesBack, distsBack);
+
+    for(unsigned int i = 0; i < tmp.size(); i++) {
+        if(indicesBack[i] == tmp[i].i0) {
+            matches.push_back(tmp[i]);
+        }
+    }
+}
+
+} // end namespace pic
+
+#endif /* PIC_FEATURES_MATCHING_BINARY_FEATURE_MATCHER_HPP */
+
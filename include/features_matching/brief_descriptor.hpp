@@ -27,6 +27,7 @@ See the GNU Lesser General Public License
 
 #include <random>
 #include "util/math.hpp"
+#include "util/hamming_distance.hpp"
 #include "image_raw.hpp"
 
 namespace pic {
@@ -84,17 +85,7 @@ protected:
      */
     static unsigned int countZeros(unsigned int x)
     {
-        unsigned int n = sizeof(unsigned int) * 8;
-
-        unsigned int ret = 0;
-
-        for(unsigned int i = 0; i < n; i++) {
-            if((x & (1 << i)) == 0) {
-                ret++;
-            }
-        }
-
-        return ret;
+        return 32 - PopCount32(x);
     }
 
     /**
@@ -233,13 +224,7 @@ public:
             return 0;
         }
 
-        unsigned int ret = 0;
-
-        for(unsigned int i = 0; i < nfv; i++) {
-            ret += countZeros(fv0[i] ^ fv1[i]);
-        }
-
-        return ret;
+        return nfv * 32 - HammingDistance(fv0, fv1, nfv);
     }
 };
 
@@ -191,7 +191,7 @@ public:
         }
 
         L = FilterLuminance::Execute(img, L, LT_CIE_LUMINANCE);
-        float maxVal = L->getMaxVal()[0];
+        float maxVal = L->getStatistics(IS_MAX).maxVal[0];
         L->Div(maxVal);
 
         grad = FilterGradient::Execute(gauss, grad);
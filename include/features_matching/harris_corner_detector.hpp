@@ -171,8 +171,9 @@ public:
             lum = FilterLuminance::Execute(img, lum, LT_CIE_LUMINANCE);
         }
 
-        float maxL = lum->getMaxVal(NULL, NULL)[0];
-        float minL = lum->getMinVal(NULL, NULL)[0];
+        ImageStatistics stats = lum->getStatistics(IS_MIN | IS_MAX);
+        float maxL = stats.maxVal[0];
+        float minL = stats.minVal[0];
 
         float delta = maxL - minL;
 
@@ -235,10 +236,8 @@ public:
         if(threshold < 0.0f) { //the best i-th points
             int bestPoints = int(-threshold);
 
-            ret->sort();
-
             int n = ret->size();
-            threshold = ret->dataTMP[n - 1 - bestPoints];
+            threshold = ImagePercentile::SelectRank(ret->data, n, n - 1 - bestPoints);
         }
 
         int width = lum->width;
@@ -27,6 +27,7 @@ See the GNU Lesser General Public License
 
 #include <random>
 #include "util/math.hpp"
+#include "util/hamming_distance.hpp"
 #include "image_raw.hpp"
 
 namespace pic {
@@ -123,13 +124,7 @@ public:
             return 0;
         }
 
-        unsigned int ret = 0;
-
-        for(unsigned int i = 0; i < nfv; i++) {
-            ret += (fv0[i] == fv1[i]) ? 1 : 0;
-        }
-
-        return ret;
+        return nfv - WordDistance(fv0, fv1, nfv);
     }
 };
 
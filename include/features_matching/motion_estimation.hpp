@@ -25,75 +25,449 @@ See the GNU Lesser General Public License
 #ifndef PIC_FEATURES_MATCHING_MOTION_ESTIMATION_HPP
 #define PIC_FEATURES_MATCHING_MOTION_ESTIMATION_HPP
 
+#include <vector>
+#include <random>
+
 #include "image_raw.hpp"
+#include "algorithms/pyramid.hpp"
+#include "util/thread_pool.hpp"
 
 #include "features_matching/patch_comp.hpp"
 
 namespace pic {
 
+/**
+ * @brief The MOTION_ESTIMATION_MODE enum:
+ * ME_EXHAUSTIVE searches all shifts of each block;
+ * ME_COARSE_TO_FINE searches the full range only at the coarsest level of
+ * a Gaussian pyramid, and refines predictions of the coarser level in a
+ * small window at the other levels;
+ * ME_PATCH_MATCH computes a dense field with PatchMatch propagation and
+ * random search.
+ */
+enum MOTION_ESTIMATION_MODE {ME_EXHAUSTIVE, ME_COARSE_TO_FINE, ME_PATCH_MATCH};
+
+/**
+ * @brief The MotionEstimation class estimates the motion from img0 to
+ * img1. The output has three channels: the horizontal and the vertical
+ * motion, refined at sub-pixel precision, and the SSD of the match.
+ */
 class MotionEstimation {
 protected:
     int         shift, blockSize, halfBlockSize;
     int         width, height;
+    int         iterations;
+    unsigned int seed;
+    MOTION_ESTIMATION_MODE mode;
+    ImageRAW    *img0, *img1;
     PatchComp   *pmc;
 
     /**
-     * @brief ProcessAux
-     * @param tiles
+     * @brief SubPixel fits a parabola to three errors at -1, 0, and +1.
+     * @param e_m
+     * @param e_0
+     * @param e_p
+     * @return It returns the offset of the minimum in [-0.5, 0.5].
+     */
+    static float SubPixel(float e_m, float e_0, float e_p)
+    {
+        float den = e_m - 2.0f * e_0 + e_p;
+
+        if(den <= 0.0f) {
+            return 0.0f;
+        }
+
+        float ret = 0.5f * (e_m - e_p) / den;
+        return CLAMPi(ret, -0.5f, 0.5f);
+    }
+
+    /**
+     * @brief Refine computes the sub-pixel motion around (dx, dy).
+     * @param pc
+     * @param x0
+     * @param y0
+     * @param dx
+     * @param dy
+     * @param err is the error at (dx, dy).
+     * @param data is the output pixel.
+     */
+    static void Refine(PatchComp *pc, int x0, int y0, int dx, int dy, float err,
+                       float *data)
+    {
+        int x1 = x0 + dx;
+        int y1 = y0 + dy;
+
+        float ex_m = pc->getSSD(x0, y0, x1 - 1, y1);
+        float ex_p = pc->getSSD(x0, y0, x1 + 1, y1);
+        float ey_m = pc->getSSD(x0, y0, x1, y1 - 1);
+        float ey_p = pc->getSSD(x0, y0, x1, y1 + 1);
+
+        data[0] = float(dx) + SubPixel(ex_m, err, ex_p);
+        data[1] = float(dy) + SubPixel(ey_m, err, ey_p);
+        data[2] = err;
+    }
+
+    /**
+     * @brief Search finds the shift with the lowest SSD for the block
+     * centered in (x0, y0) in the window of radius r around (cx, cy).
+     * Shifts are checked in raster order, and ties keep the first one.
+     * @param pc
+     * @param x0
+     * @param y0
+     * @param cx
+     * @param cy
+     * @param r
+     * @param dx
+     * @param dy
+     * @param err
+     */
+    static void Search(PatchComp *pc, int x0, int y0, int cx, int cy, int r,
+                       int &dx, int &dy, float &err)
+    {
+        for(int k = cy - r; k <= cy + r; k++) {
+            int y1 = y0 + k;
+
+            for(int l = cx - r; l <= cx + r; l++) {
+                int x1 = x0 + l;
+
+                float tmp_err = pc->getSSD(x0, y0, x1, y1);
+
+                if(tmp_err < err) {
+                    err = tmp_err;
+                    dx = l;
+                    dy = k;
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief FillBlock writes data in the block (bx, by) of imgOut.
+     * @param imgOut
+     * @param bx
+     * @param by
+     * @param data
+     */
+    void FillBlock(ImageRAW *imgOut, int bx, int by, float *data)
+    {
+        int x = bx * blockSize;
+        int y = by * blockSize;
+        int x_e = MIN((x + blockSize), imgOut->width);
+        int y_e = MIN((y + blockSize), imgOut->height);
+
+        for(int k = y; k < y_e; k++) {
+            for(int l = x; l < x_e; l++) {
+                float *tmp = (*imgOut)(l, k);
+                tmp[0] = data[0];
+                tmp[1] = data[1];
+                tmp[2] = data[2];
+            }
+        }
+    }
+
+    /**
+     * @brief ProcessExhaustive
+     * @param imgOut
+     */
+    void ProcessExhaustive(ImageRAW *imgOut)
+    {
+        int bw = (width + blockSize - 1) / blockSize;
+        int bh = (height + blockSize - 1) / blockSize;
+
+        ThreadPool::Execute(bw * bh, [&](unsigned int i) {
+            int bx = i % bw;
+            int by = i / bw;
+
+            int x0 = bx * blockSize + halfBlockSize;
+            int y0 = by * blockSize + halfBlockSize;
+
+            int dx = 0;
+            int dy = 0;
+            float err = FLT_MAX;
+            Search(pmc, x0, y0, 0, 0, shift, dx, dy, err);
+
+            float data[3];
+            Refine(pmc, x0, y0, dx, dy, err, data);
+            FillBlock(imgOut, bx, by, data);
+        });
+    }
+
+    /**
+     * @brief ProcessCoarseToFine
      * @param imgOut
      */
-    void ProcessAux(TileList *tiles, ImageRAW *imgOut) {
-        bool state = true;
+    void ProcessCoarseToFine(ImageRAW *imgOut)
+    {
+        //local search radius at fine levels
+        int r = 2;
+
+        //the number of levels: the coarsest one has a small search range
+        //and at least two blocks per side
+        int levels = 0;
+        int minSize = MIN(width, height);
+
+        while(((shift >> levels) > r) &&
+              ((minSize >> (levels + 1)) >= (blockSize * 2))) {
+            levels++;
+        }
+
+        if(levels == 0) {
+            ProcessExhaustive(imgOut);
+            return;
+        }
+
+        int limitLevel = MAX(log2(minSize) - levels, 0);
+        Pyramid p0(img0, false, limitLevel);
+        Pyramid p1(img1, false, limitLevel);
+
+        levels = MIN(levels, int(p0.stack.size()) - 1);
+
+        std::vector<int> flow, flowCoarse;
+        int bwc = 0, bhc = 0;
 
-        while(state) {
-            unsigned int currentTile = tiles->getNext();
+        for(int l = levels; l >= 0; l--) {
+            ImageRAW *l0 = p0.stack[l];
+            ImageRAW *l1 = p1.stack[l];
 
-            if(currentTile < tiles->tiles.size()) {
-                int x = tiles->tiles[currentTile].startX;
-                int y = tiles->tiles[currentTile].startY;
+            PatchComp pc(l0, l1, blockSize);
 
-                int x0 = x + halfBlockSize;
-                int y0 = y + halfBlockSize;
+            int bw = (l0->width + blockSize - 1) / blockSize;
+            int bh = (l0->height + blockSize - 1) / blockSize;
+            int shift_l = (shift + (1 << l) - 1) >> l;
 
+            flow.resize(bw * bh * 2);
 
-                int x_e = MAX((x + blockSize), imgOut->width);
-                int y_e = MAX((y + blockSize), imgOut->height);
+            ThreadPool::Execute(bw * bh, [&](unsigned int i) {
+                int bx = i % bw;
+                int by = i / bw;
+
+                int x0 = bx * blockSize + halfBlockSize;
+                int y0 = by * blockSize + halfBlockSize;
 
                 int dx = 0;
                 int dy = 0;
                 float err = FLT_MAX;
 
+                if(l == levels) {
+                    Search(&pc, x0, y0, 0, 0, shift_l, dx, dy, err);
+                } else {
+                    //predictions of the coarse blocks around (x0, y0)
+                    int cbx = MIN((x0 >> 1) / blockSize, bwc - 1);
+                    int cby = MIN((y0 >> 1) / blockSize, bhc - 1);
+
+                    int cx = 0;
+                    int cy = 0;
 
-                for(int k=-shift; k<=shift; k++) {
-                    int y1 = y0 + k;
+                    for(int j = -1; j <= 1; j++) {
+                        int ty = cby + j;
+
+                        if((ty < 0) || (ty >= bhc)) {
+                            continue;
+                        }
 
-                    for(int l=-shift; l<=shift; l++) {
-                        int x1 = x0 + l;
+                        for(int k = -1; k <= 1; k++) {
+                            int tx = cbx + k;
 
-                        float tmp_err = pmc->getSSD(x0, y0, x1, y1);
+                            if((tx < 0) || (tx >= bwc)) {
+                                continue;
+                            }
 
-                        if(tmp_err < err) {
-                            err = tmp_err;
-                            dx = l;
-                            dy = k;
+                            int *pred = &flowCoarse[(ty * bwc + tx) * 2];
+                            int px = CLAMPi(pred[0] * 2, -shift_l, shift_l);
+                            int py = CLAMPi(pred[1] * 2, -shift_l, shift_l);
+
+                            float tmp_err = pc.getSSD(x0, y0, x0 + px, y0 + py);
+
+                            if(tmp_err < err) {
+                                err = tmp_err;
+                                cx = px;
+                                cy = py;
+                            }
                         }
                     }
+
+                    dx = cx;
+                    dy = cy;
+                    Search(&pc, x0, y0, cx, cy, r, dx, dy, err);
+                }
+
+                flow[i * 2    ] = dx;
+                flow[i * 2 + 1] = dy;
+
+                if(l == 0) {
+                    float data[3];
+                    Refine(&pc, x0, y0, dx, dy, err, data);
+                    FillBlock(imgOut, bx, by, data);
+                }
+            });
+
+            flowCoarse.swap(flow);
+            bwc = bw;
+            bhc = bh;
+        }
+    }
+
+    /**
+     * @brief PropagateTile runs a PatchMatch iteration on a tile; even
+     * iterations scan in raster order and propagate from the left and the
+     * top, odd ones scan in reverse order and propagate from the right and
+     * the bottom.
+     * @param pcInv compares img1 (candidates) to img0.
+     * @param box
+     * @param it
+     * @param nnf stores (dx, dy) for each pixel.
+     * @param err
+     * @param m
+     */
+    void PropagateTile(PatchComp *pcInv, BBox &box, int it, int *nnf,
+                       float *err, std::mt19937 &m)
+    {
+        bool bForward = (it % 2) == 0;
+        int step = bForward ? 1 : -1;
+
+        int ys = bForward ? box.y0 : (box.y1 - 1);
+        int ye = bForward ? box.y1 : (box.y0 - 1);
+        int xs = bForward ? box.x0 : (box.x1 - 1);
+        int xe = bForward ? box.x1 : (box.x0 - 1);
+
+        std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+        for(int y = ys; y != ye; y += step) {
+            for(int x = xs; x != xe; x += step) {
+                int ind = y * width + x;
+
+                int xb = x + nnf[ind * 2];
+                int yb = y + nnf[ind * 2 + 1];
+                float db = err[ind];
+
+                //propagation
+                int xn = x - step;
+                int yn = y - step;
+
+                if((xn >= 0) && (xn < width)) {
+                    int *n = &nnf[(y * width + xn) * 2];
+                    int x1 = x + n[0];
+                    int y1 = y + n[1];
+
+                    if((x1 >= 0) && (x1 < width)) {
+                        pcInv->improve(x1, y1, x, y, xb, yb, db);
+                    }
+                }
+
+                if((yn >= 0) && (yn < height)) {
+                    int *n = &nnf[(yn * width + x) * 2];
+                    int x1 = x + n[0];
+                    int y1 = y + n[1];
+
+                    if((y1 >= 0) && (y1 < height)) {
+                        pcInv->improve(x1, y1, x, y, xb, yb, db);
+                    }
                 }
 
-                for(int k=y; k<y_e; k++) {
-                    for(int l=x; l<x_e; l++) {
+                //random search around the best shift
+                int cx = xb - x;
+                int cy = yb - y;
+
+                for(int radius = shift; radius >= 1; radius >>= 1) {
+                    int dx = cx + int(dist(m) * float(radius));
+                    int dy = cy + int(dist(m) * float(radius));
+
+                    dx = CLAMPi(dx, -shift, shift);
+                    dy = CLAMPi(dy, -shift, shift);
 
-                        float *data = (*imgOut)(l, k);
-                        data[0] = float(dx);
-                        data[1] = float(dy);
-                        data[2] = err;
+                    int x1 = x + dx;
+                    int y1 = y + dy;
+
+                    if((x1 >= 0) && (x1 < width) && (y1 >= 0) && (y1 < height)) {
+                        pcInv->improve(x1, y1, x, y, xb, yb, db);
                     }
                 }
 
-            } else {
-                state = false;
+                nnf[ind * 2    ] = xb - x;
+                nnf[ind * 2 + 1] = yb - y;
+                err[ind] = db;
+            }
+        }
+    }
+
+    /**
+     * @brief ProcessPatchMatch
+     * @param imgOut
+     */
+    void ProcessPatchMatch(ImageRAW *imgOut)
+    {
+        int n = width * height;
+        std::vector<int> nnf(n * 2);
+        std::vector<float> err(n);
+
+        PatchComp pcInv(img1, img0, blockSize);
+
+        //tiles are processed in a checkerboard order: propagation reads
+        //only pixels of edge-adjacent tiles, which have the other color
+        int tileSize = 64;
+        int tw = (width + tileSize - 1) / tileSize;
+        int th = (height + tileSize - 1) / tileSize;
+
+        std::vector<BBox> boxes[2];
+
+        for(int j = 0; j < th; j++) {
+            for(int i = 0; i < tw; i++) {
+                BBox box(i * tileSize, MIN((i + 1) * tileSize, width),
+                         j * tileSize, MIN((j + 1) * tileSize, height));
+                boxes[(i + j) % 2].push_back(box);
+            }
+        }
+
+        //random initialization; the zero shift is always a candidate
+        ThreadPool::Execute(th, [&](unsigned int j) {
+            std::mt19937 m(seed + j);
+            std::uniform_int_distribution<int> dist(-shift, shift);
+
+            int y0 = j * tileSize;
+            int y1 = MIN(y0 + tileSize, height);
+
+            for(int y = y0; y < y1; y++) {
+                for(int x = 0; x < width; x++) {
+                    int ind = y * width + x;
+
+                    int dx = dist(m);
+                    int dy = dist(m);
+                    dx = CLAMPi(dx, -x, width - 1 - x);
+                    dy = CLAMPi(dy, -y, height - 1 - y);
+
+                    int xb = x;
+                    int yb = y;
+                    float db = pmc->getSSD(x, y, x, y);
+
+                    pcInv.improve(x + dx, y + dy, x, y, xb, yb, db);
+
+                    nnf[ind * 2    ] = xb - x;
+                    nnf[ind * 2 + 1] = yb - y;
+                    err[ind] = db;
+                }
+            }
+        });
+
+        for(int it = 0; it < iterations; it++) {
+            for(int c = 0; c < 2; c++) {
+                std::vector<BBox> &lst = boxes[c];
+
+                ThreadPool::Execute(lst.size(), [&](unsigned int i) {
+                    std::mt19937 m(seed + (it * 2 + c) * 7919 + i);
+                    PropagateTile(&pcInv, lst[i], it, &nnf[0], &err[0], m);
+                });
             }
         }
+
+        ThreadPool::ExecuteRows(width, height, [&](int y0, int y1) {
+            for(int y = y0; y < y1; y++) {
+                for(int x = 0; x < width; x++) {
+                    int ind = y * width + x;
+                    Refine(pmc, x, y, nnf[ind * 2], nnf[ind * 2 + 1], err[ind],
+                           (*imgOut)(x, y));
+                }
+            }
+        });
     }
 
 public:
@@ -104,9 +478,16 @@ public:
      * @param img1
      * @param blockSize
      * @param maxRadius
+     * @param mode
      */
-    MotionEstimation(ImageRAW *img0, ImageRAW *img1, int blockSize, int maxRadius) {
+    MotionEstimation(ImageRAW *img0, ImageRAW *img1, int blockSize, int maxRadius,
+                     MOTION_ESTIMATION_MODE mode = ME_EXHAUSTIVE) {
         pmc = NULL;
+        this->img0 = NULL;
+        this->img1 = NULL;
+        this->mode = mode;
+        iterations = 5;
+        seed = 1;
 
         Setup(img0, img1, blockSize, maxRadius);
     }
@@ -151,34 +532,61 @@ public:
         this->width = img0->width;
         this->height = img0->height;
 
+        this->img0 = img0;
+        this->img1 = img1;
+
+        if(pmc != NULL) {
+            delete pmc;
+        }
+
         pmc = new PatchComp(img0, img1, blockSize);
     }
 
+    /**
+     * @brief SetMode
+     * @param mode
+     */
+    void SetMode(MOTION_ESTIMATION_MODE mode)
+    {
+        this->mode = mode;
+    }
+
+    /**
+     * @brief SetPatchMatchParameters
+     * @param iterations is the number of PatchMatch iterations.
+     * @param seed is the seed of the random search.
+     */
+    void SetPatchMatchParameters(int iterations, unsigned int seed)
+    {
+        this->iterations = MAX(iterations, 1);
+        this->seed = seed;
+    }
+
     /**
      * @brief Process
      * @param imgOut
      * @return
      */
     ImageRAW *Process(ImageRAW *imgOut) {
+        if(pmc == NULL) {
+            return imgOut;
+        }
+
         if(imgOut == NULL) {
             imgOut = new ImageRAW(1, width, height, 3);
         }
 
-        TileList lst(blockSize, width, height);
-
-        //Creating threads
-        int numCores = std::thread::hardware_concurrency();
+        switch(mode) {
+        case ME_COARSE_TO_FINE:
+            ProcessCoarseToFine(imgOut);
+            break;
 
-        std::thread **thrd = new std::thread*[numCores];
+        case ME_PATCH_MATCH:
+            ProcessPatchMatch(imgOut);
+            break;
 
-        for(int i = 0; i < numCores; i++) {
-            thrd[i] = new std::thread(
-                std::bind(&MotionEstimation::ProcessAux, this, &lst, imgOut));
-        }
-
-        //Threads join
-        for(int i = 0; i < numCores; i++) {
-            thrd[i]->join();
+        default:
+            ProcessExhaustive(imgOut);
         }
 
         return imgOut;
@@ -191,10 +599,12 @@ public:
      * @param blockSize
      * @param maxRadius
      * @param imgOut
+     * @param mode
      * @return
      */
-    static ImageRAW *Execute(ImageRAW *img0, ImageRAW *img1, int blockSize, int maxRadius, ImageRAW *imgOut) {
-        MotionEstimation me(img0, img1, blockSize, maxRadius);
+    static ImageRAW *Execute(ImageRAW *img0, ImageRAW *img1, int blockSize, int maxRadius, ImageRAW *imgOut,
+                             MOTION_ESTIMATION_MODE mode = ME_EXHAUSTIVE) {
+        MotionEstimation me(img0, img1, blockSize, maxRadius, mode);
 
         return me.Process(imgOut);
     }
@@ -203,3 +613,4 @@ public:
 } // end namespace pic
 
 #endif /* PIC_FEATURES_MATCHING_MOTION_ESTIMATION_HPP */
+
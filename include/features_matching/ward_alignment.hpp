@@ -28,9 +28,9 @@ See the GNU Lesser General Public License
 #include <vector>
 
 #include "image_raw.hpp"
-#include "image_samplers/image_sampler_bilinear.hpp"
-#include "filtering/filter_downsampler_2D.hpp"
 #include "filtering/filter_luminance.hpp"
+#include "util/hamming_distance.hpp"
+#include "util/thread_pool.hpp"
 
 #ifndef PIC_DISABLE_EIGEN
 #include "externals/Eigen/Dense"
@@ -38,6 +38,184 @@ See the GNU Lesser General Public License
 
 namespace pic {
 
+/**
+ * @brief MTBShiftedWord extracts 64 bits of a row of 64-bit words starting
+ * at the bit bit; bits outside the row are zero.
+ * @param row
+ * @param nWords
+ * @param bit may be negative.
+ * @return
+ */
+inline unsigned long long MTBShiftedWord(const unsigned long long *row,
+        int nWords, int bit)
+{
+    int q = (bit >= 0) ? (bit >> 6) : -((63 - bit) >> 6);
+    int s = bit - (q << 6);
+
+    unsigned long long lo = ((q >= 0) && (q < nWords)) ? row[q] : 0ULL;
+
+    if(s == 0) {
+        return lo;
+    }
+
+    unsigned long long hi = ((q >= -1) && ((q + 1) < nWords)) ? row[q + 1] : 0ULL;
+
+    return (lo >> s) | (hi << (64 - s));
+}
+
+/**
+ * @brief MTBRowErrorScalar counts the bits of (at ^ bt) & ae & be where b
+ * rows are shifted by dx bits.
+ * @param at
+ * @param ae
+ * @param bt
+ * @param be
+ * @param nWords
+ * @param dx
+ * @return
+ */
+inline int MTBRowErrorScalar(const unsigned long long *at,
+                             const unsigned long long *ae,
+                             const unsigned long long *bt,
+                             const unsigned long long *be, int nWords, int dx)
+{
+    int err = 0;
+
+    for(int w = 0; w < nWords; w++) {
+        int bit = (w << 6) + dx;
+        unsigned long long diff = at[w] ^ MTBShiftedWord(bt, nWords, bit);
+        err += PopCount64(diff & ae[w] & MTBShiftedWord(be, nWords, bit));
+    }
+
+    return err;
+}
+
+#ifdef PIC_SIMD_X86
+
+PIC_TARGET_POPCNT inline int MTBRowErrorPOPCNT(const unsigned long long *at,
+        const unsigned long long *ae, const unsigned long long *bt,
+        const unsigned long long *be, int nWords, int dx)
+{
+    int err = 0;
+
+    for(int w = 0; w < nWords; w++) {
+        int bit = (w << 6) + dx;
+        unsigned long long diff = at[w] ^ MTBShiftedWord(bt, nWords, bit);
+        diff &= ae[w] & MTBShiftedWord(be, nWords, bit);
+
+#if defined(__x86_64__) || defined(_M_X64)
+        err += int(_mm_popcnt_u64(diff));
+#else
+        err += _mm_popcnt_u32((unsigned int)(diff)) +
+               _mm_popcnt_u32((unsigned int)(diff >> 32));
+#endif
+    }
+
+    return err;
+}
+
+#endif
+
+/**
+ * @brief The MTBBitmap class is a median threshold bitmap with its
+ * exclusion bitmap, packed in 64-bit words; each row starts at a new word.
+ */
+class MTBBitmap
+{
+public:
+    int width, height, nWords;
+    std::vector<unsigned long long> tb, eb;
+
+    /**
+     * @brief MTBBitmap
+     */
+    MTBBitmap()
+    {
+        width = 0;
+        height = 0;
+        nWords = 0;
+    }
+
+    /**
+     * @brief Compute computes the bitmaps of a luminance image.
+     * @param L is a single channel image.
+     * @param percentile
+     * @param tolerance
+     */
+    void Compute(ImageRAW *L, float percentile, float tolerance)
+    {
+        width = L->width;
+        height = L->height;
+        nWords = (width + 63) >> 6;
+
+        tb.assign(size_t(nWords) * height, 0ULL);
+        eb.assign(size_t(nWords) * height, 0ULL);
+
+        float medVal = ImagePercentile::Select(L->data, width * height, percentile);
+
+        float A = medVal - tolerance;
+        float B = medVal + tolerance;
+
+        ThreadPool::ExecuteRows(width, height, [&](int y0, int y1) {
+            for(int y = y0; y < y1; y++) {
+                const float *row = &L->data[y * width];
+                unsigned long long *t = &tb[size_t(y) * nWords];
+                unsigned long long *e = &eb[size_t(y) * nWords];
+
+                for(int x = 0; x < width; x++) {
+                    unsigned long long bit = 1ULL << (x & 63);
+
+                    if(row[x] > medVal) {
+                        t[x >> 6] |= bit;
+                    }
+
+                    if(!((row[x] >= A) && (row[x] <= B))) {
+                        e[x >> 6] |= bit;
+                    }
+                }
+            }
+        });
+    }
+
+    /**
+     * @brief getError counts the pixels where the threshold bits differ
+     * and neither pixel is excluded, with b shifted as by BufferShift;
+     * i.e., pixel (x, y) is compared to pixel (x + dx, y + dy) of b, and
+     * pixels outside b do not count.
+     * @param b
+     * @param dx
+     * @param dy
+     * @return
+     */
+    int getError(MTBBitmap &b, int dx, int dy)
+    {
+        int y0 = MAX(0, -dy);
+        int y1 = MIN(height, b.height - dy);
+
+#ifdef PIC_SIMD_X86
+        bool bPOPCNT = hasPOPCNT();
+#endif
+
+        int err = 0;
+
+        for(int y = y0; y < y1; y++) {
+            size_t i = size_t(y) * nWords;
+            size_t j = size_t(y + dy) * nWords;
+
+#ifdef PIC_SIMD_X86
+            if(bPOPCNT) {
+                err += MTBRowErrorPOPCNT(&tb[i], &eb[i], &b.tb[j], &b.eb[j], nWords, dx);
+                continue;
+            }
+#endif
+
+            err += MTBRowErrorScalar(&tb[i], &eb[i], &b.tb[j], &b.eb[j], nWords, dx);
+        }
+
+        return err;
+    }
+};
+
 #ifndef PIC_DISABLE_EIGEN
 
 /**
@@ -50,7 +228,6 @@ protected:
 
 public:
     ImageRAWVec             img1_v, img2_v, luminance;
-    std::vector< bool* >    tb1_v, tb2_v, eb2_shifted_v, tb2_shifted_v;
 
     /**
      * @brief WardAlignment
@@ -73,22 +250,6 @@ public:
         for(unsigned int i=0; i<img2_v.size(); i++) {
             delete img2_v[i];
         }
-
-        for(unsigned int i=0; i<tb1_v.size(); i++) {
-            delete tb1_v[i];
-        }
-
-        for(unsigned int i=0; i<tb2_v.size(); i++) {
-            delete tb2_v[i];
-        }
-
-        for(unsigned int i=0; i<eb2_shifted_v.size(); i++) {
-            delete eb2_shifted_v[i];
-        }
-
-        for(unsigned int i=0; i<tb2_shifted_v.size(); i++) {
-            delete tb2_shifted_v[i];
-        }
     }
 
     /**
@@ -110,6 +271,38 @@ public:
         this->tolerance = tolerance;
     }
 
+    /**
+     * @brief Shrink2 halves a single channel image averaging 2x2 blocks.
+     * @param img
+     * @return
+     */
+    static ImageRAW *Shrink2(ImageRAW *img)
+    {
+        int width  = MAX(img->width  >> 1, 1);
+        int height = MAX(img->height >> 1, 1);
+
+        ImageRAW *ret = new ImageRAW(1, width, height, 1);
+
+        int w1 = img->width - 1;
+        int h1 = img->height - 1;
+
+        ThreadPool::ExecuteRows(width, height, [&](int y0, int y1) {
+            for(int y = y0; y < y1; y++) {
+                float *r0 = &img->data[MIN(y * 2,     h1) * img->width];
+                float *r1 = &img->data[MIN(y * 2 + 1, h1) * img->width];
+                float *out = &ret->data[y * width];
+
+                for(int x = 0; x < width; x++) {
+                    int x0 = MIN(x * 2,     w1);
+                    int x1 = MIN(x * 2 + 1, w1);
+                    out[x] = (r0[x0] + r0[x1] + r1[x0] + r1[x1]) * 0.25f;
+                }
+            }
+        });
+
+        return ret;
+    }
+
     /**
      * @brief MTB computes the median threshold mask
      * @param img
@@ -132,7 +325,7 @@ public:
         bool *maskThr = new bool[n * 2];
         bool *maskEb = &maskThr[n];
 
-        float medVal = L->getMedVal(percentile);
+        float medVal = ImagePercentile::Select(L->data, n, percentile);
 
         float A = medVal - tolerance;
         float B = medVal + tolerance;
@@ -193,41 +386,34 @@ public:
         cur_shift = Eigen::Vector2i(0, 0);
         ret_shift = Eigen::Vector2i(0, 0);
 
-        ImageRAW *sml_img1 = NULL;
-        ImageRAW *sml_img2 = NULL;
+        //pyramids by halving
+        ImageRAW *sml_img1 = L1;
+        ImageRAW *sml_img2 = L2;
 
-        while(shift_bits > 0) {
-            float scale = powf(2.0f, float(-shift_bits));
+        ImageRAWVec pyr1, pyr2;
 
-            sml_img1 = FilterDownSampler2D::Execute(L1, NULL, scale);
-            sml_img2 = FilterDownSampler2D::Execute(L2, NULL, scale);
+        for(int i = 0; i < shift_bits; i++) {
+            sml_img1 = Shrink2(sml_img1);
+            sml_img2 = Shrink2(sml_img2);
 
             //tracking memory
             img1_v.push_back(sml_img1);
             img2_v.push_back(sml_img2);
 
-            int width  = sml_img1->width;
-            int height = sml_img1->height;
-            int n = width * height;
-
-             //Computing the median threshold mask
-            bool *tb1 = MTB(sml_img1, NULL);
-            bool *eb1  = &tb1[n];
-
-            bool *tb2 = MTB(sml_img2, NULL);
-            bool *eb2  = &tb2[n];
+            pyr1.push_back(sml_img1);
+            pyr2.push_back(sml_img2);
+        }
 
-            //tracking memory
-            tb1_v.push_back(tb1);
-            tb2_v.push_back(tb2);
-            
-            int min_err = n;
+        while(shift_bits > 0) {
+            sml_img1 = pyr1[shift_bits - 1];
+            sml_img2 = pyr2[shift_bits - 1];
 
-            bool *tb2_shifted = new bool[n];
-            bool *eb2_shifted = new bool[n];
+            //Computing the median threshold bitmaps
+            MTBBitmap mtb1, mtb2;
+            mtb1.Compute(sml_img1, percentile, tolerance);
+            mtb2.Compute(sml_img2, percentile, tolerance);
 
-            tb2_shifted_v.push_back(tb2_shifted);
-            eb2_shifted_v.push_back(eb2_shifted);
+            int min_err = sml_img1->nPixels();
 
             for(int i = -1; i <= 1; i++) {
 
@@ -236,19 +422,7 @@ public:
                     int xs = cur_shift[0] + i;
                     int ys = cur_shift[1] + j;
 
-                    BufferShift(tb2_shifted, tb2, xs, ys, width, height, 1, 1);
-                    BufferShift(eb2_shifted, eb2, xs, ys, width, height, 1, 1);
-
-                    int err = 0;
-                    for(int k=0; k<n; k++) {
-                        bool diff_b = tb1[k] ^ tb2_shifted[k];
-                        diff_b = diff_b & eb1[k];
-                        diff_b = diff_b & eb2_shifted[k];
-
-                        if(diff_b) {
-                            err++;
-                        }
-                    }
+                    int err = mtb1.getError(mtb2, xs, ys);
 
                     if(err < min_err) {
                         ret_shift[0] = xs;
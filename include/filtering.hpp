@@ -41,6 +41,7 @@ See the GNU Lesser General Public License
 #include "filtering/filter_bilateral_2das.hpp"
 #include "filtering/filter_bilateral_2df.hpp"
 #include "filtering/filter_bilateral_2dg.hpp"
+#include "filtering/filter_bilateral_2dpl.hpp"
 #include "filtering/filter_bilateral_2ds.hpp"
 #include "filtering/filter_bilateral_2dsp.hpp"
 #include "filtering/filter_channel.hpp"
@@ -74,6 +75,7 @@ See the GNU Lesser General Public License
 #include "filtering/filter_mosaic.hpp"
 #include "filtering/filter_normal.hpp"
 #include "filtering/filter_npasses.hpp"
+#include "filtering/filter_rank.hpp"
 #include "filtering/filter_nswe.hpp"
 #include "filtering/filter_remove_nuked.hpp"
 #include "filtering/filter_sampler_1d.hpp"
@@ -28,11 +28,8 @@ See the GNU Lesser General Public License
 #include "image_raw_vec.hpp"
 #include "util/tile_list.hpp"
 #include "util/string.hpp"
-
-
-#ifndef PIC_DISABLE_THREAD
-#include <thread>
-#endif
+#include "util/thread_pool.hpp"
+#include "util/result_cache.hpp"
 
 namespace pic {
 
@@ -43,6 +40,7 @@ class Filter
 {
 protected:
     float scale;
+    int   maxThreads;
     std::vector< float > param_f;
 
     /**
@@ -72,12 +70,28 @@ public:
     {
         cachedOnly = false;
         scale = 1.0f;
+        maxThreads = -1;
     }
 
     ~Filter()
     {
     }
 
+    /**
+     * @brief SetMaxThreads caps the number of workers used by ProcessP.
+     * The cap is propagated to the sub-filters.
+     * @param maxThreads is the maximum number of workers; a value <= 0
+     * means all workers of the pool.
+     */
+    void SetMaxThreads(int maxThreads)
+    {
+        this->maxThreads = maxThreads;
+
+        for(unsigned int i = 0; i < filters.size(); i++) {
+            filters[i]->SetMaxThreads(maxThreads);
+        }
+    }
+
     /**
      * @brief ChangePass changes the pass direction.
      * @param pass
@@ -85,6 +99,36 @@ public:
      */
     virtual void ChangePass(int pass, int tPass) {}
 
+    /**
+     * @brief getKernelRadius returns the radius, in pixels, of the support
+     * of the filter on the horizontal and vertical axes. It is used for
+     * sizing the halo of tiles when passes are fused (see FilterNPasses).
+     * @return It returns -1 when the support is unknown or the filter
+     * depends on absolute coordinates.
+     */
+    virtual int getKernelRadius()
+    {
+        return -1;
+    }
+
+    /**
+     * @brief ProcessBBoxPass filters a BBox as in the pass-th pass of
+     * tPass passes without changing the state of the filter, so different
+     * passes can run concurrently. This is the case of filters with
+     * getKernelRadius() >= 0 which have a pass dependent state; these
+     * have to override this method.
+     * @param dst
+     * @param src
+     * @param box
+     * @param pass
+     * @param tPass
+     */
+    virtual void ProcessBBoxPass(ImageRAW *dst, ImageRAWVec src, BBox *box,
+                                 int pass, int tPass)
+    {
+        ProcessBBox(dst, src, box);
+    }
+
     /**
      * @brief Signature returns the signature for the filter.
      * @return
@@ -115,15 +159,31 @@ public:
      */
     std::string GetOutPutName(std::string nameIn);
 
+    /**
+     * @brief CachedProcess filters imgIn using the process-wide ResultCache.
+     * Results are indexed by the content of imgIn and by Signature(). Only
+     * filters which override Signature are cached, and their signature has
+     * to encode all the parameters which change the output; filters with
+     * random results keep the default signature, so they are just processed.
+     * @param imgIn
+     * @param imgOut
+     * @return It returns NULL if cachedOnly is true and the result is not
+     * in the cache.
+     */
+    ImageRAW *CachedProcess(ImageRAWVec imgIn, ImageRAW *imgOut);
+
     /**
      * @brief CachedProcess
      * @param imgIn
      * @param imgOut
-     * @param nameIn
+     * @param nameIn is not used anymore; results are indexed by content.
      * @return
      */
     ImageRAW *CachedProcess(ImageRAWVec imgIn, ImageRAW *imgOut,
-                            std::string nameIn);
+                            std::string nameIn)
+    {
+        return CachedProcess(imgIn, imgOut);
+    }
 
     /**
      * @brief OutputSize
@@ -159,13 +219,14 @@ public:
     virtual ImageRAW *Process(ImageRAWVec imgIn, ImageRAW *imgOut);
 
     /**
-     * @brief ProcessPAux
+     * @brief ProcessPAux filters a single tile.
      * @param imgIn
      * @param imgOut
      * @param tiles
+     * @param i is the index of the tile to process.
      */
-    virtual void	  ProcessPAux(ImageRAWVec imgIn, ImageRAW *imgOut,
-                                  TileList *tiles);
+    virtual void	  ProcessPAux(ImageRAWVec &imgIn, ImageRAW *imgOut,
+                                  TileList *tiles, unsigned int i);
 
     /**
      * @brief ProcessP
@@ -206,32 +267,35 @@ PIC_INLINE std::string Filter::GetOutPutName(std::string nameIn)
     return outputName;
 }
 
-PIC_INLINE ImageRAW *Filter::CachedProcess(ImageRAWVec imgIn, ImageRAW *imgOut,
-        std::string nameIn)
+PIC_INLINE ImageRAW *Filter::CachedProcess(ImageRAWVec imgIn, ImageRAW *imgOut)
 {
-    std::string outputName = GetOutPutName(nameIn);
+    if(imgIn.empty() || (imgIn[0] == NULL)) {
+        return NULL;
+    }
 
-    //Check if it is chaced
-    ImageRAW *imgOut2 = new ImageRAW(outputName);
+    std::string signature = Signature();
 
-    printf("%s\n", outputName.c_str());
+    //the default signature does not tell filters apart
+    if(signature.compare("FLT") == 0) {
+        return cachedOnly ? NULL : ProcessP(imgIn, imgOut);
+    }
 
-    if(imgOut2->data == NULL) {
-        if(!cachedOnly) {
-            imgOut = ProcessP(imgIn, imgOut);
-            imgOut->Write(outputName);
-            return imgOut;
-        } else {
-            return NULL;
-        }
-    } else {
-        if(imgOut != NULL) {
-            imgOut->Assign(imgOut2);
-            return imgOut;
-        } else {
-            return imgOut2;
-        }
+    ResultCache *cache = ResultCache::getInstance();
+    unsigned long long key = ResultCache::Key(imgIn, signature);
+    std::string tag = ResultCache::Tag(imgIn, signature);
+
+    if(cache->Get(key, tag, imgOut)) {
+        return imgOut;
     }
+
+    if(cachedOnly) {
+        return NULL;
+    }
+
+    imgOut = ProcessP(imgIn, imgOut);
+    cache->Put(key, tag, imgOut);
+
+    return imgOut;
 }
 
 /**Process: filters the imgIn and stores it in imgOut*/
@@ -250,25 +314,15 @@ PIC_INLINE ImageRAW *Filter::Process(ImageRAWVec imgIn, ImageRAW *imgOut)
     return imgOut;
 }
 
-/**ProcessPAux: filters the imgIn and stores it in imgOut*/
-PIC_INLINE void Filter::ProcessPAux(ImageRAWVec imgIn, ImageRAW *imgOut,
-                                    TileList *tiles)
+/**ProcessPAux: filters the i-th tile of imgIn and stores it in imgOut*/
+PIC_INLINE void Filter::ProcessPAux(ImageRAWVec &imgIn, ImageRAW *imgOut,
+                                    TileList *tiles, unsigned int i)
 {
-    bool state = true;
     BBox box;
-
-    while(state) {
-        unsigned int currentTile = tiles->getNext();
-
-        if(currentTile < tiles->tiles.size()) {
-            tiles->genBBox(currentTile, &box);
-            box.z0 = 0;
-            box.z1 = imgOut->frames;
-            ProcessBBox(imgOut, imgIn, &box);
-        } else {
-            state = false;
-        }
-    }
+    tiles->genBBox(i, &box);
+    box.z0 = 0;
+    box.z1 = imgOut->frames;
+    ProcessBBox(imgOut, imgIn, &box);
 }
 
 /**This function filters  imgIn and stores it in imgOut using multi-threading*/
@@ -283,27 +337,17 @@ PIC_INLINE ImageRAW *Filter::ProcessP(ImageRAWVec imgIn, ImageRAW *imgOut)
 
     if((imgOut->width < TILE_SIZE) &&
        (imgOut->height < TILE_SIZE)) {
-        BBox box(imgOut->width, imgOut->height);
+        BBox box(imgOut->width, imgOut->height, imgOut->frames);
 
         ProcessBBox(imgOut, imgIn, &box);
         return imgOut;
     }
 
-    //Creating threads
-    int numCores = std::thread::hardware_concurrency();
-
-    std::thread **thrd = new std::thread*[numCores];
     TileList lst(TILE_SIZE, imgOut->width, imgOut->height);
 
-    for(int i = 0; i < numCores; i++) {
-        thrd[i] = new std::thread(
-            std::bind(&Filter::ProcessPAux, this, imgIn, imgOut, &lst));
-    }
-
-    //Threads join
-    for(int i = 0; i < numCores; i++) {
-        thrd[i]->join();
-    }
+    ThreadPool::Execute(lst.tiles.size(), [&](unsigned int i) {
+        ProcessPAux(imgIn, imgOut, &lst, i);
+    }, maxThreads);
 
     return imgOut;
 #else
@@ -314,7 +358,7 @@ PIC_INLINE ImageRAW *Filter::ProcessP(ImageRAWVec imgIn, ImageRAW *imgOut)
 PIC_INLINE std::string GenBilString(std::string type, float sigma_s,
                                     float sigma_r)
 {
-    std::string ret = type + "_Ss_"+NumberToString(sigma_s)+"_Sr_"+NumberToString(sigma_r);
+    std::string ret = type + "_Ss_"+FloatToStringExact(sigma_s)+"_Sr_"+FloatToStringExact(sigma_r);
     return ret;
 }
 
@@ -25,12 +25,126 @@ See the GNU Lesser General Public License
 #ifndef PIC_FILTERING_FILTER_ASSEMBLE_HDR_HPP
 #define PIC_FILTERING_FILTER_ASSEMBLE_HDR_HPP
 
+#include <vector>
+
 #include "filtering/filter.hpp"
+#include "util/simd.hpp"
 
 #include "algorithms/camera_response_function.hpp"
 
 namespace pic {
 
+/**
+ * @brief AssembleHDRAccumulateScalar accumulates a row of a quantized
+ * exposure into acc and accW using tables; i.e., for each element e
+ * with level q: acc[e] += weightLin[q + offset[e]] * scale and
+ * accW[e] += weight[q].
+ * @param x is the row of the exposure.
+ * @param offset is the offset of the table of each element.
+ * @param i0
+ * @param n is the number of elements of the row.
+ * @param weight is the weight table.
+ * @param weightLin is the weight times linearized value table.
+ * @param maxLevel is the maximum level of the input; e.g., 255 for 8-bit.
+ * @param scale is the reciprocal of the exposure time.
+ * @param acc
+ * @param accW
+ */
+inline void AssembleHDRAccumulateScalar(const float *x, const int *offset,
+                                        int i0, int n, const float *weight,
+                                        const float *weightLin, float maxLevel,
+                                        float scale, float *acc, float *accW)
+{
+    for(int e = i0; e < n; e++) {
+        float t = x[e] * maxLevel + 0.5f;
+
+        if(!(t >= 0.0f)) {
+            t = 0.0f;
+        }
+
+        if(t > maxLevel) {
+            t = maxLevel;
+        }
+
+        int q = int(t);
+
+        acc[e]  += weightLin[q + offset[e]] * scale;
+        accW[e] += weight[q];
+    }
+}
+
+#ifdef PIC_SIMD_X86
+
+PIC_TARGET_AVX2 inline void AssembleHDRAccumulateAVX2(const float *x,
+        const int *offset, int n, const float *weight, const float *weightLin,
+        float maxLevel, float scale, float *acc, float *accW)
+{
+    __m256 vMax   = _mm256_set1_ps(maxLevel);
+    __m256 vHalf  = _mm256_set1_ps(0.5f);
+    __m256 vZero  = _mm256_setzero_ps();
+    __m256 vScale = _mm256_set1_ps(scale);
+
+    int e = 0;
+
+    for(; e <= (n - 8); e += 8) {
+        __m256 t = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(x + e), vMax), vHalf);
+
+        //NaNs go to zero as in the scalar code
+        t = _mm256_min_ps(_mm256_max_ps(t, vZero), vMax);
+
+        __m256i q  = _mm256_cvttps_epi32(t);
+        __m256i qo = _mm256_add_epi32(q, _mm256_loadu_si256((const __m256i *) (offset + e)));
+
+        __m256 wl = _mm256_i32gather_ps(weightLin, qo, 4);
+        __m256 w  = _mm256_i32gather_ps(weight, q, 4);
+
+        _mm256_storeu_ps(acc  + e, _mm256_add_ps(_mm256_loadu_ps(acc  + e), _mm256_mul_ps(wl, vScale)));
+        _mm256_storeu_ps(accW + e, _mm256_add_ps(_mm256_loadu_ps(accW + e), w));
+    }
+
+    AssembleHDRAccumulateScalar(x, offset, e, n, weight, weightLin, maxLevel,
+                                scale, acc, accW);
+}
+
+#endif
+
+/**
+ * @brief AssembleHDRAccumulate is AssembleHDRAccumulateScalar using the
+ * widest available instruction set; all code paths give the same results.
+ * @param x
+ * @param offset
+ * @param n
+ * @param weight
+ * @param weightLin
+ * @param maxLevel
+ * @param scale
+ * @param acc
+ * @param accW
+ */
+inline void AssembleHDRAccumulate(const float *x, const int *offset, int n,
+                                  const float *weight, const float *weightLin,
+                                  float maxLevel, float scale, float *acc,
+                                  float *accW)
+{
+#ifdef PIC_SIMD_X86
+    if(getSIMDLevel() == SIMD_AVX2) {
+        AssembleHDRAccumulateAVX2(x, offset, n, weight, weightLin, maxLevel,
+                                  scale, acc, accW);
+        return;
+    }
+#endif
+
+    AssembleHDRAccumulateScalar(x, offset, 0, n, weight, weightLin, maxLevel,
+                                scale, acc, accW);
+}
+
+/**
+ * @brief The FilterAssembleHDR class merges a stack of exposures into an
+ * HDR image. When the bit depth of the inputs is known, weights and
+ * linearization are read from tables built once per channel, and
+ * exposure times are applied as a scale per image. Exposures can also be
+ * streamed in one at a time with Add and Merge.
+ */
 class FilterAssembleHDR: public Filter
 {
 protected:
@@ -38,76 +152,317 @@ protected:
     IMG_LIN                 linearization_type;
     std::vector<float *>    *icrf;
 
-    /**ProcessBBox: assembling an HDR image*/
-    void ProcessBBox(ImageRAW *dst, ImageRAWVec src, BBox *box)
+    //tables
+    int                     bits, lutBits, lutChannels;
+    float                   maxLevel;
+    std::vector<float>      lutWeight, lutWeightLin;
+    std::vector<int>        lutOffset;
+
+    //streaming
+    std::vector<float>      streamAcc, streamWeight;
+    int                     streamWidth, streamHeight, streamChannels;
+
+    /**
+     * @brief isICRF
+     * @return It returns true if an inverse CRF is used.
+     */
+    bool isICRF()
     {
-        int width = dst->width;
-        int channels = dst->channels;
+        return (linearization_type == LIN_ICFR) && (icrf != NULL);
+    }
 
-        unsigned int n = src.size();
+    /**
+     * @brief Update builds the tables for images with channels channels
+     * and rows of up to width pixels.
+     * @param width
+     * @param channels
+     */
+    void Update(int width, int channels)
+    {
+        if(bits <= 0) {
+            return;
+        }
 
-        for(int j = box->y0; j < box->y1; j++) {
-            int ind = j * width;
+        bool bICRF = isICRF();
+        int levels = 1 << bits;
+        int nTables = bICRF ? channels : 1;
 
-            for(int i = box->x0; i < box->x1; i++) {
+        if((lutBits != bits) || (lutChannels != channels)) {
+            lutBits = bits;
+            lutChannels = channels;
+            maxLevel = float(levels - 1);
 
-                //Assembling kernel
-                int c = (ind + i) * channels;
+            lutWeight.resize(levels);
+            lutWeightLin.resize(nTables * levels);
 
-                bool flag = false;
+            //LIN_ICFR without an inverse CRF is linear
+            IMG_LIN type = linearization_type;
 
-                float maxVal = -1.0f;
+            if((type == LIN_ICFR) && !bICRF) {
+                type = LIN_LIN;
+            }
 
-                for(int k = 0; k < channels; k++) {
-                    float weight_norm = 0.0f;
-                    float acc = 0.0f;
+            for(int i = 0; i < levels; i++) {
+                float x = float(i) / maxLevel;
+                float w = WeightFunction(x, weight_type);
 
-                    for(unsigned int l = 0; l < n; l++) {
-                        float x = src[l]->data[c + k];
+                lutWeight[i] = w;
 
-                        float weight = WeightFunction(x, weight_type);
+                for(int k = 0; k < nTables; k++) {
+                    float x_lin = Linearize(x, type, bICRF ? icrf->at(k) : NULL);
+                    lutWeightLin[k * levels + i] = w * x_lin;
+                }
+            }
 
-                        float x_lin;
-                        if((icrf != NULL) || (linearization_type != LIN_ICFR)) {
-                            x_lin = Linearize(x, linearization_type, icrf->at(k));
-                        } else {
-                            x_lin = x;
-                        }
+            lutOffset.clear();
+        }
 
-                        acc += (weight * x_lin) / src[l]->exposure;
+        int n = width * channels;
 
-                        weight_norm += weight;
-                    }
+        if(int(lutOffset.size()) < n) {
+            lutOffset.resize(n);
 
-                    flag = flag || (weight_norm <= 0.0f);
+            for(int e = 0; e < n; e++) {
+                lutOffset[e] = bICRF ? (e % channels) * levels : 0;
+            }
+        }
+    }
 
-                    float final_value = weight_norm > 0.0f ? (acc / weight_norm) : -1.0f;
-                    dst->data[c + k] = final_value;
+    /**
+     * @brief AccumulateRow adds a row of an exposure to acc and accW.
+     * @param x
+     * @param n is the number of elements of the row.
+     * @param channels
+     * @param scale is the reciprocal of the exposure time.
+     * @param acc
+     * @param accW
+     */
+    void AccumulateRow(const float *x, int n, int channels, float scale,
+                       float *acc, float *accW)
+    {
+        if(bits > 0) {
+            AssembleHDRAccumulate(x, &lutOffset[0], n, &lutWeight[0],
+                                  &lutWeightLin[0], maxLevel, scale, acc, accW);
+            return;
+        }
 
-                    maxVal = final_value > maxVal ? final_value : maxVal;
-                }
+        bool bICRF = isICRF();
+        IMG_LIN type = (linearization_type == LIN_ICFR) ? LIN_LIN : linearization_type;
 
-                //we had a saturated pixel...
-                for(int k = 0; k < channels; k++) {
-                    if(dst->data[c + k] < 0.0f) {
-                        dst->data[c + k] = maxVal;
-                    }
+        for(int e = 0; e < n; e++) {
+            float weight = WeightFunction(x[e], weight_type);
+            float x_lin = bICRF ? Linearize(x[e], LIN_ICFR, icrf->at(e % channels)) :
+                                  Linearize(x[e], type);
+
+            acc[e]  += weight * x_lin * scale;
+            accW[e] += weight;
+        }
+    }
+
+    /**
+     * @brief NormalizeRow divides acc by accW; pixels with a channel
+     * without weight (i.e., saturated) are set to the maximum channel.
+     * @param acc
+     * @param accW
+     * @param nPixels
+     * @param channels
+     * @param out
+     */
+    static void NormalizeRow(const float *acc, const float *accW, int nPixels,
+                             int channels, float *out)
+    {
+        for(int i = 0; i < nPixels; i++) {
+            int c = i * channels;
+            float maxVal = -1.0f;
+
+            for(int k = 0; k < channels; k++) {
+                float final_value = accW[c + k] > 0.0f ? (acc[c + k] / accW[c + k]) : -1.0f;
+                out[c + k] = final_value;
+                maxVal = final_value > maxVal ? final_value : maxVal;
+            }
+
+            //we had a saturated pixel...
+            for(int k = 0; k < channels; k++) {
+                if(out[c + k] < 0.0f) {
+                    out[c + k] = maxVal;
                 }
             }
         }
     }
 
+    /**
+     * @brief SetupAux builds the tables before processing.
+     * @param imgIn
+     * @param imgOut
+     * @return
+     */
+    ImageRAW *SetupAux(ImageRAWVec imgIn, ImageRAW *imgOut)
+    {
+        Update(imgIn[0]->width, imgIn[0]->channels);
+        return Filter::SetupAux(imgIn, imgOut);
+    }
+
+    /**ProcessBBox: assembling an HDR image*/
+    void ProcessBBox(ImageRAW *dst, ImageRAWVec src, BBox *box)
+    {
+        int width = dst->width;
+        int channels = dst->channels;
+
+        unsigned int n = src.size();
+
+        int nPixels = box->x1 - box->x0;
+        int nElements = nPixels * channels;
+
+        if(nElements <= 0) {
+            return;
+        }
+
+        std::vector<float> acc(nElements), accW(nElements);
+
+        for(int j = box->y0; j < box->y1; j++) {
+            int c = (j * width + box->x0) * channels;
+
+            std::fill(acc.begin(), acc.end(), 0.0f);
+            std::fill(accW.begin(), accW.end(), 0.0f);
+
+            for(unsigned int l = 0; l < n; l++) {
+                AccumulateRow(&src[l]->data[c], nElements, channels,
+                              1.0f / src[l]->exposure, &acc[0], &accW[0]);
+            }
+
+            NormalizeRow(&acc[0], &accW[0], nPixels, channels, &dst->data[c]);
+        }
+    }
+
 public:
-    //Basic constructors
-    FilterAssembleHDR(CRF_WEIGHT weight_type = CRF_GAUSS, IMG_LIN linearization_type = LIN_LIN, std::vector<float *> *icrf = NULL)
+    /**
+     * @brief FilterAssembleHDR
+     * @param weight_type
+     * @param linearization_type
+     * @param icrf is the inverse CRF of each channel with 256 entries; it
+     * is used only with LIN_ICFR.
+     * @param bits is the bit depth of the inputs, e.g. 8, 10, 12, or 16;
+     * inputs in [0, 1] are quantized to 2^bits levels and tables are used.
+     * A value <= 0 means unquantized inputs; weights and linearization are
+     * computed for each value.
+     */
+    FilterAssembleHDR(CRF_WEIGHT weight_type = CRF_GAUSS, IMG_LIN linearization_type = LIN_LIN, std::vector<float *> *icrf = NULL, int bits = 0)
     {
         this->weight_type = weight_type;
 
         this->linearization_type = linearization_type;
         this->icrf = icrf;
+
+        this->bits = MIN(bits, 16);
+        lutBits = -1;
+        lutChannels = -1;
+        maxLevel = 0.0f;
+
+        streamWidth = 0;
+        streamHeight = 0;
+        streamChannels = 0;
+    }
+
+    /**
+     * @brief Add accumulates an exposure of the stack, with exposure time
+     * img->exposure; the image can be released after the call. So stacks
+     * can be merged while reading exposures one at a time from disk.
+     * @param img
+     * @return It returns false if img does not match the previous exposures.
+     */
+    bool Add(ImageRAW *img)
+    {
+        if(img == NULL) {
+            return false;
+        }
+
+        if(!img->isValid()) {
+            return false;
+        }
+
+        if(streamAcc.empty()) {
+            streamWidth = img->width;
+            streamHeight = img->height;
+            streamChannels = img->channels;
+
+            int size = streamWidth * streamHeight * streamChannels;
+            streamAcc.assign(size, 0.0f);
+            streamWeight.assign(size, 0.0f);
+        } else {
+            if((img->width != streamWidth) || (img->height != streamHeight) ||
+               (img->channels != streamChannels)) {
+                return false;
+            }
+        }
+
+        Update(streamWidth, streamChannels);
+
+        int n = streamWidth * streamChannels;
+        float scale = 1.0f / img->exposure;
+
+        ThreadPool::ExecuteRows(streamWidth, streamHeight, [&](int y0, int y1) {
+            for(int j = y0; j < y1; j++) {
+                int c = j * n;
+                AccumulateRow(&img->data[c], n, streamChannels, scale,
+                              &streamAcc[c], &streamWeight[c]);
+            }
+        }, maxThreads);
+
+        return true;
     }
 
-    //Assemble an HDR image from RAW images
+    /**
+     * @brief Merge computes the HDR image from the exposures added with
+     * Add, and resets the stream.
+     * @param imgOut
+     * @return It returns NULL if no exposures were added.
+     */
+    ImageRAW *Merge(ImageRAW *imgOut = NULL)
+    {
+        if(streamAcc.empty()) {
+            return NULL;
+        }
+
+        if(imgOut == NULL) {
+            imgOut = new ImageRAW(1, streamWidth, streamHeight, streamChannels);
+        } else {
+            if((imgOut->width != streamWidth) || (imgOut->height != streamHeight) ||
+               (imgOut->channels != streamChannels)) {
+                imgOut = new ImageRAW(1, streamWidth, streamHeight, streamChannels);
+            }
+        }
+
+        int n = streamWidth * streamChannels;
+
+        ThreadPool::ExecuteRows(streamWidth, streamHeight, [&](int y0, int y1) {
+            for(int j = y0; j < y1; j++) {
+                int c = j * n;
+                NormalizeRow(&streamAcc[c], &streamWeight[c], streamWidth,
+                             streamChannels, &imgOut->data[c]);
+            }
+        }, maxThreads);
+
+        Reset();
+
+        return imgOut;
+    }
+
+    /**
+     * @brief Reset discards the exposures added with Add.
+     */
+    void Reset()
+    {
+        std::vector<float>().swap(streamAcc);
+        std::vector<float>().swap(streamWeight);
+    }
+
+    /**
+     * @brief FromRAWs assembles an HDR image from 16-bit RAW images; these
+     * are read and merged one at a time.
+     * @param nameFileIn is a text file with the size of the images,
+     * followed by pairs of exposure time and RAW file name.
+     * @param nameFileOut
+     */
     static void FromRAWs(std::string nameFileIn, std::string nameFileOut)
     {
         FILE *file = fopen(nameFileIn.c_str(), "r");
@@ -126,30 +481,29 @@ public:
         fscanf(file, "%s", tmp);
         fscanf(file, "%d", &bits);
 
-        ImageRAWVec stack;
-        int i = 0;
+        //RAW_U16_RGGB values are normalized by 2^16 - 1
+        FilterAssembleHDR fAHDR(CRF_GAUSS, LIN_LIN, NULL, 16);
 
-        while(!feof(file)) {
-            char name[1024];
-            float exposure;
-            fscanf(file, "%f", &exposure);
-            fscanf(file, "%s", name);
+        char name[1024];
+        float exposure;
 
+        while(fscanf(file, "%f %1023s", &exposure, name) == 2) {
             printf("Processing image: %s\n", name);
 
-            ImageRAW *img = new ImageRAW();
-
-            img->ReadRAW(name, "NULL", RAW_U16_RGGB, width, height);
-            img->exposure = exposure;
-            stack.push_back(img);
-            i++;
+            ImageRAW img;
+            img.ReadRAW(name, "", RAW_U16_RGGB, width, height);
+            img.exposure = exposure;
+            fAHDR.Add(&img);
         }
 
         fclose(file);
 
-        FilterAssembleHDR fAHDR;
-        ImageRAW *imgOut = fAHDR.ProcessP(stack, NULL);
-        imgOut->Write(nameFileOut);
+        ImageRAW *imgOut = fAHDR.Merge();
+
+        if(imgOut != NULL) {
+            imgOut->Write(nameFileOut);
+            delete imgOut;
+        }
     }
 };
 
@@ -48,7 +48,9 @@ public:
 
     std::string Signature()
     {
-        return GenBilString("1D", sigma_s, sigma_r);
+        return GenBilString("1D", sigma_s, sigma_r) + "_D_" +
+               NumberToString(dirs[0]) + NumberToString(dirs[1]) +
+               NumberToString(dirs[2]);
     }
 
     //Change data for this pass
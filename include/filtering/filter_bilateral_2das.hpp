@@ -57,16 +57,21 @@ public:
 
     ~FilterBilateral2DAS();
 
+    /**
+     * @brief Signature returns the default signature, since samples are
+     * drawn at random; so results are not cached.
+     * @return
+     */
     std::string Signature()
     {
-        return GenBilString("AS", sigma_s, sigma_r);
+        return "FLT";
     }
 
     static ImageRAW *Execute(ImageRAW *imgIn, ImageRAW *imgOut, float sigma_s, float sigma_r)
     {
         FilterSamplingMap fsm(sigma_s);
         ImageRAW *samplingMap = fsm.ProcessP(Single(imgIn), NULL);
-        samplingMap->Div(samplingMap->getMaxVal(NULL, NULL)[0]);
+        samplingMap->Div(samplingMap->getStatistics(IS_MAX).maxVal[0]);
 
         FilterBilateral2DAS fltBil2DAS(ST_DARTTHROWING, sigma_s, sigma_r, 1);
         imgOut = fltBil2DAS.Process(Double(imgIn, samplingMap), imgOut);
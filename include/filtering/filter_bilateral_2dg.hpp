@@ -25,7 +25,7 @@ See the GNU Lesser General Public License
 #ifndef PIC_FILTERING_FILTER_BILATERAL_2DG_HPP
 #define PIC_FILTERING_FILTER_BILATERAL_2DG_HPP
 
-//#define BILATERAL_GRID_MULTI_PASS
+#include <vector>
 
 #include "filtering/filter.hpp"
 #include "filtering/filter_gaussian_3d.hpp"
@@ -34,7 +34,10 @@ See the GNU Lesser General Public License
 namespace pic {
 
 /**
- * @brief The FilterBilateral2DG class
+ * @brief The FilterBilateral2DG class is the bilateral grid; the range is
+ * the mean of the edge channels. Splatting, blurring, and slicing run in
+ * parallel with ProcessP, and grids are reused by calls with the same grid
+ * size. See FilterBilateral2DPL for a guide with full color distances.
  */
 class FilterBilateral2DG: public Filter
 {
@@ -47,6 +50,18 @@ protected:
     ImageRAW	            *grid, *gridBlur;
     bool		            parallel;
 
+    //first image row of each grid row
+    std::vector<int>        gridRows;
+
+    /**
+     * @brief getMaxThreads returns the number of workers of the current call.
+     * @return
+     */
+    int getMaxThreads()
+    {
+        return parallel ? maxThreads : 1;
+    }
+
 public:
     float s_S, s_R, mul_E;
 
@@ -56,22 +71,22 @@ public:
     }
 
     /**
-     * @brief Splat splats values into the grid.
+     * @brief Splat splats values into the grid. Grid rows are split among
+     * workers, so there are no concurrent writes to a grid cell.
      * @param base
      * @param edge
-     * @param channel
+     * @param maxE is the maximum range value of edge.
      * @return
      */
-    ImageRAW *Splat(ImageRAW *base, ImageRAW *edge, int channel);
+    ImageRAW *Splat(ImageRAW *base, ImageRAW *edge, float maxE);
 
     /**
      * @brief Slice slices the grid into the output image
      * @param out
      * @param base
      * @param edge
-     * @param channels
      */
-    void Slice(ImageRAW *out, ImageRAW *base, ImageRAW *edge, int channels);
+    void Slice(ImageRAW *out, ImageRAW *base, ImageRAW *edge);
 
     /**
      * @brief FilterBilateral2DG
@@ -82,6 +97,14 @@ public:
 
     ~FilterBilateral2DG();
 
+    /**
+     * @brief Update sets the sigmas; grids are kept if their size does not
+     * change, e.g. for the frames of a video.
+     * @param sigma_s
+     * @param sigma_r
+     */
+    void Update(float sigma_s, float sigma_r);
+
     //Processing
     ImageRAW *Process(ImageRAWVec imgIn, ImageRAW *imgOut);
 
@@ -164,12 +187,21 @@ FilterBilateral2DG::FilterBilateral2DG(float sigma_s, float sigma_r)
 
     parallel = false;
 
+    width = height = range = 0;
+    s_S = s_R = mul_E = 1.0f;
+
     grid = NULL;
     gridBlur = NULL;
 
     fltG = new FilterGaussian3D(1.0f);
 }
 
+void FilterBilateral2DG::Update(float sigma_s, float sigma_r)
+{
+    this->sigma_s = sigma_s;
+    this->sigma_r = sigma_r;
+}
+
 FilterBilateral2DG::~FilterBilateral2DG()
 {
     if(grid != NULL) {
@@ -185,136 +217,128 @@ FilterBilateral2DG::~FilterBilateral2DG()
     }
 }
 
-ImageRAW *FilterBilateral2DG::Splat(ImageRAW *base, ImageRAW *edge, int channels)
+ImageRAW *FilterBilateral2DG::Splat(ImageRAW *base, ImageRAW *edge, float maxE)
 {
-    if(grid == NULL) {
-        #ifdef PIC_DEBUG
-            printf("S Rate: %f R Rate: %f Mul E: %f\n", s_S, s_R, mul_E);
-        #endif
+    width =  int(ceilf(float(base->width) * s_S));
+    height = int(ceilf(float(base->height) * s_S));
+    range =  int(ceilf(maxE * mul_E));
 
-        width =  int(ceilf(float(base->width) * s_S));
-        height = int(ceilf(float(base->height) * s_S));
-        range =  int(ceilf(s_R));
+    if(range < 1) {
+        range = 1;
+    }
+
+    int channels = base->channels;
+
+    //grids are reused when they have the same size
+    if((grid == NULL) || (grid->width != (width + 1)) ||
+       (grid->height != (height + 1)) || (grid->frames != (range + 1)) ||
+       (grid->channels != (channels + 1))) {
 
         #ifdef PIC_DEBUG
+            printf("S Rate: %f R Rate: %f Mul E: %f\n", s_S, s_R, mul_E);
             printf("Grid Size: %d %d %d\n", width, height, range);
+            printf("Grid - Memory Mb: %3.2f\n",
+                   float(width + 1)*float(height + 1)*float(range + 1) * 16.0f /
+                   (1024.0f * 1024.0f));
         #endif
 
-#ifdef PIC_BILATERAL_GRID_MULTI_PASS
-        printf("Grid - Memory Mb: %3.2f\n",
-               float(width + 1)*float(height + 1)*float(range + 1) * 8.0f /
-               (1024.0f * 1024.0f));
-        grid = new ImageRAW(range + 1, width + 1, height + 1, 2);
-        gridBlur = new ImageRAW(range + 1, width + 1, height + 1, 2);
-#else
-        printf("Grid - Memory Mb: %3.2f\n",
-               float(width + 1)*float(height + 1)*float(range + 1) * 16.0f /
-               (1024.0f * 1024.0f));
-        grid = new ImageRAW(range + 1, width + 1, height + 1, base->channels + 1);
-        gridBlur = new ImageRAW(range + 1, width + 1, height + 1, base->channels + 1);
-#endif
+        if(grid != NULL) {
+            delete grid;
+            delete gridBlur;
+        }
+
+        grid = new ImageRAW(range + 1, width + 1, height + 1, channels + 1);
+        gridBlur = new ImageRAW(range + 1, width + 1, height + 1, channels + 1);
     }
 
     grid->SetZero();
 
-    for(int j = 0; j < base->height; j++) {
+    //image rows of each grid row
+    gridRows.assign(height + 2, base->height);
+
+    for(int j = base->height - 1; j >= 0; j--) {
         int y = int(lround(float(j) * s_S));
+        gridRows[y] = j;
+    }
 
-        for(int i = 0; i < base->width; i++) {
+    for(int y = height; y >= 0; y--) {
+        gridRows[y] = MIN(gridRows[y], gridRows[y + 1]);
+    }
 
-            int ind = i * base->xstride + j * base->ystride;
+    ThreadPool::Execute(height + 1, [&](unsigned int y) {
+        for(int j = gridRows[y]; j < gridRows[y + 1]; j++) {
+            for(int i = 0; i < base->width; i++) {
+                float *tmp_base = (*base)(i, j);
+                float *tmp_edge = (*edge)(i, j);
 
-#ifdef PIC_BILATERAL_GRID_MULTI_PASS
-            float E = edge->data[ind + channel];
-#else
-            float E = 0.0f;
+                float E = 0.0f;
 
-            for(int k = 0; k < edge->channels; k++) {
-                E += edge->data[ind + k];
-            }
+                for(int k = 0; k < edge->channels; k++) {
+                    E += tmp_edge[k];
+                }
 
-#endif
-            E *= mul_E;
+                E *= mul_E;
 
-            int x = int(lround(float(i) * s_S));
-            int r = int(lround(E));
+                int x = int(lround(float(i) * s_S));
+                int r = int(lround(E));
+                r = CLAMPi(r, 0, range);
 
-            int grdInd = x * grid->xstride + y * grid->ystride + r * grid->tstride;
+                float *tmp_grid = (*grid)(x, y, r);
 
-#ifdef PIC_BILATERAL_GRID_MULTI_PASS
-            grid->data[grdInd + 0] += base->data[ind + channels];
-            grid->data[grdInd + 1] += 1.0f;
-#else
+                for(int k = 0; k < channels; k++) {
+                    tmp_grid[k] += tmp_base[k];
+                }
 
-            for(int k = 0; k < base->channels; k++) {
-                grid->data[grdInd + k] += base->data[ind + k];
+                tmp_grid[channels] += 1.0f;	//Counter
             }
-
-            grid->data[grdInd + base->channels] += 1.0f;	//Counter
-#endif
         }
-    }
+    }, getMaxThreads());
+
     return grid;
 }
 
-void FilterBilateral2DG::Slice(ImageRAW *out, ImageRAW *base, ImageRAW *edge,
-                               int channels)
+void FilterBilateral2DG::Slice(ImageRAW *out, ImageRAW *base, ImageRAW *edge)
 {
     float widthf = float(grid->width);
     float heightf = float(grid->height);
     float rangef = float(grid->frames);
 
-#ifdef PIC_BILATERAL_GRID_MULTI_PASS
-    float vOut[2];
-#else
-    float *vOut = new float [out->channels + 1];
-#endif
-
-    for(int j = 0; j < out->height; j++) {
-        for(int i = 0; i < out->width; i++) {
-            int ind = i * out->xstride + j * out->ystride;
+    int channels = out->channels;
 
-            float x = float(i) * s_S;
-            float y = float(j) * s_S;
+    ThreadPool::ExecuteRows(out->width, out->height, [&](int y0, int y1) {
+        std::vector<float> vOut(channels + 1);
 
-#ifdef PIC_BILATERAL_GRID_MULTI_PASS
-            float E = edge->data[ind + channels];
-#else
-            float E = 0.0f;
-
-            for(int k = 0; k < out->channels; k++) {
-                E += edge->data[ind + k];
-            }
+        for(int j = y0; j < y1; j++) {
+            for(int i = 0; i < out->width; i++) {
+                float *tmp_out = (*out)(i, j);
+                float *tmp_edge = (*edge)(i, j);
 
-#endif
-            E *= mul_E;
+                float x = float(i) * s_S;
+                float y = float(j) * s_S;
 
-            //Trilinear filtering
-            isb.SampleImage(gridBlur, x / widthf, y / heightf, E / rangef, vOut);
+                float E = 0.0f;
 
-#ifdef PIC_BILATERAL_GRID_MULTI_PASS
+                for(int k = 0; k < edge->channels; k++) {
+                    E += tmp_edge[k];
+                }
 
-            if(vOut[1] > 0.0f) {
-                out->data[ind + channels] = vOut[0] / vOut[1];
-            } else {
-                out->data[ind + channels] = 0.0f;
-            }
+                E *= mul_E;
 
-#else
+                //Trilinear filtering
+                isb.SampleImage(gridBlur, x / widthf, y / heightf, E / rangef, &vOut[0]);
 
-            if(vOut[out->channels] > 0.0f) {
-                for(int k = 0; k < out->channels; k++) {
-                    out->data[ind + k] = vOut[k] / vOut[out->channels];
-                }
-            } else {
-                for(int k = 0; k < out->channels; k++) {
-                    out->data[ind + k] = 0.0f;
+                if(vOut[channels] > 0.0f) {
+                    for(int k = 0; k < channels; k++) {
+                        tmp_out[k] = vOut[k] / vOut[channels];
+                    }
+                } else {
+                    for(int k = 0; k < channels; k++) {
+                        tmp_out[k] = 0.0f;
+                    }
                 }
             }
-
-#endif
         }
-    }
+    }, getMaxThreads());
 }
 
 ImageRAW *FilterBilateral2DG::Process(ImageRAWVec imgIn, ImageRAW *imgOut)
@@ -323,60 +347,51 @@ ImageRAW *FilterBilateral2DG::Process(ImageRAWVec imgIn, ImageRAW *imgOut)
         return NULL;
     }
 
-    if(imgOut == NULL) {
-        imgOut = imgIn[0]->AllocateSimilarOne();
-    }
+    imgOut = SetupAux(imgIn, imgOut);
 
     ImageRAW *base, *edge;
 
-    float maxVal;
-
-    if(imgIn.size() == 2) {
+    if((imgIn.size() == 2) && (imgIn[1] != NULL)) {
         base = imgIn[0];
         edge = imgIn[1];
-        maxVal = MAX(base->getMaxVal()[0], edge->getMaxVal()[0]);
-        edge->Div(maxVal);
     } else {
         base = imgIn[0];
         edge = imgIn[0];
-        maxVal = base->getMaxVal()[0];
     }
 
-    //Range in [0,1]
-    base->Div(maxVal);
-    float tmpSigma_r = sigma_r;
-    sigma_r /= maxVal;
-
     //Grid's Initialization
     s_S = 1.0f / sigma_s;	//Spatial Sampling rate
-    s_R = 1.0f / sigma_r; //Range Sampling rate
-
-#ifdef PIC_BILATERAL_GRID_MULTI_PASS
-    int n = imgIn[0]->channels;
-    mul_E = s_R;
-#else
-    int n = 1;
-    mul_E = s_R / float(imgIn[0]->channels);
-#endif
-
-    //For each R,G,B, color channel
-    for(int i = 0; i < n; i++) {
-        //Splatting
-        Splat(base, edge, i);
-
-        //Blurring
-        if(parallel) {
-            fltG->Process(Single(grid), gridBlur);
-        } else {
-            fltG->ProcessP(Single(grid), gridBlur);
+    s_R = 1.0f / sigma_r;   //Range Sampling rate
+
+    //the range is the mean of edge channels; inputs are not normalized
+    //since the grid is invariant to the scale of values
+    mul_E = s_R / float(edge->channels);
+
+    float maxE = 0.0f;
+
+    for(int i = 0; i < edge->size(); i += edge->channels) {
+        float E = 0.0f;
+
+        for(int k = 0; k < edge->channels; k++) {
+            E += edge->data[i + k];
         }
 
-        //Slicing
-        Slice(imgOut, base, edge, i);
+        maxE = MAX(maxE, E);
     }
 
-    imgOut->Mul(maxVal);
-    sigma_r = tmpSigma_r;
+    //Splatting
+    Splat(base, edge, maxE);
+
+    //Blurring
+    if(parallel) {
+        fltG->ProcessP(Single(grid), gridBlur);
+    } else {
+        fltG->Process(Single(grid), gridBlur);
+    }
+
+    //Slicing
+    Slice(imgOut, base, edge);
+
     parallel = false;
 
     return imgOut;
@@ -0,0 +1,227 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+PICCANTE is free software; you can redistribute it and/or modify
+under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation; either version 3.0 of
+the License, or (at your option) any later version.
+
+PICCANTE is distributed in the hope that it will be useful, but
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU Lesser General Public License
+( http://www.gnu.org/licenses/lgpl-3.0.html ) for more details.
+
+*/
+
+#ifndef PIC_FILTERING_FILTER_BILATERAL_2DPL_HPP
+#define PIC_FILTERING_FILTER_BILATERAL_2DPL_HPP
+
+#include <vector>
+
+#include "filtering/filter.hpp"
+#include "util/permutohedral_lattice.hpp"
+
+namespace pic {
+
+/**
+ * @brief The FilterBilateral2DPL class is a bilateral filter based on the
+ * permutohedral lattice. Positions are (x / sigma_s, y / sigma_s, e_k / sigma_r)
+ * where e_k are the channels of the edge image; so a color edge image gives
+ * a 5D filter with full color distances. The lattice is kept across calls.
+ */
+class FilterBilateral2DPL: public Filter
+{
+protected:
+    float                   sigma_s, sigma_r;
+    PermutohedralLattice    lattice;
+
+    /**
+     * @brief ProcessAux
+     * @param imgIn
+     * @param imgOut
+     * @param maxThreads
+     * @return It returns NULL if positions are out of the range of the
+     * lattice; see PermutohedralLattice::getMaxPosition.
+     */
+    ImageRAW *ProcessAux(ImageRAWVec &imgIn, ImageRAW *imgOut, int maxThreads);
+
+public:
+
+    /**
+     * @brief FilterBilateral2DPL
+     * @param sigma_s
+     * @param sigma_r
+     */
+    FilterBilateral2DPL(float sigma_s, float sigma_r)
+    {
+        this->sigma_s = sigma_s;
+        this->sigma_r = sigma_r;
+    }
+
+    std::string Signature()
+    {
+        return GenBilString("PL", sigma_s, sigma_r);
+    }
+
+    /**
+     * @brief Process
+     * @param imgIn
+     * @param imgOut
+     * @return
+     */
+    ImageRAW *Process(ImageRAWVec imgIn, ImageRAW *imgOut)
+    {
+        return ProcessAux(imgIn, imgOut, 1);
+    }
+
+    /**
+     * @brief ProcessP blurs and slices in parallel; splatting is serial.
+     * @param imgIn
+     * @param imgOut
+     * @return
+     */
+    ImageRAW *ProcessP(ImageRAWVec imgIn, ImageRAW *imgOut)
+    {
+        return ProcessAux(imgIn, imgOut, maxThreads);
+    }
+
+    /**
+     * @brief Execute
+     * @param imgIn
+     * @param imgEdge may be NULL.
+     * @param imgOut
+     * @param sigma_s
+     * @param sigma_r
+     * @return
+     */
+    static ImageRAW *Execute(ImageRAW *imgIn, ImageRAW *imgEdge, ImageRAW *imgOut,
+                             float sigma_s, float sigma_r)
+    {
+        FilterBilateral2DPL filter(sigma_s, sigma_r);
+
+        if(imgEdge == NULL) {
+            return filter.ProcessP(Single(imgIn), imgOut);
+        } else {
+            return filter.ProcessP(Double(imgIn, imgEdge), imgOut);
+        }
+    }
+};
+
+PIC_INLINE ImageRAW *FilterBilateral2DPL::ProcessAux(ImageRAWVec &imgIn,
+        ImageRAW *imgOut, int maxThreads)
+{
+    if(imgIn[0] == NULL) {
+        return NULL;
+    }
+
+    ImageRAW *base = imgIn[0];
+    ImageRAW *edge = ((imgIn.size() == 2) && (imgIn[1] != NULL)) ? imgIn[1] : imgIn[0];
+
+    int channels = base->channels;
+    int d = MIN(2 + edge->channels, PERMUTOHEDRAL_MAX_DIM);
+    int vd = channels + 1;
+
+    float inv_sigma_s = 1.0f / sigma_s;
+    float inv_sigma_r = 1.0f / sigma_r;
+
+    //positions have to be inside the range of the lattice
+    float maxPosition = PermutohedralLattice::getMaxPosition(d);
+
+    if((float(MAX(base->width, base->height)) * inv_sigma_s) > maxPosition) {
+        return NULL;
+    }
+
+    ImageStatistics stats;
+    edge->getStatistics(stats, IS_MIN | IS_MAX, NULL);
+
+    for(int k = 2; k < d; k++) {
+        float range = MAX(fabsf(stats.minVal[k - 2]), fabsf(stats.maxVal[k - 2]));
+
+        if(!((range * inv_sigma_r) <= maxPosition)) {
+            return NULL;
+        }
+    }
+
+    imgOut = SetupAux(imgIn, imgOut);
+
+    //the number of vertices is roughly proportional to the downsampled image
+    lattice.Init(d, vd, int(float(base->width * base->height) * inv_sigma_s *
+                            inv_sigma_s) + 1);
+
+    //Splatting
+    std::vector<float> position(d);
+    std::vector<float> value(vd);
+
+    for(int j = 0; j < base->height; j++) {
+        for(int i = 0; i < base->width; i++) {
+            float *tmp_base = (*base)(i, j);
+            float *tmp_edge = (*edge)(i, j);
+
+            position[0] = float(i) * inv_sigma_s;
+            position[1] = float(j) * inv_sigma_s;
+
+            for(int k = 2; k < d; k++) {
+                position[k] = tmp_edge[k - 2] * inv_sigma_r;
+            }
+
+            for(int k = 0; k < channels; k++) {
+                value[k] = tmp_base[k];
+            }
+
+            value[channels] = 1.0f;
+
+            lattice.Splat(&position[0], &value[0]);
+        }
+    }
+
+    //Blurring
+    lattice.Blur(maxThreads);
+
+    //Slicing
+    ThreadPool::ExecuteRows(imgOut->width, imgOut->height, [&](int y0, int y1) {
+        std::vector<float> position(d);
+        std::vector<float> vOut(vd);
+
+        for(int j = y0; j < y1; j++) {
+            for(int i = 0; i < imgOut->width; i++) {
+                float *tmp_out = (*imgOut)(i, j);
+                float *tmp_edge = (*edge)(i, j);
+
+                position[0] = float(i) * inv_sigma_s;
+                position[1] = float(j) * inv_sigma_s;
+
+                for(int k = 2; k < d; k++) {
+                    position[k] = tmp_edge[k - 2] * inv_sigma_r;
+                }
+
+                lattice.Slice(&position[0], &vOut[0]);
+
+                if(vOut[channels] > 0.0f) {
+                    for(int k = 0; k < channels; k++) {
+                        tmp_out[k] = vOut[k] / vOut[channels];
+                    }
+                } else {
+                    for(int k = 0; k < channels; k++) {
+                        tmp_out[k] = 0.0f;
+                    }
+                }
+            }
+        }
+    }, maxThreads);
+
+    return imgOut;
+}
+
+} // end namespace pic
+
+#endif /* PIC_FILTERING_FILTER_BILATERAL_2DPL_HPP */
+
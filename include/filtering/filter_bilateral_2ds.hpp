@@ -65,9 +65,14 @@ public:
     //Init
     void Init(SAMPLER_TYPE type, float sigma_s, float sigma_r, int mult);
 
+    /**
+     * @brief Signature returns the default signature, since samples are
+     * drawn at random; so results are not cached.
+     * @return
+     */
     std::string Signature()
     {
-        return GenBilString("S", sigma_s, sigma_r);
+        return "FLT";
     }
 
     //Set sigma_r
@@ -34,7 +34,9 @@ See the GNU Lesser General Public License
 namespace pic {
 
 /**
- * @brief The FilterColorConv class
+ * @brief The FilterColorConv class applies a chain of color conversions.
+ * Three-channel images are converted by rows, and consecutive linear
+ * conversions are merged into a single matrix.
  */
 class FilterColorConv: public Filter
 {
@@ -43,6 +45,57 @@ protected:
     unsigned int				n;
     bool						bDirect;
 
+    /**
+     * @brief The ColorConvStage struct is a conversion of the chain, or a
+     * matrix when conv is NULL.
+     */
+    struct ColorConvStage
+    {
+        ColorConv   *conv;
+        float       mtx[9];
+    };
+
+    std::vector<ColorConvStage> stages;
+
+    /**
+     * @brief BuildStages builds the conversions in order of application,
+     * merging consecutive linear conversions.
+     */
+    void BuildStages()
+    {
+        stages.clear();
+
+        for(unsigned int k = 0; k < n; k++) {
+            ColorConv *conv = bDirect ? conv_list[k] : conv_list[n - k - 1];
+
+            ColorConvStage stage;
+            stage.conv = conv;
+
+            if(conv->getLinear(stage.mtx, bDirect)) {
+                stage.conv = NULL;
+
+                if(!stages.empty() && (stages.back().conv == NULL)) {
+                    ColorConv::mul(stage.mtx, stages.back().mtx, stages.back().mtx);
+                    continue;
+                }
+            }
+
+            stages.push_back(stage);
+        }
+    }
+
+    /**
+     * @brief SetupAux
+     * @param imgIn
+     * @param imgOut
+     * @return
+     */
+    ImageRAW *SetupAux(ImageRAWVec imgIn, ImageRAW *imgOut)
+    {
+        BuildStages();
+        return Filter::SetupAux(imgIn, imgOut);
+    }
+
     /**
      * @brief ProcessBBox
      * @param dst
@@ -57,6 +110,32 @@ protected:
 
         int channels	= src[0]->channels;
 
+        if(channels == 3) {
+            int width = box->x1 - box->x0;
+
+            for(int j = box->y0; j < box->y1; j++) {
+                float *dataIn  = (*src[0]) (box->x0, j);
+                float *dataOut = (*dst)    (box->x0, j);
+
+                for(unsigned int k = 0; k < stages.size(); k++) {
+                    ColorConv *conv = stages[k].conv;
+                    float *rowIn = (k == 0) ? dataIn : dataOut;
+
+                    if(conv == NULL) {
+                        ColorConv::applyRow(stages[k].mtx, rowIn, dataOut, width);
+                    } else {
+                        if(bDirect) {
+                            conv->directRow(rowIn, dataOut, width);
+                        } else {
+                            conv->inverseRow(rowIn, dataOut, width);
+                        }
+                    }
+                }
+            }
+
+            return;
+        }
+
         float *tmpCol = new float [channels];
         float *tmp[2];
 
@@ -150,7 +229,7 @@ public:
         flt.insertColorConv(&csXYZ);
         flt.insertColorConv(&csLogLuv);
 
-        return flt.Process(Single(imgIn), imgOut);
+        return flt.ProcessP(Single(imgIn), imgOut);
     }
 
     /**
@@ -171,7 +250,7 @@ public:
         flt.insertColorConv(&csXYZ);
         flt.insertColorConv(&csCIELAB);
 
-        return flt.Process(Single(imgIn), imgOut);
+        return flt.ProcessP(Single(imgIn), imgOut);
     }
 
     /**
@@ -192,7 +271,7 @@ public:
         flt.insertColorConv(&csCIELAB);
         flt.insertColorConv(&csXYZ);
 
-        return flt.Process(Single(imgIn), imgOut);
+        return flt.ProcessP(Single(imgIn), imgOut);
     }
 };
 
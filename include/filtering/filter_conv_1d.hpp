@@ -25,8 +25,11 @@ See the GNU Lesser General Public License
 #ifndef PIC_FILTERING_FILTER_CONV_1D_HPP
 #define PIC_FILTERING_FILTER_CONV_1D_HPP
 
+#include <vector>
+
 #include "filtering/filter.hpp"
 #include "util/precomputed_gaussian.hpp"
+#include "util/simd.hpp"
 
 namespace pic {
 
@@ -45,6 +48,36 @@ protected:
      */
     void ProcessBBox(ImageRAW *dst, ImageRAWVec src, BBox *box);
 
+    /**
+     * @brief ProcessBBoxDirs
+     * @param dst
+     * @param src
+     * @param box
+     * @param dirs
+     */
+    void ProcessBBoxDirs(ImageRAW *dst, ImageRAWVec &src, BBox *box, int *dirs);
+
+    /**
+     * @brief ProcessPixel filters a single pixel with clamped coordinates.
+     * @param dst
+     * @param source
+     * @param i
+     * @param j
+     * @param m
+     * @param dirs
+     */
+    void ProcessPixel(ImageRAW *dst, ImageRAW *source, int i, int j, int m,
+                      int *dirs);
+
+    /**
+     * @brief GetPassDirs computes the directions for a given pass.
+     * @param pass
+     * @param tPass
+     * @param dirs
+     * @return It returns false if tPass is not valid.
+     */
+    static bool GetPassDirs(int pass, int tPass, int *dirs);
+
 public:
 
     /**
@@ -85,6 +118,26 @@ public:
      */
     void ChangePass(int x, int y, int z);
 
+    /**
+     * @brief getKernelRadius
+     * @return
+     */
+    int getKernelRadius()
+    {
+        return n >> 1;
+    }
+
+    /**
+     * @brief ProcessBBoxPass
+     * @param dst
+     * @param src
+     * @param box
+     * @param pass
+     * @param tPass
+     */
+    void ProcessBBoxPass(ImageRAW *dst, ImageRAWVec src, BBox *box,
+                         int pass, int tPass);
+
     /**
      * @brief Execute
      * @param imgIn
@@ -170,7 +223,7 @@ FilterConv1D::~FilterConv1D()
     n = -1;
 }
 
-void FilterConv1D::ChangePass(int pass, int tPass)
+bool FilterConv1D::GetPassDirs(int pass, int tPass, int *dirs)
 {
     int tMod;
 
@@ -180,8 +233,7 @@ void FilterConv1D::ChangePass(int pass, int tPass)
         if(tPass == 1) {
             tMod = 2;
         } else {
-            printf("ERROR: FilterConv1D::ChangePass");
-            return;
+            return false;
         }
     }
 
@@ -190,6 +242,16 @@ void FilterConv1D::ChangePass(int pass, int tPass)
     for(int i = 1; i < tMod; i++) {
         dirs[(pass + i) % tMod] = 0;
     }
+
+    return true;
+}
+
+void FilterConv1D::ChangePass(int pass, int tPass)
+{
+    if(!GetPassDirs(pass, tPass, dirs)) {
+        printf("ERROR: FilterConv1D::ChangePass");
+        return;
+    }
     
     #ifdef PIC_DEBUG
         printf("%d %d %d\n",dirs[0],dirs[1],dirs[2]);
@@ -203,7 +265,51 @@ void FilterConv1D::ChangePass(int x, int y, int z)
     dirs[2] = z;
 }
 
+void FilterConv1D::ProcessBBoxPass(ImageRAW *dst, ImageRAWVec src, BBox *box,
+                                   int pass, int tPass)
+{
+    int tmpDirs[3] = {dirs[0], dirs[1], dirs[2]};
+    GetPassDirs(pass, tPass, tmpDirs);
+    ProcessBBoxDirs(dst, src, box, tmpDirs);
+}
+
 void FilterConv1D::ProcessBBox(ImageRAW *dst, ImageRAWVec src, BBox *box)
+{
+    ProcessBBoxDirs(dst, src, box, dirs);
+}
+
+void FilterConv1D::ProcessPixel(ImageRAW *dst, ImageRAW *source, int i, int j,
+                                int m, int *dirs)
+{
+    int channels = dst->channels;
+    int halfKernelSize = n >> 1;
+
+    float *tmpDst = (*dst)(i, j, m);
+
+    for(int l = 0; l < channels; l++) {
+        tmpDst[l] = 0.0f;
+    }
+
+    for(int k = 0; k < n; k++) { //1D Filtering
+        int tmpCoord = k - halfKernelSize;
+
+        //Address cj
+        int cj = j + tmpCoord * dirs[0];
+        //Address ci
+        int ci = i + tmpCoord * dirs[1];
+        //Address cm
+        int cm = m + tmpCoord * dirs[2];
+
+        float *tmpSource = (*source)(ci, cj, cm);
+
+        for(int l = 0; l < channels; l++) {
+            tmpDst[l] += tmpSource[l] * data[k];
+        }
+    }
+}
+
+void FilterConv1D::ProcessBBoxDirs(ImageRAW *dst, ImageRAWVec &src, BBox *box,
+                                   int *dirs)
 {
     int channels = dst->channels;
 
@@ -211,31 +317,70 @@ void FilterConv1D::ProcessBBox(ImageRAW *dst, ImageRAWVec src, BBox *box)
 
     int halfKernelSize = n >> 1;
 
+    //vectorized rows need the same layout for input and output
+    bool bSameLayout = (source->width == dst->width) &&
+                       (source->height == dst->height) &&
+                       (source->frames == dst->frames) &&
+                       (source->channels == channels);
+
+    bool bHorizontal = (dirs[1] == 1) && (dirs[0] == 0) && (dirs[2] == 0);
+
+    if(!bSameLayout || (n < 1) || ((dirs[1] != 0) && !bHorizontal)) {
+        for(int m = box->z0; m < box->z1; m++) {
+            for(int j = box->y0; j < box->y1; j++) {
+                for(int i = box->x0; i < box->x1; i++) {
+                    ProcessPixel(dst, source, i, j, m, dirs);
+                }
+            }
+        }
+
+        return;
+    }
+
+    std::vector<const float *> rows(n);
+
+    //pixels whose taps are all inside the row
+    int xi0 = MAX(box->x0, halfKernelSize);
+    int xi1 = MIN(box->x1, source->width - (n - 1 - halfKernelSize));
+
     for(int m = box->z0; m < box->z1; m++) {
         for(int j = box->y0; j < box->y1; j++) {
-            for(int i = box->x0; i < box->x1; i++) {
-                float *tmpDst = (*dst)(i, j, m);
+            if(bHorizontal) {
+                //a tap of a pixel is a shift of the whole row
+                if(xi0 >= xi1) {
+                    for(int i = box->x0; i < box->x1; i++) {
+                        ProcessPixel(dst, source, i, j, m, dirs);
+                    }
 
-                for(int l = 0; l < channels; l++) {
-                    tmpDst[l] = 0.0f;
+                    continue;
                 }
 
-                for(int k = 0; k < n; k++) { //1D Filtering
-                    int tmpCoord = k - halfKernelSize;
+                for(int i = box->x0; i < xi0; i++) {
+                    ProcessPixel(dst, source, i, j, m, dirs);
+                }
 
-                    //Address cj
-                    int cj = j + tmpCoord * dirs[0];
-                    //Address ci
-                    int ci = i + tmpCoord * dirs[1];
-                    //Address cm
-                    int cm = m + tmpCoord * dirs[2];
+                float *tmpSource = (*source)(0, j, m);
 
-                    float *tmpSource = (*source)(ci, cj, cm);
+                for(int k = 0; k < n; k++) {
+                    rows[k] = tmpSource + (xi0 + k - halfKernelSize) * channels;
+                }
 
-                    for(int l = 0; l < channels; l++) {
-                        tmpDst[l] += tmpSource[l] * data[k];
-                    }
+                WeightedSum(&rows[0], data, n, (*dst)(xi0, j, m),
+                            (xi1 - xi0) * channels);
+
+                for(int i = xi1; i < box->x1; i++) {
+                    ProcessPixel(dst, source, i, j, m, dirs);
+                }
+            } else {
+                //a tap is a whole row; borders are clamped per row
+                for(int k = 0; k < n; k++) {
+                    int tmpCoord = k - halfKernelSize;
+                    rows[k] = (*source)(box->x0, j + tmpCoord * dirs[0],
+                                        m + tmpCoord * dirs[2]);
                 }
+
+                WeightedSum(&rows[0], data, n, (*dst)(box->x0, j, m),
+                            (box->x1 - box->x0) * channels);
             }
         }
     }
@@ -118,8 +118,7 @@ public:
         ImageRAW img(nameImg, LT_NOR_GAMMA);
         ImageRAW conv(nameConv, LT_NOR_GAMMA);
 
-        float *sumVal = conv.getSumVal(NULL, NULL);
-        conv.Div(sumVal[0]);
+        conv.Div(conv.getStatistics(IS_SUM).sumVal[0]);
 
         ImageRAW *imgOut = Execute(&img, &conv, NULL);
 
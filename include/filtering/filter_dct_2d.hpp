@@ -27,6 +27,7 @@ See the GNU Lesser General Public License
 
 #include "filtering/filter_npasses.hpp"
 #include "filtering/filter_dct_1d.hpp"
+#include "algorithms/discrete_cosine_transform.hpp"
 
 namespace pic {
 
@@ -81,7 +82,8 @@ public:
     }
 
     /**
-     * @brief Transform
+     * @brief Transform computes the same blocks of the filter with the
+     * separable engine of DCT.
      * @param imgIn
      * @param imgOut
      * @param nCoeff
@@ -89,12 +91,13 @@ public:
      */
     static ImageRAW *Transform(ImageRAW *imgIn, ImageRAW *imgOut, int nCoeff)
     {
-        FilterDCT2D filter(nCoeff, true);
-        return filter.Process(Single(imgIn), imgOut);
+        DCT dct(nCoeff);
+        return dct.Process(imgIn, imgOut, true);
     }
 
     /**
-     * @brief Inverse
+     * @brief Inverse computes the same blocks of the filter with the
+     * separable engine of DCT.
      * @param imgIn
      * @param imgOut
      * @param nCoeff
@@ -102,8 +105,8 @@ public:
      */
     static ImageRAW *Inverse(ImageRAW *imgIn, ImageRAW *imgOut, int nCoeff)
     {
-        FilterDCT2D filter(nCoeff, false);
-        return filter.ProcessP(Single(imgIn), imgOut);
+        DCT dct(nCoeff);
+        return dct.Process(imgIn, imgOut, false);
     }
 };
 
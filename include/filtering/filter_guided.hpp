@@ -25,12 +25,22 @@ See the GNU Lesser General Public License
 #ifndef PIC_FILTERING_FILTER_GUIDED_HPP
 #define PIC_FILTERING_FILTER_GUIDED_HPP
 
+#include <vector>
+
 #include "filtering/filter.hpp"
+#include "filtering/filter_integral_image.hpp"
 
 #include "util/math.hpp"
 
 namespace pic {
 
+/**
+ * @brief The FilterGuided class implements the guided filter. Window
+ * statistics are computed from double-precision summed-area tables of the
+ * moments of the guide and the input, one table per tile; so the cost per
+ * pixel does not depend on the radius. Tiles are at least 4 * radius
+ * pixels wide so the overhead of their borders is bounded too.
+ */
 class FilterGuided: public Filter
 {
 protected:
@@ -43,6 +53,15 @@ protected:
     void Process3Channel(ImageRAW *I, ImageRAW *p, ImageRAW *q, BBox *box);
     void ProcessBBox(ImageRAW *dst, ImageRAWVec src, BBox *box);
 
+    /**
+     * @brief ProcessTiles filters imgIn in tiles sized for the radius.
+     * @param imgIn
+     * @param imgOut
+     * @param maxThreads
+     * @return
+     */
+    ImageRAW *ProcessTiles(ImageRAWVec &imgIn, ImageRAW *imgOut, int maxThreads);
+
 public:
     //Basic constructor
     FilterGuided()
@@ -56,6 +75,28 @@ public:
 
     void Update(int radius, float e_regularization);
 
+    /**
+     * @brief Process
+     * @param imgIn
+     * @param imgOut
+     * @return
+     */
+    ImageRAW *Process(ImageRAWVec imgIn, ImageRAW *imgOut)
+    {
+        return ProcessTiles(imgIn, imgOut, 1);
+    }
+
+    /**
+     * @brief ProcessP
+     * @param imgIn
+     * @param imgOut
+     * @return
+     */
+    ImageRAW *ProcessP(ImageRAWVec imgIn, ImageRAW *imgOut)
+    {
+        return ProcessTiles(imgIn, imgOut, maxThreads);
+    }
+
     static ImageRAW *Execute(ImageRAW *imgIn, ImageRAW *guide, ImageRAW *imgOut,
                              int radius, float e_regularization)
     {
@@ -71,44 +112,67 @@ void FilterGuided::Update(int radius, float e_regularization)
     nPixels = float(radius * radius * 4);
 }
 
+PIC_INLINE ImageRAW *FilterGuided::ProcessTiles(ImageRAWVec &imgIn,
+        ImageRAW *imgOut, int maxThreads)
+{
+    if(imgIn[0] == NULL) {
+        return NULL;
+    }
+
+    imgOut = SetupAux(imgIn, imgOut);
+
+    int tileSize = MAX(TILE_SIZE, radius * 4);
+    TileList lst(tileSize, imgOut->width, imgOut->height);
+
+    ThreadPool::Execute(lst.tiles.size(), [&](unsigned int i) {
+        ProcessPAux(imgIn, imgOut, &lst, i);
+    }, maxThreads);
+
+    return imgOut;
+}
+
 void FilterGuided::Process1Channel(ImageRAW *I, ImageRAW *p, ImageRAW *q,
                                    BBox *box)
 {
-    float I_mean, I_var;
-    float *p_mean = new float [p->channels];
+    int channels = p->channels;
 
-    for(int j = box->y0; j < box->y1; j++) {
-        for(int i = box->x0; i < box->x1; i++) {
-            float *tmpQ = (*q)(i, j);
-            float *tmpI   = (*I)(i, j);
+    //the window of a pixel (i, j) is [i - radius, i + radius) x
+    //[j - radius, j + radius)
+    int size = radius * 2;
+    int w = box->x1 - box->x0;
+    int h = box->y1 - box->y0;
 
-            BBox tmpBox(i - radius, i + radius, j - radius, j + radius);
+    std::vector<double> table;
+    int M = FilterIntegralImage::ComputeMoments(I, p, box->x0 - radius,
+            box->y0 - radius, w + size, h + size, table);
 
-            I->getMeanVal(&tmpBox, &I_mean);
-            I->getVarianceVal(&I_mean, &tmpBox, &I_var);
+    std::vector<double> S(M);
 
-            p->getMeanVal(&tmpBox, p_mean);
+    double N = double(nPixels);
 
-            for(int c = 0; c < p->channels; c++) {
-                float I_mean_p_mean = I_mean * p_mean[c];
-                float a = 0.0f;
+    for(int j = 0; j < h; j++) {
+        for(int i = 0; i < w; i++) {
+            float *tmpQ = (*q)(box->x0 + i, box->y0 + j);
+            float *tmpI = (*I)(box->x0 + i, box->y0 + j);
 
-                for(int k = -radius; k < radius; k++) {
-                    for(int l = -radius; l < radius; l++) {
-                        float *I_i = (*I)(i + l, j + k);
-                        float *p_i = (*p)(i + l, j + k);
-                        a += I_i[0] * p_i[c] - I_mean_p_mean;
-                    }
-                }
+            FilterIntegralImage::SumMoments(&table[0], w + size, M, i, j,
+                                            i + size, j + size, &S[0]);
+
+            //moments: I, I * I, p_c, I * p_c
+            double I_mean = S[0] / N;
+            double I_var = (S[1] - S[0] * I_mean) / (N - 1.0);
 
-                a /= (nPixels * (I_var + e_regularization));
-                float b = p_mean[c] - a * I_mean;
-                tmpQ[c] = a * tmpI[0] + b;
+            for(int c = 0; c < channels; c++) {
+                double p_mean = S[2 + c] / N;
+
+                double a = (S[2 + channels + c] / N - I_mean * p_mean) /
+                           (I_var + e_regularization);
+                double b = p_mean - a * I_mean;
+
+                tmpQ[c] = float(a * tmpI[0] + b);
             }
         }
     }
-
-    delete p_mean;
 }
 
 PIC_INLINE void FilterGuided::Process3Channel(ImageRAW *I, ImageRAW *p,
@@ -116,76 +180,92 @@ PIC_INLINE void FilterGuided::Process3Channel(ImageRAW *I, ImageRAW *p,
 {
     int channels = p->channels;
 
-    float *buf = new float [channels * 4];
-
-    float *I_mean	= &buf[0];
-    float *p_mean	= &buf[channels    ];
-    float *a		= &buf[channels * 2];
-    float *tmp_A	= &buf[channels * 3];
+    int size = radius * 2;
+    int w = box->x1 - box->x0;
+    int h = box->y1 - box->y0;
 
-    Matrix3x3 cov, inv;
+    std::vector<double> table;
+    int M = FilterIntegralImage::ComputeMoments(I, p, box->x0 - radius,
+            box->y0 - radius, w + size, h + size, table);
 
-    for(int j = box->y0; j < box->y1; j++) {
-        for(int i = box->x0; i < box->x1; i++) {
-            float *tmpQ = (*q)(i, j);
-            float *tmpI = (*I)(i, j);
+    std::vector<double> S(M);
 
-            BBox tmpBox(i - radius, i + radius, j - radius, j + radius);
+    //offsets of moments: I (3), I * I (6), p_c, I * p_c
+    const int offIP = 9 + channels;
 
-            I->getMeanVal(&tmpBox, I_mean);
-            I->getCovMtxVal(I_mean, &tmpBox, cov.data);
+    double N = double(nPixels);
 
-            //regularization
-            cov.Add(e_regularization);
-            //invert matrix
-            cov.Inverse(&inv);
+    //the system is solved in double precision since the covariance of
+    //flat windows is close to singular
+    double I_mean[3], cov[9], inv[9], tmp_A[3], a[3];
 
-            p->getMeanVal(&tmpBox, p_mean);
+    for(int j = 0; j < h; j++) {
+        for(int i = 0; i < w; i++) {
+            float *tmpQ = (*q)(box->x0 + i, box->y0 + j);
+            float *tmpI = (*I)(box->x0 + i, box->y0 + j);
 
-            for(int c = 0; c < channels; c++) {
+            FilterIntegralImage::SumMoments(&table[0], w + size, M, i, j,
+                                            i + size, j + size, &S[0]);
 
-                for(int n = 0; n < channels; n++) {
-                    tmp_A[n] = 0.0f;
-                }
+            for(int n = 0; n < 3; n++) {
+                I_mean[n] = S[n] / N;
+            }
 
-                for(int k = -radius; k < radius; k++) {
-                    for(int l = -radius; l < radius; l++) {
-                        float *I_i = (*I)(i + l, j + k);
-                        float *p_i = (*p)(i + l, j + k);
+            //covariance matrix of the guide
+            int k = 3;
 
-                        for(int n = 0; n < channels; n++) {
-                            tmp_A[n] += I_i[n] * p_i[c] - I_mean[n] * p_mean[c];
-                        }
-                    }
+            for(int n = 0; n < 3; n++) {
+                for(int m = n; m < 3; m++) {
+                    double val = (S[k] - S[n] * S[m] / N) / (N - 1.0);
+                    cov[n * 3 + m] = val;
+                    cov[m * 3 + n] = val;
+                    k++;
                 }
+            }
 
-                for(int n = 0; n < channels; n++) {
-                    tmp_A[n] /= nPixels;
-                }
+            //regularization
+            cov[0] += e_regularization;
+            cov[4] += e_regularization;
+            cov[8] += e_regularization;
 
-                //multiply for inverted matrix
-                inv.Mul(tmp_A, a);
+            //invert matrix
+            inv[0] = cov[4] * cov[8] - cov[5] * cov[7];
+            inv[1] = cov[2] * cov[7] - cov[1] * cov[8];
+            inv[2] = cov[1] * cov[5] - cov[2] * cov[4];
+            inv[3] = cov[5] * cov[6] - cov[3] * cov[8];
+            inv[4] = cov[0] * cov[8] - cov[2] * cov[6];
+            inv[5] = cov[2] * cov[3] - cov[0] * cov[5];
+            inv[6] = cov[3] * cov[7] - cov[4] * cov[6];
+            inv[7] = cov[1] * cov[6] - cov[0] * cov[7];
+            inv[8] = cov[0] * cov[4] - cov[1] * cov[3];
+
+            double det = cov[0] * inv[0] + cov[1] * inv[3] + cov[2] * inv[6];
+
+            for(int n = 0; n < 9; n++) {
+                inv[n] /= det;
+            }
 
-                float a_dot_I_mean = 0.0f;
+            for(int c = 0; c < channels; c++) {
+                double p_mean = S[9 + c] / N;
 
-                for(int n = 0; n < channels; n++) {
-                    a_dot_I_mean += a[n] * I_mean[n];
+                for(int n = 0; n < 3; n++) {
+                    tmp_A[n] = S[offIP + n * channels + c] / N - I_mean[n] * p_mean;
                 }
 
-                float b = p_mean[c] - a_dot_I_mean;
+                //multiply for inverted matrix
+                double a_dot_I = 0.0;
 
-                float a_dot_I = 0.0f;
+                for(int n = 0; n < 3; n++) {
+                    a[n] = inv[n * 3] * tmp_A[0] + inv[n * 3 + 1] * tmp_A[1] +
+                           inv[n * 3 + 2] * tmp_A[2];
 
-                for(int n = 0; n < channels; n++) {
-                    a_dot_I += a[n] * tmpI[n];
+                    a_dot_I += a[n] * (double(tmpI[n]) - I_mean[n]);
                 }
 
-                tmpQ[c] = a_dot_I + b;
+                tmpQ[c] = float(a_dot_I + p_mean);
             }
         }
     }
-
-    delete[] buf;
 }
 
 //Process in a box
@@ -25,6 +25,8 @@ See the GNU Lesser General Public License
 #ifndef PIC_FILTERING_FILTER_INTEGRAL_IMAGE
 #define PIC_FILTERING_FILTER_INTEGRAL_IMAGE
 
+#include <vector>
+
 #include "filtering/filter.hpp"
 
 namespace pic {
@@ -104,6 +106,120 @@ public:
     {
         return Process(imgIn, imgOut);
     }
+
+    /**
+     * @brief getNumberOfMoments returns the number of moments per pixel
+     * of a moment table.
+     * @param cI is the number of channels of I.
+     * @param cP is the number of channels of p; 0 if there is no p.
+     * @return
+     */
+    static int getNumberOfMoments(int cI, int cP)
+    {
+        return cI + (cI * (cI + 1)) / 2 + cP + cI * cP;
+    }
+
+    /**
+     * @brief ComputeMoments computes a double-precision summed-area table
+     * of the moments of I and p in the region [x0, x0 + w) x [y0, y0 + h);
+     * coordinates outside the images are clamped. For each pixel the
+     * moments are, in this order: I_n, I_n * I_m (with m >= n), p_c, and
+     * I_n * p_c.
+     * @param I
+     * @param p may be NULL.
+     * @param x0
+     * @param y0
+     * @param w
+     * @param h
+     * @param table is the output; it has (w + 1) x (h + 1) entries and
+     * the first row and the first column are zeros.
+     * @return It returns the number of moments per entry.
+     */
+    static int ComputeMoments(ImageRAW *I, ImageRAW *p, int x0, int y0,
+                              int w, int h, std::vector<double> &table)
+    {
+        int cI = I->channels;
+        int cP = (p != NULL) ? p->channels : 0;
+        int M = getNumberOfMoments(cI, cP);
+
+        int stride = (w + 1) * M;
+        table.assign(size_t(stride) * (h + 1), 0.0);
+
+        std::vector<double> row(M);
+
+        for(int j = 0; j < h; j++) {
+            double *prev = &table[j * stride];
+            double *cur  = &table[(j + 1) * stride];
+
+            for(int k = 0; k < M; k++) {
+                row[k] = 0.0;
+            }
+
+            for(int i = 0; i < w; i++) {
+                float *tmpI = (*I)(x0 + i, y0 + j);
+                int k = 0;
+
+                for(int n = 0; n < cI; n++) {
+                    row[k++] += tmpI[n];
+                }
+
+                for(int n = 0; n < cI; n++) {
+                    for(int m = n; m < cI; m++) {
+                        row[k++] += double(tmpI[n]) * double(tmpI[m]);
+                    }
+                }
+
+                if(p != NULL) {
+                    float *tmpP = (*p)(x0 + i, y0 + j);
+
+                    for(int c = 0; c < cP; c++) {
+                        row[k++] += tmpP[c];
+                    }
+
+                    for(int n = 0; n < cI; n++) {
+                        for(int c = 0; c < cP; c++) {
+                            row[k++] += double(tmpI[n]) * double(tmpP[c]);
+                        }
+                    }
+                }
+
+                int ind = (i + 1) * M;
+
+                for(int l = 0; l < M; l++) {
+                    cur[ind + l] = prev[ind + l] + row[l];
+                }
+            }
+        }
+
+        return M;
+    }
+
+    /**
+     * @brief SumMoments sums the moments of a table in [x0, x1) x [y0, y1),
+     * where coordinates are relative to the region of the table.
+     * @param table
+     * @param w is the width of the region of the table.
+     * @param M is the number of moments.
+     * @param x0
+     * @param y0
+     * @param x1
+     * @param y1
+     * @param out
+     */
+    static void SumMoments(const double *table, int w, int M, int x0, int y0,
+                           int x1, int y1, double *out)
+    {
+        int stride = (w + 1) * M;
+
+        const double *t00 = &table[y0 * stride + x0 * M];
+        const double *t01 = &table[y0 * stride + x1 * M];
+        const double *t10 = &table[y1 * stride + x0 * M];
+        const double *t11 = &table[y1 * stride + x1 * M];
+
+        for(int k = 0; k < M; k++) {
+            out[k] = t11[k] - t01[k] - t10[k] + t00[k];
+        }
+    }
 };
 
 } // end namespace pic
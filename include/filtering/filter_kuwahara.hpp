@@ -39,151 +39,118 @@ protected:
     unsigned int  halfKernelSize;
 
     /**
-     * @brief ProcessBBox
-     * @param dst
+     * @brief BoxStatistics computes mean and variance of src in
+     * [x0, x1) x [y0, y1) as Image::getStatistics does, i.e., sums in double
+     * shifted by the first pixel; the boxes are tiny so a direct loop is
+     * much cheaper than a generic reduction.
      * @param src
-     * @param box
+     * @param x0
+     * @param x1
+     * @param y0
+     * @param y1
+     * @param acc is an array of 2 * channels doubles.
+     * @param mean
+     * @param variance
      */
-    void ProcessBBox(ImageRAW *dst, ImageRAWVec src, BBox *box)
+    static void BoxStatistics(ImageRAW *src, int x0, int x1, int y0, int y1,
+                              double *acc, float *mean, float *variance)
     {
-        int channels = dst->channels;
-
-        ImageRAW *source = src[0];
+        int channels = src->channels;
+        double *s  = &acc[0];
+        double *s2 = &acc[channels];
 
-        float *buf = new float[channels * 8];
+        float *first = (*src)(x0, y0);
 
-        int start = 0;
-        float *m00 = &buf[start];
-        start += channels;
-        float *m10 = &buf[start];
-        start += channels;
-        float *m01 = &buf[start];
-        start += channels;
-        float *m11 = &buf[start];
-        start += channels;
-        float *s00 = &buf[start];
-        start += channels;
-        float *s10 = &buf[start];
-        start += channels;
-        float *s01 = &buf[start];
-        start += channels;
-        float *s11 = &buf[start];
-
-        for(int m = box->z0; m < box->z1; m++) {
-            for(int j = box->y0; j < box->y1; j++) {
-                for(int i = box->x0; i < box->x1; i++) {
-                    //1D Filtering
-                    float mean = FLT_MAX;
-                    int indx;
-                    float tmpMean;
-
-                    float *tmpDst = (*dst)(i, j, m);
-
-                    //First block
-                    BBox tmp00(i - halfKernelSize, i + 1, j - halfKernelSize, j + 1);
-                    source->getMeanVal(&tmp00, m00);
-                    source->getVarianceVal(m00, &tmp00, s00);
-
-                    tmpMean = 0.0f;
-
-                    for(int l = 0; l < channels; l++) {
-                        tmpMean += s00[l];
-                    }
+        for(int l = 0; l < channels; l++) {
+            s[l] = 0.0;
+            s2[l] = 0.0;
+        }
 
-                    if(tmpMean < mean) {
-                        mean = tmpMean;
-                        indx = 0;
-                    }
+        for(int j = y0; j < y1; j++) {
+            float *row = (*src)(0, j);
 
-                    //Second block
-                    BBox tmp01(i, i + halfKernelSize, j - halfKernelSize, j + 1);
-                    source->getMeanVal(&tmp01, m01);
-                    source->getVarianceVal(m01, &tmp01, s01);
+            for(int i = x0; i < x1; i++) {
+                float *tmp = row + CLAMP(i, src->width) * channels;
 
-                    tmpMean = 0.0f;
+                for(int l = 0; l < channels; l++) {
+                    double d = double(tmp[l]) - double(first[l]);
+                    s[l]  += d;
+                    s2[l] += d * d;
+                }
+            }
+        }
 
-                    for(int l = 0; l < channels; l++) {
-                        tmpMean += s01[l];
-                    }
+        double n = double((x1 - x0) * (y1 - y0));
+        double inv_n = 1.0 / n;
+        double inv_n1 = 1.0 / (n - 1.0);
 
-                    if(tmpMean < mean) {
-                        mean = tmpMean;
-                        indx = 1;
-                    }
+        for(int l = 0; l < channels; l++) {
+            mean[l] = float(s[l] * inv_n + double(first[l]));
+            variance[l] = float((s2[l] - s[l] * s[l] * inv_n) * inv_n1);
+        }
+    }
 
-                    //Third block
-                    BBox tmp10(i - halfKernelSize, i + 1, j, j + halfKernelSize);
-                    source->getMeanVal(&tmp10, m10);
-                    source->getVarianceVal(m10, &tmp10, s10);
+    /**
+     * @brief ProcessBBox
+     * @param dst
+     * @param src
+     * @param box
+     */
+    void ProcessBBox(ImageRAW *dst, ImageRAWVec src, BBox *box)
+    {
+        int channels = dst->channels;
 
-                    tmpMean = 0.0f;
+        ImageRAW *source = src[0];
 
-                    for(int l = 0; l < channels; l++) {
-                        tmpMean += s10[l];
-                    }
+        float *buf = new float[channels * 8];
+        double *acc = new double[channels * 2];
 
-                    if(tmpMean < mean) {
-                        mean = tmpMean;
-                        indx = 2;
-                    }
+        //means and variances of the four blocks
+        float *m[4], *s[4];
 
-                    //Fourth block
-                    BBox tmp11(i, i + halfKernelSize, j, j + halfKernelSize);
-                    source->getMeanVal(&tmp11, m11);
-                    source->getVarianceVal(m11, &tmp11, s11);
+        for(int k = 0; k < 4; k++) {
+            m[k] = &buf[k * channels];
+            s[k] = &buf[(k + 4) * channels];
+        }
 
-                    tmpMean = 0.0f;
+        int h = halfKernelSize;
 
-                    for(int l = 0; l < channels; l++) {
-                        tmpMean += s11[l];
-                    }
+        for(int t = box->z0; t < box->z1; t++) {
+            for(int j = box->y0; j < box->y1; j++) {
+                for(int i = box->x0; i < box->x1; i++) {
+                    BoxStatistics(source, i - h, i + 1, j - h, j + 1, acc, m[0], s[0]);
+                    BoxStatistics(source, i, i + h, j - h, j + 1, acc, m[1], s[1]);
+                    BoxStatistics(source, i - h, i + 1, j, j + h, acc, m[2], s[2]);
+                    BoxStatistics(source, i, i + h, j, j + h, acc, m[3], s[3]);
 
-                    if(tmpMean < mean) {
-                        mean = tmpMean;
-                        indx = 3;
-                    }
+                    //the block with the smallest variance
+                    float minVar = FLT_MAX;
+                    int indx = -1;
 
-                    //Final filtering
-                    switch(indx) {
-                    case 0: {
-                        for(int l = 0; l < channels; l++) {
-                            tmpDst[l] = m00[l];
-                        }
-                    }
-                    break;
+                    for(int k = 0; k < 4; k++) {
+                        float tmpVar = 0.0f;
 
-                    case 1: {
                         for(int l = 0; l < channels; l++) {
-                            tmpDst[l] = m01[l];
+                            tmpVar += s[k][l];
                         }
-                    }
-                    break;
 
-                    case 2: {
-                        for(int l = 0; l < channels; l++) {
-                            tmpDst[l] = m10[l];
+                        if(tmpVar < minVar) {
+                            minVar = tmpVar;
+                            indx = k;
                         }
                     }
-                    break;
 
-                    case 3: {
-                        for(int l = 0; l < channels; l++) {
-                            tmpDst[l] = m11[l];
-                        }
-                    }
-                    break;
+                    float *tmpDst = (*dst)(i, j, t);
+                    float *tmpSrc = (indx >= 0) ? m[indx] : (*source)(i, j, t);
 
-                    default: {
-                        float *tmpSrc = (*source)(i, j, m);
-                        for(int l = 0; l < channels; l++) {
-                            tmpDst[l] = tmpSrc[l];
-                        }
-                    }break;
+                    for(int l = 0; l < channels; l++) {
+                        tmpDst[l] = tmpSrc[l];
                     }
                 }
             }
         }
 
+        delete[] acc;
         delete[] buf;
     }
 
@@ -26,6 +26,7 @@ See the GNU Lesser General Public License
 #define PIC_FILTERING_FILTER_LINEAR_COLOR_SPACE_HPP
 
 #include "filtering/filter.hpp"
+#include "colors/color_conv.hpp"
 
 namespace pic {
 
@@ -46,6 +47,15 @@ protected:
         int channels = src[0]->channels;
         float *data  = src[0]->data;
 
+        if(channels == 3) {
+            for(int j = box->y0; j < box->y1; j++) {
+                int c1 = (j * width + box->x0) * channels;
+                ColorConv::applyRow(matrix, &data[c1], &dst->data[c1], box->x1 - box->x0);
+            }
+
+            return;
+        }
+
         for(int j = box->y0; j < box->y1; j++) {
             int c = j * width;
 
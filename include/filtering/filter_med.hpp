@@ -25,60 +25,19 @@ See the GNU Lesser General Public License
 #ifndef PIC_FILTERING_FILTER_MED_HPP
 #define PIC_FILTERING_FILTER_MED_HPP
 
-#include "filtering/filter.hpp"
+#include "filtering/filter_rank.hpp"
 
 namespace pic {
 
-class FilterMed: public Filter
+/**
+ * @brief The FilterMed class is a median filter; see FilterRank.
+ */
+class FilterMed: public FilterRank
 {
-protected:
-    int halfSize;
-
-    //Process in a box
-    void ProcessBBox(ImageRAW *dst, ImageRAWVec src, BBox *box)
-    {
-        int width = dst->width;
-        int i, j, k, l, ch, c, c2;
-        int ci, cj;
-
-        float *data = src[0]->data;
-        int areaKernel = (halfSize * 2 + 1) * (halfSize * 2 + 1);
-        float *values = new float[areaKernel];
-
-        int channels = dst->channels;
-
-        for(j = box->y0; j < box->y1; j++) {
-            for(i = box->x0; i < box->x1; i++) {
-                //Central weight
-                c = (j * width + i) * channels;
-
-                for(ch = 0; ch < channels; ch++) {
-                    c2 = 0;
-
-                    for(k = -halfSize; k <= halfSize; k++) {
-                        ci = CLAMP((i + k), dst->width);
-
-                        for(l = -halfSize; l <= halfSize; l++) {
-                            cj = CLAMP((j + l), dst->height);
-                            values[c2] = data[(cj * width + ci) * channels + ch];
-                            c2++;
-                        }
-                    }
-
-                    std::sort(values, values + areaKernel);
-                    dst->data[c + ch] = values[areaKernel >> 1];
-                }
-            }
-        }
-
-        delete[] values;
-    }
-
 public:
     //Basic constructor
-    FilterMed(int size)
+    FilterMed(int size) : FilterRank(size, 0.5f)
     {
-        this->halfSize = checkHalfSize(size);
     }
 
     static ImageRAW *Execute(ImageRAW *imgIn, ImageRAW *imgOut, int size)
@@ -29,6 +29,9 @@ See the GNU Lesser General Public License
 
 namespace pic {
 
+//tiles for fused passes are larger for amortizing the halo
+#define FUSED_TILE_SIZE 128
+
 /**
  * @brief The FilterNPasses class
  */
@@ -38,10 +41,32 @@ protected:
     ImageRAW	*imgTmpSame[2];
     ImageRAWVec imgTmp;
 
-    bool        bSame;
+    bool        bSame, bFused;
+
+    //per-worker scratch tiles for the fused mode
+    ImageRAWVec scratch;
+    int         scratchSize, scratchChannels;
 
     void CheckSame(ImageRAWVec imgIn);
 
+    /**
+     * @brief getFusedHalo returns the sum of the kernel radii of all passes.
+     * @param imgIn
+     * @return It returns -1 if the passes cannot be fused.
+     */
+    int getFusedHalo(ImageRAWVec &imgIn);
+
+    /**
+     * @brief ProcessFusedTile runs all passes on a tile plus its halo
+     * into a scratch buffer, and it copies the result into imgOut.
+     * @param imgIn
+     * @param imgOut
+     * @param tile
+     * @param halo
+     */
+    void ProcessFusedTile(ImageRAWVec &imgIn, ImageRAW *imgOut, Tile &tile,
+                          int halo);
+
 public:
 
     /**
@@ -56,6 +81,28 @@ public:
      */
     void Destroy();
 
+    /**
+     * @brief SetFused enables the fused execution of passes. When all
+     * passes have a known kernel radius (see Filter::getKernelRadius),
+     * each worker runs all passes on a tile plus its halo in a cache
+     * resident scratch buffer, without full-frame intermediates.
+     * Filters that cannot be fused fall back to the pass-by-pass mode.
+     * @param bFused
+     */
+    void SetFused(bool bFused)
+    {
+        this->bFused = bFused;
+    }
+
+    /**
+     * @brief ProcessFused
+     * @param imgIn
+     * @param imgOut
+     * @param parallel
+     * @return
+     */
+    ImageRAW *ProcessFused(ImageRAWVec imgIn, ImageRAW *imgOut, bool parallel);
+
     /**
      * @brief PreProcess
      * @param imgIn
@@ -124,6 +171,10 @@ public:
 PIC_INLINE FilterNPasses::FilterNPasses()
 {
     bSame = true;
+    bFused = false;
+
+    scratchSize = 0;
+    scratchChannels = 0;
 
     for(int i = 0; i < 2; i++) {
         imgTmpSame[i] = NULL;
@@ -155,6 +206,14 @@ PIC_INLINE void FilterNPasses::Destroy()
     }
 
     imgTmp.clear();
+
+    for(unsigned int i = 0; i < scratch.size(); i++) {
+        delete scratch[i];
+    }
+
+    scratch.clear();
+    scratchSize = 0;
+    scratchChannels = 0;
 }
 
 PIC_INLINE void FilterNPasses::CheckSame(ImageRAWVec imgIn)
@@ -187,6 +246,10 @@ PIC_INLINE void FilterNPasses::InsertFilter(Filter *flt)
             InsertFilter(flt->filters[i]);
         }
     } else {
+        if(maxThreads > 0) {
+            flt->SetMaxThreads(maxThreads);
+        }
+
         filters.push_back(flt);
     }
 }
@@ -301,6 +364,164 @@ PIC_INLINE ImageRAW *FilterNPasses::ProcessSame(ImageRAWVec imgIn, ImageRAW *img
     return imgOut;
 }
 
+PIC_INLINE int FilterNPasses::getFusedHalo(ImageRAWVec &imgIn)
+{
+    if((imgIn.size() != 1) || (imgIn[0]->frames != 1) || (filters.size() < 2)) {
+        return -1;
+    }
+
+    int halo = 0;
+
+    for(unsigned int i = 0; i < filters.size(); i++) {
+        int radius = filters[i]->getKernelRadius();
+
+        if(radius < 0) {
+            return -1;
+        }
+
+        halo += radius;
+    }
+
+    //the halo has to fit a tile
+    if(halo > FUSED_TILE_SIZE) {
+        return -1;
+    }
+
+    return halo;
+}
+
+PIC_INLINE void FilterNPasses::ProcessFusedTile(ImageRAWVec &imgIn,
+        ImageRAW *imgOut, Tile &tile, int halo)
+{
+    int index = ThreadPool::getWorkerIndex() * 2;
+    ImageRAW *tmp[2] = {scratch[index], scratch[index + 1]};
+
+    ImageRAW *src = imgIn[0];
+    int channels = src->channels;
+
+    //the scratch origin is at (x0, y0) in image coordinates
+    int x0 = tile.startX - halo;
+    int y0 = tile.startY - halo;
+    int sw = tile.width  + halo * 2;
+    int sh = tile.height + halo * 2;
+
+    //interior columns are copied per row; borders are clamped
+    int ix0 = MAX(x0, 0);
+    int ix1 = MIN(x0 + sw, src->width);
+    size_t rowBytes = sizeof(float) * (ix1 - ix0) * channels;
+
+    for(int j = 0; j < sh; j++) {
+        float *row_src = (*src)(0, y0 + j);
+        float *row_dst = (*tmp[0])(0, j);
+
+        memcpy(row_dst + (ix0 - x0) * channels, row_src + ix0 * channels, rowBytes);
+
+        for(int i = 0; i < (ix0 - x0); i++) {
+            memcpy(row_dst + i * channels, row_src, sizeof(float) * channels);
+        }
+
+        for(int i = (ix1 - x0); i < sw; i++) {
+            memcpy(row_dst + i * channels, row_src + (src->width - 1) * channels,
+                   sizeof(float) * channels);
+        }
+    }
+
+    int remaining = halo;
+    BBox box;
+
+    for(unsigned int p = 0; p < filters.size(); p++) {
+        remaining -= filters[p]->getKernelRadius();
+
+        int bx0 = halo - remaining;
+        int by0 = halo - remaining;
+        int bx1 = bx0 + tile.width  + remaining * 2;
+        int by1 = by0 + tile.height + remaining * 2;
+
+        box.SetBox(bx0, bx1, by0, by1, 0, 1, scratchSize, scratchSize, 1);
+        filters[p]->ProcessBBoxPass(tmp[1], Single(tmp[0]), &box, p, 1);
+
+        //pixels outside the image are set as their clamped counterparts
+        //like in the pass-by-pass mode
+        if(remaining > 0) {
+            for(int j = by0; j < by1; j++) {
+                int cj = CLAMP(y0 + j, src->height) - y0;
+
+                for(int i = bx0; i < bx1; i++) {
+                    int ci = CLAMP(x0 + i, src->width) - x0;
+
+                    if((ci == i) && (cj == j)) {
+                        continue;
+                    }
+
+                    float *tmp_src = (*tmp[1])(ci, cj);
+                    float *tmp_dst = (*tmp[1])(i, j);
+
+                    for(int k = 0; k < channels; k++) {
+                        tmp_dst[k] = tmp_src[k];
+                    }
+                }
+            }
+        }
+
+        ImageRAW *swp = tmp[0];
+        tmp[0] = tmp[1];
+        tmp[1] = swp;
+    }
+
+    for(int j = 0; j < tile.height; j++) {
+        memcpy((*imgOut)(tile.startX, tile.startY + j), (*tmp[0])(halo, j + halo),
+               sizeof(float) * tile.width * channels);
+    }
+}
+
+PIC_INLINE ImageRAW *FilterNPasses::ProcessFused(ImageRAWVec imgIn,
+        ImageRAW *imgOut, bool parallel = false)
+{
+    int halo = getFusedHalo(imgIn);
+
+    if(halo < 0) {
+        return NULL;
+    }
+
+    imgOut = SetupAux(imgIn, imgOut);
+
+    //serial calls may run inside a worker of the pool too
+    int nWorkers = ThreadPool::getInstance()->getMaxThreads();
+    int size = FUSED_TILE_SIZE + halo * 2;
+
+    if((scratchSize != size) || (scratchChannels != imgIn[0]->channels) ||
+       (int(scratch.size()) < (nWorkers * 2))) {
+        for(unsigned int i = 0; i < scratch.size(); i++) {
+            delete scratch[i];
+        }
+
+        scratch.clear();
+
+        for(int i = 0; i < (nWorkers * 2); i++) {
+            scratch.push_back(new ImageRAW(1, size, size, imgIn[0]->channels));
+        }
+
+        scratchSize = size;
+        scratchChannels = imgIn[0]->channels;
+    }
+
+    TileList lst(FUSED_TILE_SIZE, imgOut->width, imgOut->height);
+
+    auto task = [&](unsigned int i) {
+        ProcessFusedTile(imgIn, imgOut, lst.tiles[i], halo);
+    };
+
+    if(parallel) {
+        ThreadPool::Execute(lst.tiles.size(), task, maxThreads);
+    } else {
+        for(unsigned int i = 0; i < lst.tiles.size(); i++) {
+            task(i);
+        }
+    }
+
+    return imgOut;
+}
+
 PIC_INLINE ImageRAW *FilterNPasses::Process(ImageRAWVec imgIn, 
         ImageRAW *imgOut, bool parallel = false)
 {
@@ -308,6 +529,10 @@ PIC_INLINE ImageRAW *FilterNPasses::Process(ImageRAWVec imgIn,
 
     CheckSame(imgIn);
 
+    if(bSame && bFused && (imgOut != imgIn[0]) && (getFusedHalo(imgIn) >= 0)) {
+        return ProcessFused(imgIn, imgOut, parallel);
+    }
+
     if(bSame) {
         return ProcessSame(imgIn, imgOut, parallel);
     } else {
@@ -0,0 +1,578 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+PICCANTE is free software; you can redistribute it and/or modify
+under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation; either version 3.0 of
+the License, or (at your option) any later version.
+
+PICCANTE is distributed in the hope that it will be useful, but
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU Lesser General Public License
+( http://www.gnu.org/licenses/lgpl-3.0.html ) for more details.
+
+*/
+
+#ifndef PIC_FILTERING_FILTER_RANK_HPP
+#define PIC_FILTERING_FILTER_RANK_HPP
+
+#include <vector>
+#include <algorithm>
+
+#include "filtering/filter.hpp"
+#include "util/image_percentile.hpp"
+
+namespace pic {
+
+//number of levels of the two-level histogram (coarse x fine)
+#define RANK_COARSE_BINS 64
+#define RANK_FINE_BINS   64
+#define RANK_BINS        (RANK_COARSE_BINS * RANK_FINE_BINS)
+
+//bits of a digit of the radix sort
+#define RANK_RADIX_BITS  11
+
+/**
+ * @brief The FilterRank class is a percentile (rank) filter for float images.
+ * It is based on the constant time median filter of Perreault and Hebert
+ * (column histograms and a two-level kernel histogram). Each channel is
+ * quantized once per image: values are radix sorted and replaced by their
+ * ranks. Then, the image is split in tiles whose side grows with the
+ * radius; ranks of a tile plus its border are radix sorted (linear time)
+ * and mapped to RANK_BINS equally populated bins. The histogram gives the
+ * bin of the wanted rank, and the exact value is then found among the few
+ * ranks of that bin. Results are exact; the per-pixel cost is
+ * O(RANK_COARSE_BINS + RANK_FINE_BINS) for the histograms plus
+ * O(r^2 / RANK_BINS) for finding the exact value, where r is the radius.
+ */
+class FilterRank: public Filter
+{
+protected:
+    int   halfSize;
+    float percentile;
+
+    /**
+     * @brief The Scratch struct is the memory of a worker; it is allocated
+     * once per call and column histograms are left empty after each tile.
+     */
+    struct Scratch
+    {
+        std::vector<unsigned int>   key, tmpKey;
+        std::vector<int>            order, tmpOrder;
+        std::vector<unsigned short> bin, colCoarse, colFine;
+        std::vector<int>            kerFine, iniFine;
+
+        void Init(int rw, int rh)
+        {
+            int M = rw * rh;
+
+            if(int(key.size()) < M) {
+                key.resize(M);
+                tmpKey.resize(M);
+                order.resize(M);
+                tmpOrder.resize(M);
+                bin.resize(M);
+            }
+
+            if(int(colCoarse.size()) < (rw * RANK_COARSE_BINS)) {
+                colCoarse.resize(rw * RANK_COARSE_BINS, 0);
+                colFine.resize(rw * RANK_BINS, 0);
+            }
+
+            kerFine.resize(RANK_BINS);
+            iniFine.resize(RANK_BINS);
+        }
+    };
+
+    /**
+     * @brief RadixSort sorts key[0..n) and applies the same permutation to
+     * order; the sort is stable. Results are in key and order.
+     * @param s
+     * @param n
+     * @param nBits is the number of significant bits of the keys.
+     */
+    static void RadixSort(Scratch &s, int n, int nBits);
+
+    /**
+     * @brief getTileSize
+     * @return It returns the side of a tile; it grows with the radius,
+     * so the border of a tile does not dominate its cost.
+     */
+    int getTileSize()
+    {
+        return MAX(TILE_SIZE, halfSize);
+    }
+
+    /**
+     * @brief ProcessTile filters a tile; s.key has to contain the sortable
+     * keys of the tile plus its border of halfSize pixels.
+     * @param dst
+     * @param x0
+     * @param y0
+     * @param w
+     * @param h
+     * @param z
+     * @param ch
+     * @param s
+     * @param nBits is the number of significant bits of the keys.
+     * @param values maps a key to its value; if it is NULL, keys are
+     * ImagePercentile::Key of the values.
+     */
+    void ProcessTile(ImageRAW *dst, int x0, int y0, int w, int h, int z,
+                     int ch, Scratch &s, int nBits, const float *values);
+
+    /**
+     * @brief ProcessBBox filters a box on its own; values are sorted per
+     * tile. Process and ProcessP share the quantization of the whole image.
+     * @param dst
+     * @param src
+     * @param box
+     */
+    void ProcessBBox(ImageRAW *dst, ImageRAWVec src, BBox *box);
+
+    /**
+     * @brief ProcessAux
+     * @param imgIn
+     * @param imgOut
+     * @param maxThreads
+     * @return
+     */
+    ImageRAW *ProcessAux(ImageRAWVec &imgIn, ImageRAW *imgOut, int maxThreads);
+
+public:
+
+    /**
+     * @brief FilterRank
+     * @param size is the size of the kernel.
+     * @param percentile is the rank in [0, 1] of the output value inside
+     * the kernel; e.g. 0.5 is the median, 0.0 is the minimum, and 1.0 is
+     * the maximum.
+     */
+    FilterRank(int size, float percentile)
+    {
+        this->halfSize = checkHalfSize(size);
+        this->percentile = CLAMPi(percentile, 0.0f, 1.0f);
+    }
+
+    /**
+     * @brief getKernelRadius
+     * @return
+     */
+    int getKernelRadius()
+    {
+        return halfSize;
+    }
+
+    /**
+     * @brief Process
+     * @param imgIn
+     * @param imgOut
+     * @return
+     */
+    ImageRAW *Process(ImageRAWVec imgIn, ImageRAW *imgOut)
+    {
+        return ProcessAux(imgIn, imgOut, 1);
+    }
+
+    /**
+     * @brief ProcessP filters tiles in parallel.
+     * @param imgIn
+     * @param imgOut
+     * @return
+     */
+    ImageRAW *ProcessP(ImageRAWVec imgIn, ImageRAW *imgOut)
+    {
+        return ProcessAux(imgIn, imgOut, maxThreads);
+    }
+
+    /**
+     * @brief Execute
+     * @param imgIn
+     * @param imgOut
+     * @param size
+     * @param percentile
+     * @return
+     */
+    static ImageRAW *Execute(ImageRAW *imgIn, ImageRAW *imgOut, int size,
+                             float percentile)
+    {
+        FilterRank filter(size, percentile);
+        return filter.ProcessP(Single(imgIn), imgOut);
+    }
+};
+
+PIC_INLINE void FilterRank::RadixSort(Scratch &s, int n, int nBits)
+{
+    unsigned int *key = &s.key[0];
+    unsigned int *tmpKey = &s.tmpKey[0];
+    int *order = &s.order[0];
+    int *tmpOrder = &s.tmpOrder[0];
+
+    int count[1 << RANK_RADIX_BITS];
+    unsigned int mask = (1 << RANK_RADIX_BITS) - 1;
+
+    for(int shift = 0; shift < nBits; shift += RANK_RADIX_BITS) {
+        for(int d = 0; d <= int(mask); d++) {
+            count[d] = 0;
+        }
+
+        for(int i = 0; i < n; i++) {
+            count[(key[i] >> shift) & mask]++;
+        }
+
+        int sum = 0;
+
+        for(int d = 0; d <= int(mask); d++) {
+            int tmp = count[d];
+            count[d] = sum;
+            sum += tmp;
+        }
+
+        for(int i = 0; i < n; i++) {
+            int k = count[(key[i] >> shift) & mask]++;
+            tmpKey[k] = key[i];
+            tmpOrder[k] = order[i];
+        }
+
+        std::swap(key, tmpKey);
+        std::swap(order, tmpOrder);
+    }
+
+    //an odd number of passes leaves the results in the temporary buffers
+    if(key != &s.key[0]) {
+        memcpy(&s.key[0], key, n * sizeof(unsigned int));
+        memcpy(&s.order[0], order, n * sizeof(int));
+    }
+}
+
+PIC_INLINE ImageRAW *FilterRank::ProcessAux(ImageRAWVec &imgIn, ImageRAW *imgOut,
+        int maxThreads)
+{
+    if(imgIn[0] == NULL) {
+        return NULL;
+    }
+
+    ImageRAW *src = imgIn[0];
+    imgOut = SetupAux(imgIn, imgOut);
+
+    int width = src->width;
+    int height = src->height;
+    int channels = src->channels;
+    int n = width * height;
+
+    int nBits = 0;
+
+    while((nBits < 32) && ((1u << nBits) < (unsigned int)(n))) {
+        nBits++;
+    }
+
+    int T = getTileSize();
+    int nx = (width + T - 1) / T;
+    int ny = (height + T - 1) / T;
+    int rw = T + halfSize * 2;
+
+    std::vector<unsigned int> rank(n);
+    std::vector<float> values(n);
+
+    Scratch global;
+    global.key.resize(n);
+    global.tmpKey.resize(n);
+    global.order.resize(n);
+    global.tmpOrder.resize(n);
+
+    std::vector<Scratch> scratch(ThreadPool::getInstance()->getMaxThreads());
+
+    for(int z = 0; z < src->frames; z++) {
+        float *data = &src->data[z * src->tstride];
+
+        for(int ch = 0; ch < channels; ch++) {
+            //quantization: values are replaced by their ranks
+            for(int i = 0; i < n; i++) {
+                global.key[i] = ImagePercentile::Key(data[i * channels + ch]);
+                global.order[i] = i;
+            }
+
+            RadixSort(global, n, 32);
+
+            for(int k = 0; k < n; k++) {
+                rank[global.order[k]] = (unsigned int)(k);
+                values[k] = ImagePercentile::Value(global.key[k]);
+            }
+
+            ThreadPool::Execute(nx * ny, [&](unsigned int t) {
+                Scratch &s = scratch[ThreadPool::getWorkerIndex()];
+                s.Init(rw, rw);
+
+                int x0 = (t % nx) * T;
+                int y0 = (t / nx) * T;
+                int w = MIN(T, width - x0);
+                int h = MIN(T, height - y0);
+
+                //gathering with clamped coordinates
+                int tw = w + halfSize * 2;
+                int th = h + halfSize * 2;
+
+                for(int j = 0; j < th; j++) {
+                    //ranks follow the stored order of rows
+                    unsigned int *row = &rank[src->Row(y0 - halfSize + j) * width];
+
+                    for(int i = 0; i < tw; i++) {
+                        int x = x0 - halfSize + i;
+                        s.key[j * tw + i] = row[CLAMP(x, width)];
+                    }
+                }
+
+                ProcessTile(imgOut, x0, y0, w, h, z, ch, s, nBits, &values[0]);
+            }, maxThreads);
+        }
+    }
+
+    return imgOut;
+}
+
+PIC_INLINE void FilterRank::ProcessBBox(ImageRAW *dst, ImageRAWVec src, BBox *box)
+{
+    int T = getTileSize();
+
+    Scratch s;
+
+    for(int z = box->z0; z < box->z1; z++) {
+        for(int j = box->y0; j < box->y1; j += T) {
+            int h = MIN(T, box->y1 - j);
+
+            for(int i = box->x0; i < box->x1; i += T) {
+                int w = MIN(T, box->x1 - i);
+
+                int tw = w + halfSize * 2;
+                int th = h + halfSize * 2;
+                s.Init(tw, th);
+
+                for(int ch = 0; ch < src[0]->channels; ch++) {
+                    //gathering with clamped coordinates
+                    for(int y = 0; y < th; y++) {
+                        for(int x = 0; x < tw; x++) {
+                            float value = (*src[0])(i - halfSize + x, j - halfSize + y, z)[ch];
+                            s.key[y * tw + x] = ImagePercentile::Key(value);
+                        }
+                    }
+
+                    ProcessTile(dst, i, j, w, h, z, ch, s, 32, NULL);
+                }
+            }
+        }
+    }
+}
+
+PIC_INLINE void FilterRank::ProcessTile(ImageRAW *dst, int x0, int y0, int w,
+                                        int h, int z, int ch, Scratch &s,
+                                        int nBits, const float *values)
+{
+    int r  = halfSize;
+    int ks = r * 2 + 1;
+
+    //the region is the tile plus its border
+    int rw = w + r * 2;
+    int rh = h + r * 2;
+    int M  = rw * rh;
+
+    int N = ks * ks;
+    int kth = int(percentile * float(N - 1) + 0.5f);
+
+    //adaptive quantization: equally populated bins of ranks
+    for(int i = 0; i < M; i++) {
+        s.order[i] = i;
+    }
+
+    RadixSort(s, M, nBits);
+
+    unsigned int *key = &s.key[0];
+    int *order = &s.order[0];
+    unsigned short *bin = &s.bin[0];
+
+    for(int k = 0; k < M; k++) {
+        bin[order[k]] = (unsigned short)((long long)(k) * RANK_BINS / M);
+    }
+
+    unsigned short *colCoarse = &s.colCoarse[0];
+    unsigned short *colFine = &s.colFine[0];
+    int *kerFine = &s.kerFine[0];
+
+    //kernel histograms of the first window of a row, i.e., columns [0, ks)
+    int *iniFine = &s.iniFine[0];
+    int iniCoarse[RANK_COARSE_BINS];
+    int kerCoarse[RANK_COARSE_BINS];
+
+    std::fill(s.iniFine.begin(), s.iniFine.end(), 0);
+
+    for(int b = 0; b < RANK_COARSE_BINS; b++) {
+        iniCoarse[b] = 0;
+    }
+
+    //last column window start for which the fine segment is valid
+    int luc[RANK_COARSE_BINS];
+
+    //column histograms for the first kernel row
+    for(int j = 0; j < (ks - 1); j++) {
+        for(int i = 0; i < rw; i++) {
+            int b = bin[j * rw + i];
+            colCoarse[i * RANK_COARSE_BINS + b / RANK_FINE_BINS]++;
+            colFine[i * RANK_BINS + b]++;
+
+            if(i < ks) {
+                iniCoarse[b / RANK_FINE_BINS]++;
+                iniFine[b]++;
+            }
+        }
+    }
+
+    for(int j = 0; j < h; j++) {
+        //column histograms slide down: rows [j, j + ks)
+        int jAdd = j + ks - 1;
+
+        for(int i = 0; i < rw; i++) {
+            int b = bin[jAdd * rw + i];
+            colCoarse[i * RANK_COARSE_BINS + b / RANK_FINE_BINS]++;
+            colFine[i * RANK_BINS + b]++;
+
+            if(i < ks) {
+                iniCoarse[b / RANK_FINE_BINS]++;
+                iniFine[b]++;
+            }
+        }
+
+        if(j > 0) {
+            int jSub = j - 1;
+
+            for(int i = 0; i < rw; i++) {
+                int b = bin[jSub * rw + i];
+                colCoarse[i * RANK_COARSE_BINS + b / RANK_FINE_BINS]--;
+                colFine[i * RANK_BINS + b]--;
+
+                if(i < ks) {
+                    iniCoarse[b / RANK_FINE_BINS]--;
+                    iniFine[b]--;
+                }
+            }
+        }
+
+        for(int b = 0; b < RANK_COARSE_BINS; b++) {
+            kerCoarse[b] = iniCoarse[b];
+            luc[b] = -ks - 1;
+        }
+
+        for(int i = 0; i < w; i++) {
+            if(i > 0) {
+                unsigned short *cAdd = &colCoarse[(i + ks - 1) * RANK_COARSE_BINS];
+                unsigned short *cSub = &colCoarse[(i - 1) * RANK_COARSE_BINS];
+
+                for(int b = 0; b < RANK_COARSE_BINS; b++) {
+                    kerCoarse[b] += int(cAdd[b]) - int(cSub[b]);
+                }
+            }
+
+            //coarse bin of the k-th element
+            int cb = 0;
+            int count = kth;
+
+            while(count >= kerCoarse[cb]) {
+                count -= kerCoarse[cb];
+                cb++;
+            }
+
+            //lazy update of the fine segment of cb
+            int *fine = &kerFine[cb * RANK_FINE_BINS];
+
+            if((luc[cb] < 0) && ((i * 2) < ks)) {
+                int *ini = &iniFine[cb * RANK_FINE_BINS];
+
+                for(int f = 0; f < RANK_FINE_BINS; f++) {
+                    fine[f] = ini[f];
+                }
+
+                luc[cb] = 0;
+            }
+
+            if((i - luc[cb]) >= ks) {
+                for(int f = 0; f < RANK_FINE_BINS; f++) {
+                    fine[f] = 0;
+                }
+
+                for(int c = i; c < (i + ks); c++) {
+                    unsigned short *col = &colFine[c * RANK_BINS + cb * RANK_FINE_BINS];
+
+                    for(int f = 0; f < RANK_FINE_BINS; f++) {
+                        fine[f] += col[f];
+                    }
+                }
+            } else {
+                for(int c = luc[cb]; c < i; c++) {
+                    unsigned short *cAdd = &colFine[(c + ks) * RANK_BINS + cb * RANK_FINE_BINS];
+                    unsigned short *cSub = &colFine[c * RANK_BINS + cb * RANK_FINE_BINS];
+
+                    for(int f = 0; f < RANK_FINE_BINS; f++) {
+                        fine[f] += int(cAdd[f]) - int(cSub[f]);
+                    }
+                }
+            }
+
+            luc[cb] = i;
+
+            //fine bin of the k-th element
+            int fb = 0;
+
+            while(count >= fine[fb]) {
+                count -= fine[fb];
+                fb++;
+            }
+
+            int gb = cb * RANK_FINE_BINS + fb;
+
+            //exact value: the count-th rank of the bin inside the kernel
+            int k0 = int(((long long)(gb) * M + RANK_BINS - 1) / RANK_BINS);
+            int k1 = int(((long long)(gb + 1) * M + RANK_BINS - 1) / RANK_BINS);
+
+            int kOut = k0;
+
+            for(int k = k0; k < k1; k++) {
+                int p  = order[k];
+                int px = p % rw;
+                int py = p / rw;
+
+                if((px >= i) && (px < (i + ks)) && (py >= j) && (py < (j + ks))) {
+                    if(count == 0) {
+                        kOut = k;
+                        break;
+                    }
+
+                    count--;
+                }
+            }
+
+            (*dst)(x0 + i, y0 + j, z)[ch] = (values != NULL) ? values[key[kOut]] :
+                                            ImagePercentile::Value(key[kOut]);
+        }
+    }
+
+    //the column histograms are left empty for the next tile
+    for(int j = h - 1; j < (h + ks - 1); j++) {
+        for(int i = 0; i < rw; i++) {
+            int b = bin[j * rw + i];
+            colCoarse[i * RANK_COARSE_BINS + b / RANK_FINE_BINS]--;
+            colFine[i * RANK_BINS + b]--;
+        }
+    }
+}
+
+} // end namespace pic
+
+#endif /* PIC_FILTERING_FILTER_RANK_HPP */
+
@@ -51,6 +51,10 @@ public:
     FilterSigmoidTMO(SIGMOID_MODE type, float alpha, float wp, float epsilon,
                      bool temporal);
 
+    //Update
+    void Update(SIGMOID_MODE type, float alpha, float wp, float epsilon,
+                bool temporal);
+
     static ImageRAW *Execute(ImageRAW *imgIn, ImageRAW *imgOut)
     {
         FilterSigmoidTMO filter;
@@ -79,6 +83,12 @@ FilterSigmoidTMO::FilterSigmoidTMO()
 
 FilterSigmoidTMO::FilterSigmoidTMO(SIGMOID_MODE type, float alpha,
                                    float wp = 1e9f, float epsilon = -1.0f, bool temporal = false)
+{
+    Update(type, alpha, wp, epsilon, temporal);
+}
+
+void FilterSigmoidTMO::Update(SIGMOID_MODE type, float alpha,
+                              float wp = 1e9f, float epsilon = -1.0f, bool temporal = false)
 {
     this->type = type;
     this->alpha = alpha;
@@ -95,11 +105,11 @@ float FilterSigmoidTMO::CalculateEpsilon(ImageRAWVec imgIn)
 
     switch(type) {
     case SIG_TMO:
-        tmpEpsilon = imgIn[0]->getLogMeanVal(NULL, NULL)[0];
+        tmpEpsilon = imgIn[0]->getStatistics(IS_LOG_MEAN).logMeanVal[0];
         break;
 
     case SIG_TMO_WP:
-        tmpEpsilon = imgIn[0]->getLogMeanVal(NULL, NULL)[0];
+        tmpEpsilon = imgIn[0]->getStatistics(IS_LOG_MEAN).logMeanVal[0];
         break;
 
     case SIG_SDM:
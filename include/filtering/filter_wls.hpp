@@ -26,17 +26,19 @@ See the GNU Lesser General Public License
 #define PIC_FILTERING_FILTER_WLS_HPP
 
 #include "filtering/filter.hpp"
+#include "algorithms/weighted_laplacian_solver.hpp"
 
 #ifndef PIC_DISABLE_EIGEN
-
 #include "externals/Eigen/Sparse"
 #include "externals/Eigen/src/SparseCore/SparseMatrix.h"
+#endif
 
 namespace pic {
 
 class FilterWLS: public Filter
 {
 protected:
+#ifndef PIC_DISABLE_EIGEN
     /**WLSFilter: smoothing WLS filter for gray-scale images*/
     ImageRAW *SingleChannel(ImageRAWVec imgIn, ImageRAW *imgOut)
     {
@@ -144,7 +146,9 @@ protected:
         int height = img->height;
         int tot    = height * width;
 
-        alpha /= 2.0f;
+        //diff is squared, so ||d||^alpha is diff^(alpha / 2); alpha is
+        //not changed, otherwise each call would halve it
+        float alphaDist = alpha * 0.5f;
 
         int stridex = width * img->channels;
 
@@ -174,7 +178,7 @@ protected:
                         diff += tmpDiff * tmpDiff;
                     }
 
-                    tmp  = -lambda / (powf(diff, alpha) + epsilon);
+                    tmp  = -lambda / (powf(diff, alphaDist) + epsilon);
 
                     tL.push_back(Eigen::Triplet< double > (indI, indI - width , tmp));
 
@@ -190,7 +194,7 @@ protected:
                         diff += tmpDiff * tmpDiff;
                     }
 
-                    tmp  = -lambda / (powf(diff, alpha) + epsilon);
+                    tmp  = -lambda / (powf(diff, alphaDist) + epsilon);
                     tL.push_back(Eigen::Triplet< double > (indI, indI + width , tmp));
                     sum += tmp;
                 }
@@ -204,7 +208,7 @@ protected:
                         diff += tmpDiff * tmpDiff;
                     }
 
-                    tmp  = -lambda / (powf(diff, alpha) + epsilon);
+                    tmp  = -lambda / (powf(diff, alphaDist) + epsilon);
                     tL.push_back(Eigen::Triplet< double > (indI, indI - 1 , tmp));
                     sum += tmp;
                 }
@@ -218,7 +222,7 @@ protected:
                         diff += tmpDiff * tmpDiff;
                     }
 
-                    tmp  = -lambda / (powf(diff, alpha) + epsilon);
+                    tmp  = -lambda / (powf(diff, alphaDist) + epsilon);
 
                     tL.push_back(Eigen::Triplet< double > (indI, indI + 1 , tmp));
                     sum += tmp;
@@ -271,21 +275,70 @@ protected:
 
         return imgOut;
     }
+#endif
+
+    /**
+     * @brief Iterative solves the WLS system with the matrix-free
+     * WeightedLaplacianSolver.
+     * @param imgIn
+     * @param imgOut
+     * @param bGuess if true, imgOut is the initial guess.
+     * @return
+     */
+    ImageRAW *Iterative(ImageRAWVec imgIn, ImageRAW *imgOut, bool bGuess)
+    {
+        solver.Update(imgIn[0], NULL, alpha, lambda, epsilon);
+        return solver.Process(imgIn[0], imgOut, bGuess);
+    }
 
     float alpha, lambda, epsilon;
+    bool  bIterative, bWarmStart;
+
+    WeightedLaplacianSolver solver;
 
 public:
 
     FilterWLS()
     {
+        SetIterative(false);
         Update(1.2f, 1.0f);
     }
 
     FilterWLS(float alpha, float lambda)
     {
+        SetIterative(false);
         Update(alpha, lambda);
     }
 
+    /**
+     * @brief SetIterative selects the solver. The direct solver (Cholesky)
+     * needs memory which grows superlinearly with the image size; the
+     * iterative one is matrix-free. Without Eigen, only the iterative
+     * solver is available.
+     * @param bIterative
+     * @param bWarmStart if true, the iterative solver starts from the
+     * content of imgOut when it is passed to Process; e.g. the output of
+     * the previous frame of a video.
+     */
+    void SetIterative(bool bIterative, bool bWarmStart = false)
+    {
+#ifdef PIC_DISABLE_EIGEN
+        bIterative = true;
+#endif
+        this->bIterative = bIterative;
+        this->bWarmStart = bWarmStart;
+    }
+
+    /**
+     * @brief getSolver returns the iterative solver; e.g. for setting
+     * its tolerance or for reading its statistics.
+     * @return
+     */
+    WeightedLaplacianSolver *getSolver()
+    {
+        return &solver;
+    }
+
     void Update(float alpha, float lambda)
     {
         epsilon = 0.0001f;
@@ -312,14 +365,24 @@ public:
             return imgOut;
         }
 
+        bool bGuess = bWarmStart && (imgOut != NULL) &&
+                      imgIn[0]->SimilarType(imgOut);
+
         imgOut = SetupAux(imgIn, imgOut);
 
-        //Convolution
+        if(bIterative) {
+            return Iterative(imgIn, imgOut, bGuess);
+        }
+
+#ifndef PIC_DISABLE_EIGEN
         if(imgIn[0]->channels == 1) {
             return SingleChannel(imgIn, imgOut);
         } else {
             return MultiChannel(imgIn, imgOut);
         }
+#else
+        return imgOut;
+#endif
     }
 
     ImageRAW *ProcessP(ImageRAWVec imgIn, ImageRAW *imgOut)
@@ -356,5 +419,3 @@ public:
 } // end namespace pic
 
 #endif /* PIC_FILTERING_FILTER_WLS_HPP */
-
-#endif
\ No newline at end of file
@@ -89,7 +89,7 @@ public:
                                float sigma_s, float sigma_r, int testing = 1)
     {
         ImageRAWGL imgIn(nameIn);
-        float maxVal = imgIn.getMaxVal()[0];
+        float maxVal = imgIn.getStatistics(IS_MAX).maxVal[0];
         imgIn.Div(maxVal);
         sigma_r = sigma_r / maxVal;
 
@@ -59,7 +59,7 @@ static ImageRAWGL *ReinhardLocal(ImageRAWGL imstd::string nameIn, std::string na
     adapt->loadToMemory();
     adapt->Write("adapt.pfm");
 
-    float Lav = imgIn.getLogMeanVal()[0];
+    float Lav = imgIn.getStatistics(IS_LOG_MEAN).logMeanVal[0];
 
     FilterGLSigmoidTMO *tmo = new FilterGLSigmoidTMO(0.18f / Lav, true, true);
 
@@ -85,7 +85,7 @@ ImageRAWGL *ReinhardGlobal(std::string nameIn, std::string nameOut)
     ImageRAWGL imgIn(nameIn);
     imgIn.generateTextureGL(false, GL_TEXTURE_2D);
 
-    float Lav = imgIn.getLogMeanVal()[0];
+    float Lav = imgIn.getStatistics(IS_LOG_MEAN).logMeanVal[0];
 
     FilterGLSigmoidTMO *filter = new FilterGLSigmoidTMO(0.18f / Lav, false, true);
 
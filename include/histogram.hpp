@@ -27,11 +27,10 @@ See the GNU Lesser General Public License
 
 #include "image_raw.hpp"
 #include "util/array.hpp"
+#include "util/image_histogram.hpp"
 
 namespace pic {
 
-enum VALUE_SPACE {VS_LDR, VS_LIN, VS_LOG_2, VS_LOG_E, VS_LOG_10};
-
 /**
  * @brief The Histogram class is a class for creating,
  * managing, loading, and saving histogram for an ImageRAW.
@@ -45,6 +44,70 @@ protected:
     VALUE_SPACE		type;
     float			fMin, fMax;
 
+    /**
+     * @brief Allocate allocates nBin bins; memory is reused when the
+     * number of bins does not change.
+     * @param nBin
+     */
+    void Allocate(int nBin)
+    {
+        if((bin != NULL) && (this->nBin != nBin)) {
+            delete [] bin;
+            bin = NULL;
+
+            if(bin_nor != NULL) {
+                delete [] bin_nor;
+                bin_nor = NULL;
+            }
+
+            if(bin_c != NULL) {
+                delete [] bin_c;
+                bin_c = NULL;
+            }
+
+            if(bin_work != NULL) {
+                delete [] bin_work;
+                bin_work = NULL;
+            }
+        }
+
+        if(bin == NULL) {
+            bin = new unsigned int[nBin];
+        }
+
+        this->nBin = nBin;
+    }
+
+    /**
+     * @brief CalculateRange computes the histogram of a color channel.
+     * @param imgIn
+     * @param type
+     * @param nBin
+     * @param channel
+     * @param fMin is a pointer to the minimum value of the range or NULL.
+     * @param fMax is a pointer to the maximum value of the range or NULL.
+     */
+    void CalculateRange(Image *imgIn, VALUE_SPACE type, int nBin, int channel,
+                        float *fMin, float *fMax)
+    {
+        if(imgIn == NULL) {
+            return;
+        }
+
+        if((channel < 0) || (channel >= imgIn->channels)) {
+            return;
+        }
+
+        bool bRange = (fMin != NULL) && (fMax != NULL);
+
+        ImageHistogram hist;
+        hist.Setup(1, type, nBin, bRange ? fMin : NULL, bRange ? fMax : NULL);
+        hist.Add(imgIn->data + channel, imgIn->width * imgIn->height * imgIn->frames,
+                 imgIn->channels);
+
+        Calculate(hist, 0);
+    }
+
 public:
     unsigned int	*bin, *bin_work;
 
@@ -79,6 +142,8 @@ public:
         bin_c   = NULL;
         bin_work = NULL;
 
+        this->nBin = 0;
+        this->type = VS_LIN;
         fMin = -FLT_MAX;
         fMax =  FLT_MAX;
 
@@ -101,7 +166,7 @@ public:
         }
 
         if(bin_nor != NULL) {
-            delete [] bin;
+            delete [] bin_nor;
             bin_nor = NULL;
         }
 
@@ -119,7 +184,8 @@ public:
     /**
      * @brief Calculate computes the histogram of an input image. In the case
      * of LDR images, they are ssumed to be normalized; i.e. with values in [0, 1].
-     * This function computes the histogram for a single color channel.
+     * This function computes the histogram for a single color channel; see
+     * ImageHistogram for computing all channels in a single pass.
      * @param imgIn is the input image for which the histogram needs to be computed
      * @param type is the domain space for histogram computations.
      * Histogram can be computed as: VS_LDR (256 bins), VS_LIN (linear space),
@@ -132,99 +198,46 @@ public:
     void Calculate(Image *imgIn, VALUE_SPACE type, int nBin,
                               int channel = 0)
     {
-        if(imgIn == NULL) {
-            return;
-        }
-
-        if((channel < 0) || (channel >= imgIn->channels)) {
-            return;
-        }
-
-        if(nBin < 1) {
-            nBin = 256;
-        }
-
-        if(type == VS_LDR) {
-            nBin = 256;
-        }
-
-        bin = new unsigned int[nBin];
-        memset((void *)bin, 0, nBin * sizeof(unsigned int));
-
-        this->nBin = nBin;
-        this->type = type;
-
-        int size = imgIn->width * imgIn->height * imgIn->channels;
-        int channels = imgIn->channels;
-
-        //Statistics
-        float epsilon = 1e-6f;
-        fMin =  FLT_MAX;
-        fMax = -FLT_MAX;
-        float log2f = logf(2.0f);
-
-        for(int i = channel; i < size; i += channels) {
-            float val = imgIn->data[i];
-
-            switch(type) {
-                case VS_LOG_2: {
-                    val = logf(imgIn->data[i] + epsilon) / log2f;
-                }
-                break;
-
-                case VS_LOG_E: {
-                    val = logf(imgIn->data[i] + epsilon);
-                }
-                break;
-
-                case VS_LOG_10: {
-                    val = log10f(imgIn->data[i] + epsilon);
-                }
-                break;
-            }
+        CalculateRange(imgIn, type, nBin, channel, NULL, NULL);
+    }
 
-            fMin = MIN(fMin, val);
-            fMax = MAX(fMax, val);
-        }
+    /**
+     * @brief Calculate computes the histogram of a color channel of an input
+     * image in a fixed range; this skips the pass for computing the range.
+     * @param imgIn is the input image for which the histogram needs to be computed
+     * @param type is the domain space for histogram computations.
+     * @param nBin is the number of bins of the Histogram to be computed.
+     * @param channel is the color channel for which the Histogram will be computed.
+     * @param fMin is the minimum value of the range in the space of type;
+     * e.g., in f-stops for VS_LOG_2.
+     * @param fMax is the maximum value of the range in the space of type.
+     */
+    void Calculate(Image *imgIn, VALUE_SPACE type, int nBin, int channel,
+                   float fMin, float fMax)
+    {
+        CalculateRange(imgIn, type, nBin, channel, &fMin, &fMax);
+    }
 
-        if(type == VS_LDR) {
-            fMin = 0.0f;
-            fMax = 1.0f;
+    /**
+     * @brief Calculate copies a color channel of an ImageHistogram; e.g.,
+     * for computing histograms of all channels in a single pass.
+     * @param hist
+     * @param channel
+     */
+    void Calculate(ImageHistogram &hist, int channel)
+    {
+        if((channel < 0) || (channel >= hist.getChannels()) ||
+           (hist.getBins(channel) == NULL)) {
+            return;
         }
-    
-        float deltaMaxMin = (fMax - fMin);
-        float nBinf = float(nBin - 1);
-
-        //Histogram calculation
-        for(int i = channel; i < size; i += channels) {
-            float val = imgIn->data[i];
-            switch(type) {
-                case VS_LOG_2: {
-                    val = logf(imgIn->data[i] + epsilon) / log2f;
-                }
-                break;
-
-                case VS_LOG_E: {
-                    val = logf(imgIn->data[i] + epsilon);
-                }
-                break;
-
-                case VS_LOG_10: {
-                    val = log10f(imgIn->data[i] + epsilon);
-                }
-                break;
-            }
 
-            int indx = int(((val - fMin) * nBinf) / deltaMaxMin);
+        Allocate(hist.getNBin());
 
-            #ifdef PIC_DEBUG
-            if((indx >= nBin) || (indx<0)) {
-                printf("Error in Calculate %d.\n",indx);
-            }
-            #endif
+        memcpy(bin, hist.getBins(channel), nBin * sizeof(unsigned int));
 
-            bin[ CLAMP(indx, nBin) ]++;
-        }
+        type = hist.getType();
+        fMin = hist.fMin[channel];
+        fMax = hist.fMax[channel];
     }
 
     /**
@@ -39,14 +39,14 @@ See the GNU Lesser General Public License
 #include "util/buffer.hpp"
 
 #include "util/math.hpp"
+#include "util/mapped_file.hpp"
+#include "util/image_statistics.hpp"
+#include "util/image_percentile.hpp"
 
 #include "io/exr.hpp"
 
 namespace pic {
 
-const double HARMONIC_MEAN_EPSILON = 1e-6;
-const float  HARMONIC_MEAN_EPSILONf = 1e-6f;
-
 /**
  * @brief The Image class stores an image as buffer of float.
  */
@@ -84,6 +84,13 @@ protected:
     int  readerCounter;
     bool notOwned;
 
+    //rows of data are stored from bottom to top (e.g., a mapped .pfm file);
+    //accessors take care of it
+    bool bottomUp;
+
+    //the file where data is mapped; NULL if data is not mapped
+    MappedFile *mapped;
+
     BBox fullBox;
 
 public:
@@ -106,6 +113,11 @@ public:
      */
     float *dataTMP;
 
+    /**
+     * @brief percentiles caches the percentile queries; see getMedVal.
+     */
+    ImagePercentile *percentiles;
+
     /**
      * @brief dataUC is a buffer for rendering 8-bit images.
      */
@@ -361,6 +373,26 @@ public:
      */
     void ApplyFunction(float(*func)(float));
 
+    /**
+     * @brief getStatistics computes a set of statistics in a single parallel
+     * pass; see ImageStatistics.
+     * @param stats stores the statistics; its memory is reused across calls.
+     * @param flags is a combination of IMAGE_STATISTICS.
+     * @param box is the bounding box where to compute the statistics. If it
+     * is set to NULL they will be computed on the entire image.
+     */
+    void getStatistics(ImageStatistics &stats, unsigned int flags, BBox *box);
+
+    /**
+     * @brief getStatistics computes a set of statistics in a single parallel
+     * pass; see ImageStatistics.
+     * @param flags is a combination of IMAGE_STATISTICS.
+     * @param box is the bounding box where to compute the statistics. If it
+     * is set to NULL they will be computed on the entire image.
+     * @return This function returns the statistics.
+     */
+    ImageStatistics getStatistics(unsigned int flags, BBox *box);
+
     /**
      * @brief getMaxVal computes the maximum value for the current Image.
      * @param box is the bounding box where to compute the function. If it
@@ -452,11 +484,23 @@ public:
     float *getCovMtxVal(float *meanVal, BBox *box, float *ret);
 
     /**
-     * @brief getMedVal computes the n-th value given a percentile.
+     * @brief getMedVal computes the n-th value given a percentile without
+     * sorting; see ImagePercentile. Queries are cached until values change.
      * @param perCent is the percentile.
+     * @param bApprox enables the approximate query; its relative error is
+     * below 2^-7.
      * @return This function returns the n-value given a percentile.
      */
-    float getMedVal(float perCent);
+    float getMedVal(float perCent, bool bApprox);
+
+    /**
+     * @brief getPercentiles computes the values of a batch of percentiles.
+     * @param perCent is an array of n percentiles.
+     * @param n is the number of percentiles.
+     * @param ret is an array of n values.
+     * @param bApprox enables the approximate queries.
+     */
+    void getPercentiles(const float *perCent, int n, float *ret, bool bApprox);
 
     /**
      * @brief getGT finds the first value greater than val.
@@ -569,6 +613,16 @@ public:
         return flippedEXR;
     }
 
+    /**
+     * @brief isBottomUp returns true if rows of data are stored from bottom
+     * to top; only code which indexes data directly has to check it.
+     * @return
+     */
+    bool isBottomUp()
+    {
+        return bottomUp;
+    }
+
     /**
      * @brief removeSpecials removes NaN and +/-Inf values and sets
      * them to 0.0f.
@@ -609,6 +663,17 @@ public:
         xstride = channels;
     }
 
+    /**
+     * @brief Row returns the stored row of the y-th row, which is clamped.
+     * @param y is the vertical coordinate in pixels
+     * @return
+     */
+    int Row(int y)
+    {
+        y = CLAMP(y, height);
+        return bottomUp ? (height - 1 - y) : y;
+    }
+
     /**
      * @brief operator () returns a pointer to a pixel at (x, y, t)
      * @param x is the horizontal coordinate in pixels
@@ -618,8 +683,8 @@ public:
      */
     float *operator()(int x, int y, int t)
     {
-        return data + CLAMP(t, frames) * tstride + CLAMP(x, width) * xstride + CLAMP(y,
-                height) * ystride;
+        return data + CLAMP(t, frames) * tstride + CLAMP(x, width) * xstride +
+               Row(y) * ystride;
     }
 
     /**
@@ -630,7 +695,7 @@ public:
      */
     float *operator()(int x, int y)
     {
-        return data + CLAMP(x, width) * xstride + CLAMP(y, height) * ystride;
+        return data + CLAMP(x, width) * xstride + Row(y) * ystride;
     }
 
     /**
@@ -643,7 +708,7 @@ public:
     float *operator()(float x, float y)
     {
         int ix = CLAMP(int(floorf(x * width)), width);
-        int iy = CLAMP(int(floorf(y * height)), height);
+        int iy = Row(int(floorf(y * height)));
         return data + ix * xstride + iy * ystride;
     }
 
@@ -670,7 +735,7 @@ public:
     int Address(int x, int y)
     {
         x = CLAMP(x, width);
-        y = CLAMP(y, height);
+        y = Row(y);
 
         return x * xstride + y * ystride;
     }
@@ -685,7 +750,7 @@ public:
     int Address(int x, int y, int t)
     {
         x = CLAMP(x, width);
-        y = CLAMP(y, height);
+        y = Row(y);
         t = CLAMP(t, frames);
 
         return x * xstride + y * ystride + t * tstride;
@@ -702,6 +767,10 @@ public:
         ind = ind / channels;
         y   = ind / width;
         x   = ind - (y * width);
+
+        if(bottomUp) {
+            y = height - 1 - y;
+        }
     }
 };
 
@@ -720,11 +789,14 @@ PIC_INLINE void Image::SetNULL()
     channels = -1;
 
     dataTMP = NULL;
+    percentiles = NULL;
     data = NULL;
     dataUC = NULL;
     dataRGBE = NULL;
+    mapped = NULL;
 
     flippedEXR = false;
+    bottomUp = false;
     readerCounter = 0;
     exposure = 1.0f;
 }
@@ -768,6 +840,10 @@ PIC_INLINE void Image::Destroy()
         delete[] dataTMP;
     }
 
+    if(percentiles != NULL) {
+        delete percentiles;
+    }
+
     if(dataUC != NULL) {
         delete[] dataUC;
     }
@@ -776,6 +852,11 @@ PIC_INLINE void Image::Destroy()
         delete[] dataRGBE;
     }
 
+    //data points inside the mapping; so it is released here
+    if(mapped != NULL) {
+        delete mapped;
+    }
+
     SetNULL();
 }
 
@@ -858,7 +939,8 @@ PIC_INLINE bool Image::SimilarType(Image *img)
                 (height		==	img->height) &&
                 (channels	==	img->channels) &&
                 (frames		==	img->frames) &&
-                (flippedEXR	==	img->flippedEXR);
+                (flippedEXR	==	img->flippedEXR) &&
+                (bottomUp	==	img->bottomUp);
 
 #ifdef PIC_DEBUG
 
@@ -1011,37 +1093,63 @@ PIC_INLINE void Image::sort()
 
     if(dataTMP == NULL) {
         dataTMP = new float[size];
-        memcpy(dataTMP, data, sizeof(float)*size);
     }
 
+    //data may have changed since the last call
+    memcpy(dataTMP, data, sizeof(float)*size);
+
     std::sort(dataTMP, dataTMP + size);
 }
 
-PIC_INLINE float Image::getMedVal(float perCent = 0.5f)
+PIC_INLINE float Image::getMedVal(float perCent = 0.5f, bool bApprox = false)
 {
-    if(dataTMP == NULL) {
-        sort();
+    float ret;
+    getPercentiles(&perCent, 1, &ret, bApprox);
+    return ret;
+}
+
+PIC_INLINE void Image::getPercentiles(const float *perCent, int n, float *ret,
+                                      bool bApprox = false)
+{
+    if(percentiles == NULL) {
+        percentiles = new ImagePercentile();
     }
 
-    int size = frames * width * height * channels;
-    return dataTMP[int(perCent * float(size))];
+    percentiles->Update(data, size());
+    percentiles->Get(perCent, n, ret, bApprox);
 }
 
 PIC_INLINE float Image::getGT(float val)
 {
-    if(dataTMP == NULL) {
-        sort();
-    }
-
     int size = frames * width * height * channels;
+    int nChunks = (size + IMAGE_PERCENTILE_CHUNK - 1) / IMAGE_PERCENTILE_CHUNK;
 
-    for(int i = 0; i < size; i++) {
-        if(dataTMP[i] > val) {
-            return dataTMP[i];
+    std::vector<float> partial(nChunks, FLT_MAX);
+    std::vector<char> found(nChunks, 0);
+
+    ThreadPool::Execute(nChunks, [&](unsigned int c) {
+        int i0 = c * IMAGE_PERCENTILE_CHUNK;
+        int i1 = MIN(i0 + IMAGE_PERCENTILE_CHUNK, size);
+
+        for(int i = i0; i < i1; i++) {
+            if((data[i] > val) && (data[i] <= partial[c])) {
+                partial[c] = data[i];
+                found[c] = 1;
+            }
+        }
+    });
+
+    float ret = -1.0f;
+    bool bFound = false;
+
+    for(int c = 0; c < nChunks; c++) {
+        if(found[c] && (!bFound || (partial[c] < ret))) {
+            ret = partial[c];
+            bFound = true;
         }
     }
 
-    return -1.0f;
+    return ret;
 }
 
 PIC_INLINE void Image::EvaluateGaussian(float sigma = -1.0f,
@@ -1123,6 +1231,7 @@ PIC_INLINE void Image::Assign(Image *imgIn)
     }
 
     flippedEXR = imgIn->flippedEXR;
+    bottomUp = imgIn->bottomUp;
 
     memcpy(data, imgIn->data, frames * width * height * channels * sizeof(float));
 }
@@ -1385,107 +1494,73 @@ PIC_INLINE void Image::SetRand()
     }
 }
 
-PIC_INLINE float *Image::getMaxVal(BBox *box = NULL, float *ret = NULL)
+PIC_INLINE void Image::getStatistics(ImageStatistics &stats,
+                                     unsigned int flags, BBox *box = NULL)
 {
     if(box == NULL) {
-        box = new BBox(width, height, frames);
+        box = &fullBox;
     }
 
-    if(ret == NULL) {
-        ret = new float[channels];
-    }
+    stats.Compute(data, width, height, frames, channels, box, flags);
+}
 
-    for(int l = 0; l < channels; l++) {
-        ret[l] = -FLT_MAX;
-    }
+PIC_INLINE ImageStatistics Image::getStatistics(unsigned int flags,
+        BBox *box = NULL)
+{
+    ImageStatistics stats;
+    getStatistics(stats, flags, box);
+    return stats;
+}
 
-    for(int k = box->z0; k < box->z1; k++) {
-        for(int j = box->y0; j < box->y1; j++) {
-            for(int i = box->x0; i < box->x1; i++) {
-                float *tmp_data = (*this)(i, j, k);
+PIC_INLINE float *Image::getMaxVal(BBox *box = NULL, float *ret = NULL)
+{
+    ImageStatistics stats;
+    getStatistics(stats, IS_MAX, box);
 
-                for(int l = 0; l < channels; l++) {
-                    ret[l] = ret[l] < tmp_data[l] ? tmp_data[l] : ret[l];
-                }
-            }
-        }
+    if(ret == NULL) {
+        ret = new float[channels];
     }
 
+    std::copy(stats.maxVal.begin(), stats.maxVal.end(), ret);
     return ret;
 }
 
 PIC_INLINE float *Image::getMinVal(BBox *box = NULL, float *ret = NULL)
 {
-    if(box == NULL) {
-        box = new BBox(width, height, frames);
-    }
+    ImageStatistics stats;
+    getStatistics(stats, IS_MIN, box);
 
     if(ret == NULL) {
         ret = new float[channels];
     }
 
-    for(int l = 0; l < channels; l++) {
-        ret[l] = FLT_MAX;
-    }
-
-    for(int k = box->z0; k < box->z1; k++) {
-        for(int j = box->y0; j < box->y1; j++) {
-            for(int i = box->x0; i < box->x1; i++) {
-                float *tmp_data = (*this)(i, j, k);
-
-                for(int l = 0; l < channels; l++) {
-                    ret[l] = ret[l] > tmp_data[l] ? tmp_data[l] : ret[l];
-                }
-            }
-        }
-    }
-
+    std::copy(stats.minVal.begin(), stats.minVal.end(), ret);
     return ret;
 }
 
 PIC_INLINE float *Image::getSumVal(BBox *box = NULL, float *ret = NULL)
 {
-    if(box == NULL) {
-        box = new BBox(width, height, frames);
-    }
+    ImageStatistics stats;
+    getStatistics(stats, IS_SUM, box);
 
     if(ret == NULL) {
         ret = new float[channels];
     }
 
-    for(int l = 0; l < channels; l++) {
-        ret[l] = 0.0f;
-    }
-
-    for(int k = box->z0; k < box->z1; k++) {
-        for(int j = box->y0; j < box->y1; j++) {
-            for(int i = box->x0; i < box->x1; i++) {
-                float *tmp_data = (*this)(i, j, k);
-
-                for(int l = 0; l < channels; l++) {
-                    ret[l] += tmp_data[l];
-                }
-            }
-        }
-    }
-
+    std::copy(stats.sumVal.begin(), stats.sumVal.end(), ret);
     return ret;
 }
 
 PIC_INLINE float *Image::getMeanVal(BBox *box = NULL, float *ret = NULL)
 {
-    if(box == NULL) {
-        box = &fullBox;
-    }
-
-    ret = getSumVal(box, ret);
+    ImageStatistics stats;
+    getStatistics(stats, IS_MEAN, box);
 
-    float totf = float(box->Size());
-
-    for(int l = 0; l < channels; l++) {
-        ret[l] /= totf;
+    if(ret == NULL) {
+        ret = new float[channels];
     }
 
+    std::copy(stats.meanVal.begin(), stats.meanVal.end(), ret);
     return ret;
 }
 
@@ -1522,54 +1597,32 @@ PIC_INLINE float *Image::getMomentsVal(int x0, int y0, int radius, float *ret =
 PIC_INLINE float *Image::getVarianceVal(float *meanVal = NULL, BBox *box = NULL,
                                         float *ret = NULL)
 {
-    if(box == NULL) {
-        box = &fullBox;
-    }
-
-    if(meanVal == NULL) {
-        meanVal = getMeanVal(box);
-    }
+    ImageStatistics stats;
+    getStatistics(stats, IS_MEAN | IS_VARIANCE, box);
 
     if(ret == NULL) {
         ret = new float[channels];
     }
 
-    for(int l = 0; l < channels; l++) {
-        ret[l] = 0.0f;
-    }
+    //a given mean adds n * (mean - meanVal)^2 to the sum of squares
+    float n = float(stats.nPixels);
 
-    for(int k = box->z0; k < box->z1; k++) {
-        for(int j = box->y0; j < box->y1; j++) {
-            for(int i = box->x0; i < box->x1; i++) {
-                float *tmp_data = (*this)(i, j, k);
+    for(int l = 0; l < channels; l++) {
+        ret[l] = stats.varianceVal[l];
 
-                for(int l = 0; l < channels; l++) {
-                    float tmp = tmp_data[l] - meanVal[l];
-                    ret[l] += tmp * tmp;
-                }
-            }
+        if(meanVal != NULL) {
+            float delta = stats.meanVal[l] - meanVal[l];
+            ret[l] += n * delta * delta / (n - 1.0f);
         }
     }
 
-    float totf = float(box->Size() - 1);
-
-    for(int l = 0; l < channels; l++) {
-        ret[l] /= totf;
-    }
-
     return ret;
 }
 
-
 PIC_INLINE float *Image::getCovMtxVal(float *meanVal, BBox *box, float *ret)
 {
-    if(box == NULL) {
-        box = &fullBox;
-    }
-
-    if(meanVal == NULL) {
-        meanVal = getMeanVal(box);
-    }
+    ImageStatistics stats;
+    getStatistics(stats, IS_MEAN | IS_COVARIANCE, box);
 
     int n = channels * channels;
 
@@ -1577,69 +1630,34 @@ PIC_INLINE float *Image::getCovMtxVal(float *meanVal, BBox *box, float *ret)
         ret = new float[n];
     }
 
-    for(int l = 0; l < n; l++) {
-        ret[l] = 0.0f;
-    }
-
-    for(int k = box->z0; k < box->z1; k++) {
-        for(int j = box->y0; j < box->y1; j++) {
-            for(int i = box->x0; i < box->x1; i++) {
-                float *tmp_data = (*this)(i, j, k);
+    float nf = float(stats.nPixels);
 
-                for(int l = 0; l < channels; l++) {
-                    float tmp1 = (tmp_data[l] - meanVal[l]);
-
-                    for(int m = 0; m < channels; m++) {
-                        float tmp2 = (tmp_data[m] - meanVal[m]);
-
-                        ret[l * channels + m] += tmp1 * tmp2;
-                    }
-                }
+    for(int l = 0; l < channels; l++) {
+        for(int m = 0; m < channels; m++) {
+            int index = l * channels + m;
+            ret[index] = stats.covMtxVal[index];
+
+            if(meanVal != NULL) {
+                float delta_l = stats.meanVal[l] - meanVal[l];
+                float delta_m = stats.meanVal[m] - meanVal[m];
+                ret[index] += nf * delta_l * delta_m / (nf - 1.0f);
             }
         }
     }
 
-    float totf = float(box->Size() - 1);
-
-    for(int l = 0; l < n; l++) {
-        ret[l] /= totf;
-    }
-
     return ret;
 }
 
 PIC_INLINE float *Image::getLogMeanVal(BBox *box = NULL, float *ret = NULL)
 {
-    if(box == NULL) {
-        box = &fullBox;
-    }
+    ImageStatistics stats;
+    getStatistics(stats, IS_LOG_MEAN, box);
 
     if(ret == NULL) {
         ret = new float[channels];
     }
 
-    for(int l = 0; l < channels; l++) {
-        ret[l] = 0.0f;
-    }
-
-    for(int k = box->z0; k < box->z1; k++) {
-        for(int j = box->y0; j < box->y1; j++) {
-            for(int i = box->x0; i < box->x1; i++) {
-                float *tmp_data = (*this)(i, j, k);
-
-                for(int l = 0; l < channels; l++) {
-                    ret[l] += logf(tmp_data[l] + HARMONIC_MEAN_EPSILONf);
-                }
-            }
-        }
-    }
-
-    float tot = float(box->Size());
-
-    for(int l = 0; l < channels; l++) {
-        ret[l] = expf(ret[l] / tot);
-    }
-
+    std::copy(stats.logMeanVal.begin(), stats.logMeanVal.end(), ret);
     return ret;
 }
 
@@ -170,6 +170,18 @@ public:
      */
     bool Read (std::string nameFile, LDR_type typeLoad);
 
+    /**
+     * @brief ReadMapped opens an ImageRAW mapping the file in memory.
+     * Pixels of .tmp and little endian .pfm files are used in place without
+     * copies; rows of .pfm files stay from bottom to top (see isBottomUp).
+     * The mapping is copy-on-write, so the file is never modified. Big
+     * endian .pfm files are decoded into a copy, and other formats fall
+     * back to Read.
+     * @param nameFile is the file name.
+     * @return This returns true if the reading succeeds, false otherwise.
+     */
+    bool ReadMapped(std::string nameFile);
+
     /**
      * @brief Write saves an ImageRAW into a file on the disk.
      * @param nameFile is the file name.
@@ -596,6 +608,67 @@ PIC_INLINE bool ImageRAW::Read(std::string nameFile,
     return bReturn;
 }
 
+PIC_INLINE bool ImageRAW::ReadMapped(std::string nameFile)
+{
+    LABEL_IO_EXTENSION label = getLabelHDRExtension(nameFile);
+
+    if((label != IO_TMP) && (label != IO_PFM)) {
+        return Read(nameFile, LT_NOR_GAMMA);
+    }
+
+    //pages are copied only if pixels are modified
+    MappedFile *file = new MappedFile();
+
+    if(!file->Open(nameFile, true)) {
+        delete file;
+        return false;
+    }
+
+    int w, h, c, f = 1;
+    float *tmp = NULL;
+    bool bSwap = false;
+
+    if(label == IO_TMP) {
+        tmp = MapTMP(file->getData(), file->getSize(), w, h, c, f);
+    } else {
+        tmp = (float *) MapPFM(file->getData(), file->getSize(), w, h, c, bSwap);
+    }
+
+    if(tmp == NULL) {
+        delete file;
+
+        //e.g., pixels of the .pfm file are not aligned
+        Destroy();
+        return Read(nameFile, LT_NOR_GAMMA);
+    }
+
+    Destroy();
+
+    this->nameFile = nameFile;
+    this->typeLoad = LT_NOR_GAMMA;
+
+    //values of a big endian .pfm file are decoded into a copy
+    if(bSwap) {
+        Allocate(w, h, c, f);
+        CopyPFM(tmp, data, w, h, c, true);
+        delete file;
+        return true;
+    }
+
+    this->width    = w;
+    this->height   = h;
+    this->channels = c;
+    this->frames   = f;
+    this->data     = tmp;
+    this->notOwned = true;
+    this->mapped   = file;
+    this->bottomUp = (label == IO_PFM);
+
+    AllocateAux();
+
+    return true;
+}
+
 PIC_INLINE bool ImageRAW::Write(std::string nameFile, LDR_type typeWrite = LT_NOR_GAMMA,
                                 int writerCounter = 0)
 {
@@ -603,6 +676,16 @@ PIC_INLINE bool ImageRAW::Write(std::string nameFile, LDR_type typeWrite = LT_NO
         return false;
     }
 
+    //writers expect rows from top to bottom
+    if(bottomUp) {
+        ImageRAW tmp(frames, width, height, channels);
+        memcpy(tmp.data, data, size_t(size()) * sizeof(float));
+        tmp.FlipV();
+        tmp.flippedEXR = flippedEXR;
+        tmp.exposure = exposure;
+        return tmp.Write(nameFile, typeWrite, writerCounter);
+    }
+
     LABEL_IO_EXTENSION label;
 
     //Reading an HDR format
@@ -716,6 +799,7 @@ PIC_INLINE ImageRAW *ImageRAW::AllocateSimilarOne()
 {
     ImageRAW *ret = new ImageRAW(frames, width, height, channels);
     ret->flippedEXR = flippedEXR;
+    ret->bottomUp = bottomUp;
     return ret;
 }
 
@@ -723,6 +807,7 @@ PIC_INLINE ImageRAW *ImageRAW::Clone()
 {
     ImageRAW *ret = new ImageRAW(frames, width, height, channels);
     ret->flippedEXR = flippedEXR;
+    ret->bottomUp = bottomUp;
     memcpy(ret->data, data, width * height * channels * sizeof(float));
     return ret;
 }
@@ -91,8 +91,8 @@ PIC_INLINE void ImageSamplerBilinear::SampleImage(Image *img, float x, float y,
     int iy1 = CLAMP(iy + 1, img->height);	//(iy+1)%img->height;
 
     //Bilinear interpolation indicies
-    int t0 = iy  * img->width;
-    int t1 = iy1 * img->width;
+    int t0 = img->Row(iy)  * img->width;
+    int t1 = img->Row(iy1) * img->width;
 
     ind0 = (ix  + t0) * img->channels;
     ind1 = (ix1 + t0) * img->channels;
@@ -128,8 +128,8 @@ PIC_INLINE void ImageSamplerBilinear::SampleImageUC(Image *img, float x,
     int iy1 = CLAMP(iy + 1, img->height);	//(iy+1)%img->height;
 
     //Bilinear interpolation indicies
-    int t0 = iy  * img->width;
-    int t1 = iy1 * img->width;
+    int t0 = img->Row(iy)  * img->width;
+    int t1 = img->Row(iy1) * img->width;
 
     ind0 = (ix  + t0) * img->channels;
     ind1 = (ix1 + t0) * img->channels;
@@ -99,7 +99,7 @@ PIC_INLINE void ImageSamplerBSplines::SampleImage(Image *img, float x, float y,
 
     for(int j = 0; j < 4; j++) {
         ry = Rx(float(j) - 1.0f - dy);
-        ey = CLAMP(iy + j, img->height);
+        ey = img->Row(iy + j);
 
         for(int i = 0; i < 4; i++) {
             rx = Rx(float(i) - 1.0f - dx) * ry;
@@ -115,7 +115,7 @@ PIC_INLINE void ImageSamplerGaussian::SampleImage(Image *img, float x, float y,
 
     for(int j = -halfSize; j <= halfSize; j++) {
         int ex = CLAMP(ix + j * dirs[0], img->width);
-        int ey = CLAMP(iy + j * dirs[1], img->height);
+        int ey = img->Row(iy + j * dirs[1]);
 
         int ind = (ey * img->width + ex) * img->channels;
 
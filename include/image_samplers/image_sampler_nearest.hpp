@@ -72,7 +72,7 @@ PIC_INLINE void ImageSamplerNearest::SampleImage(Image *img, float x, float y,
     int iy = int(y);
     
     //Bilinear interpolation indicies
-    int ind = (ix * img->xstride + iy * img->ystride);
+    int ind = (ix * img->xstride + img->Row(iy) * img->ystride);
 
     for(int i = 0; i < img->channels; i++) {
         vOut[i] = img->data[ind + i];
@@ -97,7 +97,7 @@ PIC_INLINE void ImageSamplerNearest::SampleImage(Image *img, float x, float y,
     int it = int(t);
     
     //Bilinear interpolation indicies
-    int ind = (ix * img->xstride + iy * img->ystride + it * img->tstride);
+    int ind = (ix * img->xstride + img->Row(iy) * img->ystride + it * img->tstride);
 
     for(int i = 0; i < img->channels; i++) {
         vOut[i] = img->data[ind + i];
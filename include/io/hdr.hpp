@@ -26,31 +26,33 @@ See the GNU Lesser General Public License
 #define PIC_IO_HDR_HPP
 
 #include <stdio.h>
+#include <string.h>
 #include <string>
+#include <vector>
 
 #include "colors/rgbe.hpp"
 #include "base.hpp"
+#include "util/mapped_file.hpp"
 //SYSTEM: X NEG Y POS
 
 namespace pic {
 
-/**ReadHDR: reads a .hdr file*/
-PIC_INLINE float *ReadHDR(std::string nameFile, float *data, int &width,
-                          int &height)
+/**
+ * @brief ReadHeaderHDR reads the header of a Radiance file.
+ * @param file
+ * @param width
+ * @param height
+ * @return It returns the offset of the first scanline, or -1 on errors.
+ */
+PIC_INLINE long ReadHeaderHDR(FILE *file, int &width, int &height)
 {
-    FILE *file = fopen(nameFile.c_str(), "rb");
-
-    if(file == NULL) {
-        return NULL;
-    }
-
     char tmp[512];
 
     //Is it a Radiance file?
     fscanf(file, "%s\n", tmp);
 
     if(strcmp(tmp, "#?RADIANCE") != 0) {
-        return NULL;
+        return -1;
     }
 
     while(true) { //Reading Radiance Header
@@ -60,7 +62,7 @@ PIC_INLINE float *ReadHDR(std::string nameFile, float *data, int &width,
             char *tmp2 = fgets(tmp, 512, file);
 
             if(tmp2 == NULL) {
-                return NULL;
+                return -1;
             }
 
             line += tmp2;
@@ -78,7 +80,7 @@ PIC_INLINE float *ReadHDR(std::string nameFile, float *data, int &width,
         //Properties:
         if(line.find("FORMAT") != std::string::npos) { //Format
             if(line.find("32-bit_rle_rgbe") == std::string::npos) {
-                return NULL;
+                return -1;
             }
         }
 
@@ -88,116 +90,303 @@ PIC_INLINE float *ReadHDR(std::string nameFile, float *data, int &width,
     }
 
     //width and height
-    fscanf(file, "-Y %d +X %d", &height, &width);
+    if(fscanf(file, "-Y %d +X %d", &height, &width) != 2) {
+        return -1;
+    }
+
     fgetc(file);
 
-    if(data == NULL) {
-        data = new float[width * height * 3];
+    if((width < 1) || (height < 1)) {
+        return -1;
+    }
+
+    return ftell(file);
+}
+
+/**
+ * @brief DecodeScanlineHDR decodes a RLE scanline of a Radiance file. RGBE
+ * values are decoded in the last third of the output line, and then they
+ * are converted in place; so no temporary buffer is needed.
+ * @param buffer is the start of the scanline.
+ * @param end is the end of the file.
+ * @param width
+ * @param data is the output line (width * 3 values); if it is NULL, the
+ * scanline is skipped.
+ * @return It returns the start of the next scanline, or NULL on errors.
+ */
+PIC_INLINE const unsigned char *DecodeScanlineHDR(const unsigned char *buffer,
+        const unsigned char *end, int width, float *data)
+{
+    if((end - buffer) < 4) {
+        return NULL;
+    }
+
+    if((buffer[0] != 2) || (buffer[1] != 2) || (buffer[2] != (width >> 8)) ||
+       (buffer[3] != (width & 0xFF))) {
+        #ifdef PIC_DEBUG
+            printf("ReadHDR ERROR: the file is not a RLE encoded .hdr file.\n");
+        #endif
+
+        return NULL;
+    }
+
+    buffer += 4;
+
+    unsigned char *rgbe = (data != NULL) ? ((unsigned char *) data) + width * 8 : NULL;
+
+    for(int j = 0; j < 4; j++) {
+        int k = 0;
+
+        //decompression of a single channel line
+        while(k < width) {
+            if(buffer >= end) {
+                return NULL;
+            }
+
+            int num = buffer[0];
+
+            if(num > 128) {
+                num -= 128;
+
+                if(((k + num) > width) || ((end - buffer) < 2)) {
+                    return NULL;
+                }
+
+                if(rgbe != NULL) {
+                    for(int l = k; l < (k + num); l++) {
+                        rgbe[l * 4 + j] = buffer[1];
+                    }
+                }
+
+                buffer += 2;
+            } else {
+                if((num == 0) || ((k + num) > width) || ((end - buffer) < (num + 1))) {
+                    return NULL;
+                }
+
+                if(rgbe != NULL) {
+                    for(int l = 0; l < num; l++) {
+                        rgbe[(l + k) * 4 + j] = buffer[1 + l];
+                    }
+                }
+
+                buffer += num + 1;
+            }
+
+            k += num;
+        }
+    }
+
+    //From RGBE to Float; the RGBE value of pixel j is read before
+    //writing it, and writes never reach RGBE values of pixels > j
+    if(rgbe != NULL) {
+        unsigned char colRGBE[4];
+
+        for(int j = 0; j < width; j++) {
+            memcpy(colRGBE, &rgbe[j * 4], 4);
+            RGBE2Float(colRGBE, &data[j * 3]);
+        }
+    }
+
+    return buffer;
+}
+
+/**ReadHDR: reads a .hdr file*/
+PIC_INLINE float *ReadHDR(std::string nameFile, float *data, int &width,
+                          int &height)
+{
+    FILE *file = fopen(nameFile.c_str(), "rb");
+
+    if(file == NULL) {
+        return NULL;
+    }
+
+    long offset = ReadHeaderHDR(file, width, height);
+
+    if(offset < 0) {
+        fclose(file);
+        return NULL;
+    }
+
+    //the file is mapped in memory; otherwise, it is read in a buffer
+    MappedFile mapped;
+    std::vector<unsigned char> buffer;
+    const unsigned char *start = NULL;
+    size_t total = 0;
+
+    if(mapped.Open(nameFile) && (mapped.getSize() > size_t(offset))) {
+        start = mapped.getData() + offset;
+        total = mapped.getSize() - size_t(offset);
+    } else {
+        fseek(file, 0 , SEEK_END);
+        long s_end = ftell(file);
+        fseek(file, offset, SEEK_SET);
+
+        if(s_end > offset) {
+            buffer.resize(s_end - offset);
+            total = fread(&buffer[0], 1, buffer.size(), file);
+            start = &buffer[0];
+        }
     }
 
-    //File size
-    long int s_cur = ftell(file);
-    fseek(file, 0 , SEEK_END);
-    long int s_end = ftell(file);
-    fseek(file, s_cur, SEEK_SET);
-    int total = s_end - s_cur;
+    fclose(file);
 
 #ifdef PIC_DEBUG
-    printf("%d %d\n", total, width * height * 4);
+    printf("%lu %d\n", total, width * height * 4);
 #endif
 
+    if(start == NULL) {
+        return NULL;
+    }
+
+    bool bAllocated = (data == NULL);
+
+    if(bAllocated) {
+        data = new float[width * height * 3];
+    }
+
+    int n = width * height;
+
     //Compressed?
-    if(total == (width * height * 4)) { //uncompressed
+    if(total == size_t(n * 4)) { //uncompressed
         unsigned char colRGBE[4];
 
-        int c = 0;
+        for(int i = 0; i < n; i++) {
+            memcpy(colRGBE, &start[i * 4], 4);
+            RGBE2Float(colRGBE, &data[i * 3]);
+        }
+    } else { //RLE compressed
+        const unsigned char *end = start + total;
+        const unsigned char *line = start;
 
-        for(int i = 0; i < width; i++) {
-            for(int j = 0; j < height; j++) {
-                fread(colRGBE, 1, 4, file);
-                RGBE2Float(colRGBE, &data[c]);
-                c += 3;
+        for(int i = 0; i < height; i++) {
+            line = DecodeScanlineHDR(line, end, width, &data[i * width * 3]);
+
+            if(line == NULL) {
+                if(bAllocated) {
+                    delete[] data;
+                }
+
+                return NULL;
             }
         }
-    } else { //RLE compressed
-        unsigned char *buffer = new unsigned char[total];
-        fread(buffer, sizeof(unsigned char)*total, 1, file);
+    }
 
-        int line_width3 = width * 3;
-        int line_width4 = width * 4;
+    return data;
+}
 
-        unsigned char *buffer_line_start;
-        unsigned char *buffer_line = new unsigned char[line_width4];
-        int c = 4;
-        int c_buffer_line = 0;
+/**
+ * @brief The HDRScanlineReader class decodes scanlines of a Radiance file
+ * on demand; the file is mapped in memory and only the requested scanlines
+ * are decoded. The offsets of scanlines are found lazily, skipping runs
+ * without decoding them.
+ */
+class HDRScanlineReader
+{
+protected:
+    MappedFile          mapped;
+    const unsigned char *start, *end;
+    bool                bRLE;
+
+    //start of scanlines found so far
+    std::vector<const unsigned char *> lines;
+
+public:
+    int width, height;
+
+    HDRScanlineReader()
+    {
+        start = end = NULL;
+        bRLE = true;
+        width = height = 0;
+    }
 
-        //for each line
-        for(int i = 0; i < height; i++) {
-            buffer_line_start = &buffer[c - 4];
+    /**
+     * @brief Open
+     * @param nameFile
+     * @return
+     */
+    bool Open(std::string nameFile)
+    {
+        FILE *file = fopen(nameFile.c_str(), "rb");
+
+        if(file == NULL) {
+            return false;
+        }
 
-            int width_check  = buffer_line_start[2];
-            int width_check2 = buffer_line_start[3];
+        long offset = ReadHeaderHDR(file, width, height);
+        fclose(file);
 
-            bool b1 = buffer_line_start[0] != 2;
-            bool b2 = buffer_line_start[1] != 2;
-            bool b3 = width_check  != (width >> 8); 
-            bool b4 = width_check2 != (width & 0xFF);
+        if(offset < 0) {
+            return false;
+        }
 
-            if(b1 || b2 || b3 || b4) {
-                #ifdef PIC_DEBUG
-                    printf("ReadHDR ERROR: the file is not a RLE encoded .hdr file.\n");
-                #endif
+        if(!mapped.Open(nameFile) || (mapped.getSize() <= size_t(offset))) {
+            return false;
+        }
 
-                fclose(file);
+        start = mapped.getData() + offset;
+        end = mapped.getData() + mapped.getSize();
+        bRLE = (size_t(end - start) != size_t(width) * size_t(height) * 4);
 
-                return NULL;
-            }
+        lines.clear();
+        lines.push_back(start);
+        return true;
+    }
 
-            for(int j = 0; j < 4; j++) {
-                int k = 0;
+    /**
+     * @brief ReadScanlines decodes scanlines in [y0, y1).
+     * @param y0
+     * @param y1
+     * @param data is the output; (y1 - y0) * width * 3 values.
+     * @return It returns false on errors.
+     */
+    bool ReadScanlines(int y0, int y1, float *data)
+    {
+        if((start == NULL) || (y0 < 0) || (y1 > height) || (y0 >= y1)) {
+            return false;
+        }
 
-                //decompression of a single channel line
-                while(k < width) {
-                    int num = buffer[c];
+        if(!bRLE) {
+            unsigned char colRGBE[4];
+            const unsigned char *src = start + size_t(y0) * width * 4;
 
-                    if(num > 128) {
-                        num -= 128;
+            for(int i = 0; i < ((y1 - y0) * width); i++) {
+                memcpy(colRGBE, &src[i * 4], 4);
+                RGBE2Float(colRGBE, &data[i * 3]);
+            }
 
-                        for(int l = k; l < (k + num); l++) {
-                            buffer_line[l * 4 + j] = buffer[c + 1];
-                        }
+            return true;
+        }
 
-                        c += 2;
-                        k += num;
-                    } else {
-                        for(int l = 0; l < num; l++) {
-                            buffer_line[(l + k) * 4 + j] = buffer[c + 1 + l];
-                        }
+        //skipping scanlines up to y0
+        while(int(lines.size()) <= y0) {
+            const unsigned char *next = DecodeScanlineHDR(lines.back(), end, width, NULL);
 
-                        c += num + 1;
-                        k += num;
-                    }
-                }
+            if(next == NULL) {
+                return false;
             }
 
-            //From RGBE to Float
-            for(int j = 0; j < width; j++) {
-                RGBE2Float(&buffer_line[j * 4], &data[c_buffer_line + j * 3]);
+            lines.push_back(next);
+        }
+
+        for(int i = y0; i < y1; i++) {
+            const unsigned char *next = DecodeScanlineHDR(lines[i], end, width,
+                                        &data[(i - y0) * width * 3]);
+
+            if(next == NULL) {
+                return false;
             }
 
-            c += 4;
-            c_buffer_line += line_width3;
+            if(int(lines.size()) == (i + 1)) {
+                lines.push_back(next);
+            }
         }
 
-        delete[] buffer_line;
-        delete[] buffer;
+        return true;
     }
+};
 
-    fclose(file);
-    return data;
-}
-
-/**This function writes a scanline of an image using RLE and RGBE encoding*/
 PIC_INLINE void WriteLineHDR(FILE *file, unsigned char *buffer_line, int width)
 {
     int cur_pointer = 0;
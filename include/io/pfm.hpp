@@ -26,7 +26,9 @@ See the GNU Lesser General Public License
 #define PIC_IO_PFM_HPP
 
 #include <stdio.h>
+#include <string.h>
 #include <string>
+#include <algorithm>
 
 #include "base.hpp"
 
@@ -68,6 +70,107 @@ PIC_INLINE float *ReadPFM(std::string nameFile, float *data, int &width,
     return data;
 }
 
+/**
+ * @brief MapPFM decodes the header of a .pfm file mapped in memory; the
+ * buffer is not modified, so it can be read-only. Note that rows are
+ * stored from bottom to top.
+ * @param buffer is the first byte of the file.
+ * @param size is the size of the file in bytes.
+ * @param width
+ * @param height
+ * @param channels
+ * @param bSwap is set to true if values have to be byte swapped, i.e.,
+ * the endianness of the file is not the one of the machine; see CopyPFM.
+ * @return It returns a pointer to the pixels inside buffer; NULL if the
+ * file is not valid or if pixels are not aligned to floats.
+ */
+PIC_INLINE const float *MapPFM(const unsigned char *buffer, size_t size,
+                               int &width, int &height, int &channels,
+                               bool &bSwap)
+{
+    if((buffer == NULL) || (size < 3) || (buffer[0] != 'P')) {
+        return NULL;
+    }
+
+    if(buffer[1] == 'F') {
+        channels = 3;
+    } else {
+        if(buffer[1] == 'f') {
+            channels = 1;
+        } else {
+            return NULL;
+        }
+    }
+
+    //the header is made of three text lines
+    std::string header;
+    size_t offset = 0;
+    int lines = 0;
+
+    while((offset < size) && (offset < 256) && (lines < 3)) {
+        char c = char(buffer[offset]);
+        header += c;
+        offset++;
+
+        if(c == 0x0a) {
+            lines++;
+        }
+    }
+
+    float flag;
+    char tmp[3];
+
+    if((lines < 3) || (sscanf(header.c_str(), "%2s %d %d %f", tmp, &width,
+                              &height, &flag) != 4)) {
+        return NULL;
+    }
+
+    size_t n = size_t(width) * size_t(height) * size_t(channels);
+
+    if((width < 1) || (height < 1) || ((offset % sizeof(float)) != 0) ||
+       ((size - offset) < (n * sizeof(float)))) {
+        return NULL;
+    }
+
+    //endianness: a negative flag means little endian
+    unsigned int one = 1;
+    bool bLittleEndian = (*((unsigned char *) &one) == 1);
+    bSwap = ((flag < 0.0f) != bLittleEndian);
+
+    return (const float *) &buffer[offset];
+}
+
+/**
+ * @brief CopyPFM copies the pixels of a .pfm file from bottom to top rows
+ * into top to bottom rows.
+ * @param src are the pixels of the file; see MapPFM.
+ * @param dst is a buffer of width * height * channels values.
+ * @param width
+ * @param height
+ * @param channels
+ * @param bSwap if true, values are byte swapped.
+ */
+PIC_INLINE void CopyPFM(const float *src, float *dst, int width, int height,
+                        int channels, bool bSwap)
+{
+    int stride = width * channels;
+
+    for(int i = 0; i < height; i++) {
+        const float *rowSrc = &src[size_t(height - 1 - i) * size_t(stride)];
+        float *rowDst = &dst[size_t(i) * size_t(stride)];
+
+        memcpy(rowDst, rowSrc, stride * sizeof(float));
+
+        if(bSwap) {
+            for(int j = 0; j < stride; j++) {
+                unsigned char *b = (unsigned char *) &rowDst[j];
+                std::swap(b[0], b[3]);
+                std::swap(b[1], b[2]);
+            }
+        }
+    }
+}
+
 /** WritePFM: writes a .pfm file*/
 PIC_INLINE bool WritePFM(std::string nameFile, const float *data, int width,
                          int height, int channels = 3)
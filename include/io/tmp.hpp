@@ -26,6 +26,7 @@ See the GNU Lesser General Public License
 #define PIC_IO_TMP_HPP
 
 #include <stdio.h>
+#include <string.h>
 #include <string>
 
 #include "base.hpp"
@@ -59,10 +60,6 @@ PIC_INLINE float *ReadTMP(std::string nameFile, float *data, int &width,
         }
     }
 
-    if(data == NULL) {
-        data = new float[width * height * channels * frames];
-    }
-
     if(bHeader) {
         width    = header.width;
         height   = header.height;
@@ -70,6 +67,10 @@ PIC_INLINE float *ReadTMP(std::string nameFile, float *data, int &width,
         frames   = header.frames;
     }
 
+    if(data == NULL) {
+        data = new float[width * height * channels * frames];
+    }
+
     fread(data, sizeof(float), frames * width * height * channels, file);
 
     fclose(file);
@@ -77,6 +78,48 @@ PIC_INLINE float *ReadTMP(std::string nameFile, float *data, int &width,
     return data;
 }
 
+/**
+ * @brief MapTMP decodes a dump temp file mapped in memory; pixels are not
+ * copied.
+ * @param buffer is the first byte of the file.
+ * @param size is the size of the file in bytes.
+ * @param width
+ * @param height
+ * @param channels
+ * @param frames
+ * @return It returns a pointer to the pixels inside buffer; NULL if the
+ * file is not valid.
+ */
+PIC_INLINE float *MapTMP(unsigned char *buffer, size_t size, int &width,
+                         int &height, int &channels, int &frames)
+{
+    if((buffer == NULL) || (size < sizeof(TMP_IMG_HEADER))) {
+        return NULL;
+    }
+
+    TMP_IMG_HEADER header;
+    memcpy(&header, buffer, sizeof(TMP_IMG_HEADER));
+
+    if(header.channels < 1 || header.frames < 1 || header.height < 1 ||
+       header.width < 1) { //invalid image!
+        return NULL;
+    }
+
+    size_t n = size_t(header.frames) * size_t(header.width) *
+               size_t(header.height) * size_t(header.channels);
+
+    if((size - sizeof(TMP_IMG_HEADER)) < (n * sizeof(float))) {
+        return NULL;
+    }
+
+    width    = header.width;
+    height   = header.height;
+    channels = header.channels;
+    frames   = header.frames;
+
+    return (float *) &buffer[sizeof(TMP_IMG_HEADER)];
+}
+
 /**WriteTMP: writes a dump temp file*/
 PIC_INLINE bool WriteTMP(std::string nameFile, const float *data, int &width,
                          int &height, int &channels, int &frames, bool bHeader = true)
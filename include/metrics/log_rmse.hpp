@@ -27,6 +27,7 @@ See the GNU Lesser General Public License
 
 #include <math.h>
 #include "image_raw.hpp"
+#include "util/thread_pool.hpp"
 #include "metrics/base.hpp"
 
 namespace pic {
@@ -42,25 +43,24 @@ double logRMSE(ImageRAW *ori, ImageRAW *cmp)
         return -1.0;
     }
 
-    int size = ori->size();
-    int counter = 0;
+    int rowSize = ori->width * ori->channels;
 
-    double acc = 0.0;
-    double val;
+    //acc[0] is the sum of squared log differences and acc[1] is the count
+    double acc[2];
 
-    for(int i = 0; i < size; i += ori->channels) {
-        for(int j = 0; j < ori->channels; j++) {
-            if(ori->data[i + j] > 0.0f && cmp->data[i + j] > 0.0f) {
-                val  = log(ori->data[i + j] / cmp->data[i + j]);
-                acc += val * val;
-                counter++;
+    ThreadPool::SumRows(ori->width, ori->height * ori->frames, 2,
+                        [&](int y0, int y1, double *acc) {
+        for(int i = y0 * rowSize; i < y1 * rowSize; i++) {
+            if(ori->data[i] > 0.0f && cmp->data[i] > 0.0f) {
+                double val = log(ori->data[i] / cmp->data[i]);
+                acc[0] += val * val;
+                acc[1] += 1.0;
             }
         }
-    }
+    }, acc);
 
-    if(counter > 0) {
-        acc = acc / double(counter);
-        return sqrt(acc);
+    if(acc[1] > 0.0) {
+        return sqrt(acc[0] / acc[1]);
     } else {
         return -3.0;
     }
@@ -27,11 +27,14 @@ See the GNU Lesser General Public License
 
 #include <math.h>
 #include "image_raw.hpp"
+#include "util/thread_pool.hpp"
 #include "metrics/base.hpp"
 
 namespace pic {
 
-/**MSE: mean squared error*/
+/**MSE: mean squared error; rows are summed in parallel and partial sums
+ * are added in a fixed order, so the result does not depend on the number
+ * of threads.*/
 double MSE(ImageRAW *ori, ImageRAW *cmp, bool bLargeDifferences=false)
 {
     if(ori == NULL || cmp == NULL) {
@@ -42,27 +45,28 @@ double MSE(ImageRAW *ori, ImageRAW *cmp, bool bLargeDifferences=false)
         return -1.0;
     }
 
-    int size = ori->width * ori->height * ori->channels;
-    double delta = 0.0;
-    double acc   = 0.0;
-
-    int count = 0;
+    int rowSize = ori->width * ori->channels;
 
     float largeDifferences = C_LARGE_DIFFERENCESf;
     if(!bLargeDifferences) {
         largeDifferences = FLT_MAX;
     }
 
-    for(int i = 0; i < size; i++) {
-        delta = ori->data[i] - cmp->data[i];
+    //acc[0] is the sum of squared differences and acc[1] is the count
+    double acc[2];
+
+    ThreadPool::SumRows(ori->width, ori->height, 2, [&](int y0, int y1, double *acc) {
+        for(int i = y0 * rowSize; i < y1 * rowSize; i++) {
+            double delta = ori->data[i] - cmp->data[i];
 
-        if(delta <= largeDifferences) {
-            acc += delta * delta;
-            count++;
+            if(delta <= largeDifferences) {
+                acc[0] += delta * delta;
+                acc[1] += 1.0;
+            }
         }
-    }
+    }, acc);
 
-    return acc / double(count);
+    return acc[0] / acc[1];
 }
 
 /** MSE: single exposure MSE at 8-bit*/
@@ -80,23 +84,28 @@ double MSE(ImageRAW *ori, ImageRAW *cmp, float gamma, float fstop)
     float exposure = powf(2.0f, fstop);
 
     int area = ori->width * ori->height;
-    int size = area * ori->channels;
+    int rowSize = ori->width * ori->channels;
 
-    unsigned long long acc = 0;
+    //integer squared differences; their sum is exact in double
+    double acc = ThreadPool::SumRows(ori->width, ori->height, [&](int y0, int y1) {
+        double acc = 0.0;
 
-    for(int i = 0; i < size; i++) {
-        int oriLDR = int(255.0f * (powf(ori->data[i] * exposure, invGamma)));
-        int cmpLDR = int(255.0f * (powf(cmp->data[i] * exposure, invGamma)));
+        for(int i = y0 * rowSize; i < y1 * rowSize; i++) {
+            int oriLDR = int(255.0f * (powf(ori->data[i] * exposure, invGamma)));
+            int cmpLDR = int(255.0f * (powf(cmp->data[i] * exposure, invGamma)));
 
-        oriLDR = CLAMPi(oriLDR, 0, 255);
-        cmpLDR = CLAMPi(cmpLDR, 0, 255);
+            oriLDR = CLAMPi(oriLDR, 0, 255);
+            cmpLDR = CLAMPi(cmpLDR, 0, 255);
 
-        int delta = cmpLDR - oriLDR;
+            int delta = cmpLDR - oriLDR;
 
-        acc += delta * delta;
-    }
+            acc += double(delta * delta);
+        }
+
+        return acc;
+    });
 
-    return (double(acc) / double(area));
+    return (acc / double(area));
 }
 
 /** RMSE: root mean squared error*/
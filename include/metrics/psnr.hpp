@@ -27,6 +27,7 @@ See the GNU Lesser General Public License
 
 #include <math.h>
 #include "image_raw.hpp"
+#include "util/thread_pool.hpp"
 #include "metrics/base.hpp"
 #include "metrics/mse.hpp"
 
@@ -63,35 +64,38 @@ double rPSNR(ImageRAW *ori, ImageRAW *cmp, bool bLargeDifferences = false)
         return -1.0;
     }
 
-    int size = ori->size();
-
-    double acc = 0.0;
-    int count = 0;
+    int rowSize = ori->width * ori->channels;
 
     double largeDifferences = C_LARGE_DIFFERENCES;
     if(!bLargeDifferences) {
         largeDifferences = FLT_MAX;
     }
 
-    for(int i = 0; i < size; i++) {
-        double valO = ori->data[i];
-        double valC = cmp->data[i];
+    //acc[0] is the sum of squared relative differences and acc[1] is the count
+    double acc[2];
+
+    ThreadPool::SumRows(ori->width, ori->height * ori->frames, 2,
+                        [&](int y0, int y1, double *acc) {
+        for(int i = y0 * rowSize; i < y1 * rowSize; i++) {
+            double valO = ori->data[i];
+            double valC = cmp->data[i];
 
-        double delta = valO - valC;
-        double maxOC = MAX(valO, valC);
+            double delta = valO - valC;
+            double maxOC = MAX(valO, valC);
 
-        if(delta <= largeDifferences) {
-            count++;
+            if(delta <= largeDifferences) {
+                acc[1] += 1.0;
 
-            if(maxOC > pic::C_SINGULARITY) {
-                //to avoid singularities
-                double tmp = delta / maxOC;
-                acc += tmp * tmp;
+                if(maxOC > pic::C_SINGULARITY) {
+                    //to avoid singularities
+                    double tmp = delta / maxOC;
+                    acc[0] += tmp * tmp;
+                }
             }
         }
-    }
+    }, acc);
 
-    return -10.0 * log10(acc / double(count));
+    return -10.0 * log10(acc[0] / acc[1]);
 }
 
 } // end namespace pic
@@ -25,7 +25,9 @@ See the GNU Lesser General Public License
 #ifndef PIC_METRICS_SNR_HPP
 #define PIC_METRICS_SNR_HPP
 
+#include <math.h>
 #include "image_raw.hpp"
+#include "util/thread_pool.hpp"
 
 namespace pic {
 
@@ -39,29 +41,35 @@ float SNR(ImageRAW *ori, ImageRAW *cmp, BBox *box)
         return -1.0f;
     }
 
+    BBox fullBox(ori->width, ori->height);
+
     if(box == NULL) {
-        box = new BBox(ori->width, ori->height);
+        box = &fullBox;
     }
 
-    double acc = 0.0;
-
-    int i, j, k, c;
+    //rows are summed in parallel and added in a fixed order
+    double acc = ThreadPool::SumRows(box->x1 - box->x0, box->y1 - box->y0,
+                                     [&](int y0, int y1) {
+        double acc = 0.0;
 
-    for(j = box->y0; j < box->y1; j++) {
-        for(i = box->x0; i < box->x1; i++) {
-            c = i * ori->xstride + j * ori->ystride;
+        for(int j = box->y0 + y0; j < box->y0 + y1; j++) {
+            for(int i = box->x0; i < box->x1; i++) {
+                int c = i * ori->xstride + j * ori->ystride;
 
-            for(k = 0; k < ori->channels; k++) {
-                double valO = static_cast<double>(ori->data[c + k]);
-                double valC = static_cast<double>(cmp->data[c + k]);
+                for(int k = 0; k < ori->channels; k++) {
+                    double valO = static_cast<double>(ori->data[c + k]);
+                    double valC = static_cast<double>(cmp->data[c + k]);
 
-                if(valO > 1e-3) {// small values are skipped to avoid numerical problems
-                    double tmp = fabs(valO - valC);
-                    acc += tmp / valO;
+                    if(valO > 1e-3) {// small values are skipped to avoid numerical problems
+                        double tmp = fabs(valO - valC);
+                        acc += tmp / valO;
+                    }
                 }
             }
         }
-    }
+
+        return acc;
+    });
 
     acc /= static_cast<double>((box->y1 - box->y0) * (box->x1 - box->x0) *
                                ori->channels);
@@ -0,0 +1,294 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+PICCANTE is free software; you can redistribute it and/or modify
+under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation; either version 3.0 of
+the License, or (at your option) any later version.
+
+PICCANTE is distributed in the hope that it will be useful, but
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU Lesser General Public License
+( http://www.gnu.org/licenses/lgpl-3.0.html ) for more details.
+
+*/
+
+#ifndef PIC_POINT_SAMPLERS_POISSON_DISK_GRID_HPP
+#define PIC_POINT_SAMPLERS_POISSON_DISK_GRID_HPP
+
+#include <math.h>
+#include <vector>
+
+#include "util/math.hpp"
+
+namespace pic {
+
+//maximum number of cells of a PoissonDiskGrid
+#define POISSON_DISK_GRID_MAX_CELLS (1 << 22)
+
+/**
+ * @brief The PoissonDiskGrid class is a background grid over [-1, 1]^N for
+ * Poisson-disk sampling with a given radius. Cells have side
+ * radius / sqrt(N), so a cell holds at most one sample, and the samples
+ * closer than radius to a point are in the cells at most reach cells away.
+ * Radii needing more than POISSON_DISK_GRID_MAX_CELLS cells give an empty
+ * grid; see isValid.
+ */
+template<unsigned int N>
+class PoissonDiskGrid
+{
+protected:
+    std::vector<int> offsets;   //neighborhood: N deltas per cell
+
+public:
+    float   radius, radius2, cellSize;
+    int     res, reach, nCells;
+
+    //index of the sample in each cell, or -1
+    std::vector<int> cells;
+
+    /**
+     * @brief PoissonDiskGrid
+     */
+    PoissonDiskGrid()
+    {
+        res = 0;
+        nCells = 0;
+    }
+
+    /**
+     * @brief PoissonDiskGrid
+     * @param radius
+     */
+    PoissonDiskGrid(float radius)
+    {
+        Init(radius);
+    }
+
+    /**
+     * @brief Init
+     * @param radius
+     */
+    void Init(float radius)
+    {
+        this->radius = radius;
+        radius2 = radius * radius;
+        cellSize = radius / sqrtf(float(N));
+        reach = int(ceilf(sqrtf(float(N))));
+
+        //the number of cells is computed in 64-bit and checked against
+        //the budget before allocating
+        double fRes = ceil(2.0 / double(cellSize));
+        long long tmpCells = 0;
+
+        if((fRes >= 1.0) && (fRes <= double(POISSON_DISK_GRID_MAX_CELLS))) {
+            res = int(fRes);
+            tmpCells = 1;
+
+            for(unsigned int i = 0; (i < N) && (tmpCells <= POISSON_DISK_GRID_MAX_CELLS); i++) {
+                tmpCells *= res;
+            }
+        }
+
+        if((tmpCells < 1) || (tmpCells > POISSON_DISK_GRID_MAX_CELLS)) {
+            res = 0;
+            nCells = 0;
+            cells.clear();
+            offsets.clear();
+            return;
+        }
+
+        nCells = int(tmpCells);
+        cells.assign(nCells, -1);
+
+        //neighborhood deltas in [-reach, reach]^N
+        offsets.clear();
+        int side = reach * 2 + 1;
+        int nOffsets = 1;
+
+        for(unsigned int i = 0; i < N; i++) {
+            nOffsets *= side;
+        }
+
+        for(int j = 0; j < nOffsets; j++) {
+            int tmp = j;
+
+            for(unsigned int i = 0; i < N; i++) {
+                offsets.push_back((tmp % side) - reach);
+                tmp /= side;
+            }
+        }
+    }
+
+    /**
+     * @brief isValid
+     * @return It returns false if the grid would exceed
+     * POISSON_DISK_GRID_MAX_CELLS cells; callers have to fall back to
+     * brute-force checks.
+     */
+    bool isValid()
+    {
+        return nCells > 0;
+    }
+
+    /**
+     * @brief getCoords computes the coordinates of the cell of x.
+     * @param x
+     * @param c
+     */
+    void getCoords(const float *x, int *c)
+    {
+        for(unsigned int i = 0; i < N; i++) {
+            int tmp = int((x[i] + 1.0f) / cellSize);
+            c[i] = CLAMPi(tmp, 0, res - 1);
+        }
+    }
+
+    /**
+     * @brief getIndex
+     * @param c
+     * @return It returns the linear index of the cell with coordinates c.
+     */
+    int getIndex(const int *c)
+    {
+        int ind = 0;
+
+        for(int i = int(N) - 1; i >= 0; i--) {
+            ind = ind * res + c[i];
+        }
+
+        return ind;
+    }
+
+    /**
+     * @brief getCell
+     * @param x
+     * @return It returns the linear index of the cell of x.
+     */
+    int getCell(const float *x)
+    {
+        int c[N];
+        getCoords(x, c);
+        return getIndex(c);
+    }
+
+    /**
+     * @brief getCellCoords computes the coordinates of a cell.
+     * @param cell
+     * @param c
+     */
+    void getCellCoords(int cell, int *c)
+    {
+        for(unsigned int i = 0; i < N; i++) {
+            c[i] = cell % res;
+            cell /= res;
+        }
+    }
+
+    /**
+     * @brief Visit calls func(cell) for the cells at most reach cells away
+     * from the cell of x, until func returns false.
+     * @param x
+     * @param func
+     * @return It returns false if func returned false.
+     */
+    template<class F>
+    bool Visit(const float *x, F func)
+    {
+        int c[N], cn[N];
+        getCoords(x, c);
+
+        for(unsigned int j = 0; j < offsets.size(); j += N) {
+            bool bInside = true;
+
+            for(unsigned int i = 0; i < N; i++) {
+                cn[i] = c[i] + offsets[j + i];
+
+                if((cn[i] < 0) || (cn[i] >= res)) {
+                    bInside = false;
+                    break;
+                }
+            }
+
+            if(bInside) {
+                if(!func(getIndex(cn))) {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Check checks whether x is at least radius away from the
+     * samples in the grid.
+     * @param x
+     * @param points stores N coordinates for each sample index.
+     * @return
+     */
+    bool Check(const float *x, const float *points)
+    {
+        return Visit(x, [&](int cell) {
+            int s = cells[cell];
+
+            if(s < 0) {
+                return true;
+            }
+
+            const float *p = &points[s * N];
+            float dist2 = 0.0f;
+
+            for(unsigned int i = 0; i < N; i++) {
+                float delta = x[i] - p[i];
+                dist2 += delta * delta;
+            }
+
+            return dist2 >= radius2;
+        });
+    }
+
+    /**
+     * @brief getPhase returns the phase group of a cell. Cells of the same
+     * group are more than reach cells apart along at least one axis, so
+     * samples can be inserted concurrently in them.
+     * @param cell
+     * @return
+     */
+    int getPhase(int cell)
+    {
+        int c[N];
+        getCellCoords(cell, c);
+
+        int phase = 0;
+
+        for(int i = int(N) - 1; i >= 0; i--) {
+            phase = phase * (reach + 1) + (c[i] % (reach + 1));
+        }
+
+        return phase;
+    }
+
+    /**
+     * @brief getNumberOfPhases
+     * @return
+     */
+    int getNumberOfPhases()
+    {
+        return powint(reach + 1, N);
+    }
+};
+
+} // end namespace pic
+
+#endif /* PIC_POINT_SAMPLERS_POISSON_DISK_GRID_HPP */
+
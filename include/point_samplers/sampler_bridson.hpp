@@ -29,11 +29,13 @@ See the GNU Lesser General Public License
 #include <random>
 #include "util/math.hpp"
 #include "util/vec.hpp"
+#include "point_samplers/poisson_disk_grid.hpp"
 
 namespace pic {
 
 /**
- *
+ * @brief checkNeighborsBruteForce checks x against all samples; it is
+ * kept as a reference for PoissonDiskGrid::Check.
  */
 template<unsigned int N>
 bool checkNeighborsBruteForce(std::vector< Vec<N, float> > &samples,
@@ -51,7 +53,39 @@ bool checkNeighborsBruteForce(std::vector< Vec<N, float> > &samples,
 }
 
 /**
- *
+ * @brief checkNeighborsBruteForce checks x against all samples stored as N
+ * coordinates each; it is used when the radius is too small for a
+ * PoissonDiskGrid.
+ */
+template<unsigned int N>
+bool checkNeighborsBruteForce(std::vector<float> &points, const float *x,
+                              float radius)
+{
+    float radius2 = radius * radius;
+
+    for(unsigned int i = 0; i < points.size(); i += N) {
+        float dist2 = 0.0f;
+
+        for(unsigned int j = 0; j < N; j++) {
+            float delta = x[j] - points[i + j];
+            dist2 += delta * delta;
+        }
+
+        if(dist2 < radius2) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief BridsonSampler generates Poisson-disk samples in [-1, 1]^N with
+ * Bridson's algorithm; neighbors are looked up in a background grid.
+ * @param m
+ * @param radius
+ * @param samples
+ * @param kSamples is the number of trials around an active sample.
  */
 template<unsigned int N>
 void BridsonSampler(std::mt19937 *m, float radius, std::vector<float> &samples,
@@ -62,17 +96,21 @@ void BridsonSampler(std::mt19937 *m, float radius, std::vector<float> &samples,
     }
 
     //Step 0: Creating an N-grid
-//	Grid<N> grid(0.999f * radius / sqrtf(float(N)));
+    PoissonDiskGrid<N> grid(radius);
+    bool bGrid = grid.isValid();
 
     //Step 1: Initial sample
     Vec<N, float> x0 = randomPoint<N>(m);
 
-    std::vector< Vec<N, float> > vecSamples;
+    std::vector<float> points;
     std::vector<int> activeList;
 
-    vecSamples.push_back(x0);
+    points.insert(points.end(), x0.data, x0.data + N);
     activeList.push_back(0);
-//	grid.setValue(0, x0);
+
+    if(bGrid) {
+        grid.cells[grid.getCell(x0.data)] = 0;
+    }
 
     //Step 2: active list
     while(!activeList.empty()) {
@@ -80,50 +118,46 @@ void BridsonSampler(std::mt19937 *m, float radius, std::vector<float> &samples,
 
         int ind = activeList[i];
 
-        bool bCheckSuccess = false;
-        bool bFlag = true;
+        Vec<N, float> center;
+
+        for(unsigned int k = 0; k < N; k++) {
+            center[k] = points[ind * N + k];
+        }
 
-        int j = 0;
+        bool bCheckSuccess = false;
 
-        while(bFlag) {
+        for(int j = 0; (j < kSamples) && (!bCheckSuccess); j++) {
             //creating samples inside the annulus around sample_i
-            Vec<N, float> x = annulusSampling<N>(m, vecSamples[ind], radius);
+            Vec<N, float> x = annulusSampling<N>(m, center, radius);
 
             //checking if the generated sample is in the bounding box
             if(insideVecBBox(x)) {
                 //checking if sample does not have neighbors in grid with distance radius
-                if(checkNeighborsBruteForce(vecSamples, x, radius)) {
-                    vecSamples.push_back(x);
-                    int value = vecSamples.size() - 1;
+                bool bCheck = bGrid ? grid.Check(x.data, &points[0]) :
+                              checkNeighborsBruteForce<N>(points, x.data, radius);
+
+                if(bCheck) {
+                    int value = int(points.size() / N);
+                    points.insert(points.end(), x.data, x.data + N);
 
                     activeList.push_back(value);
-                    //                grid.setValue(value, x);
+
+                    if(bGrid) {
+                        grid.cells[grid.getCell(x.data)] = value;
+                    }
+
                     bCheckSuccess = true;
                 }
             }
-
-            j++;
-
-            bFlag = (j < kSamples) && (!bCheckSuccess);
         }
 
         if(!bCheckSuccess) { //removing i-th sample from the active list
-            if(activeList.size() > 1) {
-                activeList[i] = activeList.back();
-                activeList.pop_back();
-            } else {
-                activeList.pop_back();
-            }
+            activeList[i] = activeList.back();
+            activeList.pop_back();
         }
     }
 
-    for(unsigned int i = 0; i < vecSamples.size(); i++) {
-        Vec<N, float> x = vecSamples[i];
-
-        for(unsigned int k = 0; k < N; k++) {
-            samples.push_back(x[k]);
-        }
-    }
+    samples.insert(samples.end(), points.begin(), points.end());
 }
 
 } // end namespace pic
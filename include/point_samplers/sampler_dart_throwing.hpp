@@ -26,57 +26,233 @@ See the GNU Lesser General Public License
 #define PIC_POINT_SAMPLERS_SAMPLER_DART_THROWING_HPP
 
 #include <random>
+#include <vector>
+#include <algorithm>
 
 #include "util/vec.hpp"
 #include "util/math.hpp"
+#include "util/thread_pool.hpp"
+#include "point_samplers/poisson_disk_grid.hpp"
 
 namespace pic {
 
 const int CONST_DARTTHROWING = 5000;
 
+//maximum number of darts per cell
+const int CONST_DARTTHROWING_ROUNDS = 32;
+
+/**
+ * @brief DartHash computes a random value in [0, 1] from a seed, a cell,
+ * a round, and an axis; so darts do not depend on the scheduling.
+ * @param seed
+ * @param cell
+ * @param round
+ * @param axis
+ * @return
+ */
+inline float DartHash(unsigned int seed, unsigned int cell, unsigned int round,
+                      unsigned int axis)
+{
+    unsigned int h = seed ^ (cell * 0x9E3779B1u) ^ (round * 0x85EBCA77u) ^
+                     (axis * 0xC2B2AE3Du);
+
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+
+    return Random(h);
+}
+
 /**
- *
+ * @brief DartThrowingSamplerBruteForce generates Poisson-disk samples in
+ * the unit ball by throwing darts in [-1, 1]^N and checking them against
+ * all samples; it is used when the radius is too small for a
+ * PoissonDiskGrid.
+ * @param m
+ * @param radius2 is the squared radius.
+ * @param nSamples
+ * @param samples
  */
 template<unsigned int N>
-void DartThrowingSampler(std::mt19937 *m, float radius2, int nSamples,
-                         std::vector<float> &samples)
+void DartThrowingSamplerBruteForce(std::mt19937 *m, float radius2, int nSamples,
+                                   std::vector<float> &samples)
 {
-    float dist2, delta;
-    Vec<N, float> val;
+    long long nDarts = (long long)(nSamples) * CONST_DARTTHROWING;
+    float x[N];
 
-    int counter = 0;
+    for(long long counter = 0; counter < nDarts; counter++) {
+        float lengthSq = 0.0f;
 
-    while(counter < (nSamples * CONST_DARTTHROWING)) {
         for(unsigned int j = 0; j < N; j++) {
-            val[j] = ( Random((*m)()) * 2.0f - 1.0f);
+            x[j] = Random((*m)()) * 2.0f - 1.0f;
+            lengthSq += x[j] * x[j];
+        }
+
+        if(lengthSq > 1.0f) {
+            continue;
         }
 
         bool bFlag = true;
 
-        for(unsigned int i = 0; i < samples.size(); i += N) {
-            dist2 = 0.0f;
+        for(unsigned int i = 0; (i < samples.size()) && bFlag; i += N) {
+            float dist2 = 0.0f;
 
             for(unsigned int j = 0; j < N; j++) {
-                delta = val[j] - samples[i + j];
+                float delta = x[j] - samples[i + j];
                 dist2 += delta * delta;
             }
 
             bFlag = dist2 >= radius2;
-
-            if(!bFlag) {
-                break;
-            }
         }
 
         if(bFlag) {
-            if(val.lengthSq() <= 1.0f) {
-                for(unsigned int j = 0; j < N; j++) {
-                    samples.push_back(val[j]);
+            samples.insert(samples.end(), x, x + N);
+        }
+    }
+}
+
+/**
+ * @brief DartThrowingSampler generates Poisson-disk samples in the unit
+ * ball by dart throwing. Darts are thrown in the empty cells of a
+ * background grid, one per cell in each round; cells are visited by phase
+ * groups, and the cells of a group are processed in parallel since their
+ * darts cannot conflict. New samples are also kept at distance from the
+ * samples already in samples (i.e., the previous levels).
+ * @param m
+ * @param radius2 is the squared radius.
+ * @param nSamples
+ * @param samples
+ */
+template<unsigned int N>
+void DartThrowingSampler(std::mt19937 *m, float radius2, int nSamples,
+                         std::vector<float> &samples)
+{
+    PoissonDiskGrid<N> grid(sqrtf(radius2));
+
+    if(!grid.isValid()) {
+        DartThrowingSamplerBruteForce<N>(m, radius2, nSamples, samples);
+        return;
+    }
+
+    int nCells = grid.nCells;
+
+    //previous samples by cell
+    int nPrev = int(samples.size() / N);
+    std::vector<int> prevStart(nCells + 1, 0), prevIndex(nPrev);
+
+    for(int i = 0; i < nPrev; i++) {
+        prevStart[grid.getCell(&samples[i * N]) + 1]++;
+    }
+
+    for(int i = 0; i < nCells; i++) {
+        prevStart[i + 1] += prevStart[i];
+    }
+
+    std::vector<int> prevPos(prevStart.begin(), prevStart.end() - 1);
+
+    for(int i = 0; i < nPrev; i++) {
+        prevIndex[prevPos[grid.getCell(&samples[i * N])]++] = i;
+    }
+
+    //phase groups
+    std::vector< std::vector<int> > phases(grid.getNumberOfPhases());
+
+    for(int i = 0; i < nCells; i++) {
+        phases[grid.getPhase(i)].push_back(i);
+    }
+
+    //as many darts as the serial thrower, up to a cap per cell
+    long long nDarts = (long long)(nSamples) * CONST_DARTTHROWING;
+    int rounds = int(MIN(nDarts / nCells, (long long)(CONST_DARTTHROWING_ROUNDS)));
+    rounds = MAX(rounds, 1);
+
+    std::vector<float> points(size_t(nCells) * N);
+    unsigned int seed = (*m)();
+    int chunk = 256;
+
+    for(int r = 0; r < rounds; r++) {
+        for(unsigned int p = 0; p < phases.size(); p++) {
+            std::vector<int> &lst = phases[p];
+            int nChunks = int((lst.size() + chunk - 1) / chunk);
+
+            ThreadPool::Execute(nChunks, [&](unsigned int t) {
+                int i0 = t * chunk;
+                int i1 = MIN(i0 + chunk, int(lst.size()));
+
+                int c[N];
+                float x[N];
+
+                for(int i = i0; i < i1; i++) {
+                    int cell = lst[i];
+
+                    if(grid.cells[cell] >= 0) {
+                        continue;
+                    }
+
+                    grid.getCellCoords(cell, c);
+
+                    float lengthSq = 0.0f;
+
+                    for(unsigned int j = 0; j < N; j++) {
+                        x[j] = (float(c[j]) + DartHash(seed, cell, r, j)) *
+                               grid.cellSize - 1.0f;
+                        lengthSq += x[j] * x[j];
+                    }
+
+                    if(lengthSq > 1.0f) {
+                        continue;
+                    }
+
+                    if(!grid.Check(x, &points[0])) {
+                        continue;
+                    }
+
+                    bool bFlag = grid.Visit(x, [&](int nc) {
+                        for(int k = prevStart[nc]; k < prevStart[nc + 1]; k++) {
+                            const float *q = &samples[prevIndex[k] * N];
+                            float dist2 = 0.0f;
+
+                            for(unsigned int j = 0; j < N; j++) {
+                                float delta = x[j] - q[j];
+                                dist2 += delta * delta;
+                            }
+
+                            if(dist2 < radius2) {
+                                return false;
+                            }
+                        }
+
+                        return true;
+                    });
+
+                    if(bFlag) {
+                        for(unsigned int j = 0; j < N; j++) {
+                            points[cell * N + j] = x[j];
+                        }
+
+                        grid.cells[cell] = cell;
+                    }
                 }
-            }
+            });
         }
+    }
+
+    //samples in random order, as the serial thrower
+    std::vector<int> order;
+
+    for(int i = 0; i < nCells; i++) {
+        if(grid.cells[i] >= 0) {
+            order.push_back(i);
+        }
+    }
+
+    std::shuffle(order.begin(), order.end(), *m);
 
-        counter++;
+    for(unsigned int i = 0; i < order.size(); i++) {
+        float *x = &points[order[i] * N];
+        samples.insert(samples.end(), x, x + N);
     }
 }
 
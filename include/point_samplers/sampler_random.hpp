@@ -76,6 +76,17 @@ public:
      */
     RandomSampler(SAMPLER_TYPE type, Vec<N, int> window, int nSamples, int nLevels);
 
+    /**
+     * @brief RandomSampler
+     * @param type
+     * @param window
+     * @param nSamples
+     * @param nLevels
+     * @param seed is the seed of the random number generator.
+     */
+    RandomSampler(SAMPLER_TYPE type, Vec<N, int> window, int nSamples, int nLevels,
+                  unsigned int seed);
+
     /**
      * @brief Update
      * @param type
@@ -206,6 +217,14 @@ template <unsigned int N> PIC_INLINE RandomSampler<N>::RandomSampler(
     Update(type, window, nSamples, nLevels);
 }
 
+template <unsigned int N> PIC_INLINE RandomSampler<N>::RandomSampler(
+    SAMPLER_TYPE type, Vec<N, int> window, int nSamples, int nLevels,
+    unsigned int seed)
+{
+    m = new std::mt19937(seed);
+    Update(type, window, nSamples, nLevels);
+}
+
 //Samples cut and rescale
 template <unsigned int N> PIC_INLINE void RandomSampler<N>::CutRescale(
     unsigned int cutDim)
@@ -27,6 +27,7 @@ See the GNU Lesser General Public License
 
 #include <random>
 #include "util/math.hpp"
+#include "util/thread_pool.hpp"
 
 #include "point_samplers/sampler_random.hpp"
 
@@ -113,11 +114,17 @@ template <unsigned int N> PIC_INLINE MRSamplers<N>::MRSamplers(
 
     samplers = new RandomSampler< N > *[nSamplers];
 
-    #pragma omp parallel for
+    //seeds are drawn serially since rand() is not thread-safe
+    std::vector<unsigned int> seeds(nSamplers);
 
     for(int i = 0; i < nSamplers; i++) {
-        samplers[i] = new RandomSampler< N >(type, window, nSamples, nLevels);
+        seeds[i] = rand();
     }
+
+    ThreadPool::Execute(nSamplers, [&](unsigned int i) {
+        samplers[i] = new RandomSampler< N >(type, window, nSamples, nLevels,
+                                             seeds[i]);
+    });
 }
 
 template <unsigned int N>
@@ -127,10 +134,10 @@ PIC_INLINE bool MRSamplers<N>::update(Vec<N, int> window, int nSamples)
         return false;
     }
 
-    //#pragma omp parallel for
-    for(int i = 0; i < nSamplers; i++) {
+    //each sampler has its own random number generator
+    ThreadPool::Execute(nSamplers, [&](unsigned int i) {
         samplers[i]->Update(type, window, nSamples, nLevels);
-    }
+    });
 
     oldWindow = window;
     oldSamples = nSamples;
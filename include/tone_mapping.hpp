@@ -39,6 +39,7 @@ See the GNU Lesser General Public License
 #include "tone_mapping/drago_tmo.hpp"
 #include "tone_mapping/ward_histogram_tmo.hpp"
 #include "tone_mapping/segmentation_tmo_approx.hpp"
+#include "tone_mapping/video_tmo.hpp"
 
 #endif /* PIC_TONE_MAPPING_HPP */
 
@@ -46,8 +46,8 @@ ImageRAW *DragoTMO(ImageRAW *imgIn, float Ld_Max = 100.0f, float b = 0.95f, Imag
     FilterLuminance filterLum;
     ImageRAW *imgLum = filterLum.ProcessP(Single(imgIn), NULL);
 
-    float Lw_Max = imgLum->getMaxVal()[0];
-    float Lw_a = imgLum->getMaxVal()[0];
+    float Lw_Max = imgLum->getStatistics(IS_MAX).maxVal[0];
+    float Lw_a = Lw_Max;
 
     //tone mapping
     FilterDragoTMO filterDrago(Ld_Max, b, Lw_Max, Lw_a);
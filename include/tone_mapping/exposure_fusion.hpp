@@ -25,6 +25,10 @@ See the GNU Lesser General Public License
 #ifndef PIC_TONE_MAPPING_EXPOSURE_FUSION_HPP
 #define PIC_TONE_MAPPING_EXPOSURE_FUSION_HPP
 
+#include <string>
+#include <vector>
+#include <functional>
+
 #include "colors/saturation.hpp"
 #include "filtering/filter_luminance.hpp"
 #include "filtering/filter_laplacian.hpp"
@@ -32,6 +36,55 @@ See the GNU Lesser General Public License
 
 namespace pic {
 
+/**
+ * @brief ExposureFusionWeights computes the (unnormalized) weights of an
+ * exposure: contrast, saturation, and well-exposedness.
+ * @param img is the exposure.
+ * @param L is a temporary single channel image for the luminance.
+ * @param weight is the output single channel image.
+ * @param fltL
+ * @param fltLap
+ * @param wC
+ * @param wE
+ * @param wS
+ */
+inline void ExposureFusionWeights(ImageRAW *img, ImageRAW *L, ImageRAW *weight,
+                                  FilterLuminance &fltL, FilterLaplacian &fltLap,
+                                  float wC, float wE, float wS)
+{
+    int channels = img->channels;
+    int size = img->width * img->height;
+
+    float mu = 0.5f;
+    float sigma = 0.2f;
+    float sigma2 = 2.0f * sigma * sigma;
+
+    fltL.ProcessP(Single(img), L);
+
+    fltLap.ProcessP(Single(L), weight);
+
+    float *data = img->data;
+
+    for(int ind = 0; ind < size; ind++) {
+        int i = ind * channels;
+
+        //Contrast
+        float pCon = fabsf(weight->data[ind]);
+
+        //Saturation
+        float pSat = computeSaturation(&data[i], channels);
+
+        //Well-exposedness
+        float tmpL = L->data[ind] - mu;
+        float pWE = expf(-(tmpL * tmpL) / sigma2);
+
+        //Final weights
+        weight->data[ind] =  powf(pCon, wC) *
+                             powf(pWE,  wE) *
+                             powf(pSat, wS);
+    }
+}
+
 /**
  * @brief ExposureFusion
  * @param imgIn
@@ -67,10 +120,6 @@ ImageRAW *ExposureFusion(ImageRAWVec imgIn, ImageRAW *imgOut, float wC = 1.0f,
 
     ImageRAWVec weights_list;
 
-    float mu = 0.5f;
-    float sigma = 0.2f;
-    float sigma2 = 2.0f * sigma * sigma;
-
     for(int j = 0; j < n; j++) {
         #ifdef PIC_DEBUG
             printf("Processing image %d\n", j);
@@ -81,30 +130,7 @@ ImageRAW *ExposureFusion(ImageRAWVec imgIn, ImageRAW *imgOut, float wC = 1.0f,
 
         weights_list.push_back(curWeight);
 
-        fltL.ProcessP(Single(imgIn[j]), L);
-
-        fltLap.ProcessP(Single(L), curWeight);
-
-        float *data = imgIn[j]->data;
-
-        for(int ind = 0; ind < size; ind++) {
-            int i = ind * channels;
-
-            //Contrast
-            float pCon = fabsf(curWeight->data[ind]);
-
-            //Saturation
-            float pSat = computeSaturation(&data[i], channels);
-
-            //Well-exposedness
-            float tmpL = L->data[ind] - mu;
-            float pWE = expf(-(tmpL * tmpL) / sigma2);
-
-            //Final weights
-            curWeight->data[ind] =  powf(pCon, wC) *
-                                    powf(pWE,  wE) *
-                                    powf(pSat, wS);
-        }
+        ExposureFusionWeights(imgIn[j], L, curWeight, fltL, fltLap, wC, wE, wS);
 
         acc->Add(curWeight);
     }
@@ -161,6 +187,155 @@ ImageRAW *ExposureFusion(ImageRAWVec imgIn, ImageRAW *imgOut, float wC = 1.0f,
     return imgOut;
 }
 
+/**
+ * @brief ExposureFusion is the streaming version of ExposureFusion; brackets
+ * are loaded one at a time, so the peak memory does not depend on their
+ * number. Each bracket is loaded twice: the first pass accumulates the
+ * weights for the normalization, and the second one blends the normalized
+ * Laplacian pyramids into a single output pyramid.
+ * @param n is the number of brackets.
+ * @param loader loads the j-th bracket into img (e.g. with Read or Assign)
+ * and it returns true on success; img is reused across calls, so brackets
+ * of the same size do not allocate memory.
+ * @param imgOut
+ * @param wC
+ * @param wE
+ * @param wS
+ * @return It returns NULL if a bracket fails to load or if its size
+ * differs from the size of the first bracket.
+ */
+ImageRAW *ExposureFusion(int n, std::function<bool(int, ImageRAW *)> loader,
+                         ImageRAW *imgOut, float wC = 1.0f, float wE = 1.0f,
+                         float wS = 1.0f)
+{
+    if(n < 2) {
+        return NULL;
+    }
+
+    ImageRAW img;
+
+    if(!loader(0, &img)) {
+        return NULL;
+    }
+
+    int channels = img.channels;
+    int width = img.width;
+    int height = img.height;
+
+    //brackets have to load and to match the first one
+    auto Load = [&](int j) -> bool {
+        if(!loader(j, &img)) {
+            return false;
+        }
+
+        return (img.width == width) && (img.height == height) &&
+               (img.channels == channels);
+    };
+
+    FilterLuminance fltL;
+    FilterLaplacian fltLap;
+
+    ImageRAW *L      = new ImageRAW(1, width, height, 1);
+    ImageRAW *weight = new ImageRAW(1, width, height, 1);
+    ImageRAW *acc    = new ImageRAW(1, width, height, 1);
+
+    acc->SetZero();
+
+    //first pass: normalization
+    for(int j = 0; j < n; j++) {
+        #ifdef PIC_DEBUG
+            printf("Weighting image %d\n", j);
+        #endif
+
+        if(j > 0) {
+            if(!Load(j)) {
+                delete acc;
+                delete weight;
+                delete L;
+                return NULL;
+            }
+        }
+
+        ExposureFusionWeights(&img, L, weight, fltL, fltLap, wC, wE, wS);
+
+        acc->Add(weight);
+    }
+
+    for(int i = 0; i < acc->size(); i++) {
+        if(acc->data[i] <= 0.0f) {
+            acc->data[i] = 1.0f;
+        }
+    }
+
+    //second pass: blending
+    Pyramid *pW   = new Pyramid(width, height, 1, false, 0);
+    Pyramid *pI   = new Pyramid(width, height, channels, true, 0);
+    Pyramid *pOut = new Pyramid(width, height, channels, true, 0);
+
+    bool bValid = true;
+
+    for(int j = 0; j < n; j++) {
+        #ifdef PIC_DEBUG
+            printf("Blending image %d\n", j);
+        #endif
+
+        if(!Load(j)) {
+            bValid = false;
+            break;
+        }
+
+        ExposureFusionWeights(&img, L, weight, fltL, fltLap, wC, wE, wS);
+
+        weight->Div(acc);
+
+        pW->Update(weight);
+
+        pI->Update(&img);
+
+        pI->Mul(pW);
+        pOut->Add(pI);
+    }
+
+    //final result
+    if(bValid) {
+        imgOut = pOut->Reconstruct(imgOut);
+
+        #pragma omp parallel for
+
+        for(int i = 0; i < imgOut->size(); i++) {
+            imgOut->data[i] = imgOut->data[i] > 0.0f ? imgOut->data[i] : 0.0f;
+        }
+    }
+
+    //free the memory
+    delete pW;
+    delete pOut;
+    delete pI;
+    delete acc;
+    delete weight;
+    delete L;
+
+    return bValid ? imgOut : NULL;
+}
+
+/**
+ * @brief ExposureFusion is the streaming version of ExposureFusion for
+ * a list of files.
+ * @param nameIn is the list of file names of the brackets.
+ * @param imgOut
+ * @param wC
+ * @param wE
+ * @param wS
+ * @return
+ */
+ImageRAW *ExposureFusion(std::vector<std::string> nameIn, ImageRAW *imgOut,
+                         float wC = 1.0f, float wE = 1.0f, float wS = 1.0f)
+{
+    return ExposureFusion(int(nameIn.size()), [&nameIn](int j, ImageRAW *img) {
+        return img->Read(nameIn[j], LT_NOR_GAMMA);
+    }, imgOut, wC, wE, wS);
+}
+
 } // end namespace pic
 
 #endif /* PIC_TONE_MAPPING_EXPOSURE_FUSION_HPP */
@@ -39,17 +39,21 @@ inline ImageRAW *HistogramTMO(ImageRAW *imgOut, ImageRAW *imgIn)
 
     ImageRAW *lum    = FilterLuminance::Execute(imgIn, NULL, LT_CIE_LUMINANCE);	//Luminance
     ImageRAW *lumOld = lum->Clone();
-    lum->sort();
 
     int size = lum->width * lum->height * lum->frames;
 
     float table[257];
 
-    for(int i = 1; i <= 256; i++) {
-        table[i] = lum->getMedVal(float(i) / 256.0f);
+    //all percentiles in a batch
+    float perCent[256];
+
+    for(int i = 0; i < 256; i++) {
+        perCent[i] = float(i + 1) / 256.0f;
     }
 
-    table[0] = lum->getMinVal()[0];
+    lum->getPercentiles(perCent, 256, &table[1]);
+
+    table[0] = lum->getStatistics(IS_MIN).minVal[0];
 
     std::vector<float> v(table, table + 257);
 
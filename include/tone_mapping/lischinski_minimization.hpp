@@ -25,12 +25,13 @@ See the GNU Lesser General Public License
 #ifndef PIC_TONE_MAPPING_LISCHINSKI_MINIMIZATION_HPP
 #define PIC_TONE_MAPPING_LISCHINSKI_MINIMIZATION_HPP
 
-#ifndef PIC_DISABLE_EIGEN
+#include "image_raw.hpp"
+#include "algorithms/weighted_laplacian_solver.hpp"
 
+#ifndef PIC_DISABLE_EIGEN
 #include "externals/Eigen/Sparse"
 #include "externals/Eigen/src/SparseCore/SparseMatrix.h"
-
-#include "image_raw.hpp"
+#endif
 
 namespace pic {
 /**
@@ -66,6 +67,8 @@ inline float LischinskiFunctionGauss(float Lcur, float Lref, float param[2])
     return expf(-powf(Lcur - Lref, 2.0f) * 10.0f);
 }
 
+#ifndef PIC_DISABLE_EIGEN
+
 /**
  * @brief LischinskiMinimization
  * @param L
@@ -185,9 +188,77 @@ ImageRAW *LischinskiMinimization(ImageRAW *L, ImageRAW *g,
     return ret;
 }
 
-} // end namespace pic
-
 #endif
 
+/**
+ * @brief LischinskiMinimizationIterative solves the system of
+ * LischinskiMinimization with the matrix-free WeightedLaplacianSolver;
+ * memory is linear in the number of pixels.
+ * @param L
+ * @param g
+ * @param omega
+ * @param alpha
+ * @param lambda
+ * @param LISCHINSKI_EPSILON
+ * @param imgOut is the output; if it is NULL, it is allocated.
+ * @param bWarmStart if true, the content of imgOut is the initial guess;
+ * e.g. the solution of the previous frame of a video.
+ * @param solver is a solver to be reused across calls; it may be NULL.
+ * @return
+ */
+inline ImageRAW *LischinskiMinimizationIterative(ImageRAW *L, ImageRAW *g,
+        ImageRAW *omega = NULL, float alpha = 1.0f, float lambda = 0.2f,
+        float LISCHINSKI_EPSILON = 0.0001f, ImageRAW *imgOut = NULL,
+        bool bWarmStart = false, WeightedLaplacianSolver *solver = NULL)
+{
+    if(L == NULL || g == NULL) {
+        return NULL;
+    }
+
+    if(imgOut == NULL) {
+        imgOut = L->AllocateSimilarOne();
+        bWarmStart = false;
+    }
+
+    int tot = L->width * L->height;
+
+    ImageRAW *b = L->AllocateSimilarOne();
+
+    for(int i = 0; i < tot; i++) {
+        b->data[i] = (omega != NULL) ? omega->data[i] * g->data[i] : 0.0f;
+    }
+
+    ImageRAW *zero = NULL;
+
+    if(omega == NULL) {
+        zero = L->AllocateSimilarOne();
+        zero->Assign(0.0f);
+        omega = zero;
+    }
+
+    bool bAllocated = (solver == NULL);
+
+    if(bAllocated) {
+        solver = new WeightedLaplacianSolver();
+    }
+
+    solver->Update(L, omega, alpha, lambda, LISCHINSKI_EPSILON);
+    solver->Process(b, imgOut, bWarmStart);
+
+    if(bAllocated) {
+        delete solver;
+    }
+
+    if(zero != NULL) {
+        delete zero;
+    }
+
+    delete b;
+
+    return imgOut;
+}
+
+} // end namespace pic
+
 #endif /* PIC_TONE_MAPPING_LISCHINSKI_MINIMIZATION_HPP */
 
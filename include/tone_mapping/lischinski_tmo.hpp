@@ -60,11 +60,13 @@ ImageRAW *LischinskiTMO(ImageRAW *imgIn, ImageRAW *imgOut = NULL,
     ImageRAW *lum_log = lum->Clone();
     lum_log->ApplyFunction(log2f);
 
-    float maxL = lum->getMaxVal()[0];
-    float minL = lum->getMinVal()[0];
+    ImageStatistics stats = lum->getStatistics(IS_MIN | IS_MAX | IS_LOG_MEAN);
+
+    float maxL = stats.maxVal[0];
+    float minL = stats.minVal[0];
     float maxL_log = log2f(maxL);
     float minL_log = log2f(minL);
-    float Lav = lum->getLogMeanVal()[0];
+    float Lav = stats.logMeanVal[0];
 
     int Z = int(ceilf(maxL_log - minL_log));
 
@@ -124,6 +126,10 @@ ImageRAW *LischinskiTMO(ImageRAW *imgIn, ImageRAW *imgOut = NULL,
             float L_log = lum_log->data[indx];
             int c = int(ceilf(L_log - minL_log));
 
+            if(c >= Z) {
+                c = Z - 1;
+            }
+
             fstopMap->data[indx] = fstop[c];
 
         }
@@ -80,9 +80,11 @@ ImageRAW *ReinhardTMO(ImageRAW *imgIn, ImageRAW *imgOut = NULL, float alpha = -1
     //luminance image
     ImageRAW *lum = FilterLuminance::Execute(imgIn, NULL, LT_CIE_LUMINANCE);
 
-    float LMax = lum->getMaxVal()[0];
-    float LMin = lum->getMinVal()[0];
-    float LogAverage = lum->getLogMeanVal()[0];
+    ImageStatistics stats = lum->getStatistics(IS_MIN | IS_MAX | IS_LOG_MEAN);
+
+    float LMax = stats.maxVal[0];
+    float LMin = stats.minVal[0];
+    float LogAverage = stats.logMeanVal[0];
 
     if(alpha <= 0.0f) {
         alpha = EstimateAlpha(LMax, LMin, LogAverage);
@@ -136,8 +136,9 @@ public:
         FilterLuminance::Execute(imgIn, imgOut, LT_CIE_LUMINANCE);
 
         //Get min and max value
-        maxVal = imgOut->getMaxVal()[0];
-        minVal = imgOut->getMinVal()[0] + 1e-9f;
+        ImageStatistics stats = imgOut->getStatistics(IS_MIN | IS_MAX);
+        maxVal = stats.maxVal[0];
+        minVal = stats.minVal[0] + 1e-9f;
 
         ImageRAW *imgIn_flt = SegmentationBilatearal(imgIn);
 
@@ -0,0 +1,658 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+PICCANTE is free software; you can redistribute it and/or modify
+under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation; either version 3.0 of
+the License, or (at your option) any later version.
+
+PICCANTE is distributed in the hope that it will be useful, but
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU Lesser General Public License
+( http://www.gnu.org/licenses/lgpl-3.0.html ) for more details.
+
+*/
+
+#ifndef PIC_TONE_MAPPING_VIDEO_TMO_HPP
+#define PIC_TONE_MAPPING_VIDEO_TMO_HPP
+
+#include <vector>
+
+#ifndef PIC_DISABLE_THREAD
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#endif
+
+#include "image_raw.hpp"
+#include "util/image_statistics.hpp"
+#include "filtering/filter_luminance.hpp"
+#include "filtering/filter_bilateral_2dg.hpp"
+#include "filtering/filter_sigmoid_tmo.hpp"
+#include "filtering/filter_drago_tmo.hpp"
+#include "algorithms/weighted_laplacian_solver.hpp"
+#include "tone_mapping/reinhard_tmo.hpp"
+#include "tone_mapping/lischinski_minimization.hpp"
+
+namespace pic {
+
+enum VIDEO_TMO_TYPE {VT_REINHARD, VT_DRAGO, VT_LISCHINSKI};
+
+/**
+ * @brief The VideoTMO class tone maps the frames of a stream with the
+ * operators of ReinhardTMO, DragoTMO, and LischinskiTMO. Luminance images,
+ * temporaries, filters, the bilateral grid, and the solver of Lischinski's
+ * minimization are kept across frames, and they are reallocated only when
+ * the size of the frames changes. Reinhard et al.'s operator filters with
+ * the bilateral grid instead of the stochastic bilateral filter, since the
+ * grid is faster at its large spatial sigma and it has no noise, which
+ * would flicker. Minimum,
+ * maximum, and log-average luminance are smoothed over time in the
+ * logarithmic domain, which avoids flickering. The luminance and the
+ * statistics of the next frame can be computed on a worker thread, which
+ * lives as long as the object, while the current frame is mapped.
+ */
+class VideoTMO
+{
+protected:
+    VIDEO_TMO_TYPE type;
+
+    //parameters
+    float alpha, whitePoint, phi, Ld_Max, b, alpha_l, temporalWeight;
+
+    //temporally smoothed statistics
+    bool bStats;
+    float LMin, LMax, LogAverage;
+
+    //double buffered luminance and statistics; cur is the current frame
+    FilterLuminance fltLum[2];
+    ImageRAW *lum[2];
+    ImageStatistics stats[2];
+    int cur;
+
+    //statistics of the next frame
+    ImageRAW *imgPrefetch;
+    int slotPrefetch;
+    bool bPrefetch, bExit;
+
+#ifndef PIC_DISABLE_THREAD
+    std::thread *prefetch;
+    std::mutex mutexPrefetch;
+    std::condition_variable cvPrefetch;
+#endif
+
+    //Reinhard et al. 2002
+    FilterBilateral2DG fltBilateral;
+    FilterSigmoidTMO fltSigmoid;
+    ImageRAW *filteredLum, *tonemapped;
+
+    //Drago et al. 2003
+    FilterDragoTMO fltDrago;
+
+    //Lischinski et al. 2006
+    ImageRAW *lum_log, *fstopMap, *omega, *fstopOut;
+    WeightedLaplacianSolver *solver;
+    std::vector<float> Rz, fstop;
+    std::vector<int> counter;
+
+    int width, height;
+
+    /**
+     * @brief SetNULL
+     */
+    void SetNULL()
+    {
+        width = -1;
+        height = -1;
+
+        lum[0] = NULL;
+        lum[1] = NULL;
+        cur = 0;
+
+        imgPrefetch = NULL;
+        slotPrefetch = 0;
+        bPrefetch = false;
+        bExit = false;
+
+#ifndef PIC_DISABLE_THREAD
+        prefetch = NULL;
+#endif
+
+        filteredLum = NULL;
+        tonemapped = NULL;
+
+        lum_log = NULL;
+        fstopMap = NULL;
+        omega = NULL;
+        fstopOut = NULL;
+        solver = NULL;
+    }
+
+    /**
+     * @brief Release frees the buffers which depend on the size of the
+     * frames.
+     */
+    void Release()
+    {
+        for(int i = 0; i < 2; i++) {
+            if(lum[i] != NULL) {
+                delete lum[i];
+                lum[i] = NULL;
+            }
+        }
+
+        if(filteredLum != NULL) {
+            delete filteredLum;
+            filteredLum = NULL;
+        }
+
+        if(tonemapped != NULL) {
+            delete tonemapped;
+            tonemapped = NULL;
+        }
+
+        if(lum_log != NULL) {
+            delete lum_log;
+            lum_log = NULL;
+        }
+
+        if(fstopMap != NULL) {
+            delete fstopMap;
+            fstopMap = NULL;
+        }
+
+        if(omega != NULL) {
+            delete omega;
+            omega = NULL;
+        }
+
+        if(fstopOut != NULL) {
+            delete fstopOut;
+            fstopOut = NULL;
+        }
+    }
+
+    /**
+     * @brief Destroy frees all memory.
+     */
+    void Destroy()
+    {
+        Wait(NULL);
+
+#ifndef PIC_DISABLE_THREAD
+        if(prefetch != NULL) {
+            {
+                std::lock_guard<std::mutex> lock(mutexPrefetch);
+                bExit = true;
+            }
+
+            cvPrefetch.notify_all();
+            prefetch->join();
+            delete prefetch;
+            prefetch = NULL;
+        }
+#endif
+
+        Release();
+
+        if(solver != NULL) {
+            delete solver;
+            solver = NULL;
+        }
+    }
+
+    /**
+     * @brief ComputeStatistics computes the luminance of img and its
+     * statistics in a slot.
+     * @param img
+     * @param slot
+     * @param maxThreads
+     */
+    void ComputeStatistics(ImageRAW *img, int slot, int maxThreads)
+    {
+        fltLum[slot].SetMaxThreads(maxThreads);
+        lum[slot] = fltLum[slot].ProcessP(Single(img), lum[slot]);
+
+        //Drago et al.'s operator needs the maximum only
+        unsigned int flags = (type == VT_DRAGO) ? IS_MAX :
+                             (IS_MIN | IS_MAX | IS_LOG_MEAN);
+
+        ImageRAW *L = lum[slot];
+        BBox box(L->width, L->height, L->frames);
+        stats[slot].Compute(L->data, L->width, L->height, L->frames, L->channels,
+                            &box, flags, maxThreads);
+    }
+
+#ifndef PIC_DISABLE_THREAD
+    /**
+     * @brief PrefetchLoop is the loop of the worker thread; it computes the
+     * statistics of a frame each time Prefetch posts one.
+     */
+    void PrefetchLoop()
+    {
+        std::unique_lock<std::mutex> lock(mutexPrefetch);
+
+        while(true) {
+            while(!bExit && !bPrefetch) {
+                cvPrefetch.wait(lock);
+            }
+
+            if(!bPrefetch) {
+                return;
+            }
+
+            ImageRAW *img = imgPrefetch;
+            int slot = slotPrefetch;
+
+            lock.unlock();
+            ComputeStatistics(img, slot, 1);
+            lock.lock();
+
+            bPrefetch = false;
+            cvPrefetch.notify_all();
+        }
+    }
+#endif
+
+    /**
+     * @brief Prefetch posts the statistics of img in a slot to the worker
+     * thread, which is started at the first call.
+     * @param img
+     * @param slot
+     */
+    void Prefetch(ImageRAW *img, int slot)
+    {
+#ifndef PIC_DISABLE_THREAD
+        {
+            std::lock_guard<std::mutex> lock(mutexPrefetch);
+            imgPrefetch = img;
+            slotPrefetch = slot;
+            bPrefetch = true;
+        }
+
+        if(prefetch == NULL) {
+            prefetch = new std::thread(&VideoTMO::PrefetchLoop, this);
+        } else {
+            cvPrefetch.notify_all();
+        }
+#endif
+    }
+
+    /**
+     * @brief Wait waits for the statistics of the next frame.
+     * @param img
+     * @return It returns true if the statistics of img were computed.
+     */
+    bool Wait(ImageRAW *img)
+    {
+#ifndef PIC_DISABLE_THREAD
+        std::unique_lock<std::mutex> lock(mutexPrefetch);
+
+        while(bPrefetch) {
+            cvPrefetch.wait(lock);
+        }
+#endif
+
+        bool bRet = (img != NULL) && (img == imgPrefetch);
+        imgPrefetch = NULL;
+        return bRet;
+    }
+
+    /**
+     * @brief Smooth blends a statistic of the previous frames with the one
+     * of the current frame in the logarithmic domain.
+     * @param prev
+     * @param value
+     * @return
+     */
+    float Smooth(float prev, float value)
+    {
+        if((prev > 0.0f) && (value > 0.0f)) {
+            return powf(2.0f, log2f(prev) + temporalWeight * (log2f(value) - log2f(prev)));
+        } else {
+            return prev + temporalWeight * (value - prev);
+        }
+    }
+
+    /**
+     * @brief UpdateStatistics updates the smoothed statistics with the ones
+     * of the current frame.
+     */
+    void UpdateStatistics()
+    {
+        ImageStatistics &s = stats[cur];
+        float curMax = s.maxVal[0];
+        float curMin = (s.flags & IS_MIN) ? s.minVal[0] : 0.0f;
+        float curLogAverage = (s.flags & IS_LOG_MEAN) ? s.logMeanVal[0] : 0.0f;
+
+        if(!bStats) {
+            LMin = curMin;
+            LMax = curMax;
+            LogAverage = curLogAverage;
+            bStats = true;
+        } else {
+            LMin = Smooth(LMin, curMin);
+            LMax = Smooth(LMax, curMax);
+            LogAverage = Smooth(LogAverage, curLogAverage);
+        }
+    }
+
+    /**
+     * @brief ProcessReinhard applies ReinhardTMO with the smoothed
+     * statistics.
+     * @param imgOut
+     */
+    void ProcessReinhard(ImageRAW *imgOut)
+    {
+        ImageRAW *L = lum[cur];
+
+        float alpha_c = alpha > 0.0f ? alpha : EstimateAlpha(LMax, LMin, LogAverage);
+        float whitePoint_c = whitePoint > 0.0f ? whitePoint :
+                             EstimateWhitePoint(LMax, LMin);
+
+        //Filtering luminance in the sigmoid-space
+        L->ApplyFunction(&Sigmoid);
+
+        float s_max = 8.0f;
+        float sigma_s = 0.56f * powf(1.6f, s_max);
+        float sigma_r = powf(2.0f, phi) * alpha_c / (s_max * s_max);
+
+        //the grid is kept while its size does not change
+        fltBilateral.Update(sigma_s, sigma_r);
+        filteredLum = fltBilateral.ProcessP(Single(L), filteredLum);
+
+        L->ApplyFunction(&SigmoidInv);
+        filteredLum->ApplyFunction(&SigmoidInv);
+
+        //Applying a sigmoid filter
+        fltSigmoid.Update(SIG_TMO, alpha_c, whitePoint_c, LogAverage, false);
+        tonemapped = fltSigmoid.ProcessP(Double(L, filteredLum), tonemapped);
+
+        //Removing HDR luminance and replacing it with LDR one
+        imgOut->changeLum(L, tonemapped);
+        imgOut->removeSpecials();
+    }
+
+    /**
+     * @brief ProcessLischinski applies LischinskiTMO with the smoothed
+     * statistics; the minimization is solved iteratively starting from
+     * the solution of the previous frame.
+     * @param imgOut
+     */
+    void ProcessLischinski(ImageRAW *imgOut)
+    {
+        ImageRAW *L = lum[cur];
+
+        if(lum_log == NULL) {
+            lum_log = L->AllocateSimilarOne();
+            fstopMap = L->AllocateSimilarOne();
+            omega = L->AllocateSimilarOne();
+            omega->Assign(0.007f);
+        }
+
+        int size = L->width * L->height;
+
+        for(int i = 0; i < size; i++) {
+            lum_log->data[i] = log2f(MAX(L->data[i], HARMONIC_MEAN_EPSILONf));
+        }
+
+        float minL_log = log2f(MAX(LMin, HARMONIC_MEAN_EPSILONf));
+        float maxL_log = log2f(MAX(LMax, HARMONIC_MEAN_EPSILONf));
+        float Lav = LogAverage;
+
+        int Z = MAX(int(ceilf(maxL_log - minL_log)), 1);
+
+        Rz.assign(Z, 0.0f);
+        fstop.assign(Z, 0.0f);
+        counter.assign(Z, 0);
+
+        //zones; the smoothed range may not contain all values of the frame
+        for(int i = 0; i < size; i++) {
+            int c = int(ceilf(lum_log->data[i] - minL_log));
+            c = CLAMPi(c, 0, Z - 1);
+
+            Rz[c] += L->data[i];
+            counter[c]++;
+        }
+
+        for(int i = 0; i < Z; i++) {
+            if(counter[i] > 0) {
+                //Average
+                Rz[i] /= float(counter[i]);
+
+                //photographic operator
+                Rz[i] = Rz[i] * alpha_l / Lav;
+                float f = Rz[i] / (Rz[i] + 1.0f);
+                float tmp = f / Rz[i];
+                fstop[i] = log2f(tmp);
+            }
+        }
+
+        //Create fstop maps
+        for(int i = 0; i < size; i++) {
+            int c = int(ceilf(lum_log->data[i] - minL_log));
+            fstopMap->data[i] = fstop[CLAMPi(c, 0, Z - 1)];
+        }
+
+        //Lischinski minimization
+        if(solver == NULL) {
+            solver = new WeightedLaplacianSolver();
+        }
+
+        bool bWarmStart = (fstopOut != NULL);
+        fstopOut = LischinskiMinimizationIterative(lum_log, fstopMap, omega, 1.0f,
+                   0.2f, 0.0001f, fstopOut, bWarmStart, solver);
+
+        int channels = imgOut->channels;
+
+        for(int i = 0; i < size; i++) {
+            float *val = &imgOut->data[i * channels];
+            float tmpValue = powf(2.0f, fstopOut->data[i]);
+
+            for(int k = 0; k < channels; k++) {
+                val[k] *= tmpValue;
+            }
+        }
+    }
+
+public:
+
+    /**
+     * @brief VideoTMO
+     * @param type is the operator.
+     * @param temporalWeight is the weight of the statistics of the current
+     * frame in (0, 1]; 1 means no temporal smoothing.
+     */
+    VideoTMO(VIDEO_TMO_TYPE type = VT_REINHARD, float temporalWeight = 0.1f) : fltBilateral(1.0f, 1.0f)
+    {
+        SetNULL();
+
+        alpha = -1.0f;
+        whitePoint = -1.0f;
+        phi = 8.0f;
+        Ld_Max = 100.0f;
+        b = 0.95f;
+        alpha_l = 0.5f;
+
+        Update(type, temporalWeight);
+    }
+
+    ~VideoTMO()
+    {
+        Destroy();
+    }
+
+    /**
+     * @brief Update sets the operator and the temporal smoothing.
+     * @param type
+     * @param temporalWeight
+     */
+    void Update(VIDEO_TMO_TYPE type, float temporalWeight = 0.1f)
+    {
+        //the statistics of the next frame depend on the operator
+        Wait(NULL);
+
+        this->type = type;
+
+        if((temporalWeight > 0.0f) && (temporalWeight <= 1.0f)) {
+            this->temporalWeight = temporalWeight;
+        } else {
+            this->temporalWeight = 0.1f;
+        }
+
+        Reset();
+    }
+
+    /**
+     * @brief SetReinhard sets the parameters of ReinhardTMO.
+     * @param alpha is estimated for each frame if it is <= 0.
+     * @param whitePoint is estimated for each frame if it is <= 0.
+     * @param phi
+     */
+    void SetReinhard(float alpha = -1.0f, float whitePoint = -1.0f, float phi = 8.0f)
+    {
+        this->alpha = alpha;
+        this->whitePoint = whitePoint;
+        this->phi = phi;
+    }
+
+    /**
+     * @brief SetDrago sets the parameters of DragoTMO.
+     * @param Ld_Max
+     * @param b
+     */
+    void SetDrago(float Ld_Max = 100.0f, float b = 0.95f)
+    {
+        this->Ld_Max = Ld_Max;
+        this->b = b;
+    }
+
+    /**
+     * @brief SetLischinski sets the parameters of LischinskiTMO.
+     * @param alpha
+     */
+    void SetLischinski(float alpha = 0.5f)
+    {
+        alpha_l = alpha > 0.0f ? alpha : 0.5f;
+    }
+
+    /**
+     * @brief Reset discards the smoothed statistics; e.g., at a scene cut.
+     */
+    void Reset()
+    {
+        bStats = false;
+        LMin = 0.0f;
+        LMax = 0.0f;
+        LogAverage = 0.0f;
+    }
+
+    /**
+     * @brief Process tone maps a frame.
+     * @param imgIn is the current frame.
+     * @param imgOut is the output; if it is NULL, it is allocated.
+     * @param imgNext is the next frame or NULL. Its luminance and statistics
+     * are computed on the worker thread while imgIn is mapped, and they are
+     * used by the next call if its imgIn is imgNext. Therefore, imgNext
+     * must not be modified until the next call.
+     * @return It returns imgOut.
+     */
+    ImageRAW *Process(ImageRAW *imgIn, ImageRAW *imgOut = NULL,
+                      ImageRAW *imgNext = NULL)
+    {
+        bool bReady = Wait(imgIn);
+
+        if(imgIn == NULL) {
+            return imgOut;
+        }
+
+        if((type == VT_LISCHINSKI) && (imgIn->channels != 3)) {
+            return NULL;
+        }
+
+        if((imgIn->width != width) || (imgIn->height != height)) {
+            Release();
+            width = imgIn->width;
+            height = imgIn->height;
+            bReady = false;
+        }
+
+        if(bReady) {
+            cur = 1 - cur;
+        } else {
+            ComputeStatistics(imgIn, cur, -1);
+        }
+
+        //the statistics of the next frame are computed outside the pool,
+        //so they overlap with the parallel mapping of this frame
+        if((imgNext != NULL) && (imgNext != imgIn) &&
+           (imgNext->width == width) && (imgNext->height == height)) {
+            Prefetch(imgNext, 1 - cur);
+        }
+
+        UpdateStatistics();
+
+        //Drago et al.'s operator writes all output values
+        if(type == VT_DRAGO) {
+            fltDrago.Update(Ld_Max, b, LMax, LMax);
+            return fltDrago.ProcessP(Double(imgIn, lum[cur]), imgOut);
+        }
+
+        if(imgOut == NULL) {
+            imgOut = imgIn->Clone();
+        } else {
+            if(imgOut != imgIn) {
+                imgOut->Assign(imgIn);
+            }
+        }
+
+        if(type == VT_REINHARD) {
+            ProcessReinhard(imgOut);
+        } else {
+            ProcessLischinski(imgOut);
+        }
+
+        return imgOut;
+    }
+
+    /**
+     * @brief getLogAverage returns the smoothed log-average luminance.
+     * @return
+     */
+    float getLogAverage()
+    {
+        return LogAverage;
+    }
+
+    /**
+     * @brief getMinLuminance returns the smoothed minimum luminance.
+     * @return
+     */
+    float getMinLuminance()
+    {
+        return LMin;
+    }
+
+    /**
+     * @brief getMaxLuminance returns the smoothed maximum luminance.
+     * @return
+     */
+    float getMaxLuminance()
+    {
+        return LMax;
+    }
+};
+
+} // end namespace pic
+
+#endif /* PIC_TONE_MAPPING_VIDEO_TMO_HPP */
+
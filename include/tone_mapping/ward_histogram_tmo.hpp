@@ -66,7 +66,7 @@ inline ImageRAW *WardHistogramTMO(ImageRAW *imgIn, ImageRAW *imgOut = NULL,
     ImageRAW *Lscaled = FilterSampler2D::Execute(L, NULL, fScaleX, fScaleY, &isb);
 
     float LMin = Lscaled->getGT(0.0f);
-    float LMax = Lscaled->getMaxVal()[0];
+    float LMax = Lscaled->getStatistics(IS_MAX).maxVal[0];
     float LlMax = logf(LMax);
     float LlMin = logf(LMin);
 
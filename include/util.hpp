@@ -34,6 +34,8 @@ See the GNU Lesser General Public License
 #include "util/compability.hpp"
 #include "util/convert_raw_to_images.hpp"
 #include "util/file_lister.hpp"
+#include "util/hash.hpp"
+#include "util/hamming_distance.hpp"
 
 #ifndef PIC_DISABLE_OPENGL
 #include "util/gl/stroke.hpp"
@@ -44,19 +46,28 @@ See the GNU Lesser General Public License
 #include "util/gl/tone.hpp"
 #endif
 
+#include "util/image_histogram.hpp"
+#include "util/image_percentile.hpp"
 #include "util/image_sampler.hpp"
+#include "util/image_statistics.hpp"
 #include "util/io.hpp"
+#include "util/mapped_file.hpp"
 #include "util/math.hpp"
 #include "util/matrix_3_x_3.hpp"
 #include "util/eigen_util.hpp"
 #include "util/computer_vision_functions.hpp"
+#include "util/permutohedral_lattice.hpp"
 #include "util/point_samplers.hpp"
 #include "util/precomputed_difference_of_gaussians.hpp"
 #include "util/precomputed_gaussian.hpp"
 #include "util/raw.hpp"
+#include "util/result_cache.hpp"
+#include "util/simd.hpp"
 #include "util/string.hpp"
 #include "util/tile.hpp"
 #include "util/tile_list.hpp"
+#include "util/thread_pool.hpp"
+#include "util/union_find.hpp"
 #include "util/vec.hpp"
 #include "util/warp_square_circle.hpp"
 #include "util/rasterizer.hpp"
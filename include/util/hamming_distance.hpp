@@ -0,0 +1,396 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+PICCANTE is free software; you can redistribute it and/or modify
+under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation; either version 3.0 of
+the License, or (at your option) any later version.
+
+PICCANTE is distributed in the hope that it will be useful, but
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU Lesser General Public License
+( http://www.gnu.org/licenses/lgpl-3.0.html ) for more details.
+
+*/
+
+#ifndef PIC_UTIL_HAMMING_DISTANCE_HPP
+#define PIC_UTIL_HAMMING_DISTANCE_HPP
+
+#include <string.h>
+
+#include "base.hpp"
+#include "util/simd.hpp"
+
+#if defined(PIC_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define PIC_TARGET_POPCNT       __attribute__((target("popcnt")))
+#define PIC_TARGET_AVX2_POPCNT  __attribute__((target("avx2,popcnt")))
+#else
+#define PIC_TARGET_POPCNT
+#define PIC_TARGET_AVX2_POPCNT
+#endif
+
+namespace pic {
+
+/**
+ * @brief DetectPOPCNT
+ * @return It returns true if the running CPU has the POPCNT instruction.
+ */
+PIC_INLINE bool DetectPOPCNT()
+{
+#if defined(PIC_SIMD_X86)
+    #if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 23)) != 0;
+    #else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("popcnt") != 0;
+    #endif
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief hasPOPCNT; the instruction is detected once.
+ * @return
+ */
+inline bool hasPOPCNT()
+{
+    static bool bPOPCNT = DetectPOPCNT();
+    return bPOPCNT;
+}
+
+/**
+ * @brief PopCount32 counts the bits set in x.
+ * @param x
+ * @return
+ */
+inline unsigned int PopCount32(unsigned int x)
+{
+    x = x - ((x >> 1) & 0x55555555);
+    x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+    x = (x + (x >> 4)) & 0x0F0F0F0F;
+    return (x * 0x01010101) >> 24;
+}
+
+/**
+ * @brief PopCount64 counts the bits set in x.
+ * @param x
+ * @return
+ */
+inline unsigned int PopCount64(unsigned long long x)
+{
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (unsigned int)((x * 0x0101010101010101ULL) >> 56);
+}
+
+/**
+ * @brief HammingDistanceScalar
+ * @param a
+ * @param b
+ * @param n
+ * @return
+ */
+inline unsigned int HammingDistanceScalar(const unsigned int *a,
+        const unsigned int *b, int n)
+{
+    unsigned int ret = 0;
+
+    for(int i = 0; i < n; i++) {
+        ret += PopCount32(a[i] ^ b[i]);
+    }
+
+    return ret;
+}
+
+/**
+ * @brief WordDistanceScalar
+ * @param a
+ * @param b
+ * @param n
+ * @return
+ */
+inline unsigned int WordDistanceScalar(const unsigned int *a,
+                                       const unsigned int *b, int n)
+{
+    unsigned int ret = 0;
+
+    for(int i = 0; i < n; i++) {
+        ret += (a[i] != b[i]) ? 1 : 0;
+    }
+
+    return ret;
+}
+
+#ifdef PIC_SIMD_X86
+
+PIC_TARGET_POPCNT inline unsigned int HammingDistancePOPCNT(
+        const unsigned int *a, const unsigned int *b, int n)
+{
+    unsigned int ret = 0;
+    int i = 0;
+
+#if defined(__x86_64__) || defined(_M_X64)
+    for(; i <= (n - 2); i += 2) {
+        unsigned long long x, y;
+        memcpy(&x, a + i, sizeof(x));
+        memcpy(&y, b + i, sizeof(y));
+        ret += (unsigned int)(_mm_popcnt_u64(x ^ y));
+    }
+#endif
+
+    for(; i < n; i++) {
+        ret += _mm_popcnt_u32(a[i] ^ b[i]);
+    }
+
+    return ret;
+}
+
+PIC_TARGET_AVX2_POPCNT inline unsigned int HammingDistanceAVX2(
+        const unsigned int *a, const unsigned int *b, int n)
+{
+    //nibble lookup table of bit counts
+    const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3,
+                                         1, 2, 2, 3, 2, 3, 3, 4,
+                                         0, 1, 1, 2, 1, 2, 2, 3,
+                                         1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+
+    __m256i acc = _mm256_setzero_si256();
+    int i = 0;
+
+    for(; i <= (n - 8); i += 8) {
+        __m256i v = _mm256_xor_si256(
+                        _mm256_loadu_si256((const __m256i *)(a + i)),
+                        _mm256_loadu_si256((const __m256i *)(b + i)));
+
+        __m256i lo = _mm256_and_si256(v, mask);
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), mask);
+        __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lut, lo),
+                                      _mm256_shuffle_epi8(lut, hi));
+
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(cnt, _mm256_setzero_si256()));
+    }
+
+    //horizontal sum of the four 64-bit counters; it does not use
+    //_mm256_extract_epi64, which exists only on x86-64
+    __m128i sum = _mm_add_epi64(_mm256_castsi256_si128(acc),
+                                _mm256_extracti128_si256(acc, 1));
+    sum = _mm_add_epi64(sum, _mm_unpackhi_epi64(sum, sum));
+
+    unsigned int ret = (unsigned int)(_mm_cvtsi128_si32(sum));
+
+    for(; i < n; i++) {
+        ret += _mm_popcnt_u32(a[i] ^ b[i]);
+    }
+
+    return ret;
+}
+
+PIC_TARGET_SSE2 inline unsigned int WordDistanceSSE2(const unsigned int *a,
+        const unsigned int *b, int n)
+{
+    unsigned int same = 0;
+    int i = 0;
+
+    for(; i <= (n - 4); i += 4) {
+        __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(a + i)),
+                                     _mm_loadu_si128((const __m128i *)(b + i)));
+        same += PopCount32(_mm_movemask_ps(_mm_castsi128_ps(eq)));
+    }
+
+    return (unsigned int)(i) - same + WordDistanceScalar(a + i, b + i, n - i);
+}
+
+#endif
+
+#ifdef PIC_SIMD_NEON
+
+inline unsigned int HammingDistanceNEON(const unsigned int *a,
+                                        const unsigned int *b, int n)
+{
+    uint32x4_t acc = vdupq_n_u32(0);
+    int i = 0;
+
+    for(; i <= (n - 4); i += 4) {
+        uint32x4_t v = veorq_u32(vld1q_u32(a + i), vld1q_u32(b + i));
+        uint8x16_t cnt = vcntq_u8(vreinterpretq_u8_u32(v));
+        acc = vpadalq_u16(acc, vpaddlq_u8(cnt));
+    }
+
+    unsigned int ret = vgetq_lane_u32(acc, 0) + vgetq_lane_u32(acc, 1) +
+                       vgetq_lane_u32(acc, 2) + vgetq_lane_u32(acc, 3);
+
+    return ret + HammingDistanceScalar(a + i, b + i, n - i);
+}
+
+#endif
+
+/**
+ * @brief The HAMMING_KERNEL enum lists the kernels for the Hamming distance.
+ */
+enum HAMMING_KERNEL {HK_SCALAR, HK_POPCNT, HK_AVX2, HK_NEON};
+
+/**
+ * @brief DetectHammingKernel selects the fastest kernel for the running CPU.
+ * @return
+ */
+PIC_INLINE HAMMING_KERNEL DetectHammingKernel()
+{
+    SIMD_LEVEL level = getSIMDLevel();
+
+    if(level == SIMD_NEON) {
+        return HK_NEON;
+    }
+
+    if(hasPOPCNT()) {
+        return (level == SIMD_AVX2) ? HK_AVX2 : HK_POPCNT;
+    }
+
+    return HK_SCALAR;
+}
+
+/**
+ * @brief getHammingKernel returns the kernel used for the Hamming
+ * distance; it is selected once.
+ * @return
+ */
+inline HAMMING_KERNEL getHammingKernel()
+{
+    static HAMMING_KERNEL kernel = DetectHammingKernel();
+    return kernel;
+}
+
+/**
+ * @brief HammingDistance counts the different bits of two bit strings of
+ * n words.
+ * @param a
+ * @param b
+ * @param n
+ * @return
+ */
+inline unsigned int HammingDistance(const unsigned int *a,
+                                    const unsigned int *b, int n)
+{
+    switch(getHammingKernel()) {
+#ifdef PIC_SIMD_X86
+    case HK_AVX2:
+        return HammingDistanceAVX2(a, b, n);
+
+    case HK_POPCNT:
+        return HammingDistancePOPCNT(a, b, n);
+#endif
+
+#ifdef PIC_SIMD_NEON
+    case HK_NEON:
+        return HammingDistanceNEON(a, b, n);
+#endif
+
+    default:
+        return HammingDistanceScalar(a, b, n);
+    }
+}
+
+/**
+ * @brief WordDistance counts the different words of two strings of n words.
+ * @param a
+ * @param b
+ * @param n
+ * @return
+ */
+inline unsigned int WordDistance(const unsigned int *a, const unsigned int *b,
+                                 int n)
+{
+#ifdef PIC_SIMD_X86
+    if(getSIMDLevel() != SIMD_NONE) {
+        return WordDistanceSSE2(a, b, n);
+    }
+#endif
+
+    return WordDistanceScalar(a, b, n);
+}
+
+#ifdef PIC_SIMD_X86
+
+PIC_TARGET_POPCNT inline void HammingDistancesPOPCNT(const unsigned int *q,
+        const unsigned int *refs, int nRefs, int n, unsigned int *out)
+{
+    for(int j = 0; j < nRefs; j++) {
+        out[j] = HammingDistancePOPCNT(q, refs + j * n, n);
+    }
+}
+
+PIC_TARGET_AVX2_POPCNT inline void HammingDistancesAVX2(const unsigned int *q,
+        const unsigned int *refs, int nRefs, int n, unsigned int *out)
+{
+    for(int j = 0; j < nRefs; j++) {
+        out[j] = HammingDistanceAVX2(q, refs + j * n, n);
+    }
+}
+
+#endif
+
+/**
+ * @brief HammingDistances computes the Hamming distance between q and
+ * each of the nRefs contiguous bit strings in refs; the kernel is
+ * selected once for the whole block.
+ * @param q is a bit string of n words.
+ * @param refs
+ * @param nRefs
+ * @param n
+ * @param out is an array of nRefs distances.
+ */
+inline void HammingDistances(const unsigned int *q, const unsigned int *refs,
+                             int nRefs, int n, unsigned int *out)
+{
+    switch(getHammingKernel()) {
+#ifdef PIC_SIMD_X86
+    case HK_AVX2:
+        HammingDistancesAVX2(q, refs, nRefs, n, out);
+        return;
+
+    case HK_POPCNT:
+        HammingDistancesPOPCNT(q, refs, nRefs, n, out);
+        return;
+#endif
+
+    default:
+        for(int j = 0; j < nRefs; j++) {
+            out[j] = HammingDistance(q, refs + j * n, n);
+        }
+    }
+}
+
+/**
+ * @brief WordDistances computes the word distance between q and each of
+ * the nRefs contiguous strings in refs.
+ * @param q is a string of n words.
+ * @param refs
+ * @param nRefs
+ * @param n
+ * @param out is an array of nRefs distances.
+ */
+inline void WordDistances(const unsigned int *q, const unsigned int *refs,
+                          int nRefs, int n, unsigned int *out)
+{
+    for(int j = 0; j < nRefs; j++) {
+        out[j] = WordDistance(q, refs + j * n, n);
+    }
+}
+
+} // end namespace pic
+
+#endif /* PIC_UTIL_HAMMING_DISTANCE_HPP */
+
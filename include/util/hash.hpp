@@ -0,0 +1,114 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+PICCANTE is free software; you can redistribute it and/or modify
+under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation; either version 3.0 of
+the License, or (at your option) any later version.
+
+PICCANTE is distributed in the hope that it will be useful, but
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU Lesser General Public License
+( http://www.gnu.org/licenses/lgpl-3.0.html ) for more details.
+
+*/
+
+#ifndef PIC_UTIL_HASH_HPP
+#define PIC_UTIL_HASH_HPP
+
+#include <string.h>
+#include <vector>
+
+#include "base.hpp"
+#include "util/math.hpp"
+#include "util/thread_pool.hpp"
+
+namespace pic {
+
+//size of the chunks hashed in parallel
+#define HASH_CHUNK_SIZE (1 << 20)
+
+/**
+ * @brief HashBytes computes a fast non-cryptographic 64-bit hash of a buffer.
+ * @param buffer
+ * @param n is the size of buffer in bytes.
+ * @param seed
+ * @return
+ */
+inline unsigned long long HashBytes(const void *buffer, size_t n,
+                                    unsigned long long seed)
+{
+    const unsigned long long m = 0xc6a4a7935bd1e995ULL;
+    const unsigned char *p = (const unsigned char *) buffer;
+
+    unsigned long long h = seed ^ (n * m);
+
+    size_t n8 = n / 8;
+
+    for(size_t i = 0; i < n8; i++) {
+        unsigned long long k;
+        memcpy(&k, p + i * 8, 8);
+
+        k *= m;
+        k ^= k >> 47;
+        k *= m;
+
+        h ^= k;
+        h *= m;
+    }
+
+    for(size_t i = n8 * 8; i < n; i++) {
+        h ^= (unsigned long long)(p[i]) << ((i & 7) * 8);
+        h *= m;
+    }
+
+    h ^= h >> 47;
+    h *= m;
+    h ^= h >> 47;
+
+    return h;
+}
+
+/**
+ * @brief HashBytesParallel computes the hash of a large buffer. Chunks
+ * of HASH_CHUNK_SIZE bytes are hashed in parallel and their hashes are
+ * combined in a fixed order.
+ * @param buffer
+ * @param n is the size of buffer in bytes.
+ * @param seed
+ * @return
+ */
+inline unsigned long long HashBytesParallel(const void *buffer, size_t n,
+        unsigned long long seed)
+{
+    size_t nChunks = (n + HASH_CHUNK_SIZE - 1) / HASH_CHUNK_SIZE;
+
+    if(nChunks == 0) {
+        return seed;
+    }
+
+    std::vector<unsigned long long> hashes(nChunks);
+    const unsigned char *bytes = (const unsigned char *) buffer;
+
+    ThreadPool::Execute((unsigned int) nChunks, [&](unsigned int i) {
+        size_t start = size_t(i) * HASH_CHUNK_SIZE;
+        size_t size = MIN(n - start, size_t(HASH_CHUNK_SIZE));
+        hashes[i] = HashBytes(bytes + start, size, i);
+    });
+
+    return HashBytes(&hashes[0], nChunks * sizeof(unsigned long long), seed);
+}
+
+} // end namespace pic
+
+#endif /* PIC_UTIL_HASH_HPP */
+
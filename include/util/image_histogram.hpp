@@ -0,0 +1,591 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+PICCANTE is free software; you can redistribute it and/or modify
+under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation; either version 3.0 of
+the License, or (at your option) any later version.
+
+PICCANTE is distributed in the hope that it will be useful, but
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU Lesser General Public License
+( http://www.gnu.org/licenses/lgpl-3.0.html ) for more details.
+
+*/
+
+#ifndef PIC_UTIL_IMAGE_HISTOGRAM_HPP
+#define PIC_UTIL_IMAGE_HISTOGRAM_HPP
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+#include "base.hpp"
+#include "util/math.hpp"
+#include "util/simd.hpp"
+#include "util/thread_pool.hpp"
+
+namespace pic {
+
+enum VALUE_SPACE {VS_LDR, VS_LIN, VS_LOG_2, VS_LOG_E, VS_LOG_10};
+
+//pixels of a chunk of the parallel passes; it has to be a multiple of 4
+#define IMAGE_HISTOGRAM_CHUNK (1 << 14)
+
+//epsilon added to values in the logarithmic spaces
+#define IMAGE_HISTOGRAM_EPSILON 1e-6f
+
+/**
+ * @brief The ImageHistogram class bins all channels of an interleaved
+ * buffer in a single traversal. Each worker fills a private histogram,
+ * and private histograms are merged at the end. In the logarithmic
+ * spaces, values are mapped with a vectorized logarithm. The range of
+ * each channel can be fixed, otherwise it is computed from the first
+ * buffer; since the logarithm is monotonic, this pass only needs the
+ * minimum and the maximum of the values. Buffers can be streamed with
+ * Add; values outside the range are binned in the first or last bin.
+ */
+class ImageHistogram
+{
+protected:
+    VALUE_SPACE type;
+    int nBin, channels, maxThreads;
+    bool bRange;
+
+    //per lane parameters of 4 * channels values; i.e., lcm(4, channels)
+    std::vector<float> lScale, lMin, lDelta;
+    std::vector<int> lBase;
+
+    /**
+     * @brief getPixels returns the pixels of chunk c.
+     * @param c
+     * @param nPixels
+     * @param p0
+     * @param p1
+     */
+    static void getPixels(int c, int nPixels, int &p0, int &p1)
+    {
+        p0 = c * IMAGE_HISTOGRAM_CHUNK;
+        p1 = MIN(p0 + IMAGE_HISTOGRAM_CHUNK, nPixels);
+    }
+
+    /**
+     * @brief getValues returns the interleaved values of the pixels
+     * [p0, p1); when stride is greater than channels, the first channels
+     * values of each pixel are gathered into tmp.
+     * @param data
+     * @param p0
+     * @param p1
+     * @param stride
+     * @param tmp
+     * @return
+     */
+    const float *getValues(const float *data, int p0, int p1, int stride,
+                           std::vector<float> &tmp)
+    {
+        if(stride == channels) {
+            return data + size_t(p0) * channels;
+        }
+
+        tmp.resize(size_t(p1 - p0) * channels);
+        float *out = &tmp[0];
+
+        for(int p = p0; p < p1; p++) {
+            const float *pixel = data + size_t(p) * stride;
+
+            for(int k = 0; k < channels; k++) {
+                *out++ = pixel[k];
+            }
+        }
+
+        return &tmp[0];
+    }
+
+    /**
+     * @brief ComputeRange computes the range of each channel from data.
+     * @param data
+     * @param nPixels
+     * @param stride
+     */
+    void ComputeRange(const float *data, int nPixels, int stride)
+    {
+        int nChunks = (nPixels + IMAGE_HISTOGRAM_CHUNK - 1) / IMAGE_HISTOGRAM_CHUNK;
+
+        //a slot per chunk; min/max do not depend on the merging order
+        std::vector<float> partial(size_t(nChunks) * channels * 2);
+
+        ThreadPool::Execute(nChunks, [&](unsigned int c) {
+            int p0, p1;
+            getPixels(c, nPixels, p0, p1);
+
+            std::vector<float> tmp;
+            float *pMin = &partial[size_t(c) * channels * 2];
+            float *pMax = pMin + channels;
+            MinMax(getValues(data, p0, p1, stride, tmp), (p1 - p0) * channels,
+                   channels, pMin, pMax);
+        }, maxThreads);
+
+        for(int k = 0; k < channels; k++) {
+            float vMin =  FLT_MAX;
+            float vMax = -FLT_MAX;
+
+            for(int c = 0; c < nChunks; c++) {
+                float *pMin = &partial[size_t(c) * channels * 2];
+                vMin = MIN(vMin, pMin[k]);
+                vMax = MAX(vMax, pMin[channels + k]);
+            }
+
+            fMin[k] = Transform(vMin, type);
+            fMax[k] = Transform(vMax, type);
+        }
+    }
+
+    /**
+     * @brief MinMax computes the minimum and the maximum of each channel of
+     * n interleaved values; NaNs are skipped.
+     * @param data
+     * @param n
+     * @param channels
+     * @param vMin
+     * @param vMax
+     */
+    static void MinMax(const float *data, int n, int channels, float *vMin,
+                       float *vMax)
+    {
+        for(int k = 0; k < channels; k++) {
+            vMin[k] =  FLT_MAX;
+            vMax[k] = -FLT_MAX;
+        }
+
+        int i = 0;
+
+#ifdef PIC_SIMD_X86
+        if((getSIMDLevel() >= SIMD_SSE2) && (channels <= 4)) {
+            i = MinMaxSSE2(data, n, channels, vMin, vMax);
+        }
+#endif
+
+        for(int k = i % channels; i < n; i++) {
+            float x = data[i];
+            vMin[k] = x < vMin[k] ? x : vMin[k];
+            vMax[k] = x > vMax[k] ? x : vMax[k];
+
+            k++;
+            k = (k == channels) ? 0 : k;
+        }
+    }
+
+#ifdef PIC_SIMD_X86
+    /**
+     * @brief MinMaxSSE2 is the SSE2 kernel of MinMax; it processes blocks
+     * of 4 * channels values, and it returns the number of processed values.
+     */
+    PIC_TARGET_SSE2 static int MinMaxSSE2(const float *data, int n,
+                                          int channels, float *vMin, float *vMax)
+    {
+        int block = 4 * channels;
+        int nb = (n / block) * block;
+
+        if(nb == 0) {
+            return 0;
+        }
+
+        __m128 mn[4], mx[4];
+
+        for(int j = 0; j < channels; j++) {
+            mn[j] = _mm_set1_ps( FLT_MAX);
+            mx[j] = _mm_set1_ps(-FLT_MAX);
+        }
+
+        for(int i = 0; i < nb; i += block) {
+            for(int j = 0; j < channels; j++) {
+                __m128 x = _mm_loadu_ps(data + i + j * 4);
+                //the NaN lanes keep the previous value
+                mn[j] = _mm_min_ps(x, mn[j]);
+                mx[j] = _mm_max_ps(x, mx[j]);
+            }
+        }
+
+        float tMin[16], tMax[16];
+
+        for(int j = 0; j < channels; j++) {
+            _mm_storeu_ps(tMin + j * 4, mn[j]);
+            _mm_storeu_ps(tMax + j * 4, mx[j]);
+        }
+
+        for(int l = 0; l < block; l++) {
+            int k = l % channels;
+            vMin[k] = MIN(vMin[k], tMin[l]);
+            vMax[k] = MAX(vMax[k], tMax[l]);
+        }
+
+        return nb;
+    }
+
+    /**
+     * @brief BinSSE2 is the SSE2 kernel of Bin; it processes blocks of
+     * 4 * channels values, and it returns the number of processed values.
+     * Log spaces use FastLogSSE2, so a value lying on the boundary of two
+     * bins may be counted in the neighboring bin of the scalar path; linear
+     * spaces give the same bins of Bin.
+     */
+    PIC_TARGET_SSE2 int BinSSE2(const float *data, int n, unsigned int *h)
+    {
+        int block = 4 * channels;
+        int nb = (n / block) * block;
+
+        __m128 zero = _mm_setzero_ps();
+        __m128 eps = _mm_set1_ps(IMAGE_HISTOGRAM_EPSILON);
+        __m128 last = _mm_set1_ps(float(nBin - 1));
+        bool bLog = (type == VS_LOG_2) || (type == VS_LOG_E) || (type == VS_LOG_10);
+
+        int index[4];
+
+        for(int i = 0; i < nb; i += block) {
+            for(int j = 0; j < channels; j++) {
+                __m128 x = _mm_loadu_ps(data + i + j * 4);
+
+                if(bLog) {
+                    //the max with zero also maps NaNs to zero
+                    x = FastLogSSE2(_mm_add_ps(_mm_max_ps(x, zero), eps));
+                }
+
+                x = _mm_sub_ps(_mm_mul_ps(x, _mm_loadu_ps(&lScale[j * 4])),
+                               _mm_loadu_ps(&lMin[j * 4]));
+                __m128 t = _mm_div_ps(_mm_mul_ps(x, last),
+                                      _mm_loadu_ps(&lDelta[j * 4]));
+                //the max with zero also maps NaNs to zero
+                t = _mm_min_ps(_mm_max_ps(t, zero), last);
+
+                __m128i ti = _mm_add_epi32(_mm_cvttps_epi32(t),
+                                           _mm_loadu_si128((const __m128i *) &lBase[j * 4]));
+                _mm_storeu_si128((__m128i *) index, ti);
+
+                h[index[0]]++;
+                h[index[1]]++;
+                h[index[2]]++;
+                h[index[3]]++;
+            }
+        }
+
+        return nb;
+    }
+#endif
+
+    /**
+     * @brief Bin adds n interleaved values to the histogram h.
+     * @param data
+     * @param n
+     * @param h
+     */
+    void Bin(const float *data, int n, unsigned int *h)
+    {
+        int i = 0;
+
+#ifdef PIC_SIMD_X86
+        if((getSIMDLevel() >= SIMD_SSE2) && (channels <= 4)) {
+            i = BinSSE2(data, n, h);
+        }
+#endif
+
+        float last = float(nBin - 1);
+        bool bLog = (type == VS_LOG_2) || (type == VS_LOG_E) || (type == VS_LOG_10);
+
+        for(int l = i % (channels * 4); i < n; i++) {
+            float x = data[i];
+
+            if(bLog) {
+                x = logf((x > 0.0f ? x : 0.0f) + IMAGE_HISTOGRAM_EPSILON);
+            }
+
+            //the same rounding of ((x - fMin) * (nBin - 1)) / (fMax - fMin)
+            float t = ((x * lScale[l] - lMin[l]) * last) / lDelta[l];
+            t = (t > 0.0f) ? t : 0.0f;
+            t = (t < last) ? t : last;
+
+            h[int(t) + lBase[l]]++;
+
+            l++;
+            l = (l == (channels * 4)) ? 0 : l;
+        }
+    }
+
+    /**
+     * @brief SetupLanes computes the per lane binning parameters from
+     * the range. A value x is binned as ((x * k - fMin) * (nBin - 1)) / delta,
+     * where k converts natural logarithms and it is 1 in linear spaces.
+     */
+    void SetupLanes()
+    {
+        //the logarithm is natural in the kernels
+        float k = 1.0f;
+
+        switch(type) {
+        case VS_LOG_2:
+            k = C_INV_LOG_NAT_2;
+            break;
+
+        case VS_LOG_10:
+            k = 0.43429448190325182765f;
+            break;
+
+        default:
+            break;
+        }
+
+        int nLanes = channels * 4;
+        lScale.resize(nLanes);
+        lMin.resize(nLanes);
+        lDelta.resize(nLanes);
+        lBase.resize(nLanes);
+
+        for(int l = 0; l < nLanes; l++) {
+            int c = l % channels;
+            float delta = fMax[c] - fMin[c];
+
+            lScale[l] = k;
+            lMin[l] = fMin[c];
+            //an empty range bins every value in the first bin
+            lDelta[l] = delta > 0.0f ? delta : INFINITY;
+            lBase[l] = c * nBin;
+        }
+    }
+
+public:
+    std::vector<float> fMin, fMax;
+    std::vector<unsigned int> bins;
+    unsigned long long nSamples;
+
+    /**
+     * @brief ImageHistogram
+     */
+    ImageHistogram()
+    {
+        type = VS_LIN;
+        nBin = 0;
+        channels = 0;
+        maxThreads = -1;
+        bRange = false;
+        nSamples = 0;
+    }
+
+    /**
+     * @brief Transform maps a value into the space of a histogram.
+     * @param x
+     * @param type
+     * @return
+     */
+    static float Transform(float x, VALUE_SPACE type)
+    {
+        float xe = (x > 0.0f ? x : 0.0f) + IMAGE_HISTOGRAM_EPSILON;
+
+        switch(type) {
+        case VS_LOG_2:
+            return logf(xe) * C_INV_LOG_NAT_2;
+
+        case VS_LOG_E:
+            return logf(xe);
+
+        case VS_LOG_10:
+            return log10f(xe);
+
+        default:
+            return x;
+        }
+    }
+
+    /**
+     * @brief Setup sets the parameters of the histogram and clears its bins.
+     * @param channels
+     * @param type is the space of the values; VS_LDR has 256 bins in [0, 1].
+     * @param nBin is the number of bins per channel.
+     * @param fMin is an array of channels minimum values in the space of
+     * type; if it is NULL, the range is computed from the first buffer.
+     * @param fMax is an array of channels maximum values.
+     * @param maxThreads
+     */
+    void Setup(int channels, VALUE_SPACE type, int nBin,
+               const float *fMin = NULL, const float *fMax = NULL,
+               int maxThreads = -1)
+    {
+        if(nBin < 1) {
+            nBin = 256;
+        }
+
+        if(type == VS_LDR) {
+            nBin = 256;
+        }
+
+        this->channels = MAX(channels, 1);
+        this->type = type;
+        this->nBin = nBin;
+        this->maxThreads = maxThreads;
+
+        this->fMin.assign(this->channels, 0.0f);
+        this->fMax.assign(this->channels, 1.0f);
+
+        bRange = (type == VS_LDR) || ((fMin != NULL) && (fMax != NULL));
+
+        if(bRange && (type != VS_LDR)) {
+            this->fMin.assign(fMin, fMin + this->channels);
+            this->fMax.assign(fMax, fMax + this->channels);
+        }
+
+        if(bRange) {
+            SetupLanes();
+        }
+
+        Clear();
+    }
+
+    /**
+     * @brief Clear sets all bins to zero; the range is kept.
+     */
+    void Clear()
+    {
+        bins.assign(size_t(channels) * nBin, 0);
+        nSamples = 0;
+    }
+
+    /**
+     * @brief Add bins a buffer of interleaved pixels; this can be called
+     * several times for streaming data.
+     * @param data
+     * @param nPixels
+     * @param stride is the number of values of a pixel of data; the first
+     * channels values of each pixel are binned. A value lower than channels
+     * means channels.
+     */
+    void Add(const float *data, int nPixels, int stride = 0)
+    {
+        if((data == NULL) || (nPixels < 1) || (nBin < 1)) {
+            return;
+        }
+
+        stride = MAX(stride, channels);
+
+        if(!bRange) {
+            ComputeRange(data, nPixels, stride);
+            SetupLanes();
+            bRange = true;
+        }
+
+        int nChunks = (nPixels + IMAGE_HISTOGRAM_CHUNK - 1) / IMAGE_HISTOGRAM_CHUNK;
+
+        if(nChunks == 1) {
+            std::vector<float> tmp;
+            Bin(getValues(data, 0, nPixels, stride, tmp), nPixels * channels,
+                &bins[0]);
+        } else {
+            int nWorkers = ThreadPool::getInstance()->getMaxThreads();
+            size_t size = size_t(channels) * nBin;
+
+            //a private histogram per worker; counts do not depend on the scheduling
+            std::vector<unsigned int> hist(size_t(nWorkers) * size, 0);
+
+            ThreadPool::Execute(nChunks, [&](unsigned int c) {
+                std::vector<float> tmp;
+                int p0, p1;
+                getPixels(c, nPixels, p0, p1);
+
+                Bin(getValues(data, p0, p1, stride, tmp), (p1 - p0) * channels,
+                    &hist[size_t(ThreadPool::getWorkerIndex()) * size]);
+            }, maxThreads);
+
+            for(int w = 0; w < nWorkers; w++) {
+                unsigned int *h = &hist[size_t(w) * size];
+
+                for(size_t i = 0; i < size; i++) {
+                    bins[i] += h[i];
+                }
+            }
+        }
+
+        nSamples += (unsigned long long) nPixels;
+    }
+
+    /**
+     * @brief Calculate computes the histogram of all channels of a buffer
+     * of interleaved pixels.
+     * @param data
+     * @param nPixels
+     * @param channels
+     * @param type
+     * @param nBin
+     * @param fMin is an array of fixed minimum values or NULL.
+     * @param fMax is an array of fixed maximum values or NULL.
+     * @param maxThreads
+     */
+    void Calculate(const float *data, int nPixels, int channels,
+                   VALUE_SPACE type, int nBin, const float *fMin = NULL,
+                   const float *fMax = NULL, int maxThreads = -1)
+    {
+        Setup(channels, type, nBin, fMin, fMax, maxThreads);
+        Add(data, nPixels);
+    }
+
+    /**
+     * @brief getBins returns the bins of a channel.
+     * @param channel
+     * @return
+     */
+    unsigned int *getBins(int channel)
+    {
+        if(bins.empty()) {
+            return NULL;
+        }
+
+        return &bins[size_t(CLAMP(channel, channels)) * nBin];
+    }
+
+    /**
+     * @brief getType
+     * @return
+     */
+    VALUE_SPACE getType()
+    {
+        return type;
+    }
+
+    /**
+     * @brief getNBin
+     * @return
+     */
+    int getNBin()
+    {
+        return nBin;
+    }
+
+    /**
+     * @brief getChannels
+     * @return
+     */
+    int getChannels()
+    {
+        return channels;
+    }
+
+    /**
+     * @brief isRangeSet returns true if the range of the bins is known.
+     * @return
+     */
+    bool isRangeSet()
+    {
+        return bRange;
+    }
+};
+
+} // end namespace pic
+
+#endif /* PIC_UTIL_IMAGE_HISTOGRAM_HPP */
+
@@ -0,0 +1,417 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+PICCANTE is free software; you can redistribute it and/or modify
+under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation; either version 3.0 of
+the License, or (at your option) any later version.
+
+PICCANTE is distributed in the hope that it will be useful, but
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU Lesser General Public License
+( http://www.gnu.org/licenses/lgpl-3.0.html ) for more details.
+
+*/
+
+#ifndef PIC_UTIL_IMAGE_PERCENTILE_HPP
+#define PIC_UTIL_IMAGE_PERCENTILE_HPP
+
+#include <string.h>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#include "base.hpp"
+#include "util/math.hpp"
+#include "util/hash.hpp"
+#include "util/thread_pool.hpp"
+
+namespace pic {
+
+//values of a chunk of the parallel passes
+#define IMAGE_PERCENTILE_CHUNK (1 << 16)
+
+//buffers up to this size are just sorted
+#define IMAGE_PERCENTILE_SMALL 4096
+
+/**
+ * @brief The ImagePercentile class answers percentile (rank) queries on a
+ * float buffer without sorting it. Values are mapped to unsigned keys with
+ * the same order, and a first level histogram counts the 16 high bits of
+ * the keys in a parallel pass. An exact query finds the bin of its rank
+ * and selects the value among the values of that bin with nth_element; an
+ * approximate query interpolates inside the bin, so its relative error is
+ * below 2^-7. The histogram and the answers are cached with the hash of
+ * the buffer; so they are recomputed only when the values change.
+ */
+class ImagePercentile
+{
+protected:
+    const float *data;
+    int n, maxThreads;
+    unsigned long long hash;
+    bool bValid;
+
+    std::vector<unsigned int> cum;
+    std::vector<float> sorted;
+    std::map<int, float> answers;
+
+    /**
+     * @brief Build computes the cumulative first level histogram.
+     */
+    void Build()
+    {
+        answers.clear();
+
+        if(n <= IMAGE_PERCENTILE_SMALL) {
+            sorted.assign(data, data + n);
+            std::sort(sorted.begin(), sorted.end());
+            cum.clear();
+            return;
+        }
+
+        sorted.clear();
+
+        //a histogram per worker; counts do not depend on the scheduling
+        int nWorkers = ThreadPool::getInstance()->getMaxThreads();
+        std::vector<unsigned int> hist(size_t(nWorkers) * 65536, 0);
+
+        int nChunks = (n + IMAGE_PERCENTILE_CHUNK - 1) / IMAGE_PERCENTILE_CHUNK;
+
+        ThreadPool::Execute(nChunks, [&](unsigned int c) {
+            unsigned int *h = &hist[size_t(ThreadPool::getWorkerIndex()) * 65536];
+
+            int i0 = c * IMAGE_PERCENTILE_CHUNK;
+            int i1 = MIN(i0 + IMAGE_PERCENTILE_CHUNK, n);
+
+            for(int i = i0; i < i1; i++) {
+                h[Key(data[i]) >> 16]++;
+            }
+        }, maxThreads);
+
+        cum.resize(65537);
+        cum[0] = 0;
+
+        for(int b = 0; b < 65536; b++) {
+            unsigned int count = 0;
+
+            for(int w = 0; w < nWorkers; w++) {
+                count += hist[size_t(w) * 65536 + b];
+            }
+
+            cum[b + 1] = cum[b] + count;
+        }
+    }
+
+    /**
+     * @brief getBin returns the bin of the k-th value.
+     * @param k
+     * @return
+     */
+    int getBin(int k)
+    {
+        //the first bin whose cumulative count is greater than k
+        return int(std::upper_bound(cum.begin(), cum.end(), (unsigned int) k) -
+                   cum.begin()) - 1;
+    }
+
+public:
+
+    /**
+     * @brief ImagePercentile
+     */
+    ImagePercentile()
+    {
+        data = NULL;
+        n = 0;
+        maxThreads = -1;
+        hash = 0;
+        bValid = false;
+    }
+
+    /**
+     * @brief Key maps a float to an unsigned int with the same order.
+     * @param x
+     * @return
+     */
+    static inline unsigned int Key(float x)
+    {
+        unsigned int u;
+        memcpy(&u, &x, sizeof(u));
+        return (u & 0x80000000u) ? ~u : (u | 0x80000000u);
+    }
+
+    /**
+     * @brief Value is the inverse of Key.
+     * @param key
+     * @return
+     */
+    static inline float Value(unsigned int key)
+    {
+        unsigned int u = (key & 0x80000000u) ? (key & 0x7FFFFFFFu) : ~key;
+        float x;
+        memcpy(&x, &u, sizeof(x));
+        return x;
+    }
+
+    /**
+     * @brief Update sets the buffer of the queries. The cache is kept if
+     * the buffer has the same size and hash of the previous one.
+     * @param data
+     * @param n is the number of values of data.
+     * @param bCache enables the cache; without it, the hash of the buffer
+     * is not computed, and the next Update rebuilds the histogram.
+     * @param maxThreads
+     * @return It returns true if the cache was valid.
+     */
+    bool Update(const float *data, int n, bool bCache = true,
+                int maxThreads = -1)
+    {
+        unsigned long long h = 0;
+
+        this->maxThreads = maxThreads;
+
+        if(bCache) {
+            h = HashBytesParallel(data, size_t(MAX(n, 0)) * sizeof(float), 0);
+
+            if(bValid && (n == this->n) && (h == hash)) {
+                this->data = data;
+                return true;
+            }
+        }
+
+        this->data = data;
+        this->n = MAX(n, 0);
+        hash = h;
+        bValid = bCache;
+
+        Build();
+        return false;
+    }
+
+    /**
+     * @brief Invalidate discards the cache.
+     */
+    void Invalidate()
+    {
+        bValid = false;
+        answers.clear();
+    }
+
+    /**
+     * @brief getRank returns the rank of a percentile as a sort would do:
+     * int(percentile * n) clamped to [0, n - 1].
+     * @param percentile
+     * @return
+     */
+    int getRank(float percentile)
+    {
+        int k = int(percentile * float(n));
+        return CLAMPi(k, 0, n - 1);
+    }
+
+    /**
+     * @brief GetRanks returns the values of ranks k; i.e., the values
+     * which a sort would place at positions k.
+     * @param k is an array of nQueries ranks.
+     * @param nQueries
+     * @param ret is an array of nQueries values.
+     * @param bApprox enables the approximate queries; they do not
+     * read the buffer.
+     */
+    void GetRanks(const int *k, int nQueries, float *ret, bool bApprox = false)
+    {
+        if(n < 1) {
+            for(int q = 0; q < nQueries; q++) {
+                ret[q] = 0.0f;
+            }
+
+            return;
+        }
+
+        if(!sorted.empty()) {
+            for(int q = 0; q < nQueries; q++) {
+                ret[q] = sorted[CLAMPi(k[q], 0, n - 1)];
+            }
+
+            return;
+        }
+
+        //bins to be selected
+        std::vector<int> bins;
+        std::vector<int> pending;
+
+        for(int q = 0; q < nQueries; q++) {
+            int kq = CLAMPi(k[q], 0, n - 1);
+            int b = getBin(kq);
+
+            if(bApprox) {
+                //linear interpolation of the keys of the bin
+                float t = (float(kq - cum[b]) + 0.5f) / float(cum[b + 1] - cum[b]);
+                unsigned int key = ((unsigned int) b << 16) + (unsigned int)(t * 65535.0f);
+                ret[q] = Value(key);
+                continue;
+            }
+
+            std::map<int, float>::iterator it = answers.find(kq);
+
+            if(it != answers.end()) {
+                ret[q] = it->second;
+            } else {
+                pending.push_back(q);
+                bins.push_back(b);
+            }
+        }
+
+        if(pending.empty()) {
+            return;
+        }
+
+        std::sort(bins.begin(), bins.end());
+        bins.erase(std::unique(bins.begin(), bins.end()), bins.end());
+
+        int nBins = int(bins.size());
+        std::vector<int> lut(65536, -1);
+
+        for(int i = 0; i < nBins; i++) {
+            lut[bins[i]] = i;
+        }
+
+        //gathering the values of the bins; their order does not matter
+        int nWorkers = ThreadPool::getInstance()->getMaxThreads();
+        std::vector< std::vector<float> > gathered(size_t(nWorkers) * nBins);
+
+        int nChunks = (n + IMAGE_PERCENTILE_CHUNK - 1) / IMAGE_PERCENTILE_CHUNK;
+
+        ThreadPool::Execute(nChunks, [&](unsigned int c) {
+            std::vector<float> *g = &gathered[size_t(ThreadPool::getWorkerIndex()) * nBins];
+
+            int i0 = c * IMAGE_PERCENTILE_CHUNK;
+            int i1 = MIN(i0 + IMAGE_PERCENTILE_CHUNK, n);
+
+            for(int i = i0; i < i1; i++) {
+                int index = lut[Key(data[i]) >> 16];
+
+                if(index >= 0) {
+                    g[index].push_back(data[i]);
+                }
+            }
+        }, maxThreads);
+
+        std::vector< std::vector<float> > values(nBins);
+
+        for(int i = 0; i < nBins; i++) {
+            values[i].reserve(cum[bins[i] + 1] - cum[bins[i]]);
+
+            for(int w = 0; w < nWorkers; w++) {
+                std::vector<float> &g = gathered[size_t(w) * nBins + i];
+                values[i].insert(values[i].end(), g.begin(), g.end());
+            }
+        }
+
+        //selection; the same bin is not processed concurrently
+        std::vector<float> results(pending.size());
+
+        ThreadPool::Execute(nBins, [&](unsigned int i) {
+            std::vector<float> &v = values[i];
+
+            for(unsigned int j = 0; j < pending.size(); j++) {
+                int kq = CLAMPi(k[pending[j]], 0, n - 1);
+                int b = getBin(kq);
+
+                if(b == bins[i]) {
+                    int r = kq - int(cum[b]);
+                    std::nth_element(v.begin(), v.begin() + r, v.end());
+                    results[j] = v[r];
+                }
+            }
+        }, maxThreads);
+
+        for(unsigned int j = 0; j < pending.size(); j++) {
+            int q = pending[j];
+            ret[q] = results[j];
+            answers[CLAMPi(k[q], 0, n - 1)] = results[j];
+        }
+    }
+
+    /**
+     * @brief Get returns the values of a batch of percentiles.
+     * @param percentiles is an array of nQueries percentiles in [0, 1].
+     * @param nQueries
+     * @param ret is an array of nQueries values.
+     * @param bApprox enables the approximate queries.
+     */
+    void Get(const float *percentiles, int nQueries, float *ret,
+             bool bApprox = false)
+    {
+        std::vector<int> k(nQueries);
+
+        for(int q = 0; q < nQueries; q++) {
+            k[q] = getRank(percentiles[q]);
+        }
+
+        if(nQueries > 0) {
+            GetRanks(&k[0], nQueries, ret, bApprox);
+        }
+    }
+
+    /**
+     * @brief Get returns the value of a percentile.
+     * @param percentile is in [0, 1].
+     * @param bApprox enables the approximate query.
+     * @return
+     */
+    float Get(float percentile, bool bApprox = false)
+    {
+        float ret;
+        Get(&percentile, 1, &ret, bApprox);
+        return ret;
+    }
+
+    /**
+     * @brief SelectRank returns the value of rank k of a buffer without
+     * caching.
+     * @param data
+     * @param n
+     * @param k
+     * @return
+     */
+    static float SelectRank(const float *data, int n, int k)
+    {
+        ImagePercentile ip;
+        ip.Update(data, n, false);
+
+        float ret;
+        ip.GetRanks(&k, 1, &ret);
+        return ret;
+    }
+
+    /**
+     * @brief Select returns the value of a percentile of a buffer without
+     * caching.
+     * @param data
+     * @param n
+     * @param percentile
+     * @return
+     */
+    static float Select(const float *data, int n, float percentile)
+    {
+        ImagePercentile ip;
+        ip.Update(data, n, false);
+        return ip.Get(percentile);
+    }
+};
+
+} // end namespace pic
+
+#endif /* PIC_UTIL_IMAGE_PERCENTILE_HPP */
+
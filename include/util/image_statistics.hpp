@@ -0,0 +1,562 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+PICCANTE is free software; you can redistribute it and/or modify
+under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation; either version 3.0 of
+the License, or (at your option) any later version.
+
+PICCANTE is distributed in the hope that it will be useful, but
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU Lesser General Public License
+( http://www.gnu.org/licenses/lgpl-3.0.html ) for more details.
+
+*/
+
+#ifndef PIC_UTIL_IMAGE_STATISTICS_HPP
+#define PIC_UTIL_IMAGE_STATISTICS_HPP
+
+#include <vector>
+#include <math.h>
+#include <float.h>
+
+#include "base.hpp"
+#include "util/bbox.hpp"
+#include "util/math.hpp"
+#include "util/simd.hpp"
+#include "util/thread_pool.hpp"
+
+namespace pic {
+
+/**
+ * @brief The IMAGE_STATISTICS enum lists the statistics computed by
+ * ImageStatistics; they are flags, so they can be combined.
+ */
+enum IMAGE_STATISTICS {IS_MIN = 1, IS_MAX = 2, IS_SUM = 4, IS_MEAN = 8,
+                       IS_LOG_MEAN = 16, IS_VARIANCE = 32, IS_COVARIANCE = 64,
+                       IS_NAN_INF = 128
+                      };
+
+/**
+ * @brief The ImageStatistics class computes a set of statistics of an image
+ * buffer in a single pass. Rows are reduced by chunks of
+ * THREAD_POOL_ROWS_CHUNK rows in parallel, and partial results are merged
+ * in a fixed order; so results do not depend on the number of threads.
+ * Sums are accumulated in double precision, shifted by the first pixel of
+ * the box for a stable (co)variance.
+ */
+class ImageStatistics
+{
+protected:
+    std::vector<double> partial;
+    std::vector<float>  shift;
+    int oSum, oSum2, oLog, oCross, oMin, oMax, oNaN, oInf, stride;
+
+    /**
+     * @brief SetupLayout sets the offsets of the accumulators of a chunk.
+     */
+    void SetupLayout()
+    {
+        int c = channels;
+        oSum   = 0;
+        oSum2  = oSum  + c;
+        oLog   = oSum2 + c;
+        oMin   = oLog  + c;
+        oMax   = oMin  + c;
+        oNaN   = oMax  + c;
+        oInf   = oNaN  + c;
+        oCross = oInf  + c;
+        stride = oCross + ((flags & IS_COVARIANCE) ? c * c : 0);
+    }
+
+    /**
+     * @brief InitAcc initializes the accumulators of a chunk.
+     * @param acc
+     */
+    void InitAcc(double *acc)
+    {
+        for(int i = 0; i < stride; i++) {
+            acc[i] = 0.0;
+        }
+
+        for(int l = 0; l < channels; l++) {
+            acc[oMin + l] =  FLT_MAX;
+            acc[oMax + l] = -FLT_MAX;
+        }
+    }
+
+    /**
+     * @brief AccumulateScalar accumulates n pixels stored contiguously;
+     * cross products are accumulated by AccumulateCross.
+     * @param src
+     * @param n
+     * @param acc
+     */
+    void AccumulateScalar(const float *src, int n, double *acc)
+    {
+        int c = channels;
+        bool bMinMax = (flags & (IS_MIN | IS_MAX)) != 0;
+        bool bSum = (flags & (IS_SUM | IS_MEAN | IS_VARIANCE | IS_COVARIANCE)) != 0;
+        bool bLog = (flags & IS_LOG_MEAN) != 0;
+        bool bNaNInf = (flags & IS_NAN_INF) != 0;
+
+        const float *K = &shift[0];
+
+        //sums only; e.g., means and variances of small boxes
+        if(bSum && !bMinMax && !bLog && !bNaNInf) {
+            for(int l = 0; l < c; l++) {
+                double s = 0.0;
+                double s2 = 0.0;
+
+                for(int i = 0; i < n; i++) {
+                    double tmp = double(src[i * c + l]) - double(K[l]);
+                    s  += tmp;
+                    s2 += tmp * tmp;
+                }
+
+                acc[oSum  + l] += s;
+                acc[oSum2 + l] += s2;
+            }
+
+            return;
+        }
+
+        for(int i = 0; i < n; i++) {
+            const float *p = src + i * c;
+
+            for(int l = 0; l < c; l++) {
+                float x = p[l];
+
+                if(bMinMax) {
+                    acc[oMin + l] = acc[oMin + l] > x ? x : acc[oMin + l];
+                    acc[oMax + l] = acc[oMax + l] < x ? x : acc[oMax + l];
+                }
+
+                if(bSum) {
+                    double tmp = double(x) - double(K[l]);
+                    acc[oSum  + l] += tmp;
+                    acc[oSum2 + l] += tmp * tmp;
+                }
+
+                if(bLog) {
+                    acc[oLog + l] += logf(x + HARMONIC_MEAN_EPSILONf);
+                }
+
+                if(bNaNInf) {
+                    acc[oNaN + l] += isnan(x) ? 1.0 : 0.0;
+                    acc[oInf + l] += isinf(x) ? 1.0 : 0.0;
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief AccumulateCross accumulates the cross products of n pixels
+     * stored contiguously; only the upper triangle, since the matrix is
+     * symmetric.
+     * @param src
+     * @param n
+     * @param acc
+     */
+    void AccumulateCross(const float *src, int n, double *acc)
+    {
+        int c = channels;
+
+        for(int i = 0; i < n; i++) {
+            const float *p = src + i * c;
+
+            for(int l = 0; l < c; l++) {
+                double *row = acc + oCross + l * c;
+                double dl = double(p[l]) - double(shift[l]);
+
+                for(int m = l; m < c; m++) {
+                    row[m] += dl * (double(p[m]) - double(shift[m]));
+                }
+            }
+        }
+    }
+
+#ifdef PIC_SIMD_X86
+    /**
+     * @brief AccumulateSSE2 accumulates n pixels stored contiguously with
+     * 1, 2, 3, or 4 channels. The lanes of a group of nv vectors map to fixed
+     * channels: nv is 3 for three channels and 1 otherwise.
+     * @param src
+     * @param n
+     * @param acc
+     */
+    PIC_TARGET_SSE2 void AccumulateSSE2(const float *src, int n, double *acc)
+    {
+        int c = channels;
+        int nv = (c == 3) ? 3 : 1;
+        int P = nv * 4;
+        int nBlocks = (n * c) / P;
+
+        bool bMinMax = (flags & (IS_MIN | IS_MAX)) != 0;
+        bool bSum = (flags & (IS_SUM | IS_MEAN | IS_VARIANCE | IS_COVARIANCE)) != 0;
+        bool bLog = (flags & IS_LOG_MEAN) != 0;
+        bool bNaNInf = (flags & IS_NAN_INF) != 0;
+
+        __m128 vMin[3], vMax[3], vShift[3], vNaN[3], vInf[3];
+        __m128d vSum[6], vSum2[6], vLog[6];
+
+        float lane[4];
+
+        for(int v = 0; v < nv; v++) {
+            for(int j = 0; j < 4; j++) {
+                lane[j] = shift[(v * 4 + j) % c];
+            }
+
+            vShift[v] = _mm_loadu_ps(lane);
+            vMin[v] = _mm_set1_ps( FLT_MAX);
+            vMax[v] = _mm_set1_ps(-FLT_MAX);
+            vNaN[v] = _mm_setzero_ps();
+            vInf[v] = _mm_setzero_ps();
+            vSum[v * 2] = vSum[v * 2 + 1] = _mm_setzero_pd();
+            vSum2[v * 2] = vSum2[v * 2 + 1] = _mm_setzero_pd();
+            vLog[v * 2] = vLog[v * 2 + 1] = _mm_setzero_pd();
+        }
+
+        __m128 one = _mm_set1_ps(1.0f);
+        __m128 eps = _mm_set1_ps(HARMONIC_MEAN_EPSILONf);
+        __m128 inf = _mm_set1_ps(INFINITY);
+        __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+
+        for(int b = 0; b < nBlocks; b++) {
+            const float *block = src + b * P;
+
+            for(int v = 0; v < nv; v++) {
+                __m128 x = _mm_loadu_ps(block + v * 4);
+
+                if(bMinMax) {
+                    //NaN values are skipped as in the scalar path
+                    vMin[v] = _mm_min_ps(x, vMin[v]);
+                    vMax[v] = _mm_max_ps(x, vMax[v]);
+                }
+
+                if(bSum) {
+                    __m128 d = _mm_sub_ps(x, vShift[v]);
+                    __m128 d2 = _mm_mul_ps(d, d);
+                    vSum[v * 2]      = _mm_add_pd(vSum[v * 2], _mm_cvtps_pd(d));
+                    vSum[v * 2 + 1]  = _mm_add_pd(vSum[v * 2 + 1], _mm_cvtps_pd(_mm_movehl_ps(d, d)));
+                    vSum2[v * 2]     = _mm_add_pd(vSum2[v * 2], _mm_cvtps_pd(d2));
+                    vSum2[v * 2 + 1] = _mm_add_pd(vSum2[v * 2 + 1], _mm_cvtps_pd(_mm_movehl_ps(d2, d2)));
+                }
+
+                if(bLog) {
+                    __m128 lx = FastLogSSE2(_mm_add_ps(x, eps));
+                    vLog[v * 2]     = _mm_add_pd(vLog[v * 2], _mm_cvtps_pd(lx));
+                    vLog[v * 2 + 1] = _mm_add_pd(vLog[v * 2 + 1], _mm_cvtps_pd(_mm_movehl_ps(lx, lx)));
+                }
+
+                if(bNaNInf) {
+                    vNaN[v] = _mm_add_ps(vNaN[v], _mm_and_ps(_mm_cmpunord_ps(x, x), one));
+                    vInf[v] = _mm_add_ps(vInf[v], _mm_and_ps(_mm_cmpeq_ps(_mm_and_ps(x, absMask), inf), one));
+                }
+            }
+        }
+
+        //flushing lanes to channels
+        float fMin[4], fMax[4], fNaN[4], fInf[4];
+        double dSum[4], dSum2[4], dLog[4];
+
+        for(int v = 0; v < nv; v++) {
+            _mm_storeu_ps(fMin, vMin[v]);
+            _mm_storeu_ps(fMax, vMax[v]);
+            _mm_storeu_ps(fNaN, vNaN[v]);
+            _mm_storeu_ps(fInf, vInf[v]);
+            _mm_storeu_pd(dSum,      vSum[v * 2]);
+            _mm_storeu_pd(dSum  + 2, vSum[v * 2 + 1]);
+            _mm_storeu_pd(dSum2,     vSum2[v * 2]);
+            _mm_storeu_pd(dSum2 + 2, vSum2[v * 2 + 1]);
+            _mm_storeu_pd(dLog,      vLog[v * 2]);
+            _mm_storeu_pd(dLog  + 2, vLog[v * 2 + 1]);
+
+            for(int j = 0; j < 4; j++) {
+                int l = (v * 4 + j) % c;
+
+                acc[oMin + l] = acc[oMin + l] > fMin[j] ? fMin[j] : acc[oMin + l];
+                acc[oMax + l] = acc[oMax + l] < fMax[j] ? fMax[j] : acc[oMax + l];
+                acc[oSum  + l] += dSum[j];
+                acc[oSum2 + l] += dSum2[j];
+                acc[oLog  + l] += dLog[j];
+                acc[oNaN  + l] += fNaN[j];
+                acc[oInf  + l] += fInf[j];
+            }
+        }
+
+        //remaining pixels
+        int done = (nBlocks * P) / c;
+
+        if(done < n) {
+            AccumulateScalar(src + done * c, n - done, acc);
+        }
+    }
+#endif
+
+    /**
+     * @brief Accumulate accumulates n contiguous pixels.
+     * @param src
+     * @param n
+     * @param acc
+     */
+    void Accumulate(const float *src, int n, double *acc)
+    {
+#ifdef PIC_SIMD_X86
+        //short rows are not worth the setup of the vector accumulators
+        if((channels <= 4) && ((n * channels) >= 32) &&
+           (getSIMDLevel() >= SIMD_SSE2)) {
+            AccumulateSSE2(src, n, acc);
+        } else {
+            AccumulateScalar(src, n, acc);
+        }
+#else
+        AccumulateScalar(src, n, acc);
+#endif
+
+        if(flags & IS_COVARIANCE) {
+            AccumulateCross(src, n, acc);
+        }
+    }
+
+    /**
+     * @brief Merge merges the accumulators b into a.
+     * @param a
+     * @param b
+     */
+    void Merge(double *a, const double *b)
+    {
+        for(int i = 0; i < stride; i++) {
+            if((i >= oMin) && (i < oMax)) {
+                a[i] = a[i] > b[i] ? b[i] : a[i];
+            } else {
+                if((i >= oMax) && (i < oNaN)) {
+                    a[i] = a[i] < b[i] ? b[i] : a[i];
+                } else {
+                    a[i] += b[i];
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Finalize computes the statistics from the merged accumulators.
+     * @param acc
+     */
+    void Finalize(double *acc)
+    {
+        int c = channels;
+        double n = double(nPixels);
+        double inv_n = 1.0 / n;
+        double inv_n1 = 1.0 / double(nPixels - 1);
+
+        if(flags & IS_MIN) {
+            minVal.resize(c);
+
+            for(int l = 0; l < c; l++) {
+                minVal[l] = float(acc[oMin + l]);
+            }
+        }
+
+        if(flags & IS_MAX) {
+            maxVal.resize(c);
+
+            for(int l = 0; l < c; l++) {
+                maxVal[l] = float(acc[oMax + l]);
+            }
+        }
+
+        if(flags & IS_SUM) {
+            sumVal.resize(c);
+
+            for(int l = 0; l < c; l++) {
+                sumVal[l] = float(acc[oSum + l] + n * double(shift[l]));
+            }
+        }
+
+        if(flags & IS_MEAN) {
+            meanVal.resize(c);
+
+            for(int l = 0; l < c; l++) {
+                meanVal[l] = float(acc[oSum + l] * inv_n + double(shift[l]));
+            }
+        }
+
+        if(flags & IS_LOG_MEAN) {
+            logMeanVal.resize(c);
+
+            for(int l = 0; l < c; l++) {
+                logMeanVal[l] = float(exp(acc[oLog + l] * inv_n));
+            }
+        }
+
+        if(flags & IS_VARIANCE) {
+            varianceVal.resize(c);
+
+            for(int l = 0; l < c; l++) {
+                double sd = acc[oSum + l];
+                varianceVal[l] = float((acc[oSum2 + l] - sd * sd * inv_n) * inv_n1);
+            }
+        }
+
+        if(flags & IS_NAN_INF) {
+            nNaN.resize(c);
+            nInf.resize(c);
+
+            for(int l = 0; l < c; l++) {
+                nNaN[l] = int(acc[oNaN + l]);
+                nInf[l] = int(acc[oInf + l]);
+            }
+        }
+
+        if(flags & IS_COVARIANCE) {
+            covMtxVal.resize(c * c);
+
+            for(int l = 0; l < c; l++) {
+                for(int m = l; m < c; m++) {
+                    double sdl = acc[oSum + l];
+                    double sdm = acc[oSum + m];
+                    float cov = float((acc[oCross + l * c + m] - sdl * sdm * inv_n) * inv_n1);
+
+                    covMtxVal[l * c + m] = cov;
+                    covMtxVal[m * c + l] = cov;
+                }
+            }
+        }
+    }
+public:
+    unsigned int flags;
+    int channels, nPixels;
+
+    std::vector<float> minVal, maxVal, sumVal, meanVal, logMeanVal;
+    std::vector<float> varianceVal, covMtxVal;
+    std::vector<int> nNaN, nInf;
+
+    /**
+     * @brief ImageStatistics
+     */
+    ImageStatistics()
+    {
+        flags = 0;
+        channels = 0;
+        nPixels = 0;
+    }
+
+    /**
+     * @brief Compute computes statistics of a buffer with the layout of
+     * Image. Pixels of the box outside the buffer are clamped to the
+     * border as in Image::operator().
+     * @param data
+     * @param width
+     * @param height
+     * @param frames
+     * @param channels
+     * @param box
+     * @param flags is a combination of IMAGE_STATISTICS.
+     * @param maxThreads
+     */
+    void Compute(float *data, int width, int height, int frames, int channels,
+                 BBox *box, unsigned int flags, int maxThreads = -1)
+    {
+        this->flags = flags;
+        this->channels = channels;
+
+        nPixels = box->Size();
+
+        SetupLayout();
+
+        int bw = box->x1 - box->x0;
+        int bh = box->y1 - box->y0;
+        int nRows = bh * (box->z1 - box->z0);
+
+        if((nPixels <= 0) || (nRows <= 0)) {
+            shift.assign(channels, 0.0f);
+            partial.resize(stride);
+            InitAcc(&partial[0]);
+            Finalize(&partial[0]);
+            return;
+        }
+
+        int xstride = channels;
+        int ystride = width * channels;
+        int tstride = width * height * channels;
+
+        //the first pixel of the box as shift
+        shift.resize(channels);
+        float *first = data + CLAMP(box->z0, frames) * tstride +
+                       CLAMP(box->y0, height) * ystride +
+                       CLAMP(box->x0, width) * xstride;
+
+        for(int l = 0; l < channels; l++) {
+            //x - x is not zero for NaN and Inf values
+            shift[l] = ((first[l] - first[l]) == 0.0f) ? first[l] : 0.0f;
+        }
+
+        bool bInside = (box->x0 >= 0) && (box->x1 <= width);
+        int nChunks = (nRows + THREAD_POOL_ROWS_CHUNK - 1) / THREAD_POOL_ROWS_CHUNK;
+
+        partial.resize(size_t(nChunks) * stride);
+
+        auto task = [&](unsigned int i) {
+            double *acc = &partial[size_t(i) * stride];
+            InitAcc(acc);
+
+            int r0 = i * THREAD_POOL_ROWS_CHUNK;
+            int r1 = MIN(r0 + THREAD_POOL_ROWS_CHUNK, nRows);
+
+            int dz = r0 / bh;
+            int dy = r0 % bh;
+
+            for(int r = r0; r < r1; r++) {
+                int z = CLAMP(box->z0 + dz, frames);
+                int y = CLAMP(box->y0 + dy, height);
+                float *row = data + z * tstride + y * ystride;
+
+                dy++;
+
+                if(dy == bh) {
+                    dy = 0;
+                    dz++;
+                }
+
+                if(bInside) {
+                    Accumulate(row + box->x0 * xstride, bw, acc);
+                } else {
+                    for(int x = box->x0; x < box->x1; x++) {
+                        Accumulate(row + CLAMP(x, width) * xstride, 1, acc);
+                    }
+                }
+            }
+        };
+
+        if(nPixels < THREAD_POOL_MIN_PIXELS) {
+            for(int i = 0; i < nChunks; i++) {
+                task(i);
+            }
+        } else {
+            ThreadPool::Execute(nChunks, task, maxThreads);
+        }
+
+        double *acc = &partial[0];
+
+        for(int i = 1; i < nChunks; i++) {
+            Merge(acc, &partial[size_t(i) * stride]);
+        }
+
+        Finalize(acc);
+    }
+};
+
+} // end namespace pic
+
+#endif /* PIC_UTIL_IMAGE_STATISTICS_HPP */
+
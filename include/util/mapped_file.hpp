@@ -0,0 +1,230 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+PICCANTE is free software; you can redistribute it and/or modify
+under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation; either version 3.0 of
+the License, or (at your option) any later version.
+
+PICCANTE is distributed in the hope that it will be useful, but
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU Lesser General Public License
+( http://www.gnu.org/licenses/lgpl-3.0.html ) for more details.
+
+*/
+
+#ifndef PIC_UTIL_MAPPED_FILE_HPP
+#define PIC_UTIL_MAPPED_FILE_HPP
+
+#include <string>
+
+#ifdef PIC_WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "base.hpp"
+
+namespace pic {
+
+/**
+ * @brief The MappedFile class maps a file in memory; pages are read on
+ * demand. The mapping is read-only, or copy-on-write: writes go to private
+ * pages which are never written back to the file.
+ */
+class MappedFile
+{
+protected:
+    unsigned char *data;
+    size_t         size;
+
+#ifdef PIC_WIN32
+    HANDLE hFile, hMapping;
+#endif
+
+public:
+
+    /**
+     * @brief MappedFile
+     */
+    MappedFile()
+    {
+        data = NULL;
+        size = 0;
+
+#ifdef PIC_WIN32
+        hFile = INVALID_HANDLE_VALUE;
+        hMapping = NULL;
+#endif
+    }
+
+    ~MappedFile()
+    {
+        Close();
+    }
+
+    /**
+     * @brief Open maps a file.
+     * @param nameFile
+     * @param bCopyOnWrite if true, data can be written; only written pages
+     * are copied.
+     * @return It returns true on success.
+     */
+    bool Open(std::string nameFile, bool bCopyOnWrite = false);
+
+    /**
+     * @brief Close unmaps the file.
+     */
+    void Close();
+
+    /**
+     * @brief getData returns the first byte of the file.
+     * @return
+     */
+    unsigned char *getData()
+    {
+        return data;
+    }
+
+    /**
+     * @brief getSize returns the size of the file in bytes.
+     * @return
+     */
+    size_t getSize()
+    {
+        return size;
+    }
+
+    /**
+     * @brief isValid
+     * @return
+     */
+    bool isValid()
+    {
+        return data != NULL;
+    }
+};
+
+#ifdef PIC_WIN32
+
+PIC_INLINE bool MappedFile::Open(std::string nameFile, bool bCopyOnWrite)
+{
+    Close();
+
+    hFile = CreateFileA(nameFile.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+    if(hFile == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+
+    if(!GetFileSizeEx(hFile, &fileSize) || (fileSize.QuadPart <= 0)) {
+        Close();
+        return false;
+    }
+
+    hMapping = CreateFileMappingA(hFile, NULL, bCopyOnWrite ? PAGE_WRITECOPY :
+                                  PAGE_READONLY, 0, 0, NULL);
+
+    if(hMapping == NULL) {
+        Close();
+        return false;
+    }
+
+    data = (unsigned char *) MapViewOfFile(hMapping, bCopyOnWrite ? FILE_MAP_COPY :
+                                           FILE_MAP_READ, 0, 0, 0);
+
+    if(data == NULL) {
+        Close();
+        return false;
+    }
+
+    size = size_t(fileSize.QuadPart);
+    return true;
+}
+
+PIC_INLINE void MappedFile::Close()
+{
+    if(data != NULL) {
+        UnmapViewOfFile(data);
+    }
+
+    if(hMapping != NULL) {
+        CloseHandle(hMapping);
+    }
+
+    if(hFile != INVALID_HANDLE_VALUE) {
+        CloseHandle(hFile);
+    }
+
+    data = NULL;
+    size = 0;
+    hFile = INVALID_HANDLE_VALUE;
+    hMapping = NULL;
+}
+
+#else
+
+PIC_INLINE bool MappedFile::Open(std::string nameFile, bool bCopyOnWrite)
+{
+    Close();
+
+    int fd = open(nameFile.c_str(), O_RDONLY);
+
+    if(fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+
+    if((fstat(fd, &st) != 0) || (st.st_size <= 0)) {
+        close(fd);
+        return false;
+    }
+
+    int prot = bCopyOnWrite ? (PROT_READ | PROT_WRITE) : PROT_READ;
+    void *ptr = mmap(NULL, size_t(st.st_size), prot, MAP_PRIVATE, fd, 0);
+
+    //the mapping keeps a reference to the file
+    close(fd);
+
+    if(ptr == MAP_FAILED) {
+        return false;
+    }
+
+    data = (unsigned char *) ptr;
+    size = size_t(st.st_size);
+    return true;
+}
+
+PIC_INLINE void MappedFile::Close()
+{
+    if(data != NULL) {
+        munmap(data, size);
+    }
+
+    data = NULL;
+    size = 0;
+}
+
+#endif
+
+} // end namespace pic
+
+#endif /* PIC_UTIL_MAPPED_FILE_HPP */
+
@@ -39,6 +39,10 @@ const float C_INV_LOG_NAT_2		= 1.4426950408889634073599246810019f;
 //Epsilon
 const float C_EPSILON			= 1e-6f;
 
+//Epsilon of logarithmic (harmonic) means
+const double HARMONIC_MEAN_EPSILON = 1e-6;
+const float  HARMONIC_MEAN_EPSILONf = 1e-6f;
+
 //Square root of 2
 const float C_SQRT_2            = 1.4142135623730950488016887242097f;
 
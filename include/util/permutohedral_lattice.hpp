@@ -0,0 +1,507 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+PICCANTE is free software; you can redistribute it and/or modify
+under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation; either version 3.0 of
+the License, or (at your option) any later version.
+
+PICCANTE is distributed in the hope that it will be useful, but
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU Lesser General Public License
+( http://www.gnu.org/licenses/lgpl-3.0.html ) for more details.
+
+*/
+
+#ifndef PIC_UTIL_PERMUTOHEDRAL_LATTICE_HPP
+#define PIC_UTIL_PERMUTOHEDRAL_LATTICE_HPP
+
+#include <math.h>
+#include <vector>
+
+#include "base.hpp"
+#include "util/thread_pool.hpp"
+
+namespace pic {
+
+//maximum number of dimensions of positions
+#define PERMUTOHEDRAL_MAX_DIM 16
+
+/**
+ * @brief The PermutohedralLattice class is the permutohedral lattice of
+ * Adams et al. for high-dimensional Gaussian filtering. Values are splatted
+ * on the vertices of the simplices enclosing their positions, blurred along
+ * the d + 1 lattice axes, and sliced back. Vertices are stored in an
+ * open-addressing hash table whose memory is kept across Init calls.
+ */
+class PermutohedralLattice
+{
+protected:
+    int d, vd, nPoints;
+
+    std::vector<float> scaleFactor;
+    std::vector<int>   canonical;
+
+    //vertices: keys (d ints) and values (vd floats)
+    std::vector<int>   keys;
+    std::vector<float> values, valuesTmp;
+
+    //hash table of indices of vertices; -1 is an empty slot
+    std::vector<int>   table;
+
+    /**
+     * @brief Hash
+     * @param key
+     * @return
+     */
+    unsigned int Hash(const int *key) const
+    {
+        unsigned int h = 0;
+
+        for(int i = 0; i < d; i++) {
+            h += key[i];
+            h *= 2531011;
+        }
+
+        return h;
+    }
+
+    /**
+     * @brief Find returns the index of the vertex of a key.
+     * @param key
+     * @return It returns -1 if the vertex does not exist.
+     */
+    int Find(const int *key) const;
+
+    /**
+     * @brief Insert returns the index of the vertex of a key; the vertex
+     * is created if it does not exist.
+     * @param key
+     * @return
+     */
+    int Insert(const int *key);
+
+    /**
+     * @brief Grow doubles the hash table.
+     */
+    void Grow();
+
+    /**
+     * @brief Locate finds the enclosing simplex of a position.
+     * @param position
+     * @param greedy is the closest remainder-0 point.
+     * @param rank
+     * @param barycentric
+     */
+    void Locate(const float *position, int *greedy, int *rank,
+                float *barycentric) const;
+
+public:
+
+    PermutohedralLattice()
+    {
+        d = 0;
+        vd = 0;
+        nPoints = 0;
+    }
+
+    /**
+     * @brief Init empties the lattice.
+     * @param d is the number of dimensions of positions.
+     * @param vd is the number of values of a vertex.
+     * @param nExpected is the expected number of vertices.
+     */
+    void Init(int d, int vd, int nExpected);
+
+    /**
+     * @brief Splat adds a value at a position.
+     * @param position
+     * @param value
+     */
+    void Splat(const float *position, const float *value);
+
+    /**
+     * @brief Blur blurs values along each lattice axis with [1 2 1] / 4.
+     * @param maxThreads
+     */
+    void Blur(int maxThreads);
+
+    /**
+     * @brief Slice interpolates values at a position. This is thread-safe.
+     * @param position
+     * @param out
+     */
+    void Slice(const float *position, float *out) const;
+
+    /**
+     * @brief getPoints returns the number of vertices.
+     * @return
+     */
+    int getPoints()
+    {
+        return nPoints;
+    }
+
+    /**
+     * @brief getMaxPosition returns the largest absolute value of a
+     * position coordinate whose lattice coordinates are still exact in
+     * single precision (2^23).
+     * @param d is the number of dimensions of positions.
+     * @return
+     */
+    static float getMaxPosition(int d)
+    {
+        d = CLAMPi(d, 1, PERMUTOHEDRAL_MAX_DIM);
+        return 8388608.0f / float(d * (d + 1));
+    }
+};
+
+PIC_INLINE void PermutohedralLattice::Init(int d, int vd, int nExpected)
+{
+    if(d > PERMUTOHEDRAL_MAX_DIM) {
+        d = PERMUTOHEDRAL_MAX_DIM;
+    }
+
+    if((this->d != d) || (this->vd != vd)) {
+        this->d = d;
+        this->vd = vd;
+
+        scaleFactor.resize(d);
+
+        //standard deviation of the blur is 1 in the input space
+        float inv_std_dev = sqrtf(2.0f / 3.0f) * float(d + 1);
+
+        for(int i = 0; i < d; i++) {
+            scaleFactor[i] = inv_std_dev / sqrtf(float((i + 1) * (i + 2)));
+        }
+
+        //canonical simplex
+        canonical.resize((d + 1) * (d + 1));
+
+        for(int i = 0; i <= d; i++) {
+            for(int j = 0; j <= (d - i); j++) {
+                canonical[i * (d + 1) + j] = i;
+            }
+
+            for(int j = d - i + 1; j <= d; j++) {
+                canonical[i * (d + 1) + j] = i - (d + 1);
+            }
+        }
+    }
+
+    nPoints = 0;
+
+    int size = 1024;
+
+    while(size < (nExpected * 2)) {
+        size *= 2;
+    }
+
+    table.assign(MAX(size, int(table.size())), -1);
+    keys.clear();
+    values.clear();
+}
+
+PIC_INLINE int PermutohedralLattice::Find(const int *key) const
+{
+    unsigned int mask = (unsigned int)(table.size() - 1);
+    unsigned int h = Hash(key) & mask;
+
+    while(true) {
+        int e = table[h];
+
+        if(e < 0) {
+            return -1;
+        }
+
+        const int *k = &keys[e * d];
+        bool bMatch = true;
+
+        for(int i = 0; i < d; i++) {
+            if(k[i] != key[i]) {
+                bMatch = false;
+                break;
+            }
+        }
+
+        if(bMatch) {
+            return e;
+        }
+
+        h = (h + 1) & mask;
+    }
+}
+
+PIC_INLINE void PermutohedralLattice::Grow()
+{
+    table.assign(table.size() * 2, -1);
+
+    unsigned int mask = (unsigned int)(table.size() - 1);
+
+    for(int e = 0; e < nPoints; e++) {
+        unsigned int h = Hash(&keys[e * d]) & mask;
+
+        while(table[h] >= 0) {
+            h = (h + 1) & mask;
+        }
+
+        table[h] = e;
+    }
+}
+
+PIC_INLINE int PermutohedralLattice::Insert(const int *key)
+{
+    //the load factor is kept under 1/2
+    if((nPoints * 2) >= int(table.size())) {
+        Grow();
+    }
+
+    unsigned int mask = (unsigned int)(table.size() - 1);
+    unsigned int h = Hash(key) & mask;
+
+    while(true) {
+        int e = table[h];
+
+        if(e < 0) {
+            table[h] = nPoints;
+
+            keys.insert(keys.end(), key, key + d);
+            values.resize(values.size() + vd, 0.0f);
+
+            return nPoints++;
+        }
+
+        const int *k = &keys[e * d];
+        bool bMatch = true;
+
+        for(int i = 0; i < d; i++) {
+            if(k[i] != key[i]) {
+                bMatch = false;
+                break;
+            }
+        }
+
+        if(bMatch) {
+            return e;
+        }
+
+        h = (h + 1) & mask;
+    }
+}
+
+PIC_INLINE void PermutohedralLattice::Locate(const float *position, int *greedy,
+        int *rank, float *barycentric) const
+{
+    float elevated[PERMUTOHEDRAL_MAX_DIM + 1];
+
+    //elevation onto the hyperplane of the lattice
+    float sm = 0.0f;
+
+    for(int i = d; i > 0; i--) {
+        float cf = position[i - 1] * scaleFactor[i - 1];
+        elevated[i] = sm - float(i) * cf;
+        sm += cf;
+    }
+
+    elevated[0] = sm;
+
+    //closest remainder-0 point
+    float down_factor = 1.0f / float(d + 1);
+    int sum = 0;
+
+    for(int i = 0; i <= d; i++) {
+        float v = elevated[i] * down_factor;
+        float up = ceilf(v) * float(d + 1);
+        float down = floorf(v) * float(d + 1);
+
+        if((up - elevated[i]) < (elevated[i] - down)) {
+            greedy[i] = int(up);
+        } else {
+            greedy[i] = int(down);
+        }
+
+        sum += greedy[i];
+    }
+
+    sum /= (d + 1);
+
+    //ranks of the differential
+    for(int i = 0; i <= d; i++) {
+        rank[i] = 0;
+    }
+
+    for(int i = 0; i < d; i++) {
+        for(int j = i + 1; j <= d; j++) {
+            if((elevated[i] - greedy[i]) < (elevated[j] - greedy[j])) {
+                rank[i]++;
+            } else {
+                rank[j]++;
+            }
+        }
+    }
+
+    if(sum > 0) {
+        for(int i = 0; i <= d; i++) {
+            if(rank[i] >= (d + 1 - sum)) {
+                greedy[i] -= (d + 1);
+                rank[i] += sum - (d + 1);
+            } else {
+                rank[i] += sum;
+            }
+        }
+    } else {
+        if(sum < 0) {
+            for(int i = 0; i <= d; i++) {
+                if(rank[i] < -sum) {
+                    greedy[i] += (d + 1);
+                    rank[i] += (d + 1) + sum;
+                } else {
+                    rank[i] += sum;
+                }
+            }
+        }
+    }
+
+    //barycentric coordinates
+    for(int i = 0; i <= (d + 1); i++) {
+        barycentric[i] = 0.0f;
+    }
+
+    for(int i = 0; i <= d; i++) {
+        float delta = (elevated[i] - greedy[i]) * down_factor;
+        barycentric[d - rank[i]] += delta;
+        barycentric[d + 1 - rank[i]] -= delta;
+    }
+
+    barycentric[0] += 1.0f + barycentric[d + 1];
+}
+
+PIC_INLINE void PermutohedralLattice::Splat(const float *position,
+        const float *value)
+{
+    int   greedy[PERMUTOHEDRAL_MAX_DIM + 1];
+    int   rank[PERMUTOHEDRAL_MAX_DIM + 1];
+    float barycentric[PERMUTOHEDRAL_MAX_DIM + 2];
+    int   key[PERMUTOHEDRAL_MAX_DIM + 1];
+
+    Locate(position, greedy, rank, barycentric);
+
+    for(int remainder = 0; remainder <= d; remainder++) {
+        for(int i = 0; i < d; i++) {
+            key[i] = greedy[i] + canonical[remainder * (d + 1) + rank[i]];
+        }
+
+        float *val = &values[Insert(key) * vd];
+
+        for(int i = 0; i < vd; i++) {
+            val[i] += barycentric[remainder] * value[i];
+        }
+    }
+}
+
+PIC_INLINE void PermutohedralLattice::Blur(int maxThreads)
+{
+    valuesTmp.resize(values.size());
+
+    //chunks of vertices
+    const int chunk = 4096;
+    int nChunks = (nPoints + chunk - 1) / chunk;
+
+    for(int j = 0; j <= d; j++) {
+        ThreadPool::Execute(nChunks, [&](unsigned int c) {
+            int n1[PERMUTOHEDRAL_MAX_DIM + 1];
+            int n2[PERMUTOHEDRAL_MAX_DIM + 1];
+
+            int e0 = c * chunk;
+            int e1 = MIN(e0 + chunk, nPoints);
+
+            for(int e = e0; e < e1; e++) {
+                const int *key = &keys[e * d];
+
+                //neighbors along the j-th axis
+                for(int k = 0; k < d; k++) {
+                    n1[k] = key[k] + 1;
+                    n2[k] = key[k] - 1;
+                }
+
+                if(j < d) {
+                    n1[j] = key[j] - d;
+                    n2[j] = key[j] + d;
+                }
+
+                int i1 = Find(n1);
+                int i2 = Find(n2);
+
+                const float *v0 = &values[e * vd];
+                float *out = &valuesTmp[e * vd];
+
+                for(int k = 0; k < vd; k++) {
+                    out[k] = 0.5f * v0[k];
+                }
+
+                if(i1 >= 0) {
+                    const float *v1 = &values[i1 * vd];
+
+                    for(int k = 0; k < vd; k++) {
+                        out[k] += 0.25f * v1[k];
+                    }
+                }
+
+                if(i2 >= 0) {
+                    const float *v2 = &values[i2 * vd];
+
+                    for(int k = 0; k < vd; k++) {
+                        out[k] += 0.25f * v2[k];
+                    }
+                }
+            }
+        }, maxThreads);
+
+        values.swap(valuesTmp);
+    }
+}
+
+PIC_INLINE void PermutohedralLattice::Slice(const float *position,
+        float *out) const
+{
+    int   greedy[PERMUTOHEDRAL_MAX_DIM + 1];
+    int   rank[PERMUTOHEDRAL_MAX_DIM + 1];
+    float barycentric[PERMUTOHEDRAL_MAX_DIM + 2];
+    int   key[PERMUTOHEDRAL_MAX_DIM + 1];
+
+    Locate(position, greedy, rank, barycentric);
+
+    for(int i = 0; i < vd; i++) {
+        out[i] = 0.0f;
+    }
+
+    for(int remainder = 0; remainder <= d; remainder++) {
+        for(int i = 0; i < d; i++) {
+            key[i] = greedy[i] + canonical[remainder * (d + 1) + rank[i]];
+        }
+
+        int e = Find(key);
+
+        if(e >= 0) {
+            const float *val = &values[e * vd];
+
+            for(int i = 0; i < vd; i++) {
+                out[i] += barycentric[remainder] * val[i];
+            }
+        }
+    }
+}
+
+} // end namespace pic
+
+#endif /* PIC_UTIL_PERMUTOHEDRAL_LATTICE_HPP */
+
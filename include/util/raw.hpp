@@ -25,9 +25,16 @@ See the GNU Lesser General Public License
 #ifndef PIC_UTIL_RAW_HPP
 #define PIC_UTIL_RAW_HPP
 
+#include <vector>
+#include <limits>
+#include <algorithm>
+
 #include "base.hpp"
 #include "util/file_lister.hpp"
 #include "util/string.hpp"
+#include "util/math.hpp"
+#include "util/mapped_file.hpp"
+#include "util/thread_pool.hpp"
 
 namespace pic {
 
@@ -261,32 +268,425 @@ template <class T> PIC_INLINE unsigned long *MeanRAWIterative(RAW<T> *img,
     return dataAcc;
 }
 
-template <class T> PIC_INLINE RAW<T> *CalculateRAWMeanFromFile(
-    std::string nameDir,
-    std::string nameFilter,
-    int width,
-    int height)
+enum RAW_REDUCTION {RR_MEAN, RR_MEDIAN, RR_SIGMA_CLIPPED_MEAN, RR_MIN, RR_MAX};
+
+/**
+ * @brief The RAWStackReducer class reduces a stack of RAW frames (e.g.,
+ * dark or flat frames) to a single frame. Frames are mapped in memory and
+ * processed by strips of values in parallel; so memory does not depend on
+ * the number of frames, except for the mappings.
+ */
+template <class T> class RAWStackReducer
 {
+protected:
+    RAW_REDUCTION       type;
+    int                 maxThreads, stripSize;
+    int                 medianBase, sigmaIterations;
+    float               sigmaKappa;
 
-    StringVec vec;
+    std::vector<const T *> frames;
 
-    FileLister::List(nameDir, nameFilter, &vec);
+    /**
+     * @brief getLevels returns the number of levels of the remedian.
+     * @return
+     */
+    int getLevels()
+    {
+        int levels = 1;
+        long long size = medianBase;
+
+        while(size < (long long)(frames.size())) {
+            size *= medianBase;
+            levels++;
+        }
+
+        return levels;
+    }
+
+    /**
+     * @brief ReduceStrip reduces the values in [i0, i1).
+     * @param i0
+     * @param i1
+     * @param out
+     * @param acc is scratch memory; see getScratchSize.
+     */
+    void ReduceStrip(int i0, int i1, float *out, double *acc)
+    {
+        int n = i1 - i0;
+        int nFrames = int(frames.size());
+
+        switch(type) {
+        case RR_MIN:
+        case RR_MAX: {
+            bool bMin = (type == RR_MIN);
+
+            for(int i = i0; i < i1; i++) {
+                out[i] = float(frames[0][i]);
+            }
+
+            for(int f = 1; f < nFrames; f++) {
+                const T *frame = frames[f];
+
+                for(int i = i0; i < i1; i++) {
+                    float x = float(frame[i]);
+                    out[i] = bMin ? MIN(out[i], x) : MAX(out[i], x);
+                }
+            }
+        }
+        break;
+
+        case RR_MEAN: {
+            std::fill(acc, acc + n, 0.0);
+
+            for(int f = 0; f < nFrames; f++) {
+                const T *frame = frames[f] + i0;
+
+                for(int i = 0; i < n; i++) {
+                    acc[i] += double(frame[i]);
+                }
+            }
+
+            for(int i = 0; i < n; i++) {
+                out[i0 + i] = float(acc[i] / double(nFrames));
+            }
+        }
+        break;
+
+        case RR_SIGMA_CLIPPED_MEAN: {
+            double *sum  = acc;
+            double *sum2 = acc + n;
+            double *mean = acc + 2 * n;
+            double *thr  = acc + 3 * n;
+            double *cnt  = acc + 4 * n;
+
+            for(int it = 0; it <= sigmaIterations; it++) {
+                std::fill(acc, acc + 2 * n, 0.0);
+                std::fill(cnt, cnt + n, 0.0);
+
+                for(int f = 0; f < nFrames; f++) {
+                    const T *frame = frames[f] + i0;
+
+                    for(int i = 0; i < n; i++) {
+                        double x = double(frame[i]);
+
+                        //the first pass keeps all values
+                        if((it == 0) || (fabs(x - mean[i]) <= thr[i])) {
+                            sum[i]  += x;
+                            sum2[i] += x * x;
+                            cnt[i]  += 1.0;
+                        }
+                    }
+                }
+
+                for(int i = 0; i < n; i++) {
+                    //if all values are clipped, the previous mean is kept
+                    if(cnt[i] > 0.0) {
+                        mean[i] = sum[i] / cnt[i];
+                        double var = sum2[i] / cnt[i] - mean[i] * mean[i];
+                        thr[i] = double(sigmaKappa) * sqrt(MAX(var, 0.0));
+                    }
+                }
+            }
+
+            for(int i = 0; i < n; i++) {
+                out[i0 + i] = float(mean[i]);
+            }
+        }
+        break;
+
+        case RR_MEDIAN: {
+            ReduceStripMedian(i0, i1, out, (float *) acc);
+        }
+        break;
+        }
+    }
+
+    /**
+     * @brief ReduceStripMedian approximates the median with the remedian:
+     * every medianBase values of a level are replaced by their median in
+     * the next level. The remaining values are merged by a weighted median.
+     * The median is exact for stacks of up to medianBase frames.
+     * @param i0
+     * @param i1
+     * @param out
+     * @param buf is scratch memory; see getScratchSize.
+     */
+    void ReduceStripMedian(int i0, int i1, float *out, float *buf)
+    {
+        int n = i1 - i0;
+        int N = medianBase;
+        int levels = getLevels();
+
+        std::vector<int> count(levels, 0);
+
+        for(unsigned int f = 0; f < frames.size(); f++) {
+            const T *frame = frames[f] + i0;
+
+            for(int i = 0; i < n; i++) {
+                buf[i * N + count[0]] = float(frame[i]);
+            }
+
+            count[0]++;
+
+            //carrying medians to the next levels
+            for(int l = 0; (l < (levels - 1)) && (count[l] == N); l++) {
+                float *src = buf + size_t(l) * n * N;
+                float *dst = buf + size_t(l + 1) * n * N;
+
+                for(int i = 0; i < n; i++) {
+                    float *values = src + i * N;
+                    std::nth_element(values, values + N / 2, values + N);
+                    dst[i * N + count[l + 1]] = values[N / 2];
+                }
+
+                count[l] = 0;
+                count[l + 1]++;
+            }
+        }
+
+        //weighted median of the remaining values
+        std::vector< std::pair<float, long long> > values;
+        long long total = 0;
+        long long weight = 1;
+
+        for(int l = 0; l < levels; l++) {
+            total += count[l] * weight;
+            weight *= N;
+        }
+
+        for(int i = 0; i < n; i++) {
+            values.clear();
+            weight = 1;
+
+            for(int l = 0; l < levels; l++) {
+                float *src = buf + (size_t(l) * n + i) * N;
+
+                for(int k = 0; k < count[l]; k++) {
+                    values.push_back(std::make_pair(src[k], weight));
+                }
+
+                weight *= N;
+            }
+
+            std::sort(values.begin(), values.end());
+
+            //lower and upper medians
+            long long cum = 0;
+            float lo = values.back().first;
+            float hi = lo;
+            bool bLo = false;
+
+            for(unsigned int k = 0; k < values.size(); k++) {
+                cum += values[k].second;
+
+                if(!bLo && ((cum * 2) >= total)) {
+                    lo = values[k].first;
+                    bLo = true;
+                }
+
+                if((cum * 2) > total) {
+                    hi = values[k].first;
+                    break;
+                }
+            }
+
+            out[i0 + i] = (lo + hi) * 0.5f;
+        }
+    }
+
+    /**
+     * @brief getScratchSize returns the size of the scratch memory of a
+     * strip in doubles.
+     * @return
+     */
+    size_t getScratchSize()
+    {
+        switch(type) {
+        case RR_MEAN:
+            return size_t(stripSize);
+
+        case RR_SIGMA_CLIPPED_MEAN:
+            return size_t(stripSize) * 5;
+
+        case RR_MEDIAN:
+            return (size_t(stripSize) * medianBase * getLevels() + 1) / 2;
+
+        default:
+            return 1;
+        }
+    }
 
-    RAW<T> imgRAW;
-    unsigned long *dataAcc = NULL;
+public:
 
-    for(unsigned int i = 0; i < vec.size(); i++) {
-        imgRAW.Read(vec[i], width * height);
-        dataAcc = MeanRAWIterative<T>(&imgRAW, dataAcc, i == 0);
+    /**
+     * @brief RAWStackReducer
+     * @param type is the reduction.
+     * @param maxThreads
+     */
+    RAWStackReducer(RAW_REDUCTION type = RR_MEAN, int maxThreads = -1)
+    {
+        this->type = type;
+        this->maxThreads = maxThreads;
+        stripSize = 8192;
+        medianBase = 15;
+        sigmaKappa = 3.0f;
+        sigmaIterations = 3;
+    }
+
+    /**
+     * @brief SetStripSize sets the number of values processed by a task.
+     * @param stripSize
+     */
+    void SetStripSize(int stripSize)
+    {
+        this->stripSize = MAX(stripSize, 64);
     }
 
-    RAW<T> *imgOut = imgRAW.Copy();
+    /**
+     * @brief SetMedianBase sets the number of values of each median of the
+     * remedian; an odd number.
+     * @param medianBase
+     */
+    void SetMedianBase(int medianBase)
+    {
+        medianBase = MAX(medianBase, 3);
+        this->medianBase = medianBase | 1;
+    }
 
-    for(int i = 0; i < imgOut->nData; i++) {
-        imgOut->data[i] = dataAcc[i] / vec.size();
+    /**
+     * @brief SetSigmaClipping sets the parameters of the sigma-clipped mean;
+     * values farther than kappa standard deviations from the mean are
+     * discarded, and the mean is updated iterations times.
+     * @param kappa
+     * @param iterations
+     */
+    void SetSigmaClipping(float kappa, int iterations)
+    {
+        sigmaKappa = kappa;
+        sigmaIterations = MAX(iterations, 0);
     }
 
-    return imgOut;
+    /**
+     * @brief Process reduces a stack of RAW files.
+     * @param nameFiles
+     * @param nData is the number of values of a frame; if it is < 1, it
+     * is the size of the first file.
+     * @param out is an array of nData values.
+     * @return It returns false if no file could be read; files which are
+     * smaller than nData values are skipped.
+     */
+    bool Process(const StringVec &nameFiles, int nData, float *out)
+    {
+        if(out == NULL) {
+            return false;
+        }
+
+        std::vector<MappedFile *> mapped;
+        frames.clear();
+
+        for(unsigned int i = 0; i < nameFiles.size(); i++) {
+            MappedFile *file = new MappedFile();
+
+            if(file->Open(nameFiles[i])) {
+                if(nData < 1) {
+                    nData = int(file->getSize() / sizeof(T));
+                }
+
+                if((nData > 0) && (file->getSize() >= (size_t(nData) * sizeof(T)))) {
+                    frames.push_back((const T *) file->getData());
+                    mapped.push_back(file);
+                    continue;
+                }
+            }
+
+            delete file;
+        }
+
+        bool bRet = !frames.empty();
+
+        if(bRet) {
+            int nStrips = (nData + stripSize - 1) / stripSize;
+            size_t scratchSize = getScratchSize();
+
+            ThreadPool::Execute(nStrips, [&](unsigned int s) {
+                int i0 = s * stripSize;
+                int i1 = MIN(i0 + stripSize, nData);
+
+                std::vector<double> scratch(scratchSize);
+                ReduceStrip(i0, i1, out, &scratch[0]);
+            }, maxThreads);
+        }
+
+        frames.clear();
+
+        for(unsigned int i = 0; i < mapped.size(); i++) {
+            delete mapped[i];
+        }
+
+        return bRet;
+    }
+
+    /**
+     * @brief Process reduces a stack of RAW files; integer values are
+     * rounded.
+     * @param nameFiles
+     * @param nData is the number of values of a frame; if it is < 1, it
+     * is the size of the first file.
+     * @return It returns NULL if no file could be read.
+     */
+    RAW<T> *Process(const StringVec &nameFiles, int nData = -1)
+    {
+        if((nData < 1) && !nameFiles.empty()) {
+            MappedFile file;
+
+            if(file.Open(nameFiles[0])) {
+                nData = int(file.getSize() / sizeof(T));
+            }
+        }
+
+        if(nData < 1) {
+            return NULL;
+        }
+
+        std::vector<float> tmp(nData);
+
+        if(!Process(nameFiles, nData, &tmp[0])) {
+            return NULL;
+        }
+
+        RAW<T> *imgOut = new RAW<T>(nData);
+        float offset = std::numeric_limits<T>::is_integer ? 0.5f : 0.0f;
+
+        for(int i = 0; i < nData; i++) {
+            imgOut->data[i] = T(tmp[i] + offset);
+        }
+
+        imgOut->valid = true;
+        return imgOut;
+    }
+};
+
+/**
+ * @brief CalculateRAWMeanFromFile computes the mean of the RAW files in a
+ * directory; see RAWStackReducer.
+ * @param nameDir
+ * @param nameFilter
+ * @param width
+ * @param height
+ * @return
+ */
+template <class T> PIC_INLINE RAW<T> *CalculateRAWMeanFromFile(
+    std::string nameDir,
+    std::string nameFilter,
+    int width,
+    int height)
+{
+    StringVec vec;
+
+    FileLister::List(nameDir, nameFilter, &vec);
+
+    RAWStackReducer<T> reducer(RR_MEAN);
+    return reducer.Process(vec, width * height);
 }
 
 template <class T> PIC_INLINE void CalculateRAWMeanFromFile(
@@ -296,8 +696,13 @@ template <class T> PIC_INLINE void CalculateRAWMeanFromFile(
     int width,
     int height)
 {
-    (CalculateRAWMeanFromFile<T>(nameDir, nameFilter, width,
-                                 height))->Write(nameOut);
+    RAW<T> *imgOut = CalculateRAWMeanFromFile<T>(nameDir, nameFilter, width,
+                     height);
+
+    if(imgOut != NULL) {
+        imgOut->Write(nameOut);
+        delete imgOut;
+    }
 }
 
 } // end namespace pic
@@ -0,0 +1,682 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+PICCANTE is free software; you can redistribute it and/or modify
+under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation; either version 3.0 of
+the License, or (at your option) any later version.
+
+PICCANTE is distributed in the hope that it will be useful, but
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU Lesser General Public License
+( http://www.gnu.org/licenses/lgpl-3.0.html ) for more details.
+
+*/
+
+#ifndef PIC_UTIL_RESULT_CACHE_HPP
+#define PIC_UTIL_RESULT_CACHE_HPP
+
+#include <stdio.h>
+#include <string>
+#include <list>
+#include <algorithm>
+#include <utility>
+#include <map>
+#include <vector>
+
+#ifndef PIC_DISABLE_THREAD
+#include <mutex>
+#endif
+
+#include "image_raw_vec.hpp"
+#include "util/thread_pool.hpp"
+#include "util/hash.hpp"
+#include "util/string.hpp"
+
+namespace pic {
+
+//version of the index of the on-disk tier
+#define RESULT_CACHE_VERSION 2
+
+/**
+ * @brief The ResultCache class is a process-wide cache of filtered images.
+ * Results are indexed by a 64-bit key, usually the hash of the input
+ * buffers plus the signature of the filter (see Key). Each result stores
+ * a tag as well, i.e., the signature and the sizes of the inputs (see Tag),
+ * which has to match on Get; so a collision of keys is a miss and not a
+ * wrong result. There are two tiers:
+ * an in-memory LRU tier, and an optional on-disk tier in a directory.
+ * Both tiers evict least recently used results when their size budget is
+ * exceeded. Files on disk are written to a temporary name and then renamed,
+ * so a result is either complete or missing.
+ */
+class ResultCache
+{
+protected:
+
+    struct MemoryEntry
+    {
+        ImageRAW    *img;
+        size_t      bytes;
+        std::string tag;
+        std::list<unsigned long long>::iterator it;
+    };
+
+    struct DiskEntry
+    {
+        size_t             bytes;
+        unsigned long long tick;
+        std::string        tag;
+        std::list<unsigned long long>::iterator it;
+    };
+
+#ifndef PIC_DISABLE_THREAD
+    std::mutex mutex;
+#endif
+
+    //in-memory tier; the front of lru is the most recently used
+    std::list<unsigned long long>                lru;
+    std::map<unsigned long long, MemoryEntry>   memory;
+    size_t                                       memoryBytes, memoryBudget;
+
+    //on-disk tier; the front of lruDisk is the most recently used, and
+    //ticks store the same order in the index
+    std::string                                  diskDir;
+    std::list<unsigned long long>                lruDisk;
+    std::map<unsigned long long, DiskEntry>     disk;
+    size_t                                       diskBytes, diskBudget;
+    unsigned long long                           tick, counter;
+    bool                                         bDiskDirty;
+
+    ResultCache()
+    {
+        memoryBytes = 0;
+        memoryBudget = size_t(256) << 20;
+
+        diskDir = "";
+        diskBytes = 0;
+        diskBudget = 0;
+        tick = 0;
+        counter = 0;
+        bDiskDirty = false;
+    }
+
+    /**
+     * @brief getFileName returns the file name of a key on the disk.
+     * @param key
+     * @return
+     */
+    std::string getFileName(unsigned long long key)
+    {
+        char tmp[32];
+        sprintf(tmp, "%016llx", key);
+        return diskDir + "/" + tmp + ".tmp";
+    }
+
+    /**
+     * @brief Commit renames a temporary file into its final name.
+     * @param nameTmp
+     * @param name
+     * @return
+     */
+    static bool Commit(std::string nameTmp, std::string name)
+    {
+#ifdef PIC_WIN32
+        //rename does not overwrite on Windows
+        remove(name.c_str());
+#endif
+
+        if(rename(nameTmp.c_str(), name.c_str()) != 0) {
+            remove(nameTmp.c_str());
+            return false;
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief LoadIndex reads the index of the on-disk tier.
+     */
+    void LoadIndex();
+
+    /**
+     * @brief SaveIndex writes the index of the on-disk tier. It is called
+     * on Put, on eviction, and on destruction; recency updates of Get are
+     * kept in memory until then.
+     */
+    void SaveIndex();
+
+    /**
+     * @brief PutMemory inserts a copy of img in the in-memory tier.
+     * @param key
+     * @param tag
+     * @param img
+     */
+    void PutMemory(unsigned long long key, std::string &tag, ImageRAW *img);
+
+    /**
+     * @brief EvictMemory removes least recently used results until the
+     * in-memory tier fits its budget.
+     */
+    void EvictMemory();
+
+    /**
+     * @brief EvictDisk removes least recently used results until the
+     * on-disk tier fits its budget.
+     * @return It returns true if results were removed.
+     */
+    bool EvictDisk();
+
+    /**
+     * @brief EraseDisk removes a result from the index of the on-disk tier.
+     * @param it
+     */
+    void EraseDisk(std::map<unsigned long long, DiskEntry>::iterator it);
+
+public:
+
+    ~ResultCache()
+    {
+        Clear();
+
+        if(!diskDir.empty() && bDiskDirty) {
+            SaveIndex();
+        }
+    }
+
+    /**
+     * @brief getInstance returns the process-wide cache.
+     * @return
+     */
+    static ResultCache *getInstance()
+    {
+        static ResultCache cache;
+        return &cache;
+    }
+
+    /**
+     * @brief HashImage computes the hash of the size and the pixels of an
+     * image. Large buffers are hashed in parallel chunks whose hashes are
+     * combined in a fixed order.
+     * @param img
+     * @param seed
+     * @return
+     */
+    static unsigned long long HashImage(ImageRAW *img, unsigned long long seed);
+
+    /**
+     * @brief Key computes the key of the result of a filter.
+     * @param imgIn is the input of the filter.
+     * @param signature is the signature of the filter, which has to
+     * encode its type and all its parameters.
+     * @return
+     */
+    static unsigned long long Key(ImageRAWVec &imgIn, std::string signature);
+
+    /**
+     * @brief Tag computes the tag of the result of a filter; i.e., the
+     * signature followed by the sizes of the inputs.
+     * @param imgIn is the input of the filter.
+     * @param signature is the signature of the filter.
+     * @return
+     */
+    static std::string Tag(ImageRAWVec &imgIn, std::string signature);
+
+    /**
+     * @brief SetMemoryBudget sets the size in bytes of the in-memory tier.
+     * @param bytes
+     */
+    void SetMemoryBudget(size_t bytes);
+
+    /**
+     * @brief SetDiskCache enables the on-disk tier.
+     * @param nameDir is an existing directory; an empty string disables
+     * the on-disk tier.
+     * @param bytes is the size budget in bytes.
+     */
+    void SetDiskCache(std::string nameDir, size_t bytes);
+
+    /**
+     * @brief Get looks for a result in the cache.
+     * @param key
+     * @param tag has to be equal to the tag of the stored result.
+     * @param imgOut receives a copy of the result; it is allocated if it
+     * is NULL.
+     * @return It returns true if the result is in the cache.
+     */
+    bool Get(unsigned long long key, std::string tag, ImageRAW *&imgOut);
+
+    /**
+     * @brief Put stores a copy of a result in the cache. The file of the
+     * on-disk tier is written without holding the lock of the cache.
+     * @param key
+     * @param tag
+     * @param img
+     */
+    void Put(unsigned long long key, std::string tag, ImageRAW *img);
+
+    /**
+     * @brief Clear removes all results from the in-memory tier; files on
+     * the disk are kept.
+     */
+    void Clear();
+};
+
+PIC_INLINE unsigned long long ResultCache::HashImage(ImageRAW *img,
+        unsigned long long seed)
+{
+    if(img == NULL) {
+        return HashBytes(NULL, 0, seed);
+    }
+
+    int header[4] = {img->width, img->height, img->channels, img->frames};
+    unsigned long long h = HashBytes(header, sizeof(header), seed);
+
+    if(img->data == NULL) {
+        return h;
+    }
+
+    return HashBytesParallel(img->data, size_t(img->size()) * sizeof(float), h);
+}
+
+PIC_INLINE unsigned long long ResultCache::Key(ImageRAWVec &imgIn,
+        std::string signature)
+{
+    unsigned long long h = HashBytes(signature.c_str(), signature.size(), 0);
+
+    for(unsigned int i = 0; i < imgIn.size(); i++) {
+        h = HashImage(imgIn[i], h);
+    }
+
+    return h;
+}
+
+PIC_INLINE std::string ResultCache::Tag(ImageRAWVec &imgIn,
+        std::string signature)
+{
+    std::string ret = signature;
+
+    for(unsigned int i = 0; i < imgIn.size(); i++) {
+        ImageRAW *img = imgIn[i];
+
+        if(img == NULL) {
+            ret += "_0";
+        } else {
+            ret += "_" + NumberToString(img->width) + "x" +
+                   NumberToString(img->height) + "x" +
+                   NumberToString(img->channels) + "x" +
+                   NumberToString(img->frames);
+        }
+    }
+
+    return ret;
+}
+
+PIC_INLINE void ResultCache::SetMemoryBudget(size_t bytes)
+{
+#ifndef PIC_DISABLE_THREAD
+    std::lock_guard<std::mutex> lock(mutex);
+#endif
+
+    memoryBudget = bytes;
+    EvictMemory();
+}
+
+PIC_INLINE void ResultCache::SetDiskCache(std::string nameDir, size_t bytes)
+{
+#ifndef PIC_DISABLE_THREAD
+    std::lock_guard<std::mutex> lock(mutex);
+#endif
+
+    if(!diskDir.empty() && bDiskDirty) {
+        SaveIndex();
+    }
+
+    diskDir = nameDir;
+    diskBudget = bytes;
+    disk.clear();
+    lruDisk.clear();
+    diskBytes = 0;
+    tick = 0;
+    bDiskDirty = false;
+
+    if(!diskDir.empty()) {
+        LoadIndex();
+
+        if(EvictDisk()) {
+            SaveIndex();
+        }
+    }
+}
+
+PIC_INLINE void ResultCache::LoadIndex()
+{
+    FILE *file = fopen((diskDir + "/index.txt").c_str(), "r");
+
+    if(file == NULL) {
+        return;
+    }
+
+    //indices without the version do not have tags, so they are dropped
+    int version = 0;
+
+    if((fscanf(file, "PIC_RESULT_CACHE %d\n", &version) != 1) ||
+       (version != RESULT_CACHE_VERSION)) {
+        fclose(file);
+        return;
+    }
+
+    unsigned long long key, t;
+    unsigned long bytes, len;
+
+    std::vector< std::pair<unsigned long long, unsigned long long> > order;
+
+    //each line is: key bytes tick length tag
+    while(fscanf(file, "%llx %lu %llu %lu", &key, &bytes, &t, &len) == 4) {
+        if(fgetc(file) != ' ') {
+            break;
+        }
+
+        std::string tag(len, ' ');
+
+        if((len > 0) && (fread(&tag[0], 1, len, file) != len)) {
+            break;
+        }
+
+        if(disk.find(key) != disk.end()) {
+            continue;
+        }
+
+        DiskEntry entry;
+        entry.bytes = bytes;
+        entry.tick = t;
+        entry.tag = tag;
+
+        disk[key] = entry;
+        diskBytes += bytes;
+        tick = MAX(tick, t);
+
+        order.push_back(std::make_pair(t, key));
+    }
+
+    fclose(file);
+
+    //rebuilding the LRU list from the ticks
+    std::sort(order.begin(), order.end());
+
+    for(unsigned int i = 0; i < order.size(); i++) {
+        lruDisk.push_front(order[i].second);
+        disk[order[i].second].it = lruDisk.begin();
+    }
+}
+
+PIC_INLINE void ResultCache::SaveIndex()
+{
+    std::string name = diskDir + "/index.txt";
+    std::string nameTmp = name + ".part";
+
+    FILE *file = fopen(nameTmp.c_str(), "w");
+
+    if(file == NULL) {
+        return;
+    }
+
+    fprintf(file, "PIC_RESULT_CACHE %d\n", RESULT_CACHE_VERSION);
+
+    std::map<unsigned long long, DiskEntry>::iterator it;
+
+    for(it = disk.begin(); it != disk.end(); it++) {
+        fprintf(file, "%016llx %lu %llu %lu %s\n", it->first,
+                (unsigned long) it->second.bytes, it->second.tick,
+                (unsigned long) it->second.tag.size(), it->second.tag.c_str());
+    }
+
+    fclose(file);
+
+    if(Commit(nameTmp, name)) {
+        bDiskDirty = false;
+    }
+}
+
+PIC_INLINE void ResultCache::EvictMemory()
+{
+    while((memoryBytes > memoryBudget) && !lru.empty()) {
+        std::map<unsigned long long, MemoryEntry>::iterator it =
+            memory.find(lru.back());
+
+        memoryBytes -= it->second.bytes;
+        delete it->second.img;
+
+        memory.erase(it);
+        lru.pop_back();
+    }
+}
+
+PIC_INLINE void ResultCache::EraseDisk(
+    std::map<unsigned long long, DiskEntry>::iterator it)
+{
+    diskBytes -= it->second.bytes;
+    lruDisk.erase(it->second.it);
+    disk.erase(it);
+    bDiskDirty = true;
+}
+
+PIC_INLINE bool ResultCache::EvictDisk()
+{
+    bool bChanged = false;
+
+    while((diskBytes > diskBudget) && !lruDisk.empty()) {
+        std::map<unsigned long long, DiskEntry>::iterator it =
+            disk.find(lruDisk.back());
+
+        remove(getFileName(it->first).c_str());
+
+        EraseDisk(it);
+        bChanged = true;
+    }
+
+    return bChanged;
+}
+
+PIC_INLINE void ResultCache::PutMemory(unsigned long long key,
+                                      std::string &tag, ImageRAW *img)
+{
+    size_t bytes = size_t(img->size()) * sizeof(float);
+
+    if(bytes > memoryBudget) {
+        return;
+    }
+
+    std::map<unsigned long long, MemoryEntry>::iterator it = memory.find(key);
+
+    if(it != memory.end()) {
+        if(it->second.tag == tag) {
+            lru.splice(lru.begin(), lru, it->second.it);
+            return;
+        }
+
+        //a collision of keys: the newest result is kept
+        memoryBytes -= it->second.bytes;
+        delete it->second.img;
+        lru.erase(it->second.it);
+        memory.erase(it);
+    }
+
+    lru.push_front(key);
+
+    MemoryEntry entry;
+    entry.img = img->Clone();
+    entry.bytes = bytes;
+    entry.tag = tag;
+    entry.it = lru.begin();
+
+    memory[key] = entry;
+    memoryBytes += bytes;
+
+    EvictMemory();
+}
+
+PIC_INLINE bool ResultCache::Get(unsigned long long key, std::string tag,
+                                 ImageRAW *&imgOut)
+{
+#ifndef PIC_DISABLE_THREAD
+    std::lock_guard<std::mutex> lock(mutex);
+#endif
+
+    //in-memory tier
+    std::map<unsigned long long, MemoryEntry>::iterator it = memory.find(key);
+
+    if((it != memory.end()) && (it->second.tag == tag)) {
+        lru.splice(lru.begin(), lru, it->second.it);
+
+        if(imgOut == NULL) {
+            imgOut = it->second.img->Clone();
+        } else {
+            imgOut->Assign(it->second.img);
+        }
+
+        return true;
+    }
+
+    //on-disk tier
+    std::map<unsigned long long, DiskEntry>::iterator itD = disk.find(key);
+
+    if(diskDir.empty() || (itD == disk.end()) || (itD->second.tag != tag)) {
+        return false;
+    }
+
+    ImageRAW tmp;
+
+    if(!tmp.Read(getFileName(key), LT_NONE) ||
+       ((size_t(tmp.size()) * sizeof(float) + sizeof(TMP_IMG_HEADER)) !=
+        itD->second.bytes)) {
+        //the file was removed or replaced by someone else
+        EraseDisk(itD);
+        return false;
+    }
+
+    lruDisk.splice(lruDisk.begin(), lruDisk, itD->second.it);
+    itD->second.tick = ++tick;
+    bDiskDirty = true;
+
+    if(imgOut == NULL) {
+        imgOut = tmp.Clone();
+    } else {
+        imgOut->Assign(&tmp);
+    }
+
+    PutMemory(key, tag, &tmp);
+
+    return true;
+}
+
+PIC_INLINE void ResultCache::Put(unsigned long long key, std::string tag,
+                                 ImageRAW *img)
+{
+    if((img == NULL) || (img->data == NULL)) {
+        return;
+    }
+
+    size_t bytes = size_t(img->size()) * sizeof(float) + sizeof(TMP_IMG_HEADER);
+    std::string name, nameTmp;
+
+    {
+#ifndef PIC_DISABLE_THREAD
+        std::lock_guard<std::mutex> lock(mutex);
+#endif
+
+        PutMemory(key, tag, img);
+
+        if(diskDir.empty() || (bytes > diskBudget)) {
+            return;
+        }
+
+        std::map<unsigned long long, DiskEntry>::iterator it = disk.find(key);
+
+        if((it != disk.end()) && (it->second.tag == tag)) {
+            return;
+        }
+
+        //each writer has its own temporary file
+        name = getFileName(key);
+        nameTmp = name + "." + NumberToString(++counter) + ".part";
+    }
+
+    //atomic write: a temporary file is renamed once complete
+    if(!WriteTMP(nameTmp, img->data, img->width, img->height, img->channels,
+                 img->frames)) {
+        remove(nameTmp.c_str());
+        return;
+    }
+
+#ifndef PIC_DISABLE_THREAD
+    std::lock_guard<std::mutex> lock(mutex);
+#endif
+
+    //the on-disk tier was changed while writing
+    if(name != getFileName(key)) {
+        remove(nameTmp.c_str());
+        return;
+    }
+
+    std::map<unsigned long long, DiskEntry>::iterator it = disk.find(key);
+
+    if((it != disk.end()) && (it->second.tag == tag)) {
+        //another writer stored the same result
+        remove(nameTmp.c_str());
+        return;
+    }
+
+    if(!Commit(nameTmp, name)) {
+        return;
+    }
+
+    if(it != disk.end()) {
+        EraseDisk(it);
+    }
+
+    lruDisk.push_front(key);
+
+    DiskEntry entry;
+    entry.bytes = bytes;
+    entry.tick = ++tick;
+    entry.tag = tag;
+    entry.it = lruDisk.begin();
+
+    disk[key] = entry;
+    diskBytes += bytes;
+
+    EvictDisk();
+    SaveIndex();
+}
+
+PIC_INLINE void ResultCache::Clear()
+{
+#ifndef PIC_DISABLE_THREAD
+    std::lock_guard<std::mutex> lock(mutex);
+#endif
+
+    std::map<unsigned long long, MemoryEntry>::iterator it;
+
+    for(it = memory.begin(); it != memory.end(); it++) {
+        delete it->second.img;
+    }
+
+    memory.clear();
+    lru.clear();
+    memoryBytes = 0;
+}
+
+} // end namespace pic
+
+#endif /* PIC_UTIL_RESULT_CACHE_HPP */
+
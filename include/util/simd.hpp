@@ -0,0 +1,458 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+PICCANTE is free software; you can redistribute it and/or modify
+under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation; either version 3.0 of
+the License, or (at your option) any later version.
+
+PICCANTE is distributed in the hope that it will be useful, but
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU Lesser General Public License
+( http://www.gnu.org/licenses/lgpl-3.0.html ) for more details.
+
+*/
+
+#ifndef PIC_UTIL_SIMD_HPP
+#define PIC_UTIL_SIMD_HPP
+
+#include "base.hpp"
+
+//SIMD code paths; define PIC_DISABLE_SIMD for scalar code only
+#ifndef PIC_DISABLE_SIMD
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define PIC_SIMD_X86
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define PIC_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+#endif
+
+//target attributes for functions compiled for a wider ISA than the default
+#if defined(PIC_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define PIC_TARGET_SSE2 __attribute__((target("sse2")))
+#define PIC_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define PIC_TARGET_SSE2
+#define PIC_TARGET_AVX2
+#endif
+
+namespace pic {
+
+enum SIMD_LEVEL {SIMD_NONE, SIMD_SSE2, SIMD_AVX2, SIMD_NEON};
+
+/**
+ * @brief DetectSIMDLevel detects the widest instruction set of the running CPU.
+ * @return
+ */
+PIC_INLINE SIMD_LEVEL DetectSIMDLevel()
+{
+#if defined(PIC_SIMD_NEON)
+    return SIMD_NEON;
+#elif defined(PIC_SIMD_X86)
+    #if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        int nIds = info[0];
+
+        __cpuid(info, 1);
+        bool bSSE2    = (info[3] & (1 << 26)) != 0;
+        bool bOSXSAVE = (info[2] & (1 << 27)) != 0;
+        bool bAVX     = (info[2] & (1 << 28)) != 0;
+
+        if(bOSXSAVE && bAVX && (nIds >= 7)) {
+            //the OS has to save YMM registers
+            unsigned long long xcr0 = _xgetbv(0);
+
+            __cpuidex(info, 7, 0);
+            bool bAVX2 = (info[1] & (1 << 5)) != 0;
+
+            if(bAVX2 && ((xcr0 & 6) == 6)) {
+                return SIMD_AVX2;
+            }
+        }
+
+        return bSSE2 ? SIMD_SSE2 : SIMD_NONE;
+    #else
+        __builtin_cpu_init();
+
+        if(__builtin_cpu_supports("avx2")) {
+            return SIMD_AVX2;
+        }
+
+        if(__builtin_cpu_supports("sse2")) {
+            return SIMD_SSE2;
+        }
+
+        return SIMD_NONE;
+    #endif
+#else
+    return SIMD_NONE;
+#endif
+}
+
+/**
+ * @brief getSIMDLevel returns the instruction set used by SIMD kernels;
+ * it is detected once.
+ * @return
+ */
+inline SIMD_LEVEL getSIMDLevel()
+{
+    static SIMD_LEVEL level = DetectSIMDLevel();
+    return level;
+}
+
+/**
+ * @brief WeightedSumScalar computes dst[i] = sum_k weights[k] * rows[k][i]
+ * for i in [i0, count).
+ * @param rows
+ * @param weights
+ * @param n
+ * @param dst
+ * @param i0
+ * @param count
+ */
+inline void WeightedSumScalar(const float **rows, const float *weights, int n,
+                              float *dst, int i0, int count)
+{
+    for(int i = i0; i < count; i++) {
+        float sum = 0.0f;
+
+        for(int k = 0; k < n; k++) {
+            sum += rows[k][i] * weights[k];
+        }
+
+        dst[i] = sum;
+    }
+}
+
+#ifdef PIC_SIMD_X86
+
+PIC_TARGET_SSE2 inline void WeightedSumSSE2(const float **rows,
+        const float *weights, int n, float *dst, int count)
+{
+    int i = 0;
+
+    for(; i <= (count - 8); i += 8) {
+        __m128 acc0 = _mm_setzero_ps();
+        __m128 acc1 = _mm_setzero_ps();
+
+        for(int k = 0; k < n; k++) {
+            __m128 w = _mm_set1_ps(weights[k]);
+            acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(rows[k] + i    ), w));
+            acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(rows[k] + i + 4), w));
+        }
+
+        _mm_storeu_ps(dst + i    , acc0);
+        _mm_storeu_ps(dst + i + 4, acc1);
+    }
+
+    for(; i <= (count - 4); i += 4) {
+        __m128 acc = _mm_setzero_ps();
+
+        for(int k = 0; k < n; k++) {
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(rows[k] + i),
+                                             _mm_set1_ps(weights[k])));
+        }
+
+        _mm_storeu_ps(dst + i, acc);
+    }
+
+    WeightedSumScalar(rows, weights, n, dst, i, count);
+}
+
+PIC_TARGET_AVX2 inline void WeightedSumAVX2(const float **rows,
+        const float *weights, int n, float *dst, int count)
+{
+    int i = 0;
+
+    for(; i <= (count - 16); i += 16) {
+        __m256 acc0 = _mm256_setzero_ps();
+        __m256 acc1 = _mm256_setzero_ps();
+
+        for(int k = 0; k < n; k++) {
+            __m256 w = _mm256_set1_ps(weights[k]);
+            acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(rows[k] + i    ), w));
+            acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_loadu_ps(rows[k] + i + 8), w));
+        }
+
+        _mm256_storeu_ps(dst + i    , acc0);
+        _mm256_storeu_ps(dst + i + 8, acc1);
+    }
+
+    for(; i <= (count - 8); i += 8) {
+        __m256 acc = _mm256_setzero_ps();
+
+        for(int k = 0; k < n; k++) {
+            acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(rows[k] + i),
+                                                   _mm256_set1_ps(weights[k])));
+        }
+
+        _mm256_storeu_ps(dst + i, acc);
+    }
+
+    WeightedSumScalar(rows, weights, n, dst, i, count);
+}
+
+#endif
+
+#ifdef PIC_SIMD_NEON
+
+inline void WeightedSumNEON(const float **rows, const float *weights, int n,
+                            float *dst, int count)
+{
+    int i = 0;
+
+    for(; i <= (count - 4); i += 4) {
+        float32x4_t acc = vdupq_n_f32(0.0f);
+
+        for(int k = 0; k < n; k++) {
+            //no fused multiply-add, so results match the scalar code
+            acc = vaddq_f32(acc, vmulq_n_f32(vld1q_f32(rows[k] + i), weights[k]));
+        }
+
+        vst1q_f32(dst + i, acc);
+    }
+
+    WeightedSumScalar(rows, weights, n, dst, i, count);
+}
+
+#endif
+
+/**
+ * @brief WeightedSum computes dst[i] = sum_k weights[k] * rows[k][i] for
+ * i in [0, count), using the widest available instruction set. Products
+ * are accumulated in the order of k without fused multiply-add, so all code
+ * paths give the same results.
+ * @param rows is an array of n pointers.
+ * @param weights is an array of n weights.
+ * @param n
+ * @param dst
+ * @param count
+ */
+inline void WeightedSum(const float **rows, const float *weights, int n,
+                        float *dst, int count)
+{
+    switch(getSIMDLevel()) {
+#ifdef PIC_SIMD_X86
+    case SIMD_AVX2:
+        WeightedSumAVX2(rows, weights, n, dst, count);
+        return;
+
+    case SIMD_SSE2:
+        WeightedSumSSE2(rows, weights, n, dst, count);
+        return;
+#endif
+
+#ifdef PIC_SIMD_NEON
+    case SIMD_NEON:
+        WeightedSumNEON(rows, weights, n, dst, count);
+        return;
+#endif
+
+    default:
+        WeightedSumScalar(rows, weights, n, dst, 0, count);
+    }
+}
+
+#ifdef PIC_SIMD_X86
+
+/**
+ * @brief LoadRGB4SSE2 loads 4 pixels with three interleaved channels as
+ * three planes.
+ * @param src
+ * @param r
+ * @param g
+ * @param b
+ */
+PIC_TARGET_SSE2 inline void LoadRGB4SSE2(const float *src, __m128 &r, __m128 &g,
+                                         __m128 &b)
+{
+    //a = [r0 g0 b0 r1], b = [g1 b1 r2 g2], c = [b2 r3 g3 b3]
+    __m128 v0 = _mm_loadu_ps(src    );
+    __m128 v1 = _mm_loadu_ps(src + 4);
+    __m128 v2 = _mm_loadu_ps(src + 8);
+
+    __m128 t0 = _mm_shuffle_ps(v1, v2, _MM_SHUFFLE(1, 1, 2, 2));
+    r = _mm_shuffle_ps(v0, t0, _MM_SHUFFLE(2, 1, 3, 0));
+
+    __m128 t1 = _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(0, 0, 1, 1));
+    __m128 t2 = _mm_shuffle_ps(v1, v2, _MM_SHUFFLE(2, 2, 3, 3));
+    g = _mm_shuffle_ps(t1, t2, _MM_SHUFFLE(2, 0, 2, 0));
+
+    __m128 t3 = _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(1, 1, 2, 2));
+    __m128 t4 = _mm_shuffle_ps(v2, v2, _MM_SHUFFLE(3, 3, 0, 0));
+    b = _mm_shuffle_ps(t3, t4, _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+/**
+ * @brief StoreRGB4SSE2 stores three planes as 4 pixels with three
+ * interleaved channels.
+ * @param dst
+ * @param r
+ * @param g
+ * @param b
+ */
+PIC_TARGET_SSE2 inline void StoreRGB4SSE2(float *dst, __m128 r, __m128 g,
+                                          __m128 b)
+{
+    __m128 t0 = _mm_shuffle_ps(r, g, _MM_SHUFFLE(0, 0, 0, 0));
+    __m128 t1 = _mm_shuffle_ps(b, r, _MM_SHUFFLE(1, 1, 0, 0));
+    _mm_storeu_ps(dst    , _mm_shuffle_ps(t0, t1, _MM_SHUFFLE(2, 0, 2, 0)));
+
+    __m128 t2 = _mm_shuffle_ps(g, b, _MM_SHUFFLE(1, 1, 1, 1));
+    __m128 t3 = _mm_shuffle_ps(r, g, _MM_SHUFFLE(2, 2, 2, 2));
+    _mm_storeu_ps(dst + 4, _mm_shuffle_ps(t2, t3, _MM_SHUFFLE(2, 0, 2, 0)));
+
+    __m128 t4 = _mm_shuffle_ps(b, r, _MM_SHUFFLE(3, 3, 2, 2));
+    __m128 t5 = _mm_shuffle_ps(g, b, _MM_SHUFFLE(3, 3, 3, 3));
+    _mm_storeu_ps(dst + 8, _mm_shuffle_ps(t4, t5, _MM_SHUFFLE(2, 0, 2, 0)));
+}
+
+/**
+ * @brief SelectSSE2 returns a where mask is set, and b elsewhere.
+ * @param mask
+ * @param a
+ * @param b
+ * @return
+ */
+PIC_TARGET_SSE2 inline __m128 SelectSSE2(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+/**
+ * @brief FastLogSSE2 computes the natural logarithm of x > 0 with the
+ * polynomial of the Cephes library; the relative error is about 1e-7.
+ * Zero and negative values give NaN.
+ * @param x
+ * @return
+ */
+PIC_TARGET_SSE2 inline __m128 FastLogSSE2(__m128 x)
+{
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 invalid = _mm_cmple_ps(x, _mm_setzero_ps());
+
+    //x = m * 2^e with m in [0.5, 1)
+    __m128i xi = _mm_castps_si128(x);
+    __m128i ei = _mm_sub_epi32(_mm_srli_epi32(xi, 23), _mm_set1_epi32(126));
+    __m128 e = _mm_cvtepi32_ps(ei);
+    __m128 m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(xi,
+                                _mm_set1_epi32(0x007FFFFF)), _mm_set1_epi32(0x3F000000)));
+
+    //m in [sqrt(0.5), sqrt(2))
+    __m128 mask = _mm_cmplt_ps(m, _mm_set1_ps(0.707106781186547524f));
+    __m128 tmp = _mm_and_ps(m, mask);
+    m = _mm_add_ps(_mm_sub_ps(m, one), tmp);
+    e = _mm_sub_ps(e, _mm_and_ps(one, mask));
+
+    __m128 z = _mm_mul_ps(m, m);
+
+    __m128 y = _mm_set1_ps(7.0376836292E-2f);
+    y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(-1.1514610310E-1f));
+    y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps( 1.1676998740E-1f));
+    y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(-1.2420140846E-1f));
+    y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps( 1.4249322787E-1f));
+    y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(-1.6668057665E-1f));
+    y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps( 2.0000714765E-1f));
+    y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(-2.4999993993E-1f));
+    y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps( 3.3333331174E-1f));
+    y = _mm_mul_ps(_mm_mul_ps(y, m), z);
+
+    y = _mm_add_ps(y, _mm_mul_ps(e, _mm_set1_ps(-2.12194440e-4f)));
+    y = _mm_sub_ps(y, _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+
+    __m128 ret = _mm_add_ps(_mm_add_ps(m, y), _mm_mul_ps(e, _mm_set1_ps(0.693359375f)));
+
+    return _mm_or_ps(ret, invalid);
+}
+
+/**
+ * @brief FastExpSSE2 computes e^x with the polynomial of the Cephes
+ * library; the relative error is about 1e-7. x is clamped to the range
+ * of normal floats.
+ * @param x
+ * @return
+ */
+PIC_TARGET_SSE2 inline __m128 FastExpSSE2(__m128 x)
+{
+    __m128 one = _mm_set1_ps(1.0f);
+
+    x = _mm_min_ps(x, _mm_set1_ps( 88.3762626647949f));
+    x = _mm_max_ps(x, _mm_set1_ps(-87.3365447504f));
+
+    //x = n * log(2) + r
+    __m128 fx = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(1.44269504088896341f)),
+                           _mm_set1_ps(0.5f));
+    __m128 fl = _mm_cvtepi32_ps(_mm_cvttps_epi32(fx));
+    fx = _mm_sub_ps(fl, _mm_and_ps(_mm_cmpgt_ps(fl, fx), one));
+
+    x = _mm_sub_ps(x, _mm_mul_ps(fx, _mm_set1_ps(0.693359375f)));
+    x = _mm_sub_ps(x, _mm_mul_ps(fx, _mm_set1_ps(-2.12194440e-4f)));
+
+    __m128 z = _mm_mul_ps(x, x);
+
+    __m128 y = _mm_set1_ps(1.9875691500E-4f);
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.3981999507E-3f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(8.3334519073E-3f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(4.1665795894E-2f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.6666665459E-1f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(5.0000001201E-1f));
+    y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(y, z), x), one);
+
+    //2^n
+    __m128i n = _mm_add_epi32(_mm_cvttps_epi32(fx), _mm_set1_epi32(127));
+    return _mm_mul_ps(y, _mm_castsi128_ps(_mm_slli_epi32(n, 23)));
+}
+
+/**
+ * @brief FastPowSSE2 computes x^y for x > 0.
+ * @param x
+ * @param y
+ * @return
+ */
+PIC_TARGET_SSE2 inline __m128 FastPowSSE2(__m128 x, __m128 y)
+{
+    return FastExpSSE2(_mm_mul_ps(y, FastLogSSE2(x)));
+}
+
+/**
+ * @brief FastCbrtSSE2 computes the cube root of x > 0; the estimate of
+ * FastPowSSE2 is refined by a Newton step.
+ * @param x
+ * @return
+ */
+PIC_TARGET_SSE2 inline __m128 FastCbrtSSE2(__m128 x)
+{
+    __m128 third = _mm_set1_ps(1.0f / 3.0f);
+    __m128 y = FastExpSSE2(_mm_mul_ps(FastLogSSE2(x), third));
+
+    //y = (2y + x / y^2) / 3
+    __m128 y2 = _mm_mul_ps(y, y);
+    return _mm_mul_ps(_mm_add_ps(_mm_add_ps(y, y), _mm_div_ps(x, y2)), third);
+}
+
+#endif
+
+} // end namespace pic
+
+#endif /* PIC_UTIL_SIMD_HPP */
+
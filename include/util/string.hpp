@@ -25,6 +25,8 @@ See the GNU Lesser General Public License
 #ifndef PIC_UTIL_STRING_HPP
 #define PIC_UTIL_STRING_HPP
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <vector>
 #include <string>
 #include <sstream>
@@ -91,6 +93,28 @@ inline std::string NumberToString(T num)
     return convert.str();
 }
 
+/**
+ * @brief FloatToStringExact converts a float into the shortest string, with
+ * at least 6 significant digits, which is read back as the same float;
+ * i.e., two different floats give two different strings.
+ * @param num is an input number.
+ */
+inline std::string FloatToStringExact(float num)
+{
+    char tmp[32];
+
+    for(int digits = 6; digits < 9; digits++) {
+        sprintf(tmp, "%.*g", digits, num);
+
+        if(strtof(tmp, NULL) == num) {
+            return tmp;
+        }
+    }
+
+    sprintf(tmp, "%.9g", num);
+    return tmp;
+}
+
 /**
  * @brief RemoveExtension removes the extension of a string.
  * @param name
@@ -0,0 +1,542 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+PICCANTE is free software; you can redistribute it and/or modify
+under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation; either version 3.0 of
+the License, or (at your option) any later version.
+
+PICCANTE is distributed in the hope that it will be useful, but
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU Lesser General Public License
+( http://www.gnu.org/licenses/lgpl-3.0.html ) for more details.
+
+*/
+
+#ifndef PIC_UTIL_THREAD_POOL_HPP
+#define PIC_UTIL_THREAD_POOL_HPP
+
+#include <vector>
+#include <deque>
+#include <functional>
+
+#ifndef PIC_DISABLE_THREAD
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#endif
+
+#include "base.hpp"
+
+namespace pic {
+
+/**
+ * @brief The ThreadPool class is a process-wide pool of persistent workers.
+ * Tasks are indices in [0, nTasks); they are split into contiguous runs,
+ * one deque per worker, and idle workers steal from the back of the others'
+ * deques. The calling thread takes part to the computation as worker 0.
+ */
+class ThreadPool
+{
+protected:
+
+#ifndef PIC_DISABLE_THREAD
+    /**
+     * @brief The WorkerQueue struct is the task deque of a worker.
+     */
+    struct WorkerQueue
+    {
+        std::deque<unsigned int> tasks;
+        std::mutex               mutex;
+    };
+
+    std::vector<std::thread *>  threads;
+    std::vector<WorkerQueue *>  queues;
+
+    std::mutex                  mutexRun, mutexJob;
+    std::condition_variable     cvJob, cvDone;
+
+    const std::function<void(unsigned int)> *job;
+    unsigned int                generation;
+    int                         nActive, nBusy;
+    bool                        bExit;
+
+    /**
+     * @brief workerIndex returns a reference to the index of the worker
+     * running on the current thread; -1 outside the pool.
+     * @return
+     */
+    static int &workerIndex()
+    {
+        static thread_local int index = -1;
+        return index;
+    }
+
+    /**
+     * @brief pop extracts a task from the front of the queue of worker i.
+     * @param i
+     * @param task
+     * @return
+     */
+    bool pop(int i, unsigned int &task);
+
+    /**
+     * @brief steal extracts a task from the back of the queue of worker i.
+     * @param i
+     * @param task
+     * @return
+     */
+    bool steal(int i, unsigned int &task);
+
+    /**
+     * @brief Work executes tasks of worker i and then steals from the others.
+     * @param i
+     */
+    void Work(int i);
+
+    /**
+     * @brief WorkerLoop is the main loop of a persistent thread.
+     * @param i
+     */
+    void WorkerLoop(int i);
+#endif
+
+    /**
+     * @brief ThreadPool spawns hardware_concurrency() - 1 threads.
+     */
+    ThreadPool();
+
+public:
+
+    ~ThreadPool();
+
+    /**
+     * @brief getInstance returns the process-wide pool.
+     * @return
+     */
+    static ThreadPool *getInstance()
+    {
+        static ThreadPool pool;
+        return &pool;
+    }
+
+    /**
+     * @brief getWorkerIndex returns the index, in [0, getMaxThreads()),
+     * of the worker executing the current task. This is useful for
+     * indexing per-worker scratch memory.
+     * @return
+     */
+    static int getWorkerIndex()
+    {
+#ifndef PIC_DISABLE_THREAD
+        int i = workerIndex();
+        return i < 0 ? 0 : i;
+#else
+        return 0;
+#endif
+    }
+
+    /**
+     * @brief getMaxThreads returns the number of available workers
+     * (including the calling thread).
+     * @return
+     */
+    int getMaxThreads();
+
+    /**
+     * @brief Run executes task(i) for each i in [0, nTasks) and returns
+     * when all tasks are completed.
+     * @param nTasks is the number of tasks.
+     * @param task is the function to be executed for each task index.
+     * @param maxThreads caps the number of workers for this call;
+     * a value <= 0 means all workers.
+     */
+    void Run(unsigned int nTasks, const std::function<void(unsigned int)> &task,
+             int maxThreads);
+
+    /**
+     * @brief Execute runs tasks on the process-wide pool.
+     * @param nTasks
+     * @param task
+     * @param maxThreads
+     */
+    static void Execute(unsigned int nTasks,
+                        const std::function<void(unsigned int)> &task,
+                        int maxThreads = -1)
+    {
+        getInstance()->Run(nTasks, task, maxThreads);
+    }
+
+    /**
+     * @brief ExecuteRows executes func(y0, y1) over chunks of rows of a
+     * width x height grid. Small grids run on the calling thread only,
+     * since they are not worth to be split among workers.
+     * @param width
+     * @param height
+     * @param func
+     * @param maxThreads
+     */
+    static void ExecuteRows(int width, int height,
+                            const std::function<void(int, int)> &func,
+                            int maxThreads = -1);
+
+    /**
+     * @brief SumRows computes the sum of func(y0, y1) over chunks of rows
+     * of a width x height grid. Partial sums are added in a fixed order
+     * so the result does not depend on the scheduling.
+     * @param width
+     * @param height
+     * @param func
+     * @param maxThreads
+     * @return
+     */
+    static double SumRows(int width, int height,
+                          const std::function<double(int, int)> &func,
+                          int maxThreads = -1);
+
+    /**
+     * @brief SumRows computes n sums at once over chunks of rows of a
+     * width x height grid; func(y0, y1, acc) adds its values to acc, which
+     * is zeroed for each chunk. Partial sums are added in a fixed order.
+     * @param width
+     * @param height
+     * @param n is the number of sums.
+     * @param func
+     * @param sum is an array of n values where the sums are stored.
+     * @param maxThreads
+     */
+    static void SumRows(int width, int height, int n,
+                        const std::function<void(int, int, double *)> &func,
+                        double *sum, int maxThreads = -1);
+};
+
+//rows of a chunk and minimum number of pixels for splitting a grid
+#define THREAD_POOL_ROWS_CHUNK 16
+#define THREAD_POOL_MIN_PIXELS 16384
+
+#ifndef PIC_DISABLE_THREAD
+
+PIC_INLINE ThreadPool::ThreadPool()
+{
+    job = NULL;
+    generation = 0;
+    nActive = 0;
+    nBusy = 0;
+    bExit = false;
+
+    int n = std::thread::hardware_concurrency();
+
+    if(n < 1) {
+        n = 1;
+    }
+
+    for(int i = 0; i < n; i++) {
+        queues.push_back(new WorkerQueue);
+    }
+
+    for(int i = 1; i < n; i++) {
+        threads.push_back(new std::thread(&ThreadPool::WorkerLoop, this, i));
+    }
+}
+
+PIC_INLINE ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutexJob);
+        bExit = true;
+    }
+
+    cvJob.notify_all();
+
+    for(unsigned int i = 0; i < threads.size(); i++) {
+        threads[i]->join();
+        delete threads[i];
+    }
+
+    for(unsigned int i = 0; i < queues.size(); i++) {
+        delete queues[i];
+    }
+
+    threads.clear();
+    queues.clear();
+}
+
+PIC_INLINE int ThreadPool::getMaxThreads()
+{
+    return int(queues.size());
+}
+
+PIC_INLINE bool ThreadPool::pop(int i, unsigned int &task)
+{
+    std::lock_guard<std::mutex> lock(queues[i]->mutex);
+
+    if(queues[i]->tasks.empty()) {
+        return false;
+    }
+
+    task = queues[i]->tasks.front();
+    queues[i]->tasks.pop_front();
+    return true;
+}
+
+PIC_INLINE bool ThreadPool::steal(int i, unsigned int &task)
+{
+    std::lock_guard<std::mutex> lock(queues[i]->mutex);
+
+    if(queues[i]->tasks.empty()) {
+        return false;
+    }
+
+    task = queues[i]->tasks.back();
+    queues[i]->tasks.pop_back();
+    return true;
+}
+
+PIC_INLINE void ThreadPool::Work(int i)
+{
+    unsigned int task;
+
+    while(true) {
+        if(pop(i, task)) {
+            (*job)(task);
+            continue;
+        }
+
+        //the own queue is empty: steal from the others
+        bool bStolen = false;
+
+        for(int k = 1; k < nActive; k++) {
+            if(steal((i + k) % nActive, task)) {
+                bStolen = true;
+                break;
+            }
+        }
+
+        if(!bStolen) {
+            //no tasks are spawned at run-time so we are done
+            return;
+        }
+
+        (*job)(task);
+    }
+}
+
+PIC_INLINE void ThreadPool::WorkerLoop(int i)
+{
+    workerIndex() = i;
+
+    unsigned int lastGeneration = 0;
+
+    while(true) {
+        {
+            std::unique_lock<std::mutex> lock(mutexJob);
+
+            while(!bExit && ((generation == lastGeneration) || (i >= nActive))) {
+                lastGeneration = generation;
+                cvJob.wait(lock);
+            }
+
+            if(bExit) {
+                return;
+            }
+
+            lastGeneration = generation;
+        }
+
+        Work(i);
+
+        {
+            std::lock_guard<std::mutex> lock(mutexJob);
+            nBusy--;
+        }
+
+        cvDone.notify_one();
+    }
+}
+
+PIC_INLINE void ThreadPool::Run(unsigned int nTasks,
+                                const std::function<void(unsigned int)> &task,
+                                int maxThreads)
+{
+    if(nTasks == 0) {
+        return;
+    }
+
+    int n = getMaxThreads();
+
+    if((maxThreads > 0) && (maxThreads < n)) {
+        n = maxThreads;
+    }
+
+    if(int(nTasks) < n) {
+        n = int(nTasks);
+    }
+
+    //nested calls from a worker, or a single worker, run serially
+    if((n < 2) || (workerIndex() >= 0)) {
+        for(unsigned int i = 0; i < nTasks; i++) {
+            task(i);
+        }
+
+        return;
+    }
+
+    std::lock_guard<std::mutex> lockRun(mutexRun);
+
+    //contiguous runs of tasks for each worker
+    for(int k = 0; k < n; k++) {
+        unsigned int start = (unsigned int)((unsigned long long)(nTasks) * k / n);
+        unsigned int end   = (unsigned int)((unsigned long long)(nTasks) * (k + 1) / n);
+
+        std::lock_guard<std::mutex> lock(queues[k]->mutex);
+
+        for(unsigned int j = start; j < end; j++) {
+            queues[k]->tasks.push_back(j);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutexJob);
+        job = &task;
+        nActive = n;
+        nBusy = n - 1;
+        generation++;
+    }
+
+    cvJob.notify_all();
+
+    workerIndex() = 0;
+    Work(0);
+    workerIndex() = -1;
+
+    {
+        std::unique_lock<std::mutex> lock(mutexJob);
+
+        while(nBusy > 0) {
+            cvDone.wait(lock);
+        }
+
+        job = NULL;
+        nActive = 0;
+    }
+}
+
+#else
+
+PIC_INLINE ThreadPool::ThreadPool()
+{
+}
+
+PIC_INLINE ThreadPool::~ThreadPool()
+{
+}
+
+PIC_INLINE int ThreadPool::getMaxThreads()
+{
+    return 1;
+}
+
+PIC_INLINE void ThreadPool::Run(unsigned int nTasks,
+                                const std::function<void(unsigned int)> &task,
+                                int maxThreads)
+{
+    for(unsigned int i = 0; i < nTasks; i++) {
+        task(i);
+    }
+}
+
+#endif
+
+PIC_INLINE void ThreadPool::ExecuteRows(int width, int height,
+                                        const std::function<void(int, int)> &func,
+                                        int maxThreads)
+{
+    if((width * height) < THREAD_POOL_MIN_PIXELS) {
+        func(0, height);
+        return;
+    }
+
+    int nChunks = (height + THREAD_POOL_ROWS_CHUNK - 1) / THREAD_POOL_ROWS_CHUNK;
+
+    Execute(nChunks, [&](unsigned int i) {
+        int y0 = i * THREAD_POOL_ROWS_CHUNK;
+        int y1 = y0 + THREAD_POOL_ROWS_CHUNK;
+        func(y0, y1 < height ? y1 : height);
+    }, maxThreads);
+}
+
+PIC_INLINE double ThreadPool::SumRows(int width, int height,
+                                      const std::function<double(int, int)> &func,
+                                      int maxThreads)
+{
+    int nChunks = (height + THREAD_POOL_ROWS_CHUNK - 1) / THREAD_POOL_ROWS_CHUNK;
+    std::vector<double> partial(nChunks, 0.0);
+
+    auto task = [&](unsigned int i) {
+        int y0 = i * THREAD_POOL_ROWS_CHUNK;
+        int y1 = y0 + THREAD_POOL_ROWS_CHUNK;
+        partial[i] = func(y0, y1 < height ? y1 : height);
+    };
+
+    if((width * height) < THREAD_POOL_MIN_PIXELS) {
+        for(int i = 0; i < nChunks; i++) {
+            task(i);
+        }
+    } else {
+        Execute(nChunks, task, maxThreads);
+    }
+
+    double sum = 0.0;
+
+    for(int i = 0; i < nChunks; i++) {
+        sum += partial[i];
+    }
+
+    return sum;
+}
+
+PIC_INLINE void ThreadPool::SumRows(int width, int height, int n,
+                                    const std::function<void(int, int, double *)> &func,
+                                    double *sum, int maxThreads)
+{
+    int nChunks = (height + THREAD_POOL_ROWS_CHUNK - 1) / THREAD_POOL_ROWS_CHUNK;
+    std::vector<double> partial(size_t(nChunks) * n, 0.0);
+
+    auto task = [&](unsigned int i) {
+        int y0 = i * THREAD_POOL_ROWS_CHUNK;
+        int y1 = y0 + THREAD_POOL_ROWS_CHUNK;
+        func(y0, y1 < height ? y1 : height, &partial[size_t(i) * n]);
+    };
+
+    if((width * height) < THREAD_POOL_MIN_PIXELS) {
+        for(int i = 0; i < nChunks; i++) {
+            task(i);
+        }
+    } else {
+        Execute(nChunks, task, maxThreads);
+    }
+
+    for(int k = 0; k < n; k++) {
+        sum[k] = 0.0;
+    }
+
+    for(int i = 0; i < nChunks; i++) {
+        for(int k = 0; k < n; k++) {
+            sum[k] += partial[size_t(i) * n + k];
+        }
+    }
+}
+
+} // end namespace pic
+
+#endif /* PIC_UTIL_THREAD_POOL_HPP */
+
@@ -0,0 +1,125 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+PICCANTE is free software; you can redistribute it and/or modify
+under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation; either version 3.0 of
+the License, or (at your option) any later version.
+
+PICCANTE is distributed in the hope that it will be useful, but
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU Lesser General Public License
+( http://www.gnu.org/licenses/lgpl-3.0.html ) for more details.
+
+*/
+
+#ifndef PIC_UTIL_UNION_FIND_HPP
+#define PIC_UTIL_UNION_FIND_HPP
+
+#include <vector>
+
+#include "base.hpp"
+
+namespace pic {
+
+/**
+ * @brief The UnionFind class is a disjoint-set forest over the integers
+ * [0, n). Roots are always the smallest element of their set, so
+ * parent[i] <= i holds for every i; this allows to flatten the whole
+ * forest with a single ordered pass. Unions on disjoint ranges of
+ * elements can be executed concurrently as long as their sets do not
+ * span those ranges.
+ */
+class UnionFind
+{
+public:
+    std::vector<int> parent;
+
+    /**
+     * @brief UnionFind
+     */
+    UnionFind()
+    {
+    }
+
+    /**
+     * @brief UnionFind
+     * @param n
+     */
+    UnionFind(int n)
+    {
+        Init(n);
+    }
+
+    /**
+     * @brief Init creates n singletons.
+     * @param n
+     */
+    void Init(int n)
+    {
+        parent.resize(n);
+
+        for(int i = 0; i < n; i++) {
+            parent[i] = i;
+        }
+    }
+
+    /**
+     * @brief Find returns the root of i; paths are compressed by halving.
+     * @param i
+     * @return
+     */
+    int Find(int i)
+    {
+        while(parent[i] != i) {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+
+        return i;
+    }
+
+    /**
+     * @brief Union merges the sets of i and j; the smaller root is kept.
+     * @param i
+     * @param j
+     * @return It returns the root of the merged set.
+     */
+    int Union(int i, int j)
+    {
+        i = Find(i);
+        j = Find(j);
+
+        if(i < j) {
+            parent[j] = i;
+            return i;
+        } else {
+            parent[i] = j;
+            return j;
+        }
+    }
+
+    /**
+     * @brief Flatten makes parent[i] the root of i for every i.
+     */
+    void Flatten()
+    {
+        for(unsigned int i = 0; i < parent.size(); i++) {
+            parent[i] = parent[parent[i]];
+        }
+    }
+};
+
+} // end namespace pic
+
+#endif /* PIC_UTIL_UNION_FIND_HPP */
+
@@ -175,7 +175,8 @@ Vec<N, float> annulusSampling(std::mt19937 *m, Vec<N, float> center, float radiu
 
         float t = x.lengthSq();
 
-        if((t < 1.0f) || (t > 4.0f)) {
+        //inside the annulus [radius, 2 * radius]
+        if((t >= 1.0f) && (t <= 4.0f)) {
             break;
         }
     }
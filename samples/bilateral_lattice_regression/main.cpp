@@ -0,0 +1,108 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+PICCANTE is free software; you can redistribute it and/or modify
+under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation; either version 3.0 of
+the License, or (at your option) any later version.
+
+PICCANTE is distributed in the hope that it will be useful, but
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU Lesser General Public License
+( http://www.gnu.org/licenses/lgpl-3.0.html ) for more details.
+
+*/
+
+#include <QCoreApplication>
+
+//This means that OpenGL acceleration layer is disabled
+#define PIC_DISABLE_OPENGL
+
+#include "piccante.hpp"
+
+/**
+ * @brief TestStepEdge filters a 64x64 step edge from 1 to high with the
+ * permutohedral bilateral filter; a small sigma_r has to keep the two sides
+ * apart.
+ * @param high
+ * @param sigma_r
+ * @return It returns true if the output matches the input.
+ */
+bool TestStepEdge(float high, float sigma_r)
+{
+    pic::ImageRAW img(1, 64, 64, 1);
+
+    for(int j = 0; j < img.height; j++) {
+        for(int i = 0; i < img.width; i++) {
+            img(i, j)[0] = (i < (img.width / 2)) ? 1.0f : high;
+        }
+    }
+
+    pic::ImageRAW *output = pic::FilterBilateral2DPL::Execute(&img, NULL, NULL, 4.0f, sigma_r);
+
+    if(output == NULL) {
+        printf("rejected ");
+        return false;
+    }
+
+    float maxErr = 0.0f;
+
+    for(int j = 0; j < img.height; j++) {
+        for(int i = 0; i < img.width; i++) {
+            float ref = img(i, j)[0];
+            maxErr = MAX(maxErr, fabsf((*output)(i, j)[0] - ref) / ref);
+        }
+    }
+
+    delete output;
+
+    return maxErr < 1e-3f;
+}
+
+int main(int argc, char *argv[])
+{
+    Q_UNUSED(argc);
+    Q_UNUSED(argv);
+
+    //large ratios between edges and sigma_r used to overflow lattice keys
+    float highs[] = {2.0f, 201.0f, 696.0f, 5000.0f};
+    int nFailed = 0;
+
+    for(int i = 0; i < 4; i++) {
+        printf("Step edge 1 to %g with sigma_r = 0.01... ", highs[i]);
+
+        if(TestStepEdge(highs[i], 0.01f)) {
+            printf("Ok\n");
+        } else {
+            printf("Failed!\n");
+            nFailed++;
+        }
+    }
+
+    //positions out of the range of the lattice have to be rejected
+    pic::ImageRAW img(1, 64, 64, 1);
+    img.SetZero();
+    img(0, 0)[0] = 1e9f;
+
+    printf("Out of range edge... ");
+    pic::ImageRAW *output = pic::FilterBilateral2DPL::Execute(&img, NULL, NULL, 4.0f, 0.01f);
+
+    if(output == NULL) {
+        printf("Ok\n");
+    } else {
+        printf("Failed!\n");
+        delete output;
+        nFailed++;
+    }
+
+    return nFailed;
+}
@@ -74,7 +74,7 @@ int main(int argc, char *argv[])
         }
 
         printf("Assembling the different exposure images...");
-        pic::FilterAssembleHDR fltAHDR(pic::CRF_GAUSS, pic::LIN_ICFR, &crf.icrf);
+        pic::FilterAssembleHDR fltAHDR(pic::CRF_GAUSS, pic::LIN_ICFR, &crf.icrf, 8);
         pic::ImageRAW *imgOut = fltAHDR.ProcessP(stack, NULL);
         printf("Ok\n");
 
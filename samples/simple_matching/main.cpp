@@ -98,33 +98,14 @@ int main(int argc, char *argv[])
 
         printf("Descriptor size: %d\n", n);
 
-        for(unsigned int i = 0; i < descs0.size(); i++) {
+        //Hamming distance, ratio test, and cross-check
+        pic::BinaryFeatureMatcher matcher(descs1, n, pic::BD_BITS);
 
-            unsigned int dist_1 = 0;
-            unsigned int dist_2 = 0;
+        std::vector< pic::FeatureMatch > fm;
+        matcher.Match(descs0, fm, 0.8f, true);
 
-            int matched_j = -1;
-
-            for(unsigned int j =0; j<descs1.size(); j++) {
-
-                unsigned int dist = pic::BRIEFDescriptor::match(descs0.at(i), descs1.at(j), n);
-
-                if(dist > 0) {
-                    if(dist > dist_1) {
-                        dist_2 = dist_1;
-                        dist_1 = dist;
-                        matched_j = j;
-                    } else {
-                        if(dist > dist_2) {
-                            dist_2 = dist;
-                        }
-                    }
-                }
-            }
-
-            if((dist_1 * 100 > dist_2 * 107) && matched_j != -1) {
-                matches.push_back(Eigen::Vector3i(i, matched_j, dist_1));
-            }
+        for(unsigned int i = 0; i < fm.size(); i++) {
+            matches.push_back(Eigen::Vector3i(fm[i].i0, fm[i].i1, fm[i].distance));
         }
 
         printf("Mathces:\n");
@@ -0,0 +1,130 @@
+/*
+
+PICCANTE
+The hottest HDR imaging library!
+http://vcg.isti.cnr.it/piccante
+
+Copyright (C) 2014
+Visual Computing Laboratory - ISTI CNR
+http://vcg.isti.cnr.it
+First author: Francesco Banterle
+
+PICCANTE is free software; you can redistribute it and/or modify
+under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation; either version 3.0 of
+the License, or (at your option) any later version.
+
+PICCANTE is distributed in the hope that it will be useful, but
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+See the GNU Lesser General Public License
+( http://www.gnu.org/licenses/lgpl-3.0.html ) for more details.
+
+*/
+#include <QCoreApplication>
+
+#include <chrono>
+
+//This means that OpenGL acceleration layer is disabled
+#define PIC_DISABLE_OPENGL
+//This means we do not use QT for I/O
+#define PIC_DISABLE_QT
+
+#include "piccante.hpp"
+
+/**
+ * @brief MedianSort is the reference sort-based median filter; it sorts
+ * the (2r+1)^2 values of each pixel's window.
+ */
+pic::ImageRAW *MedianSort(pic::ImageRAW *imgIn, int halfSize)
+{
+    pic::ImageRAW *imgOut = imgIn->AllocateSimilarOne();
+
+    int areaKernel = (halfSize * 2 + 1) * (halfSize * 2 + 1);
+    std::vector<float> values(areaKernel);
+
+    for(int j = 0; j < imgIn->height; j++) {
+        for(int i = 0; i < imgIn->width; i++) {
+            for(int ch = 0; ch < imgIn->channels; ch++) {
+                int c = 0;
+
+                for(int k = -halfSize; k <= halfSize; k++) {
+                    for(int l = -halfSize; l <= halfSize; l++) {
+                        values[c] = (*imgIn)(i + l, j + k)[ch];
+                        c++;
+                    }
+                }
+
+                std::sort(values.begin(), values.end());
+                (*imgOut)(i, j)[ch] = values[areaKernel >> 1];
+            }
+        }
+    }
+
+    return imgOut;
+}
+
+double getTime(std::chrono::steady_clock::time_point t0)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+int main(int argc, char *argv[])
+{
+    Q_UNUSED(argc);
+    Q_UNUSED(argv);
+
+    printf("Reading an HDR file...");
+
+    pic::ImageRAW img;
+    img.Read("../data/input/bottles.hdr");
+
+    printf("Ok\n");
+
+    printf("Is it valid? ");
+    if(img.isValid()) {
+        printf("Ok\n");
+
+        int sizes[] = {3, 7, 11, 21, 41};
+
+        for(int i = 0; i < 5; i++) {
+            int size = sizes[i];
+
+            auto t0 = std::chrono::steady_clock::now();
+            pic::ImageRAW *imgRank = pic::FilterMed::Execute(&img, NULL, size);
+            double tRank = getTime(t0);
+
+            t0 = std::chrono::steady_clock::now();
+            pic::ImageRAW *imgSort = MedianSort(&img, size >> 1);
+            double tSort = getTime(t0);
+
+            float maxErr = 0.0f;
+            for(int j = 0; j < img.size(); j++) {
+                maxErr = MAX(maxErr, fabsf(imgRank->data[j] - imgSort->data[j]));
+            }
+
+            printf("Median size %d: histogram %f s, sort %f s, max error: %f\n",
+                   size, tRank, tSort, maxErr);
+
+            delete imgRank;
+            delete imgSort;
+        }
+
+        printf("Filtering the image with a 25th percentile filter of size 21...");
+        pic::ImageRAW *output = pic::FilterRank::Execute(&img, NULL, 21, 0.25f);
+        printf("Ok!\n");
+
+        printf("Writing the file to disk...");
+        bool bWritten = output->Write("../data/output/filtered_rank_21_25.hdr");
+
+        if(bWritten) {
+            printf("Ok\n");
+        } else {
+            printf("Writing had some issues!\n");
+        }
+    } else {
+        printf("No it is not a valid file!\n");
+    }
+
+    return 0;
+}